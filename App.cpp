@@ -27,6 +27,8 @@ App::App(yoss::input::Input* input, yoss::sound::SoundEngine* sound, yoss::AccEn
     _input(input),
     _sound(sound),
     _acc(acc),
+    _accWorker(nullptr),
+    _latencyTracer(nullptr),
     _iap(nullptr),
     _buyingButtonsShown(false),
     _isWaitingForResponseToBuy(false),
@@ -35,6 +37,9 @@ App::App(yoss::input::Input* input, yoss::sound::SoundEngine* sound, yoss::AccEn
     _suppressInitialVideo(false),
     _optionsVersion(100),
     _currentInstrument(nullptr),
+    _beatsInstrument(nullptr),
+    _provisionalBeatInstrument(nullptr),
+    _provisionalBeatId(NO_BEAT_ID),
     _currentInstrumentIndex(-1),
     _prevInstrumentIndex(-1),
     _instrumentSwitchTimestamp(0),
@@ -75,6 +80,16 @@ App::App(yoss::input::Input* input, yoss::sound::SoundEngine* sound, yoss::AccEn
 //-----------------------------------------------------------------------
 App::~App()
 {
+    if (_accWorker)
+        delete _accWorker;
+    
+    if (_latencyTracer)
+    {
+        _acc->SetLatencyTracer(nullptr);
+        _sound->SetLatencyTracer(nullptr);
+        delete _latencyTracer;
+    }
+    
     for (auto instrument : _instruments)
         delete instrument;
     
@@ -87,7 +102,8 @@ App::~App()
 //-----------------------------------------------------------------------
 void App::Suspend()
 {
-    
+    if (_latencyTracer)
+        Log::LogText(_latencyTracer->ToString());
 }
 
 //-----------------------------------------------------------------------
@@ -319,6 +335,7 @@ void App::SetCurrentInstrument(int instrument_index)
     _currentInstrumentIndex = _instrumentsListScrolledIndex = instrument_index;
     _currentInstrument = _instruments[_currentInstrumentIndex];
     _currentInstrument->OnGainFocus();
+    _beatsInstrument.store(_currentInstrument, std::memory_order_release);
     
     if (_currentInstrument && !_sound->IsPlayingInstrument(_currentInstrument))
         _sound->AddInstrument((Instrument*)_currentInstrument);
@@ -395,7 +412,7 @@ void App::OrderResetOrientation()
 {
     //_geoOrientationBaseAngle = _acc->GetMagTrajectory().GetPositions().GetAverage(0, FPS).z;
     //_geoOrientationBaseAngle *= 180;
-    _acc->ResetInput();
+    ResetAccInput();
     // _geoOrientationBaseAngle = _geoOrientationAngle;
 }
 
@@ -450,7 +467,7 @@ void App::OnPointerEvent(input::Pointer* pointer)
         else if (pointer->isClick && _resetOrientButtonClickRect.Contains(pointer_pos) &&
             _currentInstrument && _currentInstrument->needsResetOrient)
         {
-            _acc->ResetInput();
+            ResetAccInput();
         }
         else if (inside_instruments_list)
         {
@@ -518,11 +535,21 @@ void App::OnAccFeed(bool beat_detected)
     ASSERT(_acc && _sound);
     if (_helpVideoPlaying) return;
     
-    auto& trajectory = _acc->GetAccTrajectory();
-    auto& mag_trajectory = _acc->GetMagTrajectory();
+    OnAccInput(_acc->GetGravity(), _acc->GetMagTrajectory().GetPositions().Get());
     
-    Vector3D mag_pos = mag_trajectory.GetPositions().Get();
-    Vector3D pos = trajectory.GetPositions().GetAverage(0, 10);
+    if (beat_detected && _currentInstrument && !_acc->GetPredictiveOnsets())
+    {
+        auto beat_amplitude = _acc->GetAccBeatAmplitude();
+        auto beat_freq = _acc->GetAccBeatFrequency();
+        
+        AddBeat(_currentInstrument, beat_freq, beat_amplitude, _acc->GetAccBeatDynamics(), _acc->GetAccBeatTrace());
+    }
+}
+
+//-----------------------------------------------------------------------
+void App::OnAccInput(const Vector3D& gravity, const Vector3D& mag_pos)
+{
+    Vector3D pos = gravity;
     bool upper_hemisphere = (pos.AngleTo(Z_AXIS) < DegToRad(90));
     
     _geoOrientationAngle = mag_pos.z * 180;
@@ -539,16 +566,71 @@ void App::OnAccFeed(bool beat_detected)
     if (!_currentInstrument) return;
     
     _currentInstrument->UpdateInput(GetGeoOrientationAngle(), _accAngleAroundX, _accAngleAroundY);
+}
+
+//-----------------------------------------------------------------------
+void App::OnAccOnset(const AccEngine::Onset& onset, KineticInstrument* instrument)
+{
+    if (_helpVideoPlaying || !instrument) return;
     
-    if (beat_detected)
+    // Only instruments that can cancel beats play provisional ones, the others wait for the confirmation
+    switch (onset.type)
     {
-        auto beat_amplitude = _acc->GetAccBeatAmplitude();
-        auto beat_freq = _acc->GetAccBeatFrequency();
-        
-        _currentInstrument->AddBeat(beat_freq, beat_amplitude);
+        case AccEngine::OnsetType_Provisional:
+            _provisionalBeatInstrument = (instrument->CanCancelBeats() ? instrument : nullptr);
+            _provisionalBeatId = NO_BEAT_ID;
+            if (_provisionalBeatInstrument)
+                _provisionalBeatId = AddBeat(instrument, onset.normalizedFreq, onset.amplitude, onset.dynamics, onset.trace);
+            break;
+        case AccEngine::OnsetType_Confirmed:
+            if (!onset.wasProvisional || !_provisionalBeatInstrument)
+                AddBeat(instrument, onset.normalizedFreq, onset.amplitude, onset.dynamics, onset.trace);
+            _provisionalBeatInstrument = nullptr;
+            break;
+        case AccEngine::OnsetType_Cancelled:
+            if (_provisionalBeatInstrument)
+            {
+                _provisionalBeatInstrument->CancelBeat(_provisionalBeatId);
+                if (_latencyTracer)
+                    _latencyTracer->OnCancelBeat(_provisionalBeatId);
+            }
+            _provisionalBeatInstrument = nullptr;
+            break;
     }
 }
 
+//-----------------------------------------------------------------------
+// AccWorker's thread, when AccOnWorkerThread. _currentInstrument belongs to the UI thread, so beats go to the one it last published
+void App::OnAccWorkerBeat()
+{
+    KineticInstrument* instrument = _beatsInstrument.load(std::memory_order_acquire);
+    if (_helpVideoPlaying || !instrument || _acc->GetPredictiveOnsets()) return;
+    
+    AddBeat(instrument, _acc->GetAccBeatFrequency(), _acc->GetAccBeatAmplitude(), _acc->GetAccBeatDynamics(), _acc->GetAccBeatTrace());
+}
+
+//-----------------------------------------------------------------------
+BeatId App::AddBeat(KineticInstrument* instrument, PartOfOne normalized_freq, Coo amplitude, const BeatDynamics& dynamics, const LatencyTrace& trace)
+{
+    ASSERT(instrument);
+    
+    if (!_latencyTracer)
+        return instrument->AddBeat(normalized_freq, amplitude, dynamics);
+    
+    LatencyTrace beat_trace = trace;
+    _latencyTracer->StampAddBeat(beat_trace);
+    BeatId beat_id = instrument->AddBeat(normalized_freq, amplitude, dynamics);
+    _latencyTracer->OnAddBeat(beat_trace, beat_id);
+    
+    return beat_id;
+}
+
+//-----------------------------------------------------------------------
+void App::ResetAccInput()
+{
+    _acc->ResetInput();
+}
+
 //-----------------------------------------------------------------------
 void App::UpdateFrame()
 {
@@ -557,6 +639,12 @@ void App::UpdateFrame()
     if (_instrumentSwitchTimestamp == 0)
         _instrumentSwitchTimestamp = system::GetCurrentTimestamp();
     
+    if (_accWorker && _accWorker->UpdateSnapshot() && !_helpVideoPlaying)
+        OnAccInput(_accWorker->GetSnapshot().gravity, _accWorker->GetSnapshot().magPos);
+    
+    if (_latencyTracer)
+        _latencyTracer->Collect();
+    
     for (auto instrument : _instruments)
     {
         if (instrument->stopInstrumentTimeout > 0)
@@ -678,7 +766,40 @@ void App::UpdateLoading()
         case LoadingStep_Finish:
         {
             _input->AddPointerListener([this] (Pointer* pointer) { OnPointerEvent(pointer); });
-            _acc->AddAccFeedListener([this] (bool beat_detected) { OnAccFeed(beat_detected); });
+
+            // Thresholds tuned offline by BeatTune, if shipped
+            BeatDetectionParams beat_params;
+            if (beat_params.Load(system::GetResourcePath("beat_detection.params")))
+                _acc->SetParams(beat_params);
+
+            if (TraceLatency)
+            {
+                _latencyTracer = new LatencyTracer([] () { return system::GetCurrentTimestamp(); });
+                _latencyTracer->SetAudioClock(&_sound->GetClock());
+                _acc->SetLatencyTracer(_latencyTracer);
+                _sound->SetLatencyTracer(_latencyTracer);
+            }
+
+            if (AccOnWorkerThread)
+            {
+                // Called on the worker's thread
+                _acc->SetPredictiveOnsets(PredictiveBeats);
+                _acc->AddAccFeedListener([this] (bool beat_detected) { OnAccWorkerBeat(); }, AccEngine::FeedEvent_Beat);
+                if (PredictiveBeats)
+                    _acc->AddOnsetListener([this] (const AccEngine::Onset& onset) { OnAccOnset(onset, _beatsInstrument.load(std::memory_order_acquire)); });
+                
+                _accWorker = new AccWorker(*_acc);
+                _accWorker->Start();
+            }
+            else
+            {
+                _acc->AddAccFeedListener([this] (bool beat_detected) { OnAccFeed(beat_detected); });
+                if (PredictiveBeats)
+                {
+                    _acc->SetPredictiveOnsets(true);
+                    _acc->AddOnsetListener([this] (const AccEngine::Onset& onset) { OnAccOnset(onset, _currentInstrument); });
+                }
+            }
             
             int current_i = GetOptionInt("current_i");
             if (_instruments[current_i]->IsLocked())
@@ -732,7 +853,8 @@ void App::DrawFrame()
     ASSERT(_graphics);
     _graphics->StartFrame();
 
-    if (_showAccTrajectory)
+    // The trajectories are AccWorker's thread's while it runs, and it only publishes snapshots of orientation
+    if (_showAccTrajectory && !_accWorker)
     {
         _graphics->ClearScreen(COLOR_BLACK);
         _acc->DrawTrajectory(_graphics);
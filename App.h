@@ -6,8 +6,10 @@
 #include "yossCommon/graphics/common/Graphics.h"
 #include "yossCommon/sound/SoundEngine.h"
 #include "yossCommon/acc/AccEngine.h"
+#include "yossCommon/acc/AccWorker.h"
 #include "yossCommon/iap/IAP.h"
 
+#include <atomic>
 #include <math.h>
 
 
@@ -75,6 +77,12 @@ namespace yoss
         void DebugPrint(const std::string& msg);
         void OnPointerEvent(input::Pointer* pointer);
         void OnAccFeed(bool beat_detected);
+        void OnAccInput(const math::Vector3D& gravity, const math::Vector3D& mag_pos);
+        void OnAccOnset(const AccEngine::Onset& onset, KineticInstrument* instrument);
+        void OnAccWorkerBeat();
+        void ResetAccInput();
+        sound::BeatId AddBeat(KineticInstrument* instrument, math::PartOfOne normalized_freq, Coo amplitude, const sound::BeatDynamics& dynamics,
+                              const sound::LatencyTrace& trace);
         
         void LoadOptions();
         void UpdateOptionsToAppVersion();
@@ -142,6 +150,9 @@ namespace yoss
         static constexpr math::Ratio SimulateScreenRatio_Widest = (3.0 / 4.0);
         static constexpr bool ShowSimulateScreensButton = true && !ProductionMode;
         static constexpr bool ShowAccTrajectoryButton = true && !ProductionMode;
+        static constexpr bool PredictiveBeats = false; // Start beats on provisional onsets from AccEngine, cancel them if not confirmed (for instruments that CanCancelBeats())
+        static constexpr bool AccOnWorkerThread = false; // Process sensor samples on AccWorker's thread; beats reach instruments on it, orientation on frames
+        static constexpr bool TraceLatency = false && !ProductionMode; // Stamp beats from the sensor to the output, log latency percentiles on suspend
         static constexpr Time MaxFrameDTForSimulations = 0.1;
         static constexpr int  FPS = 60;
 #define SPRING_ACC(acc) (FPS == 30 ? acc : FPS == 60 ? acc / 2 : 1/0)
@@ -204,6 +215,8 @@ namespace yoss
         yoss::graphics::Graphics* _graphics;
         yoss::sound::SoundEngine* _sound;
         yoss::AccEngine* _acc;
+        yoss::AccWorker* _accWorker;
+        yoss::sound::LatencyTracer* _latencyTracer;
         yoss::iap::IAPEngine* _iap;
         
         std::map<std::string, std::string> _options;
@@ -220,6 +233,9 @@ namespace yoss
         
         std::vector<KineticInstrument*> _instruments;
         KineticInstrument* _currentInstrument;
+        std::atomic<KineticInstrument*> _beatsInstrument; // _currentInstrument as published to AccWorker's thread, which adds beats to it when AccOnWorkerThread
+        KineticInstrument* _provisionalBeatInstrument; // Played the beat of the pending provisional onset, nullptr if none did
+        sound::BeatId      _provisionalBeatId;
         int _currentInstrumentIndex;
         int _prevInstrumentIndex;
         Time _instrumentSwitchTimestamp;
@@ -272,7 +288,7 @@ namespace yoss
         Rect2D _helpButtonRect;
         math::Stepper<PartOfOne> _helpButtonAnim;
         bool _helpVideoRequested;
-        bool _helpVideoPlaying;
+        std::atomic<bool> _helpVideoPlaying; // Also read by the audio thread
         
         // Reset orientation button
         graphics::Image _resetOrientButton;
@@ -32,6 +32,7 @@ BozhinInstrument::BozhinInstrument() :
     _leftDelay(1, 1.0),
     _rightDelay(1, 1.0),
     _beatIsFinished(true),
+    _beatId(NO_BEAT_ID),
     _lastHitKey(-1),
     _hoveredKey(-1),
     _lastHoverChangeTimestamp(-1),
@@ -39,6 +40,7 @@ BozhinInstrument::BozhinInstrument() :
     _keyboardModelProgram(nullptr)
 {
     InitPartials();
+    SetControlBlockSize(ControlBlockSize);
     
     _leftDelay.AddDelay(0.434, 0.3, 0.0, 8);
     _rightDelay.AddDelay(0.29238, 0.3, 0.0, 4);
@@ -51,6 +53,20 @@ BozhinInstrument::~BozhinInstrument()
         delete _keyboardModelProgram;
 }
 
+//-----------------------------------------------------------------------
+void BozhinInstrument::SetUnitsContext(const AudioContext& context)
+{
+    KineticInstrument::SetUnitsContext(context);
+    
+    for (auto& partial : _partials)
+        partial.SetContext(context);
+    _waveFilters.SetContext(context);
+    _lowPassFilters.SetContext(context);
+    _sustainGeoDiffStepper.SetContext(context);
+    _leftDelay.SetContext(context);
+    _rightDelay.SetContext(context);
+}
+
 //-----------------------------------------------------------------------
 void BozhinInstrument::LoadSamples()
 {
@@ -125,10 +141,10 @@ void BozhinInstrument::InitPartials()
                 SET_P_VIBRATO(4.0, 73);
                 SET_P_STEPPERS(0.15, 0, 0,  0, 0.0001, 0.95);
                 SET_P_LFO_STEPPERS(1.0, 0, 0.001, 0.4,   0.1, 0, 0.001, 0.4);
-                partial.lowPassStepper.SetSpring(0.1, 0.97);
-                //partial.lowPassStepper.SetHalfStep(1.0);
+                _lowPassFilters.SetSpring(pi, 0.1, 0.97);
+                //_lowPassFilters.SetHalfStep(pi, 1.0);
             
-                partial.waveFilterStepper.SetHalfStep(0.9);
+                _waveFilters.SetHalfStep(pi, 0.9);
                 partial.basePulseWidth = 0.24957657;
                 partial.pulseWidthLFO1.SetFrequency(0.8543);
                 partial.pulseWidthLFO2.SetFrequency(0.58730928);
@@ -141,10 +157,10 @@ void BozhinInstrument::InitPartials()
                 SET_P_STEPPERS(0.16, 0, 0,  0, 0.0001, 0.95);
                 //SET_P_LFO_STEPPERS(1.0, 0, 0.001, 0.4,   0.1, 0, 0.001, 0.4);
                 SET_P_LFO_STEPPERS(1.43967086, 0, 0.001, 0.4,   0.05, 0, 0.001, 0.4);
-                partial.lowPassStepper.SetSpring(0.1, 0.97);
-                //partial.lowPassStepper.SetHalfStep(1.0);
+                _lowPassFilters.SetSpring(pi, 0.1, 0.97);
+                //_lowPassFilters.SetHalfStep(pi, 1.0);
             
-                partial.waveFilterStepper.SetHalfStep(0.9);
+                _waveFilters.SetHalfStep(pi, 0.9);
                 partial.basePulseWidth = 0.15957657;
                 partial.pulseWidthLFO1.SetFrequency(0.74299482);
                 partial.pulseWidthLFO3.SetFrequency(0.674982095);
@@ -158,10 +174,10 @@ void BozhinInstrument::InitPartials()
                 SET_P_STEPPERS(0.12, 0, 0,  0, 0.0001, 0.95);
                 SET_P_LFO_STEPPERS(1.2, 0, 0.001, 0.4,   0.08, 0, 0.001, 0.4);
                 //SET_P_LFO_STEPPERS(1.43967086, 0, 0.001, 0.4,   0.1, 0, 0.001, 0.4);
-                partial.lowPassStepper.SetSpring(0.1, 0.97);
-                //partial.lowPassStepper.SetHalfStep(1.0);
+                _lowPassFilters.SetSpring(pi, 0.1, 0.97);
+                //_lowPassFilters.SetHalfStep(pi, 1.0);
             
-                partial.waveFilterStepper.SetHalfStep(0.9);
+                _waveFilters.SetHalfStep(pi, 0.9);
                 partial.basePulseWidth = 0.8567;
                 partial.pulseWidthLFO1.SetFrequency(0.56299482);
                 partial.pulseWidthLFO2.SetFrequency(6.697837240);
@@ -174,8 +190,8 @@ void BozhinInstrument::InitPartials()
                 SET_P_VIBRATO(2.0, 73);
                 SET_P_STEPPERS(0.15, 0, 0,  0, 0.0001, 0.95);
                 SET_P_LFO_STEPPERS(1.0, 0, 0.001, 0.4,   0.15, 0, 0.001, 0.4);
-                partial.lowPassStepper.SetSpring(0.1, 0.97);
-                partial.waveFilterStepper.SetHalfStep(0.9);
+                _lowPassFilters.SetSpring(pi, 0.1, 0.97);
+                _waveFilters.SetHalfStep(pi, 0.9);
                 break;
                 
             case 4:
@@ -184,8 +200,8 @@ void BozhinInstrument::InitPartials()
                 SET_P_VIBRATO(3.0, 73);
                 SET_P_STEPPERS(0.15, 0, 0,  0, 0.0001, 0.95);
                 SET_P_LFO_STEPPERS(1.0, 0, 0.001, 0.4,   0.15, 0, 0.001, 0.4);
-                partial.lowPassStepper.SetSpring(0.1, 0.97);
-                partial.waveFilterStepper.SetHalfStep(0.9);
+                _lowPassFilters.SetSpring(pi, 0.1, 0.97);
+                _waveFilters.SetHalfStep(pi, 0.9);
                 break;
                 
             case 5:
@@ -194,7 +210,7 @@ void BozhinInstrument::InitPartials()
                 SET_P_VIBRATO(3.0, 45);
                 SET_P_STEPPERS(0.16, 0, 0,  0, 0.0001, 0.95);
                 SET_P_LFO_STEPPERS(1.43967086, 0, 0.001, 0.4,   0.1, 0, 0.001, 0.4);
-                partial.lowPassStepper.SetSpring(0.1, 0.97);
+                _lowPassFilters.SetSpring(pi, 0.1, 0.97);
                 break;
                 
             case 6:
@@ -203,7 +219,7 @@ void BozhinInstrument::InitPartials()
                 SET_P_VIBRATO(3.0, 11);
                 SET_P_STEPPERS(0.12, 0, 0,  0, 0.0001, 0.95);
                 SET_P_LFO_STEPPERS(1.2, 0, 0.001, 0.4,   0.08, 0, 0.001, 0.4);
-                partial.lowPassStepper.SetSpring(0.1, 0.97);
+                _lowPassFilters.SetSpring(pi, 0.1, 0.97);
                 break;
 
             default: ASSERT(false);
@@ -214,9 +230,15 @@ void BozhinInstrument::InitPartials()
 }
 
 //-----------------------------------------------------------------------
-void BozhinInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
+BeatId BozhinInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
+{
+    return AddBeat(normalized_freq, volume, BeatDynamics());
+}
+
+//-----------------------------------------------------------------------
+BeatId BozhinInstrument::AddBeat(PartOfOne normalized_freq, Volume volume, const BeatDynamics& dynamics)
 {
-    if (!CanPlay()) return;
+    if (!CanPlay()) return NO_BEAT_ID;
     
     volume *= 0.25;
     volume *= volume;// * volume;
@@ -233,7 +255,7 @@ void BozhinInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
     _lastHitKey = GetKeyAtPosInBGImage(_lastHitPos);
     _lastHitKeyIsBlack = IsKeyBlack(_lastHitKey);
     
-    if (_lastHitKey < 0) return;
+    if (_lastHitKey < 0) return NO_BEAT_ID;
     
     //auto& master_envelope = _partials[MasterEnvPartial].envelope;
     PartOfOne clamped_volume = CLAMP(volume, 0, 1);
@@ -243,7 +265,7 @@ void BozhinInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
     Ratio pitch_change = _prevPitch / new_pitch;
     pitch_change = MAX(pitch_change, 1.0 / pitch_change);
     
-    _beats.push_back(CreateBeatData(_lastHitKey, volume, true));
+    _beats.push_back(CreateBeatData(_lastHitKey, volume, true, dynamics));
     
     std::lock_guard<std::mutex> lock(_beatMutex);
     
@@ -252,6 +274,7 @@ void BozhinInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
     _normalizedPitch = (_pitch - min_pitch) / (max_pitch - min_pitch);
     _beatVolume = volume;
     _beatIsFinished = false;
+    _beatId = NewBeatId();
     _isSustained = false;
     _sustainGPos *= 0;
     _sustainGeoOrientBase = _sustainGeoOrient = _geoOrientationAngle;
@@ -266,7 +289,7 @@ void BozhinInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
         auto& partial = _partials[pi];
         Frequency partial_freq = partial.overtoneMultiplier * _pitch;
         
-        if (!Unit::IsFrequencyPlayable(partial_freq))
+        if (!GetContext().IsFrequencyPlayable(partial_freq))
         {
             partial.leftVolume = partial.rightVolume = 0;
             continue;
@@ -282,6 +305,27 @@ void BozhinInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
         
         partial.freqStepper.SetTarget(partial_freq);
     }
+    
+    return _beatId;
+}
+
+//-----------------------------------------------------------------------
+// Monophonic, so only the last beat can still be cancelled: an earlier one's note has been taken over by it
+void BozhinInstrument::CancelBeat(BeatId beat_id)
+{
+    std::lock_guard<std::mutex> lock(_beatMutex);
+    if (beat_id == NO_BEAT_ID || beat_id != _beatId)
+        return;
+    
+    _isSustained = false;
+    for (int pi = 0; pi < PartialsNum; pi++)
+    {
+        auto& envelope = _partials[pi].envelope;
+        envelope.SetIsSustained(false);
+        envelope.SetReleaseFadeFactor(BEAT_CANCEL_FADE_FACTOR, BEAT_CANCEL_FADE_FACTOR);
+        envelope.Release();
+    }
+    _beatId = NO_BEAT_ID;
 }
 
 //-----------------------------------------------------------------------
@@ -393,7 +437,7 @@ void BozhinInstrument::UpdateEnvelope()
             auto& partial = _partials[pi];
             Frequency partial_freq = partial.overtoneMultiplier * _pitch;
             
-            if (Unit::IsFrequencyPlayable(partial_freq))
+            if (GetContext().IsFrequencyPlayable(partial_freq))
             {
                 if (is_start_of_sustain)
                 {
@@ -408,76 +452,113 @@ void BozhinInstrument::UpdateEnvelope()
 }
 
 //-----------------------------------------------------------------------
-StereoSample BozhinInstrument::GenerateSample()
+void BozhinInstrument::UpdateModulators(int samples_num)
 {
-    StereoSample output_sample;
-    Time dt = Unit::GetSampleDuration();
-    
-    if (_pitch == 0)
-        return output_sample;
-    
-    std::lock_guard<std::mutex> lock(_beatMutex);
-    UpdateEnvelope();
+    // Steppers advance by the whole block at once, with the same dynamics as when stepped per sample
+    Time dt = GetContext().sampleDuration;
     
-    auto& master_partial = _partials[MasterEnvPartial];
-    auto& master_envelope = master_partial.envelope;
-    auto master_step = master_envelope.GetStep();
+    _sustainGeoDiffStepper.UpdateMovement(dt * samples_num);
+    Angle sustain_geo_diff = _sustainGeoDiffStepper.Update(samples_num);
+    Ratio lowpass_geo_factor = std::powf(0.9, sustain_geo_diff * 2.0);
     
-    _sustainGeoDiffStepper.UpdateMovement(dt);
-    Angle sustain_geo_diff = _sustainGeoDiffStepper.UpdateLagged();
-   
     for (int pi = 0; pi < PartialsNum; pi++)
     {
         auto& partial = _partials[pi];
         if (partial.leftVolume == 0 && partial.rightVolume == 0) continue;
         
-        partial.volStepper.UpdateMovement(dt);
-        auto partial_vol = partial.volStepper.UpdateLagged();
-        auto lfo_volume = partial.lfoVolStepper.UpdateLagged();
-        auto lfo_freq = partial.lfoFreqStepper.UpdateLagged();
+        partial.volStepper.UpdateMovement(dt * samples_num);
+        if (partial.overtoneMultiplier != 0)
+            partial.freqStepper.UpdateMovement(dt * samples_num);
+        
+        Volume partial_vol = partial.volStepper.Update(samples_num);
+        Volume lfo_volume = partial.lfoVolStepper.Update(samples_num);
+        Frequency lfo_freq = partial.lfoFreqStepper.Update(samples_num);
+        Frequency partial_freq = (partial.overtoneMultiplier != 0 ? partial.freqStepper.Update(samples_num) : 0);
         
         partial.tremoloLFO.SetFrequency(lfo_freq);
         partial.vibratoLFO.SetFrequency(lfo_freq);
-        auto tremolo_output = partial.tremoloLFO.Update() * partial.tremoloVolume * lfo_volume;
-        auto vibrato_output = partial.vibratoLFO.Update() * partial.vibratoSize * lfo_volume;
+        auto tremolo_output = partial.tremoloLFO.Update(samples_num) * partial.tremoloVolume * lfo_volume;
+        auto vibrato_output = partial.vibratoLFO.Update(samples_num) * partial.vibratoSize * lfo_volume;
         
         if (partial.overtoneMultiplier != 0)
         {
-            partial.freqStepper.UpdateMovement(dt);
-            auto partial_freq = partial.freqStepper.UpdateLagged();
             partial_freq += vibrato_output;
             
             CLAMP(partial_freq, BEAT_MIN_SWING_FREQUENCY, 20000);
-            partial.wave.SetFrequency(partial_freq);
+            partial.freqRamp.SetTarget(partial_freq, samples_num);
         }
-    
-        auto wave_output = partial.wave.Update();
         
-        partial.waveFilterStepper.SetTarget(wave_output);
-        wave_output = partial.waveFilterStepper.UpdateLagged();
+        auto pulse_lfo_output = 0.8 * partial.pulseWidthLFO1.Update(samples_num) + 0.16 * partial.pulseWidthLFO2.Update(samples_num) + 0.04 * partial.pulseWidthLFO3.Update(samples_num);
+        partial.pulseWidthRamp.SetTarget(partial.basePulseWidth + 0.10 * pulse_lfo_output, samples_num);
         
-        auto pulse_lfo_output = 0.8 * partial.pulseWidthLFO1.Update() + 0.16 * partial.pulseWidthLFO2.Update() + 0.04 * partial.pulseWidthLFO3.Update();
-        partial.wave.SetPulseWidth(partial.basePulseWidth + 0.10 * pulse_lfo_output);
-        
-        wave_output *= partial_vol * (1 + tremolo_output);
-
-        Volume env_vol = partial.envelope.Update();
-        env_vol = MAX(env_vol, _sustainByYAxis);
-        wave_output *= env_vol;
-        ASSERT(ABS(wave_output) < 10.0);
+        partial.gainRamp.SetTarget(partial_vol * (1 + tremolo_output), samples_num);
         
         CooMultiplier spring_acc = partial.freqStepper.GetLaggedPos() * 0.0009;// * (_envCurrentVolume * 0.2 + 0.8);
-        spring_acc = spring_acc * std::powf(0.9, sustain_geo_diff * 2.0);
+        spring_acc = spring_acc * lowpass_geo_factor;
         spring_acc = CLAMP(spring_acc, 0.001, 0.95);
+        _lowPassFilters.SetSpringAccTarget(pi, spring_acc);
+    }
+    
+    _lowPassFilters.StartRamp(samples_num);
+}
+
+//-----------------------------------------------------------------------
+StereoSample BozhinInstrument::GenerateSample()
+{
+    StereoSample output_sample;
+    
+    if (_pitch == 0)
+        return output_sample;
+    
+    std::lock_guard<std::mutex> lock(_beatMutex);
+    UpdateEnvelope();
+    
+    if (IsControlTick())
+        UpdateModulators(_controlBlockSize);
+   
+    // Partials are filtered together, one lane per partial; lanes of silent partials keep their state
+    Sample lanes[PartialsNum];
+    
+    for (int pi = 0; pi < PartialsNum; pi++)
+    {
+        auto& partial = _partials[pi];
+        lanes[pi] = 0;
+        bool is_silent = (partial.leftVolume == 0 && partial.rightVolume == 0);
+        _waveFilters.SetFrozen(pi, is_silent);
+        _lowPassFilters.SetFrozen(pi, is_silent);
+        if (is_silent) continue;
         
-        partial.lowPassStepper.SetSpringAcc(spring_acc);
-        partial.lowPassStepper.SetTarget(wave_output);
-        wave_output = partial.lowPassStepper.UpdateLagged();
-        //ASSERT(ABS(wave_output) < 10.0);
+        if (partial.overtoneMultiplier != 0)
+            partial.wave.SetFrequency(partial.freqRamp.Update());
+        partial.wave.SetPulseWidth(partial.pulseWidthRamp.Update());
+    
+        lanes[pi] = partial.wave.Update();
+    }
+    
+    _waveFilters.Process(lanes);
+    
+    for (int pi = 0; pi < PartialsNum; pi++)
+    {
+        auto& partial = _partials[pi];
+        if (partial.leftVolume == 0 && partial.rightVolume == 0) continue;
+        
+        lanes[pi] *= partial.gainRamp.Update();
+
+        Volume env_vol = partial.envelope.Update();
+        env_vol = MAX(env_vol, _sustainByYAxis);
+        lanes[pi] *= env_vol;
+        ASSERT(ABS(lanes[pi]) < 10.0);
+    }
+    
+    _lowPassFilters.Process(lanes);
+    
+    for (int pi = 0; pi < PartialsNum; pi++)
+    {
+        auto& partial = _partials[pi];
         
         StereoSample partial_sample;
-        partial_sample.left = wave_output * partial.leftVolume;
-        partial_sample.right = wave_output * partial.rightVolume;
+        partial_sample.left = lanes[pi] * partial.leftVolume;
+        partial_sample.right = lanes[pi] * partial.rightVolume;
         
         output_sample += partial_sample;
     }
@@ -2,6 +2,7 @@
 
 #include "KineticInstrument.h"
 #include "shaders/BozhinViz.h"
+#include "yossCommon/sound/FilterBank.h"
 #include <mutex>
 
 namespace yoss
@@ -18,6 +19,8 @@ namespace yoss
             // Constants:
             static constexpr bool DebugSustain = !true;
             
+            static constexpr int ControlBlockSize = 16; // [samples] Modulators are evaluated once per block and ramped in between
+            
             static constexpr int PartialsNum = 7;
             static constexpr int MasterEnvPartial = 0;
             static constexpr Volume NotePartialsVolume = 3.0 / PartialsNum;
@@ -72,15 +75,23 @@ namespace yoss
                 Frequency vibratoSize;
                 Envelope envelope;
                 
-                math::Stepper<Frequency> freqStepper;
-                math::Stepper<Volume>    volStepper;
-                math::Stepper<Volume>    lfoVolStepper;
-                math::Stepper<Volume>    lfoFreqStepper;
-                math::Stepper<Sample>    lowPassStepper;
-                
-                math::Stepper<Sample>    waveFilterStepper;
+                ControlStepper freqStepper;
+                ControlStepper volStepper;
+                ControlStepper lfoVolStepper;
+                ControlStepper lfoFreqStepper;
                 Ratio basePulseWidth;
                 WaveSource pulseWidthLFO1, pulseWidthLFO2, pulseWidthLFO3;
+                
+                // Control-rate outputs of modulators
+                ControlRamp freqRamp, gainRamp, pulseWidthRamp;
+                
+                void SetContext(const AudioContext& context)
+                {
+                    wave.SetContext(context); tremoloLFO.SetContext(context); vibratoLFO.SetContext(context); envelope.SetContext(context);
+                    freqStepper.SetContext(context); volStepper.SetContext(context); lfoVolStepper.SetContext(context); lfoFreqStepper.SetContext(context);
+                    pulseWidthLFO1.SetContext(context); pulseWidthLFO2.SetContext(context); pulseWidthLFO3.SetContext(context);
+                    freqRamp.SetContext(context); gainRamp.SetContext(context); pulseWidthRamp.SetContext(context);
+                }
             };
             
             //-----------------------------------------------------------------------
@@ -109,14 +120,19 @@ namespace yoss
             virtual void OnLoseFocus();
             virtual void OnPointerEvent(input::Pointer* pointer);
 
-            virtual void AddBeat(PartOfOne normalized_freq, Volume volume);
+            virtual BeatId AddBeat(PartOfOne normalized_freq, Volume volume);
+            virtual BeatId AddBeat(PartOfOne normalized_freq, Volume volume, const BeatDynamics& dynamics);
+            virtual void CancelBeat(BeatId beat_id);
+            virtual bool CanCancelBeats() const { return true; }
             
             virtual StereoSample GenerateSample();
             
         protected:
             virtual void OnUpdateInput();
+            virtual void SetUnitsContext(const AudioContext& context);
             
             void InitPartials();
+            void UpdateModulators(int samples_num);
             void InitKeys();
             int  GetKeyAtPosInBGImage(const graphics::Point2D& point);
             bool IsSustainingWhiteKey(const graphics::Point2D& point);
@@ -136,9 +152,12 @@ namespace yoss
             Volume     _envCurrentVolume;            
             Volume     _beatVolume;
             bool       _beatIsFinished;
+            BeatId     _beatId; // Of the note played, till the next beat takes over
             std::mutex _beatMutex;
             
             Partial _partials[PartialsNum];
+            FilterBank<PartialsNum> _waveFilters;
+            FilterBank<PartialsNum> _lowPassFilters;
 
             graphics::Image   _keyboardKeysImage;
             std::vector<graphics::Image> _glowingKeys;
@@ -156,7 +175,7 @@ namespace yoss
             Angle _sustainGeoOrient;
             Angle _sustainGeoOrientBase;
             Angle _sustainAccAroundYBase;
-            math::Stepper<Angle> _sustainGeoDiffStepper;
+            ControlStepper _sustainGeoDiffStepper;
             math::Vector3D _sustainGPos;
             
             std::vector<BeatData> _beats;
@@ -19,6 +19,7 @@ DroneInstrument::DroneInstrument() :
     _powerClipByXAxis(0)
 {
     InitPartials();
+    SetControlBlockSize(ControlBlockSize);
     
     _leftDelay.AddDelay(0.63487, 0.23, 0.0, 8);
     _rightDelay.AddDelay(0.41238, 0.28, 0.0, 4);
@@ -29,6 +30,22 @@ DroneInstrument::~DroneInstrument()
 {
 }
 
+//-----------------------------------------------------------------------
+void DroneInstrument::SetUnitsContext(const AudioContext& context)
+{
+    KineticInstrument::SetUnitsContext(context);
+    
+    for (auto& partial : _partials)
+        partial.SetContext(context);
+    _waveFilters.SetContext(context);
+    _lowPassFilters.SetContext(context);
+    _leftDelay.SetContext(context);
+    _rightDelay.SetContext(context);
+    _sustainGeoDiffStepper.SetContext(context);
+    _powerClipVolStepper.SetContext(context);
+    _powerClipVolRamp.SetContext(context);
+}
+
 //-----------------------------------------------------------------------
 void DroneInstrument::LoadSamples()
 {
@@ -109,10 +126,10 @@ void DroneInstrument::InitPartials()
                 SET_P_STEPPERS(0.15, 0, 0,  0, 0.0001, 0.95);
                 SET_P_LFO_STEPPERS(1.0, 0, 0.001, 0.4,   0.15, 0, 0.001, 0.4);
                 SET_P_POWER_LFO(WaveSource::WST_Sine, PowerFreq, 0, 0.95 * PowerVol, 0, 0.001, 0.4);
-                partial.lowPassStepper.SetSpring(0.1, 0.97);
-                //partial.lowPassStepper.SetHalfStep(1.0);
+                _lowPassFilters.SetSpring(pi, 0.1, 0.97);
+                //_lowPassFilters.SetHalfStep(pi, 1.0);
                 
-                partial.waveFilterStepper.SetHalfStep(WaveFilterHalfStep);
+                _waveFilters.SetHalfStep(pi, WaveFilterHalfStep);
                 partial.basePulseWidth = 0.24957657;
                 partial.pulseWidthLFO1.SetFrequency(0.8543);
                 partial.pulseWidthLFO2.SetFrequency(0.58730928);
@@ -126,10 +143,10 @@ void DroneInstrument::InitPartials()
                 //SET_P_LFO_STEPPERS(1.0, 0, 0.001, 0.4,   0.1, 0, 0.001, 0.4);
                 SET_P_LFO_STEPPERS(1.43967086, 0, 0.001, 0.4,   0.1, 0, 0.001, 0.4);
                 SET_P_POWER_LFO(WaveSource::WST_Sine, PowerFreq, 90, 1.0 * PowerVol, 0, 0.001, 0.4);
-                partial.lowPassStepper.SetSpring(0.1, 0.97);
-                //partial.lowPassStepper.SetHalfStep(1.0);
+                _lowPassFilters.SetSpring(pi, 0.1, 0.97);
+                //_lowPassFilters.SetHalfStep(pi, 1.0);
                 
-                partial.waveFilterStepper.SetHalfStep(WaveFilterHalfStep);
+                _waveFilters.SetHalfStep(pi, WaveFilterHalfStep);
                 partial.basePulseWidth = 0.15957657;
                 partial.pulseWidthLFO1.SetFrequency(0.74299482);
                 partial.pulseWidthLFO3.SetFrequency(0.674982095);
@@ -143,10 +160,10 @@ void DroneInstrument::InitPartials()
                 SET_P_STEPPERS(0.12, 0, 0,  0, 0.0001, 0.95);
                 SET_P_LFO_STEPPERS(1.2, 0, 0.001, 0.4,   0.1, 0, 0.001, 0.4);
                 SET_P_POWER_LFO(WaveSource::WST_Sine, PowerFreq * 0.5, 0, 1.0 * PowerVol, 0, 0.001, 0.4);
-                partial.lowPassStepper.SetSpring(0.1, 0.97);
-                //partial.lowPassStepper.SetHalfStep(1.0);
+                _lowPassFilters.SetSpring(pi, 0.1, 0.97);
+                //_lowPassFilters.SetHalfStep(pi, 1.0);
                 
-                partial.waveFilterStepper.SetHalfStep(WaveFilterHalfStep);
+                _waveFilters.SetHalfStep(pi, WaveFilterHalfStep);
                 partial.basePulseWidth = 0.9267;
                 partial.pulseWidthLFO1.SetFrequency(0.56299482);
                 partial.pulseWidthLFO2.SetFrequency(6.697837240);
@@ -160,8 +177,8 @@ void DroneInstrument::InitPartials()
                 SET_P_STEPPERS(0.15, 0, 0,  0, 0.0001, 0.95);
                 SET_P_LFO_STEPPERS(1.073, 0, 0.001, 0.4,   0.1, 0, 0.001, 0.4);
                 SET_P_POWER_LFO(WaveSource::WST_Sine, PowerFreq * 0.5, 90, 1.0 * PowerVol, 0, 0.001, 0.4);
-                partial.lowPassStepper.SetSpring(0.1, 0.97);
-                partial.waveFilterStepper.SetHalfStep(0.1);
+                _lowPassFilters.SetSpring(pi, 0.1, 0.97);
+                _waveFilters.SetHalfStep(pi, 0.1);
                 partial.basePulseWidth = 0.9334;
                 break;
                 
@@ -172,8 +189,8 @@ void DroneInstrument::InitPartials()
                 SET_P_STEPPERS(0.15, 0, 0,  0, 0.0001, 0.95);
                 SET_P_LFO_STEPPERS(1.3928347, 0, 0.001, 0.4,   0.1, 0, 0.001, 0.4);
                 SET_P_POWER_LFO(WaveSource::WST_Sine, PowerFreq / 3.0, 0, 1.0 * PowerVol, 0, 0.001, 0.4);
-                partial.lowPassStepper.SetSpring(0.1, 0.97);
-                partial.waveFilterStepper.SetHalfStep(0.2);
+                _lowPassFilters.SetSpring(pi, 0.1, 0.97);
+                _waveFilters.SetHalfStep(pi, 0.2);
                 partial.basePulseWidth = 0.05;
                 break;
            
@@ -202,9 +219,9 @@ void DroneInstrument::OnLoseFocus()
 }
 
 //-----------------------------------------------------------------------
-void DroneInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
+BeatId DroneInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
 {
-    
+    return NO_BEAT_ID;
 }
 
 //-----------------------------------------------------------------------
@@ -234,7 +251,7 @@ void DroneInstrument::OnUpdateInput()
         auto& partial = _partials[pi];
         Frequency partial_freq = partial.overtoneMultiplier * _fundamentalFreq;
         
-        if (!Unit::IsFrequencyPlayable(partial_freq))
+        if (!GetContext().IsFrequencyPlayable(partial_freq))
         {
             partial.leftVolume = partial.rightVolume = 0;
             continue;
@@ -256,67 +273,108 @@ void DroneInstrument::OnUpdateInput()
 }
 
 //-----------------------------------------------------------------------
-StereoSample DroneInstrument::GenerateSample()
+void DroneInstrument::UpdateModulators(int samples_num)
 {
-    StereoSample output_sample;
-    Time dt = Unit::GetSampleDuration();
-    
-    //if (_pitch == 0)
-    //    return output_sample;
-    
-    //std::lock_guard<std::mutex> lock(_paramsChangeMutex);
+    // Steppers advance by the whole block at once, with the same dynamics as when stepped per sample
+    Time dt = GetContext().sampleDuration;
     
-    _sustainGeoDiffStepper.UpdateMovement(dt);
+    _sustainGeoDiffStepper.UpdateMovement(dt * samples_num);
     
-    Angle sustain_geo_diff = _sustainGeoDiffStepper.UpdateLagged();
-    Volume power_clip_volume = _powerClipVolStepper.UpdateLagged();
+    Angle sustain_geo_diff = _sustainGeoDiffStepper.Update(samples_num);
+    Volume power_clip_volume = _powerClipVolStepper.Update(samples_num);
+    _powerClipVolRamp.SetTarget(power_clip_volume, samples_num);
+    Ratio lowpass_geo_factor = std::powf(0.9, sustain_geo_diff * 1.3);
     
     for (int pi = 0; pi < PartialsNum; pi++)
     {
         auto& partial = _partials[pi];
         if (partial.leftVolume == 0 && partial.rightVolume == 0) continue;
         
-        partial.volStepper.UpdateMovement(dt);
-        auto partial_vol = partial.volStepper.UpdateLagged();
-        auto lfo_volume = partial.lfoVolStepper.UpdateLagged();
-        auto lfo_freq = partial.lfoFreqStepper.UpdateLagged();
+        partial.volStepper.UpdateMovement(dt * samples_num);
+        if (partial.overtoneMultiplier != 0)
+            partial.freqStepper.UpdateMovement(dt * samples_num);
+        
+        Volume partial_vol = partial.volStepper.Update(samples_num);
+        Volume lfo_volume = partial.lfoVolStepper.Update(samples_num);
+        Frequency lfo_freq = partial.lfoFreqStepper.Update(samples_num);
+        Volume power_lfo_volume = partial.powerLFOVolStepper.Update(samples_num);
+        Frequency partial_freq = (partial.overtoneMultiplier != 0 ? partial.freqStepper.Update(samples_num) : 0);
         
-        auto power_lfo_volume = partial.powerLFOVolStepper.UpdateLagged();
-        auto power_lfo_output = partial.powerLFO.Update() * power_lfo_volume * partial.powerLFOVolume;
+        auto power_lfo_output = partial.powerLFO.Update(samples_num) * power_lfo_volume * partial.powerLFOVolume;
         
         partial.tremoloLFO.SetFrequency(lfo_freq);
         partial.vibratoLFO.SetFrequency(lfo_freq);
-        auto tremolo_output = partial.tremoloLFO.Update() * partial.tremoloVolume * lfo_volume;
-        auto vibrato_output = partial.vibratoLFO.Update() * partial.vibratoSize * lfo_volume;
+        auto tremolo_output = partial.tremoloLFO.Update(samples_num) * partial.tremoloVolume * lfo_volume;
+        auto vibrato_output = partial.vibratoLFO.Update(samples_num) * partial.vibratoSize * lfo_volume;
         
         if (partial.overtoneMultiplier != 0)
         {
-            partial.freqStepper.UpdateMovement(dt);
-            auto partial_freq = partial.freqStepper.UpdateLagged();
             partial_freq += vibrato_output;
             
             CLAMP(partial_freq, BEAT_MIN_SWING_FREQUENCY, 20000);
-            partial.wave.SetFrequency(partial_freq);
+            partial.freqRamp.SetTarget(partial_freq, samples_num);
         }
         
-        auto pulse_lfo_output = PulseWidthLFO1Vol * partial.pulseWidthLFO1.Update() + PulseWidthLFO2Vol * partial.pulseWidthLFO2.Update() + PulseWidthLFO3Vol * partial.pulseWidthLFO3.Update();
+        auto pulse_lfo_output = PulseWidthLFO1Vol * partial.pulseWidthLFO1.Update(samples_num) + PulseWidthLFO2Vol * partial.pulseWidthLFO2.Update(samples_num) + PulseWidthLFO3Vol * partial.pulseWidthLFO3.Update(samples_num);
         auto pulse_w = partial.basePulseWidth + pulse_lfo_output;
         pulse_w = CLAMP(pulse_w, 0.01, 0.99);
-        partial.wave.SetPulseWidth(pulse_w);
-        
-        auto wave_output = partial.wave.Update();
-        //if (partial.wave.GetType() == WaveSource::WST_Sine)
+        partial.pulseWidthRamp.SetTarget(pulse_w, samples_num);
         
-        partial.waveFilterStepper.SetTarget(wave_output);
-        wave_output = partial.waveFilterStepper.UpdateLagged();
+        partial.gainRamp.SetTarget(partial_vol * (1 + tremolo_output) * (1 + power_lfo_output), samples_num);
         
         CooMultiplier spring_acc = partial.freqStepper.GetLaggedPos() * 0.001;// * (_envCurrentVolume * 0.2 + 0.8);
-        spring_acc = spring_acc * std::powf(0.9, sustain_geo_diff * 1.3);
+        spring_acc = spring_acc * lowpass_geo_factor;
         spring_acc = CLAMP(spring_acc, 0.0003, 0.95);
+        _lowPassFilters.SetSpringAccTarget(pi, spring_acc);
+    }
+    
+    _lowPassFilters.StartRamp(samples_num);
+}
+
+//-----------------------------------------------------------------------
+StereoSample DroneInstrument::GenerateSample()
+{
+    StereoSample output_sample;
+    
+    //if (_pitch == 0)
+    //    return output_sample;
+    
+    //std::lock_guard<std::mutex> lock(_paramsChangeMutex);
+    
+    if (IsControlTick())
+        UpdateModulators(_controlBlockSize);
+    
+    Volume power_clip_volume = _powerClipVolRamp.Update();
+    
+    // Partials are filtered together, one lane per partial; lanes of silent partials keep their state
+    Sample lanes[PartialsNum];
+    
+    for (int pi = 0; pi < PartialsNum; pi++)
+    {
+        auto& partial = _partials[pi];
+        lanes[pi] = 0;
+        bool is_silent = (partial.leftVolume == 0 && partial.rightVolume == 0);
+        _waveFilters.SetFrozen(pi, is_silent);
+        _lowPassFilters.SetFrozen(pi, is_silent);
+        if (is_silent) continue;
+        
+        if (partial.overtoneMultiplier != 0)
+            partial.wave.SetFrequency(partial.freqRamp.Update());
+        partial.wave.SetPulseWidth(partial.pulseWidthRamp.Update());
+        
+        lanes[pi] = partial.wave.Update();
+        //if (partial.wave.GetType() == WaveSource::WST_Sine)
+    }
+    
+    _waveFilters.Process(lanes);
+    _lowPassFilters.Process(lanes);
+    
+    for (int pi = 0; pi < PartialsNum; pi++)
+    {
+        auto& partial = _partials[pi];
+        if (partial.leftVolume == 0 && partial.rightVolume == 0) continue;
         
-        partial.lowPassStepper.SetSpringAcc(spring_acc);
-        partial.lowPassStepper.SetTarget(wave_output);
-        wave_output = partial.lowPassStepper.UpdateLagged();
+        auto wave_output = lanes[pi];
         ASSERT(ABS(wave_output) < 5.0);
         
         if (power_clip_volume > 0)
@@ -334,7 +392,7 @@ StereoSample DroneInstrument::GenerateSample()
                 wave_output += step_progress * 2.5 * power_clip_volume;
         }
         
-        wave_output *= partial_vol * (1 + tremolo_output) * (1 + power_lfo_output);
+        wave_output *= partial.gainRamp.Update();
         ASSERT(ABS(wave_output) < 10.0);
         
         StereoSample partial_sample;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "KineticInstrument.h"
+#include "yossCommon/sound/FilterBank.h"
 
 namespace yoss
 {
@@ -13,6 +14,8 @@ namespace yoss
             
             //-----------------------------------------------------------------------
             // Constants:
+            static constexpr int ControlBlockSize = 16; // [samples] Modulators are evaluated once per block and ramped in between
+            
             static constexpr int PartialsNum = 4;
             static constexpr Volume PartialsVolume = 3.0 / PartialsNum;
             static constexpr Frequency DroneFundamental = 50.0 / 1.0;
@@ -64,16 +67,24 @@ namespace yoss
                 Frequency vibratoSize;
                 Envelope envelope;
                 
-                math::Stepper<Frequency> freqStepper;
-                math::Stepper<Volume>    volStepper;
-                math::Stepper<Volume>    powerLFOVolStepper;
-                math::Stepper<Volume>    lfoVolStepper;
-                math::Stepper<Volume>    lfoFreqStepper;
-                math::Stepper<Sample>    lowPassStepper;
-                
-                math::Stepper<Sample>    waveFilterStepper;
+                ControlStepper freqStepper;
+                ControlStepper volStepper;
+                ControlStepper powerLFOVolStepper;
+                ControlStepper lfoVolStepper;
+                ControlStepper lfoFreqStepper;
                 Ratio basePulseWidth;
                 WaveSource pulseWidthLFO1, pulseWidthLFO2, pulseWidthLFO3;
+                
+                // Control-rate outputs of modulators
+                ControlRamp freqRamp, gainRamp, pulseWidthRamp;
+                
+                void SetContext(const AudioContext& context)
+                {
+                    wave.SetContext(context); tremoloLFO.SetContext(context); vibratoLFO.SetContext(context); envelope.SetContext(context);
+                    freqStepper.SetContext(context); volStepper.SetContext(context); lfoVolStepper.SetContext(context); lfoFreqStepper.SetContext(context);
+                    pulseWidthLFO1.SetContext(context); pulseWidthLFO2.SetContext(context); pulseWidthLFO3.SetContext(context);
+                    freqRamp.SetContext(context); gainRamp.SetContext(context); pulseWidthRamp.SetContext(context); powerLFO.SetContext(context); powerLFOVolStepper.SetContext(context);
+                }
             };
             
             //-----------------------------------------------------------------------
@@ -88,19 +99,25 @@ namespace yoss
             virtual void DrawInstrument();
             virtual void OnPointerEvent(input::Pointer* pointer) {}
 
-            virtual void AddBeat(PartOfOne normalized_freq, Volume volume);
+            // Beats play nothing, so there's none to cancel: the instrument gets confirmed beats only (see CanCancelBeats())
+            using Instrument::AddBeat;
+            virtual BeatId AddBeat(PartOfOne normalized_freq, Volume volume);
             
             virtual StereoSample GenerateSample();
             
         protected:
             virtual void OnUpdateInput();
+            virtual void SetUnitsContext(const AudioContext& context);
             
             void InitPartials();
+            void UpdateModulators(int samples_num);
             
         protected:
             Frequency _fundamentalFreq;
 
             Partial _partials[PartialsNum];
+            FilterBank<PartialsNum> _waveFilters;
+            FilterBank<PartialsNum> _lowPassFilters;
             Delays _leftDelay, _rightDelay;
             
             std::mutex _paramsChangeMutex;
@@ -111,8 +128,9 @@ namespace yoss
             Angle     _sustainGeoOrient;
             Angle     _sustainGeoOrientBase;
             Angle     _sustainAccAroundYBase;
-            math::Stepper<Angle> _sustainGeoDiffStepper;
-            math::Stepper<Volume> _powerClipVolStepper;
+            ControlStepper        _sustainGeoDiffStepper;
+            ControlStepper        _powerClipVolStepper;
+            ControlRamp           _powerClipVolRamp;
             
             graphics::Image  _dronePlate;
             graphics::Image  _dronePlateDistort;
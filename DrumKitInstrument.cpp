@@ -30,7 +30,12 @@ DrumKitInstrument::~DrumKitInstrument()
 void DrumKitInstrument::LoadDrum(const std::string& file, Volume native_vol, const Rect2D& rect, const Color& flash_col)
 {
     LoadSample(file, true, UnnormalizeFrequency(), native_vol);
-    _drums.push_back(Drum((int)_samples.size() - 1, rect, flash_col));
+    int sample_index = (int)_samples.size() - 1;
+    _drums.push_back(Drum(sample_index, rect, flash_col));
+    
+    std::string hard_file = file.substr(0, file.rfind('.')) + "_hard" + file.substr(file.rfind('.'));
+    if (system::FileExists(system::GetResourcePath(hard_file)))
+        LoadSampleLayer(sample_index, hard_file, native_vol, HardHitMinVelocity);
 }
 
 //-----------------------------------------------------------------------
@@ -50,6 +55,8 @@ void DrumKitInstrument::LoadSamples()
     LoadDrum("snare.pcm", 1, Rect2D::WithMaxPoint(0, 150, 150, 500), Color::FromFloats(1.0, 0.5, 0.5));
     LoadDrum("kick.pcm", 1, Rect2D::WithMaxPoint(150, 150, 330, 500), Color::FromFloats(0.5, 1.0, 0.5));
     LoadDrum("floor_tom.pcm", 1, Rect2D::WithMaxPoint(330, 150, 500, 500), Color::FromFloats(0.5, 0.5, 1.0));
+    
+    StartSamplesPitchCacheForNotes(this);
 }
 
 //-----------------------------------------------------------------------
@@ -97,9 +104,17 @@ void DrumKitInstrument::OnLoseFocus()
 }
 
 //-----------------------------------------------------------------------
-void DrumKitInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
+BeatId DrumKitInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
 {
-    if (!CanPlay()) return;
+    return AddBeat(normalized_freq, volume, BeatDynamics());
+}
+
+//-----------------------------------------------------------------------
+// Dynamics pick the layer of the drums' samples and shape their gain and brightness (see SamplerInstrument)
+// Both drums of a hit play as one beat, cancelled together
+BeatId DrumKitInstrument::AddBeat(PartOfOne normalized_freq, Volume volume, const BeatDynamics& dynamics)
+{
+    if (!CanPlay()) return NO_BEAT_ID;
     
     PartOfOne geo_input = (_geoOrientationAngle + BgGeoHemiRange) / (2 * BgGeoHemiRange);
     geo_input = 1 - CLAMP(geo_input, 0, 1);
@@ -109,10 +124,13 @@ void DrumKitInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
     _lastHitTimestamp = system::GetCurrentTimestamp();
     _lastHitPos = { geo_input * BgWidth, x_axis_input * BgHeight };
     GetDrumsAtPosInBGImage(_lastHitPos, _lastHitDrum1, _lastHitDrum2);
+    BeatId beat_id = NO_BEAT_ID;
     if (_lastHitDrum1 >= 0)
-        SamplerInstrument::AddBeat(0, volume, GetSample(_lastHitDrum1));
+        beat_id = SamplerInstrument::AddBeat(0, volume, GetSample(_lastHitDrum1), dynamics, beat_id);
     if (_lastHitDrum2 >= 0)
-        SamplerInstrument::AddBeat(0, volume, GetSample(_lastHitDrum2));
+        beat_id = SamplerInstrument::AddBeat(0, volume, GetSample(_lastHitDrum2), dynamics, beat_id);
+    
+    return beat_id;
 }
 
 //-----------------------------------------------------------------------
@@ -42,7 +42,8 @@ namespace yoss
             virtual void DrawInstrument();
             virtual void OnPointerEvent(input::Pointer* pointer);
             
-            virtual void AddBeat(PartOfOne normalized_freq, Volume volume);
+            virtual BeatId AddBeat(PartOfOne normalized_freq, Volume volume);
+            virtual BeatId AddBeat(PartOfOne normalized_freq, Volume volume, const BeatDynamics& dynamics);
             
             //virtual StereoSample GenerateSample();
 
@@ -54,6 +55,8 @@ namespace yoss
             static constexpr math::Coo BgWidth  = 500;
             static constexpr math::Coo BgHeight = 500;
             
+            static constexpr PartOfOne HardHitMinVelocity = 0.7; // Of BeatDynamics, from which a drum's "<name>_hard.pcm" layer is played, if shipped
+            
             graphics::Rect2D  _bgRect;
             std::vector<Drum> _drums;
             graphics::Model   _sceneDeco;
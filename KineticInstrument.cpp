@@ -2,6 +2,8 @@
 #include "yossCommon/common/System.h"
 #include "yossCommon/acc/AccEngine.h"
 
+#include <algorithm>
+
 using namespace yoss;
 using namespace yoss::math;
 using namespace yoss::sound;
@@ -103,6 +105,22 @@ void KineticInstrument::SetSamplesNativeFrequencyFromNotes(std::vector<SamplerIn
         samples[note].nativeFrequency = GetFreqFromNote(note);
 }
 
+//-----------------------------------------------------------------------
+// Caches the samples at the frequencies beats are played at, as UnnormalizeFrequency() maps the notes to them;
+// the sampler skips the samples already at a frequency
+void KineticInstrument::StartSamplesPitchCacheForNotes(SamplerInstrument* sampler)
+{
+    std::vector<Frequency> frequencies;
+    for (Note note = 0; note < NotesNum; note++)
+    {
+        Frequency freq = UnnormalizeFrequency(GetNormFreqFromNote(note));
+        if (std::find(frequencies.begin(), frequencies.end(), freq) == frequencies.end())
+            frequencies.push_back(freq);
+    }
+    
+    sampler->StartPitchCache(frequencies, PitchCacheMaxBytes);
+}
+
 //-----------------------------------------------------------------------
 Frequency KineticInstrument::GetFreqFromNormFreq(PartOfOne normalized_freq)
 {
@@ -171,7 +189,7 @@ void KineticInstrument::PlayDemo(Volume volume)
 }
 
 //-----------------------------------------------------------------------
-KineticInstrument::BeatData KineticInstrument::CreateBeatData(Note note, Volume volume, bool user_generated)
+KineticInstrument::BeatData KineticInstrument::CreateBeatData(Note note, Volume volume, bool user_generated, const BeatDynamics& dynamics)
 {
     BeatData beat;
     beat.instrument = this;
@@ -179,6 +197,7 @@ KineticInstrument::BeatData KineticInstrument::CreateBeatData(Note note, Volume
     beat.volume = volume;
     beat.timestamp = system::GetCurrentTimestamp();
     beat.userGenerated = user_generated;
+    beat.dynamics = dynamics;
     beat.vizProgress = 0;
     
     return beat;
@@ -28,6 +28,7 @@ namespace yoss
                 Volume volume;
                 Time   timestamp;
                 bool   userGenerated;
+                BeatDynamics dynamics;
                 math::PartOfOne vizProgress;
             };
 
@@ -46,6 +47,8 @@ namespace yoss
             static constexpr Time MaxFreeSessions      = 10;
             static constexpr Time InstrumentFadeOutDuration = 1.0;
             static constexpr Time InstrumentStopTimeout = 3.0;
+            
+            static constexpr size_t PitchCacheMaxBytes = 32 * 1024 * 1024;
             //-----------------------------------------------------------------------
             
             //-----------------------------------------------------------------------
@@ -89,7 +92,7 @@ namespace yoss
             virtual void OnPointerEvent(input::Pointer* pointer) = 0;
             
             virtual void PlayDemo(Volume volume);
-            virtual BeatData CreateBeatData(Note note, Volume volume, bool user_generated);
+            virtual BeatData CreateBeatData(Note note, Volume volume, bool user_generated, const BeatDynamics& dynamics = BeatDynamics());
             
             Note      GetNoteFromNormFreq(PartOfOne normalized_freq);
             Frequency GetFreqFromNormFreq(PartOfOne normalized_freq);
@@ -103,6 +106,7 @@ namespace yoss
             void DrawViz();
             void DrawInput(Angle geo_max, Angle axis_y_max, Angle axis_x_start_angle = -1, Angle axis_x_end_angle = -1);
             void SetSamplesNativeFrequencyFromNotes(std::vector<SamplerInstrument::SamplerSample>& samples);
+            void StartSamplesPitchCacheForNotes(SamplerInstrument* sampler);
             
             virtual void OnUpdateInput() {}
             
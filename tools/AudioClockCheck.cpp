@@ -0,0 +1,128 @@
+//-----------------------------------------------------------------------
+// AudioClockCheck: feeds AudioClock the observations of simulated audio callbacks, of an audio clock drifting
+// against the host clock and called late by a random delay, and checks the drift it measures and its mapping.
+//
+// Usage: AudioClockCheck [-s seed] [-d duration] [-v]
+//   -s  seed of the callback delays (default: 1)
+//   -d  simulated seconds per run (default: 60); the errors are taken over the second half
+//   -v  print the clock's state every simulated second
+//   Exits with 1 if any run fails its limits.
+//
+// Built with the sources of yossCommon/sound and the common lib of the app.
+//-----------------------------------------------------------------------
+
+#include "../yossCommon/sound/AudioClock.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+using namespace std;
+using namespace yoss;
+using namespace yoss::math;
+using namespace yoss::sound;
+
+
+//-----------------------------------------------------------------------
+// Static defines, consts and vars
+static const Frequency SAMPLES_PER_SEC = 44100;
+static const int       SLICE_SIZE = 512;
+static const Ratio     DRIFTS[] = { -500e-6, -100e-6, 0, 100e-6, 500e-6 };
+static const Time      MAX_DELAYS[] = { 0, 0.001, 0.003 }; // [sec] Callbacks come late by up to this, uniformly
+static const Ratio     MAX_RMS_DRIFT_ERROR = 50e-6; // The rate follows the delays a little, which moves the mapping by ~50 us per sec
+static const Time      MAX_MAPPING_ERROR = 0.0005; // [sec] Of host times of samples, besides the mean callback delay
+
+//-----------------------------------------------------------------------
+struct RunResult
+{
+    Ratio maxDriftError = 0;
+    Ratio rmsDriftError = 0;
+    Time  maxMappingError = 0;
+    Time  jitter = 0;
+};
+
+//-----------------------------------------------------------------------
+// Host time of sample i is i / (SAMPLES_PER_SEC * (1 + drift)), its callback comes up to max_delay later.
+// Mapping error is of the host time of each slice's first sample, less the mean delay the mapping lags by
+static RunResult Run(Ratio drift, Time max_delay, Time duration, int seed, bool verbose)
+{
+    mt19937 random_engine(seed);
+    uniform_real_distribution<double> random_delay(0, max_delay);
+
+    AudioClock clock(SAMPLES_PER_SEC);
+    Frequency true_samples_per_sec = SAMPLES_PER_SEC * (1 + drift);
+    RunResult result;
+    Time next_print_time = 1;
+    double sq_drift_error_sum = 0;
+    int errors_num = 0;
+
+    for (uint64_t sample_index = 0; sample_index / true_samples_per_sec < duration; sample_index += SLICE_SIZE)
+    {
+        Time sample_time = sample_index / true_samples_per_sec;
+        clock.AddObservation(sample_time + random_delay(random_engine), sample_index);
+
+        if (sample_time >= duration / 2 && clock.IsSynced())
+        {
+            Ratio drift_error = clock.GetDrift() - drift;
+            result.maxDriftError = MAX(result.maxDriftError, ABS(drift_error));
+            sq_drift_error_sum += drift_error * drift_error;
+            errors_num++;
+            Time mapping_error = clock.GetHostTimeAt((double)sample_index) - sample_time - max_delay / 2;
+            result.maxMappingError = MAX(result.maxMappingError, ABS(mapping_error));
+        }
+
+        if (verbose && sample_time >= next_print_time)
+        {
+            printf("  %6.1f drift=%+.1fppm jitter=%.2fms synced=%d\n", sample_time, clock.GetDrift() * 1e6,
+                   clock.GetJitter() * 1000, (clock.IsSynced() ? 1 : 0));
+            next_print_time += 1;
+        }
+    }
+
+    result.rmsDriftError = (errors_num > 0 ? sqrt(sq_drift_error_sum / errors_num) : 0);
+    result.jitter = clock.GetJitter();
+    return result;
+}
+
+//-----------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    int seed = 1;
+    Time duration = 60;
+    bool verbose = false;
+
+    for (int arg_i = 1; arg_i < argc; arg_i++)
+    {
+        if (!strcmp(argv[arg_i], "-s") && arg_i + 1 < argc)
+            seed = atoi(argv[++arg_i]);
+        else if (!strcmp(argv[arg_i], "-d") && arg_i + 1 < argc)
+            duration = atof(argv[++arg_i]);
+        else if (!strcmp(argv[arg_i], "-v"))
+            verbose = true;
+        else
+        {
+            printf("Usage: %s [-s seed] [-d duration] [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    int failed_num = 0;
+    for (Time max_delay : MAX_DELAYS)
+    {
+        for (Ratio drift : DRIFTS)
+        {
+            auto result = Run(drift, max_delay, duration, seed, verbose);
+            bool is_ok = (result.rmsDriftError <= MAX_RMS_DRIFT_ERROR && result.maxMappingError <= MAX_MAPPING_ERROR);
+            if (!is_ok)
+                failed_num++;
+
+            printf("drift=%+5.0fppm delay=0-%.0fms %s drift_error: rms=%.1fppm max=%.1fppm max_mapping_error=%.3fms jitter=%.2fms\n",
+                   drift * 1e6, max_delay * 1000, (is_ok ? "OK  " : "FAIL"), result.rmsDriftError * 1e6, result.maxDriftError * 1e6,
+                   result.maxMappingError * 1000, result.jitter * 1000);
+        }
+    }
+
+    return (failed_num > 0 ? 1 : 0);
+}
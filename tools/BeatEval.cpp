@@ -0,0 +1,423 @@
+//-----------------------------------------------------------------------
+// BeatEval: replays recorded FeedAcc streams through AccEngine and scores the detected beats
+// against labelled onsets (see AccRecording for the file formats).
+//
+// Usage: BeatEval [-j threads] [-p] [-h] [-l] [-o] [-P params] [-C model] recording1 [recording2 ...]
+//   Labels of each recording are read from the same path with extension ".onsets".
+//   -j  num of files replayed in parallel (default: num of cores)
+//   -p  also enable predictive onsets and report their latency gain and false fires
+//   -h  print latency histograms
+//   -l  also play the beats by an offline SoundEngine and report the motion-to-sound latency of their stages
+//   -o  also replay the orientation the app reads (angle around X of the fused gravity) and compare it with the one
+//       of the mean of the last 10 acc samples, which the app read before OrientationEstimator
+//   Exits with 2 if any file fails to load, with 1 if the fused gravity of -o was ever not finite.
+//   -P  beat-detection params file (e.g. saved by BeatTune) instead of the built-in defaults
+//   -C  beat classifier model file (saved by BeatTrain) deciding the beats instead of the thresholds of the params
+//
+// The latency of -l is the one of a device without output latency, rendering slices of 512 samples at 44.1 kHz:
+// add_beat -> output is the wait for the next slice (up to 11.6 ms) and for the output of SingleBeatInstrument to rise
+// over what was sounding (see LatencyTracer). Measure it on labelled recordings of the device, e.g.
+//   BeatEval -j 1 -l recordings/*.csv
+// No recordings ship with the repo, so there are no reference figures.
+//
+// Built with ToolsCommon.cpp, the sources of yossCommon/acc and yossCommon/sound and the common/graphics libs of the app,
+// without the native bridge.
+//-----------------------------------------------------------------------
+
+#include "../yossCommon/acc/AccEngine.h"
+#include "../yossCommon/acc/BeatClassifier.h"
+#include "../yossCommon/acc/BeatDetectionParams.h"
+#include "../yossCommon/acc/BeatEvaluation.h"
+#include "../yossCommon/common/Log.h"
+#include "../yossCommon/sound/SoundEngine.h"
+#include "../yossCommon/sound/LatencyTracer.h"
+#include "ToolsCommon.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+using namespace yoss;
+using namespace yoss::math;
+using namespace yoss::sound;
+
+
+//-----------------------------------------------------------------------
+// Static defines, consts and vars
+static const int ORIENTATION_ACC_AVERAGE_SAMPLES = 10; // Of the previous estimate, as App::OnAccFeed took it
+
+//-----------------------------------------------------------------------
+// Angle around X (as App::OnAccInput takes it) of the fused gravity, against the one of the previous estimate.
+// Steps are the changes from sample to sample, of which the RMS tells how much each estimate shakes with the beats
+struct OrientationStats
+{
+    int    samplesNum = 0;
+    int    nonFiniteNum = 0; // Of the fused gravity, which should never be
+    double absDiffSum = 0; // [deg]
+    double maxAbsDiff = 0; // [deg]
+    double sqStepSum = 0; // [deg^2]
+    double sqPrevStepSum = 0; // [deg^2]
+
+    void   Add(AccEngine& acc_engine);
+    void   Add(const OrientationStats& other);
+    string ToString() const;
+
+private:
+    int    _fedNum = 0;
+    double _angle = 0, _prevEstimateAngle = 0;
+};
+
+//-----------------------------------------------------------------------
+struct FileResult
+{
+    bool isLoaded = false;
+    Time duration = 0;
+    BeatEvaluation eval;
+    AccEngine::OnsetStats onsetStats;
+    unique_ptr<LatencyTracer> latencyTracer;
+    OrientationStats orientationStats;
+};
+
+//-----------------------------------------------------------------------
+static double GetAngleDiff(double angle1, double angle2)
+{
+    return fmod(angle1 - angle2 + 540, 360) - 180;
+}
+
+//-----------------------------------------------------------------------
+// After each fed sample
+void OrientationStats::Add(AccEngine& acc_engine)
+{
+    const Vector3D& gravity = acc_engine.GetGravity();
+    if (!isfinite(gravity.x) || !isfinite(gravity.y) || !isfinite(gravity.z))
+    {
+        nonFiniteNum++;
+        return;
+    }
+
+    if (++_fedNum < ORIENTATION_ACC_AVERAGE_SAMPLES || !acc_engine.GetOrientation().IsInitialized())
+        return;
+
+    Vector3D prev_estimate = acc_engine.GetAccTrajectory().GetPositions().GetAverage(0, ORIENTATION_ACC_AVERAGE_SAMPLES);
+    double angle = PointToDeg(-gravity.z, -gravity.y);
+    double prev_estimate_angle = PointToDeg(-prev_estimate.z, -prev_estimate.y);
+
+    double abs_diff = ABS(GetAngleDiff(angle, prev_estimate_angle));
+    absDiffSum += abs_diff;
+    maxAbsDiff = MAX(maxAbsDiff, abs_diff);
+    if (samplesNum > 0)
+    {
+        double step = GetAngleDiff(angle, _angle);
+        double prev_step = GetAngleDiff(prev_estimate_angle, _prevEstimateAngle);
+        sqStepSum += step * step;
+        sqPrevStepSum += prev_step * prev_step;
+    }
+
+    _angle = angle;
+    _prevEstimateAngle = prev_estimate_angle;
+    samplesNum++;
+}
+
+//-----------------------------------------------------------------------
+void OrientationStats::Add(const OrientationStats& other)
+{
+    samplesNum += other.samplesNum;
+    nonFiniteNum += other.nonFiniteNum;
+    absDiffSum += other.absDiffSum;
+    maxAbsDiff = MAX(maxAbsDiff, other.maxAbsDiff);
+    sqStepSum += other.sqStepSum;
+    sqPrevStepSum += other.sqPrevStepSum;
+}
+
+//-----------------------------------------------------------------------
+string OrientationStats::ToString() const
+{
+    int steps_num = MAX(samplesNum - 1, 1);
+    return "samples=" + Log::ToStr(samplesNum) +
+           " non_finite=" + Log::ToStr(nonFiniteNum) +
+           " diff: avg=" + Log::ToStr(samplesNum > 0 ? absDiffSum / samplesNum : 0, 2) + "deg" +
+           " max=" + Log::ToStr(maxAbsDiff, 2) + "deg" +
+           " rms_step: fused=" + Log::ToStr(sqrt(sqStepSum / steps_num), 3) + "deg" +
+           " prev=" + Log::ToStr(sqrt(sqPrevStepSum / steps_num), 3) + "deg";
+}
+
+static const Frequency LATENCY_SAMPLES_PER_SEC = 44100;
+
+//-----------------------------------------------------------------------
+// Feeds the samples one by one to acc_engine, the beats are played by an offline SoundEngine rendering slices in between.
+// Runs on a virtual clock: each sample arrives at its timestamp and each slice is rendered at its start,
+// so the latency is the one of a device rendering slices of DEFAULT_AUDIO_BLOCK_SIZE just in time.
+static vector<Time> ReplayWithLatency(const AccRecording& recording, AccEngine& acc_engine, unique_ptr<LatencyTracer>& latency_tracer,
+                                      OrientationStats* orientation_stats)
+{
+    vector<Time> detections;
+    if (recording.samples.empty())
+        return detections;
+
+    auto virtual_time = make_shared<Time>(0);
+    latency_tracer.reset(new LatencyTracer([virtual_time] () { return *virtual_time; }));
+
+    AudioContext context(LATENCY_SAMPLES_PER_SEC);
+    SoundEngine sound_engine(context);
+    unique_ptr<Instrument> instrument;
+    {
+        lock_guard<mutex> lock(GetConstructMutex());
+        AudioContext::Scope context_scope(sound_engine.GetContext());
+        instrument.reset(new SingleBeatInstrument());
+    }
+    sound_engine.AddInstrument(instrument.get());
+    sound_engine.SetLatencyTracer(latency_tracer.get());
+    acc_engine.SetLatencyTracer(latency_tracer.get());
+
+    // Same as the app does
+    BeatId provisional_beat_id = NO_BEAT_ID;
+    auto add_beat = [&] (PartOfOne normalized_freq, Coo amplitude, const LatencyTrace& trace)
+    {
+        LatencyTrace beat_trace = trace;
+        latency_tracer->StampAddBeat(beat_trace);
+        BeatId beat_id = instrument->AddBeat(normalized_freq, amplitude);
+        latency_tracer->OnAddBeat(beat_trace, beat_id);
+        return beat_id;
+    };
+    auto feed_token = acc_engine.AddAccFeedListener([&] (bool beat_is_detected)
+    {
+        if (!acc_engine.GetPredictiveOnsets())
+            add_beat(acc_engine.GetAccBeatFrequency(), acc_engine.GetAccBeatAmplitude(), acc_engine.GetAccBeatTrace());
+    }, AccEngine::FeedEvent_Beat);
+    auto onset_token = acc_engine.AddOnsetListener([&] (const AccEngine::Onset& onset)
+    {
+        if (onset.type == AccEngine::OnsetType_Provisional)
+            provisional_beat_id = add_beat(onset.normalizedFreq, onset.amplitude, onset.trace);
+        else if (onset.type == AccEngine::OnsetType_Confirmed && !onset.wasProvisional)
+            add_beat(onset.normalizedFreq, onset.amplitude, onset.trace);
+        else if (onset.type == AccEngine::OnsetType_Cancelled)
+        {
+            instrument->CancelBeat(provisional_beat_id);
+            latency_tracer->OnCancelBeat(provisional_beat_id);
+        }
+    });
+
+    const Time slice_duration = context.blockSize * context.sampleDuration;
+    vector<OutputSampleType> slice(context.blockSize * OUTPUT_CHANELS);
+    Time slice_time = recording.samples.front().timestamp;
+    auto render_until = [&] (Time time)
+    {
+        for ( ; slice_time <= time; slice_time += slice_duration)
+        {
+            *virtual_time = slice_time;
+            sound_engine.GenerateSlice(slice.data(), slice.data(), context.blockSize);
+            latency_tracer->Collect();
+        }
+    };
+
+    for (auto& sample : recording.samples)
+    {
+        render_until(sample.timestamp);
+        *virtual_time = sample.timestamp;
+        acc_engine.FeedAccBatch(&sample, 1, &detections);
+        if (orientation_stats)
+            orientation_stats->Add(acc_engine);
+    }
+    render_until(recording.samples.back().timestamp + LATENCY_TRACE_MAX_OUTPUT_DELAY + slice_duration);
+
+    acc_engine.RemoveAccFeedListener(feed_token);
+    acc_engine.RemoveOnsetListener(onset_token);
+    acc_engine.SetLatencyTracer(nullptr);
+    sound_engine.SetLatencyTracer(nullptr);
+
+    return detections;
+}
+
+//-----------------------------------------------------------------------
+// Feeds the samples one by one, as the app does, to follow the orientation after each
+static vector<Time> ReplayWithOrientation(const AccRecording& recording, AccEngine& acc_engine, OrientationStats& orientation_stats)
+{
+    vector<Time> detections;
+    for (auto& sample : recording.samples)
+    {
+        acc_engine.FeedAccBatch(&sample, 1, &detections);
+        orientation_stats.Add(acc_engine);
+    }
+    return detections;
+}
+
+//-----------------------------------------------------------------------
+static void EvaluateFile(const string& path, const BeatDetectionParams& params, const BeatClassifier* classifier, bool predictive,
+                         bool with_latency, bool with_orientation, FileResult& result)
+{
+    AccRecording recording;
+    if (!recording.Load(path))
+        return;
+
+    unique_ptr<AccEngine> acc_engine;
+    {
+        lock_guard<mutex> lock(GetConstructMutex());
+        acc_engine.reset(new AccEngine());
+    }
+    acc_engine->SetParams(params);
+    acc_engine->SetBeatClassifier(classifier);
+    acc_engine->SetPredictiveOnsets(predictive);
+
+    vector<Time> detections;
+    if (with_latency)
+        detections = ReplayWithLatency(recording, *acc_engine, result.latencyTracer, (with_orientation ? &result.orientationStats : nullptr));
+    else if (with_orientation)
+        detections = ReplayWithOrientation(recording, *acc_engine, result.orientationStats);
+    else
+        detections = recording.Replay(*acc_engine);
+
+    result.isLoaded = true;
+    result.duration = recording.GetDuration();
+    result.eval = BeatEvaluation::Evaluate(recording.onsets, detections);
+    result.onsetStats = acc_engine->GetOnsetStats();
+}
+
+//-----------------------------------------------------------------------
+static string OnsetStatsToString(const AccEngine::OnsetStats& stats)
+{
+    return "provisional=" + Log::ToStr(stats.provisionalNum) +
+           " confirmed=" + Log::ToStr(stats.confirmedNum) +
+           " false_fires=" + Log::ToStr(stats.cancelledNum) +
+           " missed=" + Log::ToStr(stats.missedNum) +
+           " avg_latency_gain=" + Log::ToStr(stats.GetAvgLatencyGain() * 1000, 1) + "ms";
+}
+
+//-----------------------------------------------------------------------
+static string LatencyToString(LatencyTracer& latency_tracer)
+{
+    auto percentiles = latency_tracer.GetPercentiles(LatencyTrace::Stage_SensorArrival, LatencyTrace::Stage_Output);
+    return "beats=" + Log::ToStr(percentiles.count) +
+           " p50=" + Log::ToStr(percentiles.p50 * 1000, 1) + "ms" +
+           " p90=" + Log::ToStr(percentiles.p90 * 1000, 1) + "ms" +
+           " p99=" + Log::ToStr(percentiles.p99 * 1000, 1) + "ms" +
+           " no_output=" + Log::ToStr(latency_tracer.GetNoOutputNum());
+}
+
+//-----------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    int threads_num = (int)thread::hardware_concurrency();
+    bool predictive = false;
+    bool with_histogram = false;
+    bool with_latency = false;
+    bool with_orientation = false;
+    string params_path, model_path;
+    vector<string> paths;
+
+    for (int arg_i = 1; arg_i < argc; arg_i++)
+    {
+        if (!strcmp(argv[arg_i], "-j") && arg_i + 1 < argc)
+            threads_num = atoi(argv[++arg_i]);
+        else if (!strcmp(argv[arg_i], "-p"))
+            predictive = true;
+        else if (!strcmp(argv[arg_i], "-h"))
+            with_histogram = true;
+        else if (!strcmp(argv[arg_i], "-l"))
+            with_latency = true;
+        else if (!strcmp(argv[arg_i], "-o"))
+            with_orientation = true;
+        else if (!strcmp(argv[arg_i], "-P") && arg_i + 1 < argc)
+            params_path = argv[++arg_i];
+        else if (!strcmp(argv[arg_i], "-C") && arg_i + 1 < argc)
+            model_path = argv[++arg_i];
+        else
+            paths.push_back(argv[arg_i]);
+    }
+
+    if (paths.empty())
+    {
+        printf("Usage: %s [-j threads] [-p] [-h] [-l] [-o] [-P params] [-C model] recording1 [recording2 ...]\n", argv[0]);
+        return 1;
+    }
+
+    BeatDetectionParams params;
+    if (!params_path.empty() && !params.Load(params_path))
+    {
+        printf("%s: failed to load\n", params_path.c_str());
+        return 2;
+    }
+
+    LinearBeatClassifier classifier;
+    if (!model_path.empty() && !classifier.Load(model_path))
+    {
+        printf("%s: failed to load\n", model_path.c_str());
+        return 2;
+    }
+
+    threads_num = CLAMP(threads_num, 1, (int)paths.size());
+    auto start_time = chrono::steady_clock::now();
+
+    // Files are taken by the workers one at a time, each is replayed by its own AccEngine
+    vector<FileResult> results(paths.size());
+    atomic<int> next_file_i(0);
+    vector<thread> workers;
+    for (int thread_i = 0; thread_i < threads_num; thread_i++)
+    {
+        workers.emplace_back([&] ()
+        {
+            for (int file_i = next_file_i++; file_i < (int)paths.size(); file_i = next_file_i++)
+                EvaluateFile(paths[file_i], params, (model_path.empty() ? nullptr : &classifier), predictive, with_latency, with_orientation, results[file_i]);
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
+
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+
+    BeatEvaluation total;
+    AccEngine::OnsetStats total_onset_stats;
+    LatencyTracer total_latency_tracer([] () { return 0.0; });
+    OrientationStats total_orientation_stats;
+    Time total_duration = 0;
+    int failed_num = 0;
+    for (size_t file_i = 0; file_i < paths.size(); file_i++)
+    {
+        auto& result = results[file_i];
+        if (!result.isLoaded)
+        {
+            printf("%s: failed to load\n", paths[file_i].c_str());
+            failed_num++;
+            continue;
+        }
+
+        printf("%s: %s\n", paths[file_i].c_str(), result.eval.ToString(with_histogram).c_str());
+        if (predictive)
+            printf("  onsets: %s\n", OnsetStatsToString(result.onsetStats).c_str());
+        if (result.latencyTracer)
+        {
+            printf("  latency: %s\n", LatencyToString(*result.latencyTracer).c_str());
+            total_latency_tracer.Merge(*result.latencyTracer);
+        }
+        if (with_orientation)
+            printf("  orientation: %s\n", result.orientationStats.ToString().c_str());
+
+        total.Add(result.eval);
+        total_duration += result.duration;
+        total_onset_stats.provisionalNum += result.onsetStats.provisionalNum;
+        total_onset_stats.confirmedNum += result.onsetStats.confirmedNum;
+        total_onset_stats.cancelledNum += result.onsetStats.cancelledNum;
+        total_onset_stats.missedNum += result.onsetStats.missedNum;
+        total_onset_stats.latencyGainSum += result.onsetStats.latencyGainSum;
+        total_orientation_stats.Add(result.orientationStats);
+    }
+
+    printf("TOTAL: %s\n", total.ToString(with_histogram).c_str());
+    if (predictive)
+        printf("  onsets: %s\n", OnsetStatsToString(total_onset_stats).c_str());
+    if (with_latency)
+        printf("%s\n", total_latency_tracer.ToString().c_str());
+    if (with_orientation)
+        printf("  orientation: %s\n", total_orientation_stats.ToString().c_str());
+    printf("Replayed %.0f sec of recordings in %.2f sec on %d threads\n", total_duration, elapsed, threads_num);
+
+    if (failed_num > 0)
+        return 2;
+    return (total_orientation_stats.nonFiniteNum > 0 ? 1 : 0);
+}
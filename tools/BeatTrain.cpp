@@ -0,0 +1,296 @@
+//-----------------------------------------------------------------------
+// BeatTrain: fits a LinearBeatClassifier (see BeatClassifier) to the candidate segments of labelled recordings,
+// and compares the beats it detects with those of the thresholds of the params.
+//
+// Usage: BeatTrain [-P params] [-i iterations] [-l l2] [-v] [-o model] recording1 [recording2 ...]
+//   Labels of each recording are read from the same path with extension ".onsets" (as in BeatEval).
+//   Candidates are the ended segments of at least minBeatAmplitude of the params; the one nearest to each labelled onset
+//   within the matching window of BeatEvaluation is a beat, the others are not.
+//   -P  beat-detection params file (default: the built-in defaults)
+//   -i  num of gradient descent iterations (default: 2000)
+//   -l  L2 regularization of the standardized weights (default: 0.001)
+//   -v  also cross-validate: each recording evaluated by a model fitted to the others
+//   -o  file the model is saved to, loadable by BeatEval -C or LinearBeatClassifier::Load()
+//
+// Built like BeatEval.
+//-----------------------------------------------------------------------
+
+#include "../yossCommon/acc/AccEngine.h"
+#include "../yossCommon/acc/BeatClassifier.h"
+#include "../yossCommon/acc/BeatDetectionParams.h"
+#include "../yossCommon/acc/BeatEvaluation.h"
+#include "../yossCommon/common/Log.h"
+#include "ToolsCommon.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+using namespace yoss;
+using namespace yoss::math;
+
+
+//-----------------------------------------------------------------------
+// Static defines, consts and vars
+static const int   DEFAULT_ITERATIONS = 2000;
+static const Ratio DEFAULT_L2 = 0.001;
+static const Ratio LEARNING_RATE = 0.5; // Of the standardized features
+static const int   BENCHMARK_REPEATS = 1000;
+
+//-----------------------------------------------------------------------
+struct Candidate
+{
+    BeatFeatures features;
+    Time         timestamp; // Detection time, as in AccRecording::Replay()
+    bool         isBeat;
+};
+
+//-----------------------------------------------------------------------
+struct TrainingSet
+{
+    vector<Candidate> candidates;
+    int onsetsNum = 0; // Including those without a candidate
+};
+
+//-----------------------------------------------------------------------
+static void CollectCandidates(const AccRecording& recording, const BeatDetectionParams& params, TrainingSet& set)
+{
+    AccEngine acc_engine;
+    acc_engine.SetParams(params);
+
+    vector<Candidate> candidates;
+    acc_engine.AddAccFeedListener([&] (bool beat_is_detected)
+    {
+        auto& features = acc_engine.GetSegmentFeatures();
+        if (features[BeatFeatures::Feature_Amplitude] >= params.minBeatAmplitude)
+            candidates.push_back({ features, acc_engine.GetFeedTimestamp(), false });
+    }, AccEngine::FeedEvent_Segment);
+
+    for (auto& sample : recording.samples)
+        acc_engine.FeedAcc(sample.timestamp, sample.accX, sample.accY, sample.accZ,
+                           sample.gyroX, sample.gyroY, sample.gyroZ, sample.magX, sample.magY, sample.magZ);
+
+    // Both are in time order
+    size_t first_i = 0;
+    for (auto onset : recording.onsets)
+    {
+        while (first_i < candidates.size() && candidates[first_i].timestamp < onset - BEAT_EVAL_MAX_EARLY)
+            first_i++;
+
+        Candidate* nearest = nullptr;
+        for (size_t candidate_i = first_i; candidate_i < candidates.size() && candidates[candidate_i].timestamp <= onset + BEAT_EVAL_MAX_LATE; candidate_i++)
+        {
+            auto& candidate = candidates[candidate_i];
+            if (!candidate.isBeat && (!nearest || fabs(candidate.timestamp - onset) < fabs(nearest->timestamp - onset)))
+                nearest = &candidate;
+        }
+        if (nearest)
+            nearest->isBeat = true;
+    }
+
+    set.candidates.insert(set.candidates.end(), candidates.begin(), candidates.end());
+    set.onsetsNum += (int)recording.onsets.size();
+}
+
+//-----------------------------------------------------------------------
+// Logistic regression by gradient descent on standardized features, converted to the features' own units.
+// Threshold is the one with the best F-measure on the set.
+static LinearBeatClassifier Fit(const TrainingSet& set, int iterations, Ratio l2)
+{
+    const int features_num = BeatFeatures::FEATURES_NUM;
+    const int candidates_num = (int)set.candidates.size();
+    LinearBeatClassifier classifier;
+    if (candidates_num == 0)
+        return classifier;
+
+    double means[features_num] = {}, scales[features_num] = {};
+    for (auto& candidate : set.candidates)
+        for (int feature = 0; feature < features_num; feature++)
+            means[feature] += candidate.features[feature] / candidates_num;
+    for (auto& candidate : set.candidates)
+        for (int feature = 0; feature < features_num; feature++)
+        {
+            double diff = candidate.features[feature] - means[feature];
+            scales[feature] += diff * diff / candidates_num;
+        }
+    for (int feature = 0; feature < features_num; feature++)
+        scales[feature] = (scales[feature] > 0 ? sqrt(scales[feature]) : 1);
+
+    vector<double> standardized(candidates_num * features_num);
+    for (int candidate_i = 0; candidate_i < candidates_num; candidate_i++)
+        for (int feature = 0; feature < features_num; feature++)
+            standardized[candidate_i * features_num + feature] = (set.candidates[candidate_i].features[feature] - means[feature]) / scales[feature];
+
+    double weights[features_num] = {}, bias = 0;
+    for (int iteration = 0; iteration < iterations; iteration++)
+    {
+        double weight_grads[features_num] = {}, bias_grad = 0;
+        for (int candidate_i = 0; candidate_i < candidates_num; candidate_i++)
+        {
+            const double* x = &standardized[candidate_i * features_num];
+            double score = bias;
+            for (int feature = 0; feature < features_num; feature++)
+                score += weights[feature] * x[feature];
+
+            double error = 1 / (1 + exp(-score)) - (set.candidates[candidate_i].isBeat ? 1 : 0);
+            for (int feature = 0; feature < features_num; feature++)
+                weight_grads[feature] += error * x[feature];
+            bias_grad += error;
+        }
+
+        for (int feature = 0; feature < features_num; feature++)
+            weights[feature] -= LEARNING_RATE * (weight_grads[feature] / candidates_num + l2 * weights[feature]);
+        bias -= LEARNING_RATE * bias_grad / candidates_num;
+    }
+
+    for (int feature = 0; feature < features_num; feature++)
+    {
+        classifier.SetWeight(feature, weights[feature] / scales[feature]);
+        bias -= weights[feature] * means[feature] / scales[feature];
+    }
+    classifier.SetBias(bias);
+
+    // Sweep of the threshold over the scores, highest first
+    vector<pair<double, bool>> scores;
+    for (auto& candidate : set.candidates)
+        scores.push_back({ classifier.Score(candidate.features), candidate.isBeat });
+    sort(scores.begin(), scores.end(), [] (const pair<double, bool>& a, const pair<double, bool>& b) { return a.first > b.first; });
+
+    int true_positives = 0;
+    double best_f_measure = -1;
+    for (size_t score_i = 0; score_i < scores.size(); score_i++)
+    {
+        true_positives += (scores[score_i].second ? 1 : 0);
+        double f_measure = 2.0 * true_positives / ((score_i + 1) + set.onsetsNum);
+        bool is_split = (score_i + 1 == scores.size() || scores[score_i + 1].first < scores[score_i].first);
+        if (is_split && f_measure > best_f_measure)
+        {
+            best_f_measure = f_measure;
+            classifier.SetThreshold(score_i + 1 < scores.size() ? (scores[score_i].first + scores[score_i + 1].first) * 0.5 : scores[score_i].first - 1);
+        }
+    }
+
+    return classifier;
+}
+
+//-----------------------------------------------------------------------
+static BeatEvaluation Evaluate(const AccRecording& recording, const BeatDetectionParams& params, const BeatClassifier* classifier)
+{
+    AccEngine acc_engine;
+    acc_engine.SetParams(params);
+    acc_engine.SetBeatClassifier(classifier);
+    return BeatEvaluation::Evaluate(recording.onsets, recording.Replay(acc_engine));
+}
+
+//-----------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    int iterations = DEFAULT_ITERATIONS;
+    Ratio l2 = DEFAULT_L2;
+    bool cross_validate = false;
+    string params_path, output_path;
+    vector<string> paths;
+
+    for (int arg_i = 1; arg_i < argc; arg_i++)
+    {
+        bool has_value = (arg_i + 1 < argc);
+        if (!strcmp(argv[arg_i], "-P") && has_value)
+            params_path = argv[++arg_i];
+        else if (!strcmp(argv[arg_i], "-i") && has_value)
+            iterations = atoi(argv[++arg_i]);
+        else if (!strcmp(argv[arg_i], "-l") && has_value)
+            l2 = atof(argv[++arg_i]);
+        else if (!strcmp(argv[arg_i], "-v"))
+            cross_validate = true;
+        else if (!strcmp(argv[arg_i], "-o") && has_value)
+            output_path = argv[++arg_i];
+        else
+            paths.push_back(argv[arg_i]);
+    }
+
+    if (paths.empty())
+    {
+        printf("Usage: %s [-P params] [-i iterations] [-l l2] [-v] [-o model] recording1 [recording2 ...]\n", argv[0]);
+        return 1;
+    }
+
+    BeatDetectionParams params;
+    if (!params_path.empty() && !params.Load(params_path))
+    {
+        printf("%s: failed to load\n", params_path.c_str());
+        return 2;
+    }
+
+    vector<AccRecording> recordings(paths.size());
+    vector<TrainingSet> sets(paths.size());
+    TrainingSet total_set;
+    for (size_t recording_i = 0; recording_i < paths.size(); recording_i++)
+    {
+        if (!recordings[recording_i].Load(paths[recording_i]))
+        {
+            printf("%s: failed to load\n", paths[recording_i].c_str());
+            return 2;
+        }
+        CollectCandidates(recordings[recording_i], params, sets[recording_i]);
+        total_set.candidates.insert(total_set.candidates.end(), sets[recording_i].candidates.begin(), sets[recording_i].candidates.end());
+        total_set.onsetsNum += sets[recording_i].onsetsNum;
+    }
+
+    int beats_num = 0;
+    for (auto& candidate : total_set.candidates)
+        beats_num += (candidate.isBeat ? 1 : 0);
+    printf("Candidates: %d, beats: %d, onsets: %d\n", (int)total_set.candidates.size(), beats_num, total_set.onsetsNum);
+
+    auto classifier = Fit(total_set, iterations, l2);
+
+    printf("Model: threshold=%g bias=%g\n", classifier.GetThreshold(), classifier.GetBias());
+    for (int feature = 0; feature < BeatFeatures::FEATURES_NUM; feature++)
+        printf("  %-20s %g\n", BeatFeatures::GetName(feature), classifier.GetWeight(feature));
+
+    BeatEvaluation params_eval, classifier_eval, cross_eval;
+    for (size_t recording_i = 0; recording_i < recordings.size(); recording_i++)
+    {
+        params_eval.Add(Evaluate(recordings[recording_i], params, nullptr));
+        classifier_eval.Add(Evaluate(recordings[recording_i], params, &classifier));
+
+        if (cross_validate)
+        {
+            TrainingSet others_set;
+            for (size_t other_i = 0; other_i < sets.size(); other_i++)
+            {
+                if (other_i == recording_i)
+                    continue;
+                others_set.candidates.insert(others_set.candidates.end(), sets[other_i].candidates.begin(), sets[other_i].candidates.end());
+                others_set.onsetsNum += sets[other_i].onsetsNum;
+            }
+            auto others_classifier = Fit(others_set, iterations, l2);
+            cross_eval.Add(Evaluate(recordings[recording_i], params, &others_classifier));
+        }
+    }
+
+    printf("Thresholds: %s\n", params_eval.ToString(false).c_str());
+    printf("Classifier: %s\n", classifier_eval.ToString(false).c_str());
+    if (cross_validate)
+        printf("Cross-validated classifier: %s\n", cross_eval.ToString(false).c_str());
+
+    // Cost of the classifier stage per candidate
+    auto start_time = chrono::steady_clock::now();
+    int beats_scored = 0;
+    for (int repeat = 0; repeat < BENCHMARK_REPEATS; repeat++)
+        for (auto& candidate : total_set.candidates)
+            beats_scored += (classifier.IsBeat(candidate.features) ? 1 : 0);
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+    printf("Scoring: %.1f ns per candidate (%d)\n", elapsed * 1e9 / MAX(BENCHMARK_REPEATS * total_set.candidates.size(), (size_t)1), beats_scored);
+
+    if (!output_path.empty() && !classifier.Save(output_path))
+    {
+        printf("%s: failed to save\n", output_path.c_str());
+        return 2;
+    }
+
+    return 0;
+}
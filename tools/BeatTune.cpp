@@ -0,0 +1,338 @@
+//-----------------------------------------------------------------------
+// BeatTune: sweeps beat-detection params (see BeatDetectionParams) over labelled recordings and ranks them
+// by F-measure of detected beats, then by average latency. Recordings are loaded once and shared by all runs.
+//
+// Usage: BeatTune [-j threads] [-n runs | -g steps] [-f field1,field2,...] [-r range] [-s seed] [-k top]
+//                 [-b base.params] [-o best.params] recording1 [recording2 ...]
+//   Labels of each recording are read from the same path with extension ".onsets" (as in BeatEval).
+//   -j  num of param sets evaluated in parallel (default: num of cores)
+//   -n  random search: num of param sets drawn uniformly within the range (default: 100)
+//   -g  grid search instead: num of values per swept field
+//   -f  fields to sweep, by their names in the params file (default: all)
+//   -r  swept range, relative to the base value of each field (default: 0.5, i.e. base * [0.5, 1.5]); fields of base 0
+//       are swept relative to their built-in defaults instead, and all are clamped to the values AccEngine accepts
+//   -s  seed of the random search (default: 1)
+//   -k  num of best param sets printed (default: 10)
+//   -b  base params file (default: the built-in defaults)
+//   -o  file the best params are saved to, loadable by the app as "beat_detection.params"
+//
+// Built like BeatEval.
+//-----------------------------------------------------------------------
+
+#include "../yossCommon/acc/AccEngine.h"
+#include "../yossCommon/acc/BeatDetectionParams.h"
+#include "../yossCommon/acc/BeatEvaluation.h"
+#include "../yossCommon/common/Log.h"
+#include "ToolsCommon.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+using namespace yoss;
+using namespace yoss::math;
+
+
+//-----------------------------------------------------------------------
+// Static defines, consts and vars
+static const int   DEFAULT_RANDOM_RUNS = 100;
+static const Ratio DEFAULT_RANGE = 0.5;
+static const int   MAX_GRID_RUNS = 100000;
+
+//-----------------------------------------------------------------------
+// Values a field may be swept to, for AccEngine and Trajectory to accept the params
+struct FieldRange
+{
+    const char* name;
+    double      minValue;
+    double      maxValue;
+};
+
+static const FieldRange FIELD_RANGES[] = {
+    { "maxAngleToZ",                 0,   180 },
+    { "segments.movingAgainstMaxCos", -1, -0.001 }, // Moving against means an angle over 90 deg
+};
+static const double FIELD_DEFAULT_MIN = 0; // Of the fields not in FIELD_RANGES, which are all sizes, durations or ratios
+static const double FIELD_DEFAULT_MAX = 1e9;
+
+//-----------------------------------------------------------------------
+struct Run
+{
+    BeatDetectionParams params;
+    BeatEvaluation eval;
+};
+
+//-----------------------------------------------------------------------
+static void EvaluateRun(const vector<AccRecording>& recordings, Run& run)
+{
+    for (auto& recording : recordings)
+    {
+        unique_ptr<AccEngine> acc_engine;
+        {
+            lock_guard<mutex> lock(GetConstructMutex());
+            acc_engine.reset(new AccEngine());
+        }
+        acc_engine->SetParams(run.params);
+
+        auto detections = recording.Replay(*acc_engine);
+        run.eval.Add(BeatEvaluation::Evaluate(recording.onsets, detections));
+    }
+}
+
+//-----------------------------------------------------------------------
+// Better F-measure first, lower latency on ties
+static bool IsRunBetter(const Run& run, const Run& other)
+{
+    auto f_measure = run.eval.GetFMeasure();
+    auto other_f_measure = other.eval.GetFMeasure();
+    if (f_measure != other_f_measure)
+        return f_measure > other_f_measure;
+
+    return run.eval.GetAvgLatency() < other.eval.GetAvgLatency();
+}
+
+//-----------------------------------------------------------------------
+static double GetFieldValue(BeatDetectionParams params, const string& name)
+{
+    for (auto& field : params.GetFields())
+        if (field.first == name)
+            return *field.second;
+
+    ASSERT(false);
+    return 0;
+}
+
+//-----------------------------------------------------------------------
+static void SetFieldValue(BeatDetectionParams& params, const string& name, double value)
+{
+    for (auto& field : params.GetFields())
+        if (field.first == name)
+            *field.second = value;
+}
+
+//-----------------------------------------------------------------------
+// Base value changed by offset (-range..range) times itself, clamped to the field's range. A base of 0 would stay 0,
+// so it's offset by the built-in default instead, or by 1 if that's 0 too
+static double GetSweptValue(const string& name, double base_value, double offset)
+{
+    double scale = base_value;
+    if (scale == 0)
+        scale = GetFieldValue(BeatDetectionParams(), name);
+    if (scale == 0)
+        scale = 1;
+
+    double min_value = FIELD_DEFAULT_MIN;
+    double max_value = FIELD_DEFAULT_MAX;
+    for (auto& range : FIELD_RANGES)
+    {
+        if (name == range.name)
+        {
+            min_value = range.minValue;
+            max_value = range.maxValue;
+        }
+    }
+
+    double value = base_value + scale * offset;
+    return CLAMP(value, min_value, max_value);
+}
+
+//-----------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    int threads_num = (int)thread::hardware_concurrency();
+    int random_runs_num = DEFAULT_RANDOM_RUNS;
+    int grid_steps = 0;
+    Ratio range = DEFAULT_RANGE;
+    unsigned seed = 1;
+    int top_num = 10;
+    string fields_arg, base_path, output_path;
+    vector<string> paths;
+
+    for (int arg_i = 1; arg_i < argc; arg_i++)
+    {
+        bool has_value = (arg_i + 1 < argc);
+        if (!strcmp(argv[arg_i], "-j") && has_value)
+            threads_num = atoi(argv[++arg_i]);
+        else if (!strcmp(argv[arg_i], "-n") && has_value)
+            random_runs_num = atoi(argv[++arg_i]);
+        else if (!strcmp(argv[arg_i], "-g") && has_value)
+            grid_steps = atoi(argv[++arg_i]);
+        else if (!strcmp(argv[arg_i], "-f") && has_value)
+            fields_arg = argv[++arg_i];
+        else if (!strcmp(argv[arg_i], "-r") && has_value)
+            range = atof(argv[++arg_i]);
+        else if (!strcmp(argv[arg_i], "-s") && has_value)
+            seed = (unsigned)atoi(argv[++arg_i]);
+        else if (!strcmp(argv[arg_i], "-k") && has_value)
+            top_num = atoi(argv[++arg_i]);
+        else if (!strcmp(argv[arg_i], "-b") && has_value)
+            base_path = argv[++arg_i];
+        else if (!strcmp(argv[arg_i], "-o") && has_value)
+            output_path = argv[++arg_i];
+        else
+            paths.push_back(argv[arg_i]);
+    }
+
+    if (paths.empty())
+    {
+        printf("Usage: %s [-j threads] [-n runs | -g steps] [-f field1,field2,...] [-r range] [-s seed] [-k top]\n"
+               "       [-b base.params] [-o best.params] recording1 [recording2 ...]\n", argv[0]);
+        return 1;
+    }
+
+    BeatDetectionParams base_params;
+    if (!base_path.empty() && !base_params.Load(base_path))
+    {
+        printf("%s: failed to load\n", base_path.c_str());
+        return 2;
+    }
+
+    // Swept fields
+    vector<string> fields;
+    if (fields_arg.empty())
+    {
+        for (auto& field : base_params.GetFields())
+            fields.push_back(field.first);
+    }
+    else
+    {
+        istringstream fields_stream(fields_arg);
+        string field;
+        while (getline(fields_stream, field, ','))
+        {
+            bool is_known = false;
+            for (auto& known_field : base_params.GetFields())
+                is_known = is_known || (known_field.first == field);
+            if (!is_known)
+            {
+                printf("Unknown field '%s'\n", field.c_str());
+                return 1;
+            }
+            fields.push_back(field);
+        }
+    }
+
+    // Recordings, loaded once
+    vector<AccRecording> recordings;
+    for (auto& path : paths)
+    {
+        AccRecording recording;
+        if (!recording.Load(path))
+        {
+            printf("%s: failed to load\n", path.c_str());
+            return 2;
+        }
+        recordings.push_back(move(recording));
+    }
+
+    // Param sets, the base one first so that it's always ranked
+    vector<Run> runs(1);
+    runs[0].params = base_params;
+    if (grid_steps > 1)
+    {
+        double grid_runs_num = pow((double)grid_steps, (double)fields.size());
+        if (grid_runs_num > MAX_GRID_RUNS)
+        {
+            printf("Grid of %.0f param sets is too big, use fewer fields or steps\n", grid_runs_num);
+            return 1;
+        }
+
+        vector<int> steps(fields.size(), 0);
+        for (int run_i = 0; run_i < (int)grid_runs_num; run_i++)
+        {
+            Run run;
+            run.params = base_params;
+            for (size_t field_i = 0; field_i < fields.size(); field_i++)
+            {
+                double base_value = GetFieldValue(base_params, fields[field_i]);
+                double offset = -range + 2 * range * steps[field_i] / (grid_steps - 1);
+                SetFieldValue(run.params, fields[field_i], GetSweptValue(fields[field_i], base_value, offset));
+            }
+            runs.push_back(run);
+
+            // Next grid point, first field changing fastest
+            for (size_t field_i = 0; field_i < fields.size() && ++steps[field_i] == grid_steps; field_i++)
+                steps[field_i] = 0;
+        }
+    }
+    else
+    {
+        mt19937 random_engine(seed);
+        uniform_real_distribution<double> random_offset(-range, range);
+        for (int run_i = 0; run_i < random_runs_num; run_i++)
+        {
+            Run run;
+            run.params = base_params;
+            for (auto& field : fields)
+                SetFieldValue(run.params, field, GetSweptValue(field, GetFieldValue(base_params, field), random_offset(random_engine)));
+            runs.push_back(run);
+        }
+    }
+
+    // Swept values may break relations AccEngine relies on
+    runs.erase(remove_if(runs.begin() + 1, runs.end(), [] (const Run& run)
+    {
+        return run.params.minBeatAmplitude >= run.params.maxBeatAmplitude;
+    }), runs.end());
+
+    threads_num = CLAMP(threads_num, 1, (int)runs.size());
+    auto start_time = chrono::steady_clock::now();
+
+    // Param sets are taken by the workers one at a time, each replays all recordings
+    atomic<int> next_run_i(0);
+    vector<thread> workers;
+    for (int thread_i = 0; thread_i < threads_num; thread_i++)
+    {
+        workers.emplace_back([&] ()
+        {
+            for (int run_i = next_run_i++; run_i < (int)runs.size(); run_i = next_run_i++)
+                EvaluateRun(recordings, runs[run_i]);
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
+
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+
+    auto base_eval = runs[0].eval;
+    stable_sort(runs.begin(), runs.end(), IsRunBetter);
+
+    printf("base: %s\n", base_eval.ToString(false).c_str());
+    top_num = MIN(top_num, (int)runs.size());
+    for (int run_i = 0; run_i < top_num; run_i++)
+    {
+        auto& run = runs[run_i];
+        printf("#%d: %s\n", run_i + 1, run.eval.ToString(false).c_str());
+
+        for (auto& field : fields)
+        {
+            double value = GetFieldValue(run.params, field);
+            double base_value = GetFieldValue(base_params, field);
+            if (value != base_value)
+                printf("  %s=%g (base %g)\n", field.c_str(), value, base_value);
+        }
+    }
+    printf("Evaluated %d param sets on %d recordings in %.2f sec on %d threads\n",
+           (int)runs.size(), (int)recordings.size(), elapsed, threads_num);
+
+    if (!output_path.empty())
+    {
+        if (!runs[0].params.Save(output_path))
+        {
+            printf("%s: failed to save\n", output_path.c_str());
+            return 2;
+        }
+        printf("Best params saved to %s\n", output_path.c_str());
+    }
+
+    return 0;
+}
@@ -0,0 +1,205 @@
+//-----------------------------------------------------------------------
+// EnsembleSim: streams recordings to an EnsembleServer as synthetic local performers, one connection per performer.
+//
+// Usage: EnsembleSim [-n performers] [-x speed] [-c chunk] [-a address] [-s] recording1 [recording2 ...]
+//   Recordings are as in BeatEval (with their ".onsets" labels); performer i streams recording i % recordings_num.
+//   -n  num of performers, each streaming from its own thread (default: num of recordings)
+//   -x  playback speed relative to the recorded timestamps, 0 = as fast as possible (default: 0)
+//   -c  num of samples sent at once, as bursts of a sensor (default: 8)
+//   -a  address of the server, "unix:<path>" or "tcp:<port>" (default: unix:/tmp/yoss_ensemble.sock)
+//   -s  run the server in this process and check the beats of each performer against a replay of its recording
+//
+// Built with ToolsCommon.cpp, the sources of yossCommon/acc, Instrument of yossCommon/sound and the common/graphics libs of the app,
+// without the native bridge.
+//-----------------------------------------------------------------------
+
+#include "../yossCommon/acc/AccEngine.h"
+#include "../yossCommon/acc/BeatEvaluation.h"
+#include "../yossCommon/acc/EnsembleServer.h"
+#include "../yossCommon/common/Log.h"
+#include "ToolsCommon.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+using namespace std;
+using namespace yoss;
+using namespace yoss::math;
+using namespace yoss::sound;
+
+
+//-----------------------------------------------------------------------
+// Static defines, consts and vars
+static const char* DEFAULT_ADDRESS = "unix:/tmp/yoss_ensemble.sock";
+static const int   DEFAULT_CHUNK_SAMPLES = 8;
+static const Time  SERVER_DRAIN_TIMEOUT = 10.0; // [sec] Wait for the server to process what was sent
+
+//-----------------------------------------------------------------------
+// Counts beats routed to it by the server
+class CountingInstrument : public Instrument
+{
+public:
+    virtual BeatId AddBeat(PartOfOne normalized_freq, Volume volume) { beatsNum++; return NO_BEAT_ID; }
+    virtual StereoSample GenerateSample() { return StereoSample(); }
+
+    atomic<int> beatsNum {0};
+};
+
+//-----------------------------------------------------------------------
+static bool StreamRecording(const string& address, int performer_id, const AccRecording& recording, Ratio speed, int chunk_samples)
+{
+    EnsembleClient client;
+    if (!client.Connect(address, performer_id))
+        return false;
+
+    auto start_time = chrono::steady_clock::now();
+    Time first_timestamp = (recording.samples.empty() ? 0 : recording.samples.front().timestamp);
+
+    for (int sample_i = 0; sample_i < recording.GetSamplesNum(); sample_i += chunk_samples)
+    {
+        int samples_num = MIN(chunk_samples, recording.GetSamplesNum() - sample_i);
+        if (speed > 0)
+        {
+            // A chunk is sent once its last sample would have arrived
+            Time send_time = (recording.samples[sample_i + samples_num - 1].timestamp - first_timestamp) / speed;
+            this_thread::sleep_until(start_time + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(send_time)));
+        }
+
+        if (!client.Send(&recording.samples[sample_i], samples_num))
+            return false;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    int performers_num = 0;
+    Ratio speed = 0;
+    int chunk_samples = DEFAULT_CHUNK_SAMPLES;
+    string address = DEFAULT_ADDRESS;
+    bool with_server = false;
+    vector<string> paths;
+
+    for (int arg_i = 1; arg_i < argc; arg_i++)
+    {
+        if (!strcmp(argv[arg_i], "-n") && arg_i + 1 < argc)
+            performers_num = atoi(argv[++arg_i]);
+        else if (!strcmp(argv[arg_i], "-x") && arg_i + 1 < argc)
+            speed = atof(argv[++arg_i]);
+        else if (!strcmp(argv[arg_i], "-c") && arg_i + 1 < argc)
+            chunk_samples = atoi(argv[++arg_i]);
+        else if (!strcmp(argv[arg_i], "-a") && arg_i + 1 < argc)
+            address = argv[++arg_i];
+        else if (!strcmp(argv[arg_i], "-s"))
+            with_server = true;
+        else
+            paths.push_back(argv[arg_i]);
+    }
+
+    if (paths.empty())
+    {
+        printf("Usage: %s [-n performers] [-x speed] [-c chunk] [-a address] [-s] recording1 [recording2 ...]\n", argv[0]);
+        return 1;
+    }
+
+    vector<AccRecording> recordings(paths.size());
+    for (size_t recording_i = 0; recording_i < paths.size(); recording_i++)
+    {
+        if (!recordings[recording_i].Load(paths[recording_i]))
+        {
+            printf("%s: failed to load\n", paths[recording_i].c_str());
+            return 2;
+        }
+    }
+    chunk_samples = MAX(chunk_samples, 1);
+    if (performers_num <= 0)
+        performers_num = (int)recordings.size();
+
+    unique_ptr<EnsembleServer> server;
+    vector<unique_ptr<CountingInstrument>> instruments;
+    if (with_server)
+    {
+        server.reset(new EnsembleServer());
+        if (!server->Start(address))
+        {
+            printf("%s: failed to start the server\n", address.c_str());
+            return 2;
+        }
+        if (address.compare(0, 4, "tcp:") == 0)
+            address = "tcp:" + Log::ToStr(server->GetPort());
+
+        for (int performer_id = 0; performer_id < performers_num; performer_id++)
+        {
+            instruments.emplace_back(new CountingInstrument());
+            server->AssignInstrument(performer_id, instruments.back().get());
+        }
+    }
+
+    auto start_time = chrono::steady_clock::now();
+
+    vector<thread> clients;
+    atomic<int> failed_num(0);
+    for (int performer_id = 0; performer_id < performers_num; performer_id++)
+    {
+        clients.emplace_back([&, performer_id] ()
+        {
+            auto& recording = recordings[performer_id % recordings.size()];
+            if (!StreamRecording(address, performer_id, recording, speed, chunk_samples))
+                failed_num++;
+        });
+    }
+    for (auto& client : clients)
+        client.join();
+
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+    printf("Streamed %d performers in %.2f sec, failed: %d\n", performers_num, elapsed, failed_num.load());
+
+    if (!server)
+        return (failed_num > 0 ? 2 : 0);
+
+    // Streams are closed by the clients, the server may still be processing them
+    vector<EnsembleServer::StreamStats> stats;
+    for (Time waited = 0; waited < SERVER_DRAIN_TIMEOUT; waited += 0.01)
+    {
+        stats = server->GetStreamStats();
+        int finished_num = 0;
+        for (auto& stream_stats : stats)
+            finished_num += (stream_stats.isConnected ? 0 : 1);
+        if (finished_num >= performers_num)
+            break;
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    server->Stop();
+
+    int mismatched_num = 0;
+    for (int performer_id = 0; performer_id < performers_num; performer_id++)
+    {
+        auto& recording = recordings[performer_id % recordings.size()];
+        AccEngine acc_engine;
+        int expected_beats_num = (int)recording.Replay(acc_engine).size();
+
+        int samples_num = 0, beats_num = 0;
+        for (auto& stream_stats : stats)
+        {
+            if (stream_stats.performerId != performer_id)
+                continue;
+            samples_num += stream_stats.samplesNum;
+            beats_num += stream_stats.beatsNum;
+        }
+        int routed_num = instruments[performer_id]->beatsNum;
+
+        bool is_ok = (samples_num == recording.GetSamplesNum() && beats_num == expected_beats_num && routed_num == beats_num);
+        mismatched_num += (is_ok ? 0 : 1);
+        printf("performer %d: samples=%d/%d beats=%d expected=%d routed=%d%s\n", performer_id, samples_num, recording.GetSamplesNum(),
+               beats_num, expected_beats_num, routed_num, (is_ok ? "" : " MISMATCH"));
+    }
+
+    return (failed_num > 0 || mismatched_num > 0 ? 2 : 0);
+}
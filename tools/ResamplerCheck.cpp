@@ -0,0 +1,175 @@
+//-----------------------------------------------------------------------
+// ResamplerCheck: plays a band-limited stereo test sample through Resampler at a sweep of play speeds, and compares
+// the output with the linear interpolation of WaveSource::UpdateStereo that Resampler replaced (kept here as the
+// reference) and with the exact signal.
+//
+// Usage: ResamplerCheck [-v]
+//   -v  print the errors at every speed
+//   Exits with 1 if any quality exceeds its limits at any speed. Linear is the old path up to its read position
+//   being quantised to 1 / RESAMPLE_PHASES_NUM of a frame; Cubic and Sinc differ from it by the old path's own error,
+//   and Sinc also by the droop of its passband, more so in the lower cutoff tables.
+//
+// Built with the sources of yossCommon/sound and the common lib of the app.
+//-----------------------------------------------------------------------
+
+#include "../yossCommon/sound/Resampler.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+using namespace yoss;
+using namespace yoss::math;
+using namespace yoss::sound;
+
+
+//-----------------------------------------------------------------------
+// Static defines, consts and vars
+static const int   SAMPLE_FRAMES = 44100;
+static const Ratio MIN_SPEED = 0.25;
+static const Ratio MAX_SPEED = 4.0;
+static const int   SPEEDS_PER_OCTAVE = 6;
+static const Ratio MAX_OUTPUT_FREQ = 0.05; // [cycles per frame] Highest partial as played (2.2 kHz at 44.1 kHz), as pitched notes are
+static const int   EDGE_FRAMES = RESAMPLE_SINC_TAPS; // Skipped at both ends of the output, where kernels reach out of the sample
+
+// Per quality: Linear, Cubic, Sinc. Peak amplitude of the test signal is 0.8
+static const char*  QUALITY_NAMES[ResampleQualities_Num] = { "linear", "cubic", "sinc" };
+static const Sample MAX_DIFFS_TO_OLD[ResampleQualities_Num] = { 0.001, 0.008, 0.01 }; // Linear: max slope of the signal (0.22 per frame) / RESAMPLE_PHASES_NUM, rounded up
+static const Sample MAX_ERRORS[ResampleQualities_Num] = { 0.008, 0.001, 0.01 }; // To the exact signal
+
+//-----------------------------------------------------------------------
+// Two partials per channel, the highest one at freq [cycles per frame]
+struct TestSignal
+{
+    Ratio freq;
+
+    StereoSample Get(double frame) const
+    {
+        return StereoSample(0.5 * sin(DOUBLE_PI * freq * frame + 0.3) + 0.3 * sin(DOUBLE_PI * freq * 0.62 * frame),
+                            0.5 * sin(DOUBLE_PI * freq * 0.81 * frame + 1.1) + 0.3 * sin(DOUBLE_PI * freq * 0.37 * frame + 2.0));
+    }
+};
+
+struct Errors
+{
+    Sample maxDiffToOld = 0;
+    Sample maxError = 0; // To the exact signal
+    Sample maxOldError = 0; // Of the old path to the exact signal
+};
+
+//-----------------------------------------------------------------------
+// WaveSource::UpdateStereo before Resampler: phase in radians over the whole sample, advanced before each read.
+// The read past the last frame is left out
+static vector<StereoSample> PlayOldPath(const vector<Sample>& buffer, Ratio speed)
+{
+    const int buffer_size = (int)buffer.size();
+    const double phase_speed = (4.0 * PI * speed) / buffer_size;
+    double phase = 0;
+    vector<StereoSample> output;
+
+    while (true)
+    {
+        phase += phase_speed;
+        if (phase > 2 * PI)
+            break;
+
+        double pos_in_buffer = phase / (2.0 * PI) * (buffer_size >> 1);
+        double interpolate_progress = pos_in_buffer - floor(pos_in_buffer);
+        int pos_in_buffer1 = 2 * (int)floor(pos_in_buffer);
+        int pos_in_buffer2 = 2 * (int)ceil(pos_in_buffer);
+        if (pos_in_buffer2 + 1 >= buffer_size)
+            break;
+
+        output.push_back(StereoSample(Interpolate(buffer[pos_in_buffer1], buffer[pos_in_buffer2], interpolate_progress),
+                                      Interpolate(buffer[pos_in_buffer1 + 1], buffer[pos_in_buffer2 + 1], interpolate_progress)));
+    }
+
+    return output;
+}
+
+//-----------------------------------------------------------------------
+// Frame i of the old path is read at (i + 1) * speed, of Resampler at i * speed
+static Errors Check(ResampleQuality quality, Ratio speed)
+{
+    TestSignal signal = { MAX_OUTPUT_FREQ / MAX(speed, 1.0) };
+    vector<Sample> buffer(SAMPLE_FRAMES * 2);
+    for (int frame_i = 0; frame_i < SAMPLE_FRAMES; frame_i++)
+    {
+        auto frame = signal.Get(frame_i);
+        buffer[2 * frame_i] = frame.left;
+        buffer[2 * frame_i + 1] = frame.right;
+    }
+
+    auto old_output = PlayOldPath(buffer, speed);
+
+    vector<StereoSample> output(old_output.size() + 1);
+    ResamplePos pos = 0;
+    auto kernel = Resampler::GetKernel(quality, speed);
+    int frames_num = Resampler::ResampleStereo(kernel, buffer.data(), SAMPLE_FRAMES, pos, Resampler::SpeedToStep(speed),
+                                               output.data(), (int)output.size());
+
+    Errors errors;
+    for (int frame_i = EDGE_FRAMES; frame_i + EDGE_FRAMES < frames_num && frame_i <= (int)old_output.size(); frame_i++)
+    {
+        auto exact = signal.Get(frame_i * speed);
+        auto& frame = output[frame_i];
+        auto& old_frame = old_output[frame_i - 1];
+
+        errors.maxDiffToOld = MAX(errors.maxDiffToOld, MAX(ABS(frame.left - old_frame.left), ABS(frame.right - old_frame.right)));
+        errors.maxError = MAX(errors.maxError, MAX(ABS(frame.left - exact.left), ABS(frame.right - exact.right)));
+        errors.maxOldError = MAX(errors.maxOldError, MAX(ABS(old_frame.left - exact.left), ABS(old_frame.right - exact.right)));
+    }
+
+    return errors;
+}
+
+//-----------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    bool verbose = false;
+
+    for (int arg_i = 1; arg_i < argc; arg_i++)
+    {
+        if (!strcmp(argv[arg_i], "-v"))
+            verbose = true;
+        else
+        {
+            printf("Usage: %s [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    Resampler::PrepareTables();
+
+    int failed_num = 0;
+    for (int quality = 0; quality < ResampleQualities_Num; quality++)
+    {
+        Errors worst;
+        bool is_ok = true;
+
+        for (Ratio speed = MIN_SPEED; speed <= MAX_SPEED * 1.0001; speed *= pow(2.0, 1.0 / SPEEDS_PER_OCTAVE))
+        {
+            auto errors = Check((ResampleQuality)quality, speed);
+            bool speed_is_ok = (errors.maxDiffToOld <= MAX_DIFFS_TO_OLD[quality] && errors.maxError <= MAX_ERRORS[quality]);
+            is_ok = is_ok && speed_is_ok;
+
+            worst.maxDiffToOld = MAX(worst.maxDiffToOld, errors.maxDiffToOld);
+            worst.maxError = MAX(worst.maxError, errors.maxError);
+            worst.maxOldError = MAX(worst.maxOldError, errors.maxOldError);
+
+            if (verbose)
+                printf("  %-6s speed=%.3f %s diff_to_old=%.5f error=%.5f old_error=%.5f\n", QUALITY_NAMES[quality], speed,
+                       (speed_is_ok ? "OK  " : "FAIL"), errors.maxDiffToOld, errors.maxError, errors.maxOldError);
+        }
+
+        if (!is_ok)
+            failed_num++;
+
+        printf("%-6s %s max: diff_to_old=%.5f error=%.5f old_error=%.5f\n", QUALITY_NAMES[quality], (is_ok ? "OK  " : "FAIL"),
+               worst.maxDiffToOld, worst.maxError, worst.maxOldError);
+    }
+
+    return (failed_num > 0 ? 1 : 0);
+}
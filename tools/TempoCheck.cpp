@@ -0,0 +1,211 @@
+//-----------------------------------------------------------------------
+// TempoCheck: feeds synthetic onset streams (steady, jittered with missed and extra onsets, tempo changes)
+// to TempoTracker and checks that it locks to their tempo and predicts and quantises their beats.
+//
+// Usage: TempoCheck [-s seed] [-v]
+//   -s  seed of the jitter (default: 1)
+//   -v  print the tracker's state after each onset
+//   Exits with 1 if any stream fails its limits.
+//
+// Built with the sources of yossCommon/acc and the common lib of the app.
+//-----------------------------------------------------------------------
+
+#include "../yossCommon/acc/TempoTracker.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace yoss;
+using namespace yoss::math;
+
+
+//-----------------------------------------------------------------------
+// Static defines, consts and vars
+static const Ratio MAX_TEMPO_ERROR = 0.02; // Of the tempo at the end of the stream, part of the true one
+static const Ratio MAX_LOCKED_TEMPO_ERROR = 0.05; // Of the tempo while locked, with the period still following the jitter
+static const Time  MAX_LOCK_TIME = 8.0; // [sec] From the first beat of the stream or of its last tempo, e.g. relocking after a missing onset
+static const PartOfOne MIN_LOCKED_PART = 0.8; // Of the beats after the first lock, as extra onsets lower confidence for a while
+static const Time  MAX_AVG_PREDICTION_ERROR = 0.02; // [sec] Of the next beat, while locked
+
+//-----------------------------------------------------------------------
+// Onset is at beatTimestamp + jitter, or is missing; extra onsets are off the beat grid
+struct SyntheticOnset
+{
+    Time beatTimestamp;
+    Time timestamp;
+    bool isExtra;
+};
+
+struct Stream
+{
+    string name;
+    vector<SyntheticOnset> onsets;
+    Time  lockFromTimestamp = 0; // Of the first beat of the last tempo, 0 = of the stream
+    Frequency finalTempo = 0;
+};
+
+//-----------------------------------------------------------------------
+// Beats of tempo changing linearly from start_tempo to end_tempo over beats_num beats
+static void AddBeats(Stream& stream, Time& timestamp, int beats_num, Frequency start_tempo, Frequency end_tempo)
+{
+    for (int beat_i = 0; beat_i < beats_num; beat_i++)
+    {
+        stream.onsets.push_back({ timestamp, timestamp, false });
+        Frequency tempo = start_tempo + (end_tempo - start_tempo) * beat_i / MAX(beats_num - 1, 1);
+        timestamp += 60.0 / tempo;
+        stream.finalTempo = tempo;
+    }
+}
+
+//-----------------------------------------------------------------------
+static void AddJitter(Stream& stream, mt19937& random_engine, Time max_jitter, PartOfOne missing_part, PartOfOne extra_part)
+{
+    uniform_real_distribution<double> random_jitter(-max_jitter, max_jitter);
+    uniform_real_distribution<double> random_part(0, 1);
+
+    vector<SyntheticOnset> onsets;
+    for (size_t onset_i = 0; onset_i < stream.onsets.size(); onset_i++)
+    {
+        auto onset = stream.onsets[onset_i];
+        if (onset_i > 0 && random_part(random_engine) < missing_part)
+            continue;
+        onset.timestamp += random_jitter(random_engine);
+        onsets.push_back(onset);
+
+        // A grace or false beat somewhere between this beat and the next
+        if (onset_i + 1 < stream.onsets.size() && random_part(random_engine) < extra_part)
+        {
+            Time next_timestamp = stream.onsets[onset_i + 1].beatTimestamp;
+            Time extra_timestamp = onset.beatTimestamp + (next_timestamp - onset.beatTimestamp) * (0.35 + 0.3 * random_part(random_engine));
+            onsets.push_back({ extra_timestamp, extra_timestamp, true });
+        }
+    }
+    stream.onsets = onsets;
+}
+
+//-----------------------------------------------------------------------
+static vector<Stream> CreateStreams(int seed)
+{
+    mt19937 random_engine(seed);
+    vector<Stream> streams;
+    Time timestamp;
+
+    // Starts at time 0, as replayed or synthetic onsets may
+    streams.push_back(Stream());
+    streams.back().name = "steady 120 bpm";
+    timestamp = 0;
+    AddBeats(streams.back(), timestamp, 40, 120, 120);
+
+    streams.push_back(Stream());
+    streams.back().name = "jittered 100 bpm";
+    timestamp = 10;
+    AddBeats(streams.back(), timestamp, 60, 100, 100);
+    AddJitter(streams.back(), random_engine, 0.015, 0.05, 0.05);
+
+    streams.push_back(Stream());
+    streams.back().name = "step 90 -> 140 bpm";
+    timestamp = 10;
+    AddBeats(streams.back(), timestamp, 30, 90, 90);
+    streams.back().lockFromTimestamp = timestamp;
+    AddBeats(streams.back(), timestamp, 40, 140, 140);
+    AddJitter(streams.back(), random_engine, 0.01, 0, 0);
+
+    streams.push_back(Stream());
+    streams.back().name = "ramp 80 -> 160 bpm";
+    timestamp = 10;
+    AddBeats(streams.back(), timestamp, 80, 80, 160);
+    streams.back().lockFromTimestamp = timestamp;
+    AddBeats(streams.back(), timestamp, 20, 160, 160);
+    AddJitter(streams.back(), random_engine, 0.01, 0, 0);
+
+    return streams;
+}
+
+//-----------------------------------------------------------------------
+// Locked = confident and on the last tempo of the stream. While locked, the prediction of each onset is the one made
+// when the previous was added, and it's quantised before it's added
+static bool CheckStream(const Stream& stream, bool verbose)
+{
+    TempoTracker tracker;
+    bool is_locked = false;
+    Time lock_timestamp = -1;
+    int beats_num = 0, locked_beats_num = 0;
+    Time prediction_error_sum = 0, raw_error_sum = 0, quantized_error_sum = 0;
+    Time next_beat_time = 0;
+
+    for (auto& onset : stream.onsets)
+    {
+        if (is_locked && !onset.isExtra)
+        {
+            // A missing onset makes the predicted beat one before this one
+            Ratio period_error = (onset.timestamp - next_beat_time) / tracker.GetPeriod();
+            prediction_error_sum += ABS(period_error - round(period_error)) * tracker.GetPeriod();
+            raw_error_sum += ABS(onset.timestamp - onset.beatTimestamp);
+            quantized_error_sum += ABS(tracker.Quantize(onset.timestamp) - onset.beatTimestamp);
+            locked_beats_num++;
+        }
+        if (lock_timestamp >= 0 && !onset.isExtra)
+            beats_num++;
+
+        tracker.AddBeat(onset.timestamp);
+        next_beat_time = tracker.GetNextBeatTime(onset.timestamp);
+
+        bool tempo_fits = (ABS(tracker.GetTempo() - stream.finalTempo) <= MAX_LOCKED_TEMPO_ERROR * stream.finalTempo);
+        is_locked = (tempo_fits && tracker.GetConfidence() >= 0.5 && onset.beatTimestamp >= stream.lockFromTimestamp);
+        if (is_locked && lock_timestamp < 0)
+            lock_timestamp = onset.beatTimestamp;
+
+        if (verbose)
+            printf("  %8.3f%s tempo=%.1f confidence=%.2f next=%.3f\n", onset.timestamp, (onset.isExtra ? "*" : " "),
+                   tracker.GetTempo(), tracker.GetConfidence(), next_beat_time);
+    }
+
+    Time start_timestamp = MAX(stream.lockFromTimestamp, stream.onsets.front().beatTimestamp);
+    Time lock_time = (lock_timestamp < 0 ? -1 : lock_timestamp - start_timestamp);
+    PartOfOne locked_part = (beats_num > 0 ? (double)locked_beats_num / beats_num : 0);
+    Time avg_prediction_error = (locked_beats_num > 0 ? prediction_error_sum / locked_beats_num : 0);
+    bool is_ok = (lock_time >= 0 && lock_time <= MAX_LOCK_TIME && locked_part >= MIN_LOCKED_PART &&
+                  ABS(tracker.GetTempo() - stream.finalTempo) <= MAX_TEMPO_ERROR * stream.finalTempo &&
+                  avg_prediction_error <= MAX_AVG_PREDICTION_ERROR);
+
+    printf("%-22s %s tempo=%.1f (true %.1f) lock_time=%.2fs locked=%.2f avg_prediction_error=%.1fms quantized_error=%.1fms (raw %.1fms)\n",
+           stream.name.c_str(), (is_ok ? "OK  " : "FAIL"), tracker.GetTempo(), stream.finalTempo, lock_time, locked_part,
+           avg_prediction_error * 1000,
+           (locked_beats_num > 0 ? quantized_error_sum / locked_beats_num * 1000 : 0),
+           (locked_beats_num > 0 ? raw_error_sum / locked_beats_num * 1000 : 0));
+    return is_ok;
+}
+
+//-----------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    int seed = 1;
+    bool verbose = false;
+
+    for (int arg_i = 1; arg_i < argc; arg_i++)
+    {
+        if (!strcmp(argv[arg_i], "-s") && arg_i + 1 < argc)
+            seed = atoi(argv[++arg_i]);
+        else if (!strcmp(argv[arg_i], "-v"))
+            verbose = true;
+        else
+        {
+            printf("Usage: %s [-s seed] [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    int failed_num = 0;
+    for (auto& stream : CreateStreams(seed))
+    {
+        if (!CheckStream(stream, verbose))
+            failed_num++;
+    }
+
+    return (failed_num > 0 ? 1 : 0);
+}
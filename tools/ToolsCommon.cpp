@@ -0,0 +1,18 @@
+#include "ToolsCommon.h"
+
+using namespace std;
+using namespace yoss;
+
+
+//-----------------------------------------------------------------------
+mutex& yoss::GetConstructMutex()
+{
+    static mutex construct_mutex;
+    return construct_mutex;
+}
+
+//-----------------------------------------------------------------------
+// The native bridge is not linked
+void OrderResetAcc()
+{
+}
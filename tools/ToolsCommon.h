@@ -0,0 +1,14 @@
+#pragma once
+
+#include <mutex>
+
+//-----------------------------------------------------------------------
+// Shared by the offline tools, each of which is built with ToolsCommon.cpp. It also stands in for the native bridge,
+// which the tools aren't linked with.
+//-----------------------------------------------------------------------
+
+namespace yoss
+{
+    // Held while AccEngines and instruments are constructed on worker threads, as their construction logs
+    std::mutex& GetConstructMutex();
+}
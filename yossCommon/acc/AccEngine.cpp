@@ -1,6 +1,7 @@
 #include <iostream>
 
 #include "AccEngine.h"
+#include "AccWorker.h"
 #include "../common/Config.h"
 #include "../common/Log.h"
 #include "../common/System.h"
@@ -16,9 +17,11 @@ using namespace yoss::sound;
 
 //-----------------------------------------------------------------------
 AccEngine::AccEngine() :
-    _accTrajectory(SegmentDetectionType_MovingAgainstSegmentInZ),
+    _accTrajectory(SegmentDetectionType_MovingAgainstSegmentInZ, TRAJECTORY_BUFFERS_SIZE, 0, true), // Pyramid for DrawTrajectory
     _magTrajectory(SegmentDetectionType_None),
     _gyroTrajectory(SegmentDetectionType_None),
+    _params(),
+    _worker(nullptr),
     _prevFeedTimestamp(system::GetCurrentTimestamp()),
     _currentFeedTimestamp(system::GetCurrentTimestamp()),
     _prevSegEndTimestamp(0),
@@ -29,9 +32,21 @@ AccEngine::AccEngine() :
     _prevSegIsAntiBeat(false),
     _prevBeatTimestamp(0),
     _prevBeatAmplitude(0),
-    _prevBeatSegment(nullptr),
-    _prevSegment(nullptr),
-    _freezeDrawingAt(0)
+    _prevBeatSegment(),
+    _prevSegment(),
+    _freezeDrawingAt(0),
+    _latencyTracer(nullptr),
+    _accBeatTrace(),
+    _accBeatDynamics(),
+    _beatClassifier(nullptr),
+    _predictiveOnsets(false),
+    _onsetThreshold(ONSET_INITIAL_THRESHOLD),
+    _onsetSegment(),
+    _onsetPeakSpeed(0),
+    _onsetIsChecked(false),
+    _onsetIsPending(false),
+    _onsetTimestamp(0),
+    _onset()
 {
     Log::ClearGr();
     
@@ -44,38 +59,119 @@ AccEngine::~AccEngine()
 }
 
 //-----------------------------------------------------------------------
-void AccEngine::AddAccFeedListener(FeedListener listener)
+void AccEngine::SetParams(const BeatDetectionParams& params)
 {
-    _accFeedListeners.push_back(listener);
+    ASSERT(params.minBeatAmplitude < params.maxBeatAmplitude);
+
+    _params = params;
+    _accTrajectory.SetParams(params.segments);
+}
+
+//-----------------------------------------------------------------------
+AccEngine::ListenerToken AccEngine::AddAccFeedListener(FeedListener listener, int feed_events)
+{
+    return _accFeedListeners.Add(listener, feed_events);
+}
+
+//-----------------------------------------------------------------------
+bool AccEngine::RemoveAccFeedListener(ListenerToken token)
+{
+    return _accFeedListeners.Remove(token);
 }
 
 //-----------------------------------------------------------------------
-void AccEngine::RemoveAccFeedListener(FeedListener& listener)
+AccEngine::ListenerToken AccEngine::AddOnsetListener(OnsetListener listener)
 {
-    ASSERT(false); // ToDo: implement how to compare lambdas
+    return _onsetListeners.Add(listener);
+}
+
+//-----------------------------------------------------------------------
+bool AccEngine::RemoveOnsetListener(ListenerToken token)
+{
+    return _onsetListeners.Remove(token);
+}
+
+//-----------------------------------------------------------------------
+void AccEngine::SetPredictiveOnsets(bool enabled)
+{
+    _predictiveOnsets = enabled;
+    _onsetSegment = SegmentHandle();
+    _onsetIsPending = false;
+}
+
+//-----------------------------------------------------------------------
+void AccEngine::ResetInput()
+{
+    ::OrderResetAcc();
     
-    auto it = _accFeedListeners.begin();
-    while (it != _accFeedListeners.end())
-        //if (*it == listener)
+    auto worker = _worker.load(std::memory_order_acquire);
+    if (worker)
+        worker->PushCommand(AccWorker::Command_ResetInput);
+    else
+        ResetInputState();
+}
+
+//-----------------------------------------------------------------------
+void AccEngine::ResetInputState()
+{
+    _orientation.Reset();
+    _tempoTracker.Reset();
+}
+
+//-----------------------------------------------------------------------
+void AccEngine::FeedAcc(double acc_x, double acc_y, double acc_z, double gyro_x, double gyro_y, double gyro_z, double mag_x, double mag_y, double mag_z)
+{
+    auto worker = _worker.load(std::memory_order_acquire);
+    if (worker)
     {
-        _accFeedListeners.erase(it);
+        Sample sample = { system::GetCurrentTimestamp(), acc_x, acc_y, acc_z, gyro_x, gyro_y, gyro_z, mag_x, mag_y, mag_z };
+        worker->PushSample(sample);
         return;
     }
     
-    ASSERT(false); // Listener was not found
+    FeedAcc(system::GetCurrentTimestamp(), acc_x, acc_y, acc_z, gyro_x, gyro_y, gyro_z, mag_x, mag_y, mag_z);
 }
 
 //-----------------------------------------------------------------------
-void AccEngine::ResetInput()
+void AccEngine::FeedAcc(Time timestamp, double acc_x, double acc_y, double acc_z, double gyro_x, double gyro_y, double gyro_z, double mag_x, double mag_y, double mag_z)
 {
-    ::OrderResetAcc();
+    Sample sample = { timestamp, acc_x, acc_y, acc_z, gyro_x, gyro_y, gyro_z, mag_x, mag_y, mag_z };
+    int events = FeedSample(sample);
+    
+    _accFeedListeners.Notify(events, (events & FeedEvent_Beat) != 0);
 }
 
 //-----------------------------------------------------------------------
-void AccEngine::FeedAcc(double acc_x, double acc_y, double acc_z, double gyro_x, double gyro_y, double gyro_z, double mag_x, double mag_y, double mag_z)
+int AccEngine::FeedAccBatch(const Sample* samples, int samples_num, vector<Time>* beat_timestamps)
+{
+    ASSERT(samples || samples_num == 0);
+    
+    int beats_num = 0;
+    int batch_events = 0;
+    for (const Sample* sample = samples; sample < samples + samples_num; sample++)
+    {
+        int events = FeedSample(*sample);
+        batch_events |= events;
+        
+        if (events & FeedEvent_Beat)
+        {
+            beats_num++;
+            if (beat_timestamps)
+                beat_timestamps->push_back(sample->timestamp);
+        }
+    }
+    
+    if (batch_events)
+        _accFeedListeners.Notify(batch_events, beats_num > 0);
+    
+    return beats_num;
+}
+
+//-----------------------------------------------------------------------
+int AccEngine::FeedSample(const Sample& sample)
 {
     _prevFeedTimestamp = _currentFeedTimestamp;
-    _currentFeedTimestamp = system::GetCurrentTimestamp();
+    _currentFeedTimestamp = sample.timestamp;
     
     //auto dt = (_currentFeedTimestamp - _prevFeedTimestamp);
     //Time dt_microseconds = dt * 1000000.0;
@@ -89,17 +185,19 @@ void AccEngine::FeedAcc(double acc_x, double acc_y, double acc_z, double gyro_x,
     //acc_x = gyro_x; acc_y = gyro_y; acc_z = gyro_z;
     //acc_x = mag_y * fake_scale; acc_y = mag_x * fake_scale; acc_z = mag_z * fake_scale;
     
-    Vector3D acc(acc_x, acc_y, acc_z);
+    Vector3D acc(sample.accX, sample.accY, sample.accZ);
     _accTrajectory.FeedNewPosition(acc, _currentFeedTimestamp);
     _accTrajectory.Update();
     
-    Vector3D mag(mag_x, mag_y, mag_z);
+    Vector3D mag(sample.magX, sample.magY, sample.magZ);
     _magTrajectory.FeedNewPosition(mag, _currentFeedTimestamp);
     _magTrajectory.Update();
     
-    Vector3D gyro(gyro_x, gyro_y, gyro_z);
+    Vector3D gyro(sample.gyroX, sample.gyroY, sample.gyroZ);
     _gyroTrajectory.FeedNewPosition(gyro, _currentFeedTimestamp);
     _gyroTrajectory.Update();
+    
+    _orientation.Update(acc, gyro, mag, _currentFeedTimestamp - _prevFeedTimestamp);
 
     //Vector3D d_acc = _accTrajectory.GetVelocities().Get(0);
     //Vector3D prev_d_acc = _accTrajectory.GetVelocities().Get(1);
@@ -138,7 +236,7 @@ void AccEngine::FeedAcc(double acc_x, double acc_y, double acc_z, double gyro_x,
         {
             auto& seg = _accTrajectory.GetSegments().Get(1);
             
-            beat_is_detected = IsSegmentABeat(seg);
+            beat_is_detected = IsSegmentABeat(seg, _segmentFeatures);
             
             auto seg_vec = seg.GetDPos();
             Coo beat_amplitude = seg_vec.Size();
@@ -147,14 +245,18 @@ void AccEngine::FeedAcc(double acc_x, double acc_y, double acc_z, double gyro_x,
             
             if (beat_is_detected)
             {
-                _prevBeatSegment = &seg;
+                _prevBeatSegment = _accTrajectory.GetSegmentHandle(1);
                 _prevBeatAmplitude = beat_amplitude;
                 _prevBeatTimestamp = _currentFeedTimestamp;
+                _tempoTracker.AddBeat(seg.endPoint.timestamp);
+                _accBeatTrace = StartLatencyTrace(seg.endPoint.timestamp);
+                _accBeatDynamics = CalcBeatDynamics(seg);
                 _prevSegIsDrawn = false;
                 
+                auto prev_seg = _accTrajectory.GetSegment(_prevSegment);
                 if ((false))
                 Log::LogText("beat_dur=" + Log::ToStr(beat_duration) +
-                             "=" + Log::ToStr(seg.endPoint->bufferTimestamp - seg.startPoint->bufferTimestamp) +
+                             "=" + Log::ToStr(seg.endPoint.bufferTimestamp - seg.startPoint.bufferTimestamp) +
                              ", beat_amp=" + Log::ToStr(beat_amplitude) +
                              //", beat_freq=" + Log::ToStr(freq) +
                              ", beat_avg_vel=" + Log::ToStr(beat_avg_velocity) +
@@ -162,14 +264,14 @@ void AccEngine::FeedAcc(double acc_x, double acc_y, double acc_z, double gyro_x,
                              //", seg_angle_to_z=" + Log::ToStr(seg_angle_to_z) +
                              ", prev_amp=" + Log::ToStr(_prevSegAmplitude) +
                              ", prev_antiB=" + Log::ToStr(_prevSegIsAntiBeat ? 1 : 0) +
-                             ", prev_dur=" + Log::ToStr(_prevSegment->endPoint->bufferTimestamp - _prevSegment->startPoint->bufferTimestamp)
+                             ", prev_dur=" + Log::ToStr(prev_seg ? prev_seg->endPoint.bufferTimestamp - prev_seg->startPoint.bufferTimestamp : -1)
                 );
             }
             
             _prevSegAmplitude2 = _prevSegAmplitude;
             _prevSegAvgVelocity2 = _prevSegAvgVelocity;
             
-            _prevSegment = &seg;
+            _prevSegment = _accTrajectory.GetSegmentHandle(1);
             _prevSegAmplitude = beat_amplitude;
             _prevSegAvgVelocity = beat_avg_velocity;
             _prevSegEndTimestamp = _currentFeedTimestamp;
@@ -179,10 +281,10 @@ void AccEngine::FeedAcc(double acc_x, double acc_y, double acc_z, double gyro_x,
         
         if (DRAW_BEAT_SEGMENTS_IN_CONSOLE)
         {
-            Segment* draw_seg = _prevBeatSegment; //_prevBeatSegment;
+            Segment* draw_seg = _accTrajectory.GetSegment(_prevBeatSegment); //_prevBeatSegment;
             if (draw_seg && !_prevSegIsDrawn) // && !_prevSegIsAntiBeat)
             {
-                if (draw_seg->endPoint->bufferTimestamp <= _accTrajectory.GetPositions().GetTimestamp() - 6)
+                if (draw_seg->endPoint.bufferTimestamp <= _accTrajectory.GetPositions().GetTimestamp() - 6)
                 {
                     //DrawSegmentInConsole(*draw_seg);
                     
@@ -192,54 +294,83 @@ void AccEngine::FeedAcc(double acc_x, double acc_y, double acc_z, double gyro_x,
         }
     }
     
-    for (auto listener : _accFeedListeners)
-        listener(beat_is_detected);
+    if (DETECT_BEATS && _predictiveOnsets)
+        UpdatePredictiveOnset(_accTrajectory.SegmentJustEnded(), beat_is_detected);
+    
+    return FeedEvent_Sample |
+           (_accTrajectory.SegmentJustEnded() ? FeedEvent_Segment : 0) |
+           (beat_is_detected ? FeedEvent_Beat : 0);
 }
 
 //-----------------------------------------------------------------------
-// Note: Might be potentially expensive to call on every frame (due to calling _accTrajectory.CalcSegmentParams)
-bool AccEngine::IsSegmentABeat(trajectories::Segment& seg)
+bool AccEngine::IsSegmentABeat(trajectories::Segment& seg, BeatFeatures& features)
+{
+    CalcBeatFeatures(seg, features);
+    
+    if (_beatClassifier)
+        return (features[BeatFeatures::Feature_Amplitude] >= _params.minBeatAmplitude && _beatClassifier->IsBeat(features));
+    
+    return IsBeatByParams(features);
+}
+
+//-----------------------------------------------------------------------
+void AccEngine::CalcBeatFeatures(trajectories::Segment& seg, BeatFeatures& features)
 {
     trajectories::Point seg_end_point(_accTrajectory.GetPositions().Get(), _accTrajectory.GetTimestamps().Get(), _accTrajectory.GetTimestamps().GetTimestamp());
-    bool temp_end_point = (seg.endPoint == nullptr);
+    bool temp_end_point = !seg.endPoint.IsSet();
     if (temp_end_point)
     {
-        seg.endPoint = &seg_end_point;
+        seg.endPoint = seg_end_point;
         
         _accTrajectory.CalcSegmentParams(seg);
     }
     
     auto seg_vec = seg.GetDPos();
-    auto seg_angle_to_z = RadToDeg(seg_vec.AngleTo(Z_AXIS));
     
-    auto seg_start_backpos = _gyroTrajectory.GetBackPos(seg.startPoint->bufferTimestamp);
-    auto seg_end_backpos = _gyroTrajectory.GetBackPos(seg.endPoint->bufferTimestamp);
+    auto seg_start_backpos = _gyroTrajectory.GetBackPos(seg.startPoint.bufferTimestamp);
+    auto seg_end_backpos = _gyroTrajectory.GetBackPos(seg.endPoint.bufferTimestamp);
     auto gyro_vec = _gyroTrajectory.GetPositions().GetSum(seg_end_backpos, seg_start_backpos);
-    Ratio gyro_y_strength = (gyro_vec.x == 0 ? 1000000 : abs(gyro_vec.y) / abs(gyro_vec.x));
     
-    Coo beat_amplitude = seg_vec.Size();
-    Time beat_duration = seg.GetDuration();
-    Coo beat_avg_velocity = seg.GetAvgVelocitySize();
-    //Coo beat_dy = (seg.endPoint->absPos.y + seg.startPoint->absPos.y) * 0.5 - seg.weightCenter.y;
+    Coo amplitude = seg_vec.Size();
+    features[BeatFeatures::Feature_Amplitude] = amplitude;
+    features[BeatFeatures::Feature_Duration] = seg.GetDuration();
+    features[BeatFeatures::Feature_AvgVelocity] = seg.GetAvgVelocitySize();
+    features[BeatFeatures::Feature_AngleToZ] = RadToDeg(seg_vec.AngleTo(Z_AXIS));
+    features[BeatFeatures::Feature_GyroYStrength] = (gyro_vec.x == 0 ? BEAT_FEATURE_MAX_RATIO : MIN(abs(gyro_vec.y) / abs(gyro_vec.x), BEAT_FEATURE_MAX_RATIO));
+    features[BeatFeatures::Feature_Straightness] = (amplitude > 0 ? MIN(seg.traveledLength / amplitude, BEAT_FEATURE_MAX_RATIO) : 1);
+    features[BeatFeatures::Feature_PrevSegAmplitude] = _prevSegAmplitude;
+    features[BeatFeatures::Feature_PrevSegAvgVelocity] = _prevSegAvgVelocity;
+    features[BeatFeatures::Feature_PrevSegIsAntiBeat] = (_prevSegIsAntiBeat ? 1 : 0);
+    //Coo beat_dy = (seg.endPoint.absPos.y + seg.startPoint.absPos.y) * 0.5 - seg.weightCenter.y;
     
     if (temp_end_point)
-        seg.endPoint = nullptr;
-    
-    Coo min_avg_velocity = Interpolate(MIN_SMALL_BEAT_AVG_VELOCITY, MIN_BIG_BEAT_AVG_VELOCITY,
-                                       MIN_BEAT_AMPLITUDE, MAX_BEAT_AMPLITUDE, beat_amplitude);
-    Coo min_amplitude = MIN_BEAT_AMPLITUDE;
+        seg.endPoint = trajectories::Point();
+}
+
+//-----------------------------------------------------------------------
+// Hand-written thresholds, tunable by BeatDetectionParams
+bool AccEngine::IsBeatByParams(const BeatFeatures& features)
+{
+    Coo beat_amplitude = features[BeatFeatures::Feature_Amplitude];
+    Coo beat_avg_velocity = features[BeatFeatures::Feature_AvgVelocity];
+    auto seg_angle_to_z = features[BeatFeatures::Feature_AngleToZ];
+    Ratio gyro_y_strength = features[BeatFeatures::Feature_GyroYStrength];
+    
+    Coo min_avg_velocity = Interpolate(_params.minSmallBeatAvgVelocity, _params.minBigBeatAvgVelocity,
+                                       _params.minBeatAmplitude, _params.maxBeatAmplitude, beat_amplitude);
+    Coo min_amplitude = _params.minBeatAmplitude;
     Coo min_amplitude_debug = min_amplitude;
-    if (_prevSegIsAntiBeat)
+    if (features[BeatFeatures::Feature_PrevSegIsAntiBeat] > 0)
     {
         //min_amplitude = _prevSegAmplitude * 0.7; // / ((_currentFeedTimestamp - _prevSegEndTimestamp) * 10);
         min_amplitude_debug = min_amplitude;
-        min_amplitude = max(min_amplitude, MIN_BEAT_AMPLITUDE);
+        min_amplitude = max(min_amplitude, _params.minBeatAmplitude);
         
-        min_avg_velocity = max(min_avg_velocity, _prevSegAvgVelocity * 0.75f);
+        min_avg_velocity = max(min_avg_velocity, features[BeatFeatures::Feature_PrevSegAvgVelocity] * _params.minAvgVelocityAfterAntiBeat);
     }
     
     //if (_prevSegAmplitude + _prevSegAmplitude2 < beat_amplitude * 0.1)
-    if (_prevSegAmplitude < beat_amplitude * 0.1)
+    if (features[BeatFeatures::Feature_PrevSegAmplitude] < beat_amplitude * _params.minPrevSegAmplitude)
     {
         // Don't fire a beat if the previous segments were too small, i.e. no acceleration
         min_amplitude = 1000;
@@ -248,9 +379,9 @@ bool AccEngine::IsSegmentABeat(trajectories::Segment& seg)
     bool beat_detected = (beat_amplitude >= min_amplitude &&
                           beat_avg_velocity >= min_avg_velocity &&
                           //(_prevSegIsAntiBeat || ) &&
-                          seg_angle_to_z > 180 - AccSegmentIsABeatMaxAngleToZ &&
-                          gyro_y_strength < 1.0);
-    if (Config::DebugAccSegmentIsABeat && beat_amplitude >= MIN_BEAT_AMPLITUDE)
+                          seg_angle_to_z > 180 - _params.maxAngleToZ &&
+                          gyro_y_strength < _params.maxGyroYStrength);
+    if (Config::DebugAccSegmentIsABeat && beat_amplitude >= _params.minBeatAmplitude)
         Log::LogText("IsSegmentABeat(is=" + string(beat_detected ? "T" : "F") +
                      "): amp=" + Log::ToStr(beat_amplitude, 2) +
                      ", min_amp=" + Log::ToStr(min_amplitude, 2) +
@@ -259,55 +390,207 @@ bool AccEngine::IsSegmentABeat(trajectories::Segment& seg)
                      ", min_avg_vel=" + Log::ToStr(min_avg_velocity, 2) +
                      (beat_avg_velocity >= min_avg_velocity ? "" : "(F)") +
                      ", gyro_y=" + Log::ToStr(gyro_y_strength, 2) +
-                     (gyro_y_strength < 1.0 ? "" : "(F)") +
+                     (gyro_y_strength < _params.maxGyroYStrength ? "" : "(F)") +
                      ", a_to_z=" + Log::ToStr(seg_angle_to_z, 2) +
-                     (seg_angle_to_z > 180 - AccSegmentIsABeatMaxAngleToZ ? "" : "(F)"));
-    if (beat_detected && gyro_y_strength > 1.0)
+                     (seg_angle_to_z > 180 - _params.maxAngleToZ ? "" : "(F)"));
+    if (beat_detected && gyro_y_strength > _params.maxGyroYStrength)
         Log::LogText("!!!!!!!!!");
     
     return beat_detected;
 }
 
+//-----------------------------------------------------------------------
+void AccEngine::UpdatePredictiveOnset(bool segment_just_ended, bool beat_is_detected)
+{
+    if (segment_just_ended && beat_is_detected)
+    {
+        bool was_provisional = (_onsetIsPending && _onsetSegment == _accTrajectory.GetSegmentHandle(1));
+        Time latency_gain = (was_provisional ? _currentFeedTimestamp - _onsetTimestamp : 0);
+        
+        if (was_provisional)
+        {
+            _onsetStats.confirmedNum++;
+            _onsetStats.latencyGainSum += latency_gain;
+            _onsetThreshold += ONSET_THRESHOLD_CONFIRMED_STEP;
+            _onsetIsPending = false;
+        }
+        else
+        {
+            // Fire earlier only if the segment never decelerated enough to be checked
+            _onsetStats.missedNum++;
+            if (!_onsetIsChecked && _onsetSegment == _accTrajectory.GetSegmentHandle(1))
+                _onsetThreshold += ONSET_THRESHOLD_STEP;
+        }
+        EmitOnset(OnsetType_Confirmed, was_provisional, latency_gain);
+    }
+    
+    auto segment_handle = _accTrajectory.GetSegmentHandle(0);
+    if (segment_handle != _onsetSegment)
+    {
+        if (_onsetIsPending)
+        {
+            // Segment ended (or was merged) without being a beat
+            _onsetStats.cancelledNum++;
+            _onsetThreshold -= ONSET_THRESHOLD_STEP;
+            EmitOnset(OnsetType_Cancelled, true, _currentFeedTimestamp - _onsetTimestamp);
+        }
+        
+        _onsetSegment = segment_handle;
+        _onsetPeakSpeed = 0;
+        _onsetIsChecked = false;
+        _onsetIsPending = false;
+    }
+    _onsetThreshold = CLAMP(_onsetThreshold, ONSET_MIN_THRESHOLD, ONSET_MAX_THRESHOLD);
+    
+    if (_onsetIsChecked)
+        return;
+    
+    auto& seg = _accTrajectory.GetSegments().Get(0);
+    auto pos = _accTrajectory.GetPositions().Get();
+    auto seg_vec = pos - seg.startPoint.absPos;
+    Coo seg_amplitude = seg_vec.Size();
+    if (seg_amplitude < _params.minBeatAmplitude)
+        return;
+    
+    // Speed along the segment, fire once it has dropped enough from its peak; less of a drop is needed while
+    // the tempo of the last beats expects the next one
+    Ratio threshold = _onsetThreshold;
+    if (IsBeatExpectedWithin(ONSET_EXPECTED_LEAD_TIME))
+        threshold = MIN(threshold + ONSET_EXPECTED_THRESHOLD_STEP, ONSET_MAX_THRESHOLD);
+    
+    Velocity speed = _accTrajectory.GetVelocities().GetAverage(0, 2).DotProduct(seg_vec) / seg_amplitude;
+    _onsetPeakSpeed = MAX(_onsetPeakSpeed, speed);
+    if (_onsetPeakSpeed <= 0 || speed > _onsetPeakSpeed * threshold)
+        return;
+    
+    // Checked once per segment: whether it would be a beat if it ended now
+    _onsetIsChecked = true;
+    BeatFeatures features;
+    if (!IsSegmentABeat(seg, features))
+        return;
+    
+    _onsetIsPending = true;
+    _onsetTimestamp = _currentFeedTimestamp;
+    _onsetStats.provisionalNum++;
+    
+    _onset.normalizedFreq = NormalizeBeatFrequency((seg.startPoint.absPos + pos) * 0.5);
+    _onset.amplitude = MIN(seg_amplitude, _params.maxBeatAmplitude);
+    _onset.dynamics = CalcBeatDynamics(seg);
+    EmitOnset(OnsetType_Provisional, true, 0);
+}
+
+//-----------------------------------------------------------------------
+void AccEngine::EmitOnset(OnsetType type, bool was_provisional, Time latency_gain)
+{
+    _onset.type = type;
+    _onset.wasProvisional = was_provisional;
+    _onset.latencyGain = latency_gain;
+    if (type == OnsetType_Confirmed)
+    {
+        _onset.normalizedFreq = GetAccBeatFrequency();
+        _onset.amplitude = GetAccBeatAmplitude();
+        _onset.dynamics = _accBeatDynamics;
+        _onset.trace = _accBeatTrace;
+    }
+    else
+    {
+        _onset.trace = StartLatencyTrace(_currentFeedTimestamp);
+    }
+    
+    if (Config::DebugAccSegmentIsABeat)
+        Log::LogText("Onset " + string(type == OnsetType_Provisional ? "provisional" : type == OnsetType_Confirmed ? "confirmed" : "cancelled") +
+                     ": latency_gain=" + Log::ToStr(latency_gain, 3) +
+                     ", threshold=" + Log::ToStr(_onsetThreshold, 2) +
+                     ", false_fires=" + Log::ToStr(_onsetStats.cancelledNum) + "/" + Log::ToStr(_onsetStats.provisionalNum));
+    
+    _onsetListeners.Notify(ListenerRegistry<const Onset&>::ALL_KINDS, _onset);
+}
+
+//-----------------------------------------------------------------------
+LatencyTrace AccEngine::StartLatencyTrace(Time sensor_arrival)
+{
+    LatencyTrace trace;
+    if (_latencyTracer)
+    {
+        trace.stamps[LatencyTrace::Stage_SensorArrival] = sensor_arrival;
+        trace.stamps[LatencyTrace::Stage_SegmentConfirmed] = _latencyTracer->Now();
+    }
+    return trace;
+}
+
+//-----------------------------------------------------------------------
+Frequency AccEngine::NormalizeBeatFrequency(const Vector3D& pos)
+{
+    Frequency freq = (PointToDeg(-pos.z, -pos.y) - BEATS_SCALE_START_ANGLE) / (BEATS_SCALE_END_ANGLE - BEATS_SCALE_START_ANGLE);
+    freq = MIN(1, MAX(0, freq));
+    return freq;
+}
+
+//-----------------------------------------------------------------------
+// Once per beat: velocity from the peak speed, sharpness from how fast it stopped and how quickly it got to the peak
+BeatDynamics AccEngine::CalcBeatDynamics(trajectories::Segment& seg)
+{
+    auto kinematics = _accTrajectory.CalcSegmentKinematics(seg);
+    auto normalize = [] (double value, double min_value, double max_value) -> PartOfOne
+    {
+        PartOfOne normalized = (value - min_value) / (max_value - min_value);
+        return CLAMP(normalized, 0, 1);
+    };
+    
+    BeatDynamics dynamics;
+    dynamics.velocity = normalize(kinematics.peakVelocity, BEAT_DYNAMICS_MIN_PEAK_VELOCITY, BEAT_DYNAMICS_MAX_PEAK_VELOCITY);
+    dynamics.sharpness = 0.5 * (normalize(kinematics.deceleration, BEAT_DYNAMICS_MIN_DECELERATION, BEAT_DYNAMICS_MAX_DECELERATION) +
+                                1 - normalize(kinematics.timeToPeak, BEAT_DYNAMICS_MIN_TIME_TO_PEAK, BEAT_DYNAMICS_MAX_TIME_TO_PEAK));
+    return dynamics;
+}
+
 //-----------------------------------------------------------------------
 Coo AccEngine::GetAccBeatAmplitude()
 {
-    ASSERT(_prevBeatSegment);
-    auto seg_vec = _prevBeatSegment->GetDPos();
+    auto prev_beat_seg = _accTrajectory.GetSegment(_prevBeatSegment);
+    ASSERT(prev_beat_seg);
+    if (!prev_beat_seg) return 0;
+    auto seg_vec = prev_beat_seg->GetDPos();
     
     Coo beat_amplitude = seg_vec.Size();
-    beat_amplitude = MIN(beat_amplitude, MAX_BEAT_AMPLITUDE);
+    beat_amplitude = MIN(beat_amplitude, _params.maxBeatAmplitude);
     return beat_amplitude;
 }
 
 //-----------------------------------------------------------------------
 Frequency AccEngine::GetAccBeatFrequency()
 {
-    ASSERT(_prevBeatSegment);
-    auto center = _prevBeatSegment->middleOfStartEnd;
-    
-    Frequency freq = (PointToDeg(-center.z, -center.y) - BEATS_SCALE_START_ANGLE) / (BEATS_SCALE_END_ANGLE - BEATS_SCALE_START_ANGLE);
-    freq = MIN(1, MAX(0, freq));
-    return freq;
+    auto prev_beat_seg = _accTrajectory.GetSegment(_prevBeatSegment);
+    ASSERT(prev_beat_seg);
+    if (!prev_beat_seg) return 0;
+    return NormalizeBeatFrequency(prev_beat_seg->middleOfStartEnd);
 }
 
 //-----------------------------------------------------------------------
 Frequency AccEngine::GetAccNextBeatFrequency()
 {
-    auto acc_pos = _accTrajectory.GetPositions().GetAverage(0, 20);
-    
-    Frequency freq = (PointToDeg(-acc_pos.z, -acc_pos.y) - BEATS_SCALE_START_ANGLE) / (BEATS_SCALE_END_ANGLE - BEATS_SCALE_START_ANGLE);
-    freq = MIN(1, MAX(0, freq));
-    return freq;
+    return NormalizeBeatFrequency(_accTrajectory.GetPositions().GetAverage(0, 20));
 }
 
 //-----------------------------------------------------------------------
 bool AccEngine::IsExpectingBeat()
 {
     auto& seg = _accTrajectory.GetSegments().Get(0);
-    bool seg_is_beat = IsSegmentABeat(seg);
+    BeatFeatures features;
+    bool seg_is_beat = IsSegmentABeat(seg, features);
     return seg_is_beat;
 }
 
+//-----------------------------------------------------------------------
+bool AccEngine::IsBeatExpectedWithin(Time lead_time, PartOfOne min_confidence)
+{
+    if (_tempoTracker.GetConfidence() < min_confidence)
+        return false;
+    
+    Time next_beat_time = _tempoTracker.GetNextBeatTime(_currentFeedTimestamp);
+    return (next_beat_time - _currentFeedTimestamp <= lead_time);
+}
+
 //-----------------------------------------------------------------------
 void AccEngine::DrawTrajectory(graphics::Graphics* graphics)
 {
@@ -336,7 +619,32 @@ void AccEngine::DrawTrajectory(graphics::Graphics* graphics)
         if (a > 0)
             graphics->AddLine(v1, v2, color, color);
     }
-    
+
+    // Draw the longer history faintly, as bin means with their y and z extents, from the pyramid level that fits it
+    if (_freezeDrawingAt <= 0)
+    {
+        const int DRAW_HISTORY_LEN = 3000; // In samples, ~30 sec
+        const int DRAW_HISTORY_BINS = 64; // At most, of the finest level that fits (47 bins of 64 samples for 3000)
+
+        auto& pyramid = _accTrajectory.GetPositionsPyramid();
+        int level = pyramid.ChooseLevel(DRAW_HISTORY_LEN, DRAW_HISTORY_BINS);
+        int samples_per_bin = pyramid.GetSamplesPerBin(level);
+        auto& bins = pyramid.GetLevel(level);
+        int bins_num = min((DRAW_HISTORY_LEN + samples_per_bin - 1) / samples_per_bin, bins.GetOccupiedSize());
+
+        for (BufferBackPos i = bins_num - 1; i > 0; i--)
+        {
+            auto& bin = bins.Get(i);
+            auto mean = bin.GetMean();
+            auto next_mean = bins.Get(i - 1).GetMean();
+            Color color(0.5, 0.5, 0.5, 0.5 * (double)(bins_num - i) / bins_num);
+
+            graphics->AddLine(Vector3D(mean.y, mean.z, 0), Vector3D(next_mean.y, next_mean.z, 0), color, color);
+            graphics->AddLine(Vector3D(bin.min.y, mean.z, 0), Vector3D(bin.max.y, mean.z, 0), color, color);
+            graphics->AddLine(Vector3D(mean.y, bin.min.z, 0), Vector3D(mean.y, bin.max.z, 0), color, color);
+        }
+    }
+
     // Draw trajectory
     auto& positions = _accTrajectory.GetPositions();
     auto& velocities = _accTrajectory.GetVelocities();
@@ -371,26 +679,26 @@ void AccEngine::DrawTrajectory(graphics::Graphics* graphics)
         if (seg)
         {
             int segs_num = 1;
-            if (seg->endPoint && timestamp == seg->endPoint->bufferTimestamp)
+            if (seg->endPoint.IsSet() && timestamp == seg->endPoint.bufferTimestamp)
             {
                 ASSERT(segments.GetNext(seg));
                 ASSERT(segments.GetNext(seg) != seg);
                 
                 Segment* next_seg = seg;
-                while (next_seg->endPoint && timestamp == next_seg->endPoint->bufferTimestamp)
+                while (next_seg->endPoint.IsSet() && timestamp == next_seg->endPoint.bufferTimestamp)
                 {
                     next_seg = segments.GetNext(next_seg);
                     segs_num++;
                 }
                 segs_num--;
                 
-                ASSERT(next_seg->startPoint->bufferTimestamp == seg->endPoint->bufferTimestamp);
-                ASSERT(!next_seg->endPoint || next_seg->endPoint->bufferTimestamp != seg->endPoint->bufferTimestamp);
+                ASSERT(next_seg->startPoint.bufferTimestamp == seg->endPoint.bufferTimestamp);
+                ASSERT(!next_seg->endPoint.IsSet() || next_seg->endPoint.bufferTimestamp != seg->endPoint.bufferTimestamp);
                 
                 seg = next_seg;
             }
             
-            if (timestamp == seg->startPoint->bufferTimestamp)
+            if (timestamp == seg->startPoint.bufferTimestamp)
             {
                 // Draw marker
                 Color color(0, 0, 1, 1);
@@ -405,10 +713,10 @@ void AccEngine::DrawTrajectory(graphics::Graphics* graphics)
                 graphics->AddLine(v1, v2, color, color);
             }
             
-            ASSERT(timestamp >= seg->startPoint->bufferTimestamp);
-            ASSERT(!seg->endPoint || timestamp <= seg->endPoint->bufferTimestamp);
+            ASSERT(timestamp >= seg->startPoint.bufferTimestamp);
+            ASSERT(!seg->endPoint.IsSet() || timestamp <= seg->endPoint.bufferTimestamp);
             
-            Vector3D seg_vec = seg->endPoint ? seg->GetDPos() : -1.0 * Z_AXIS;
+            Vector3D seg_vec = seg->endPoint.IsSet() ? seg->GetDPos() : -1.0 * Z_AXIS;
             if (seg_vec.AngleTo(Z_AXIS) < 90 * ONE_DEG)
             {
                 red = 0.4;
@@ -469,17 +777,17 @@ void AccEngine::DrawSegmentInConsole(Segment segment)
     auto& positions = _accTrajectory.GetPositions();
     
     const int show_prevs_num = 50;
-    for (auto prev_t = max(segment.startPoint->bufferTimestamp - show_prevs_num, 0); prev_t < segment.startPoint->bufferTimestamp; prev_t++)
+    for (auto prev_t = max(segment.startPoint.bufferTimestamp - show_prevs_num, 0); prev_t < segment.startPoint.bufferTimestamp; prev_t++)
     {
         auto prev_back_t = positions.GetBackPos(prev_t);
         auto prev_acc = positions.Get(prev_back_t);
-        char prev_pos_char = '1' + (char)(min(9, segment.startPoint->bufferTimestamp - prev_t) - 1);
+        char prev_pos_char = '1' + (char)(min(9, segment.startPoint.bufferTimestamp - prev_t) - 1);
         Log::AddGrPoint(prev_acc.z, -prev_acc.y, prev_pos_char);
     }
     
     const int show_nexts_num = 6;
     char next_pos_char = '1' + (char)(show_nexts_num - 1);
-    for (auto next_t = min(segment.endPoint->bufferTimestamp + show_nexts_num, positions.GetTimestamp()); next_t > segment.endPoint->bufferTimestamp; next_t--)
+    for (auto next_t = min(segment.endPoint.bufferTimestamp + show_nexts_num, positions.GetTimestamp()); next_t > segment.endPoint.bufferTimestamp; next_t--)
     {
         auto next_back_t = positions.GetBackPos(next_t);
         auto next_acc = positions.Get(next_back_t);
@@ -491,15 +799,17 @@ void AccEngine::DrawSegmentInConsole(Segment segment)
     Vector3D seg_middle = segment.weightCenter;
     Vector3D seg_middle2 = segment.middleOfStartEnd;
     
-    for (auto t = segment.startPoint->bufferTimestamp; t <= segment.endPoint->bufferTimestamp; t++)
+    for (auto t = segment.startPoint.bufferTimestamp; t <= segment.endPoint.bufferTimestamp; t++)
     {
         auto back_t = positions.GetBackPos(t);
         auto acc = positions.Get(back_t);
 
+#ifdef YOSS_DEBUG_TRAJECTORY_PEAKS
         bool is_peak = (FOUND_IN_VECTOR(segment.debugPeaksTimestamps, t));
         bool is_wide_peak = (FOUND_IN_VECTOR(segment.debugWidePeaksTimestamps, t));
-        char is_start = (t == segment.startPoint->bufferTimestamp);
-        char is_end = (t == segment.endPoint->bufferTimestamp);
+#endif
+        char is_start = (t == segment.startPoint.bufferTimestamp);
+        char is_end = (t == segment.endPoint.bufferTimestamp);
         char pos_char = C_DEFAULT; //(is_peak ? (is_wide_peak ? C_BOTH_PEAKS : C_PEAK) : (is_wide_peak ? C_WIDE_PEAK : C_DEFAULT));
         pos_char = (is_start ? (is_end ? C_BOTH_ENDS : C_SEG_START) : (is_end ? C_SEG_END : pos_char));
 
@@ -518,10 +828,10 @@ void AccEngine::DrawSegmentInConsole(Segment segment)
     
     if ((0))
     {
-        auto end_back_pos = positions.GetBackPos(segment.endPoint->bufferTimestamp);
+        auto end_back_pos = positions.GetBackPos(segment.endPoint.bufferTimestamp);
         Vector3D dpos = positions.GetDiff(end_back_pos - 1);
         auto seg_vec = segment.GetDPos();
-        if (dpos.Size() > ACC_NOISE_SIZE)
+        if (dpos.Size() > _params.segments.accNoiseSize)
         {
             Log::LogText("seg_vec=(x:" + Log::ToStr(seg_vec.x) +
                          ", y:" + Log::ToStr(seg_vec.y) +
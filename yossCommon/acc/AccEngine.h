@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <iostream>
 
 #include "../common/Math.h"
@@ -8,58 +9,187 @@
 #include "../graphics/common/Graphics.h"
 #include "../graphics/common/Scene.h"
 #include "Trajectory.h"
+#include "OrientationEstimator.h"
+#include "TempoTracker.h"
+#include "BeatDetectionParams.h"
+#include "BeatClassifier.h"
+#include "../structs/ListenerRegistry.h"
 
 namespace yoss
 {
+    class AccWorker;
+    
     //-----------------------------------------------------------------------
     class AccEngine
     {
     public:
         typedef std::function<void (bool beat_is_detected)> FeedListener;
+        typedef int ListenerToken;
+        
+        // Kinds of feed events a listener is subscribed to; it's called once per sample (or batch) in which any of them occurred
+        enum FeedEvent
+        {
+            FeedEvent_Sample  = 1, // Every fed sample
+            FeedEvent_Segment = 2, // A segment of the acc trajectory ended (beat_is_detected tells if it was a beat)
+            FeedEvent_Beat    = 4
+        };
+        
+        // One sensor sample as passed to FeedAcc; plain doubles so that buffers of samples can be filled directly
+        struct Sample
+        {
+            math::Time timestamp;
+            double accX, accY, accZ;
+            double gyroX, gyroY, gyroZ;
+            double magX, magY, magZ;
+        };
+        
+        //-----------------------------------------------------------------------
+        // Predictive onsets: a provisional onset is emitted while a beat segment is still decelerating,
+        // followed by its confirmation or cancellation once the segment ends
+        enum OnsetType
+        {
+            OnsetType_Provisional,
+            OnsetType_Confirmed, // Also emitted for beats that had no provisional onset (wasProvisional = false)
+            OnsetType_Cancelled  // Provisional onset whose segment turned out not to be a beat
+        };
+        struct Onset
+        {
+            OnsetType       type;
+            bool            wasProvisional;
+            math::Time      latencyGain; // [sec] Time from the provisional onset to the end of segment being detected
+            math::PartOfOne normalizedFreq;
+            math::Coo       amplitude;
+            sound::BeatDynamics dynamics; // Of a provisional onset: of its segment up to the onset
+            sound::LatencyTrace trace; // Stamped while a latency tracer is set
+        };
+        struct OnsetStats
+        {
+            int provisionalNum = 0;
+            int confirmedNum = 0;  // Provisional onsets that were confirmed
+            int cancelledNum = 0;  // False fires
+            int missedNum = 0;     // Beats without a provisional onset
+            math::Time latencyGainSum = 0;
+            
+            math::Time GetAvgLatencyGain() const { return (confirmedNum > 0 ? latencyGainSum / confirmedNum : 0); }
+        };
+        typedef std::function<void (const Onset& onset)> OnsetListener;
         
-        static constexpr math::Angle AccSegmentIsABeatMaxAngleToZ = Config::AccSegmentIsABeatMaxAngleToZ;
         static const bool DETECT_BEATS = true;
         static constexpr math::Angle BEATS_SCALE_START_ANGLE = -20.0;
         static constexpr math::Angle BEATS_SCALE_END_ANGLE   = 120.0;
         static const bool DRAW_BEAT_SEGMENTS_IN_CONSOLE = false;
         
+        // Ranges of the kinematics of beat segments mapped to sound::BeatDynamics 0..1 (~5th to 95th percentile of beats)
+        static constexpr math::Velocity BEAT_DYNAMICS_MIN_PEAK_VELOCITY = 15.0; // [acc/sec]
+        static constexpr math::Velocity BEAT_DYNAMICS_MAX_PEAK_VELOCITY = 75.0;
+        static constexpr math::Coo      BEAT_DYNAMICS_MIN_DECELERATION = 0.0; // [acc/sec^2]
+        static constexpr math::Coo      BEAT_DYNAMICS_MAX_DECELERATION = 1500.0;
+        static constexpr math::Time     BEAT_DYNAMICS_MIN_TIME_TO_PEAK = 0.03; // [sec]
+        static constexpr math::Time     BEAT_DYNAMICS_MAX_TIME_TO_PEAK = 0.13;
+        
         AccEngine();
         ~AccEngine();
+        // Orders the native side to reset the sensors and resets the orientation and tempo tracked from them. From the UI thread;
+        // while a worker runs, it resets the engine's state before the next sample it processes
         void ResetInput();
+        void ResetInputState(); // Engine's part of ResetInput(), on the thread that feeds the engine
         
         trajectories::Trajectory& GetAccTrajectory() { return _accTrajectory; }
         trajectories::Trajectory& GetMagTrajectory() { return _magTrajectory; }
         
-        trajectories::Segment&    GetAccBeatSegment() { return *_prevBeatSegment; }
+        // Fused orientation, gravity and linear acc of the last fed sample
+        OrientationEstimator&       GetOrientation() { return _orientation; }
+        const math::Vector3D&       GetGravity() const { return _orientation.GetGravity(); }
+        const math::Vector3D&       GetLinearAcc() const { return _orientation.GetLinearAcc(); }
+        
+        trajectories::Segment&    GetAccBeatSegment() { auto seg = _accTrajectory.GetSegment(_prevBeatSegment); ASSERT(seg); return *seg; }
         math::Coo       GetAccBeatAmplitude();
         math::Frequency GetAccBeatFrequency();
+        const sound::BeatDynamics& GetAccBeatDynamics() const { return _accBeatDynamics; }
+        const sound::LatencyTrace& GetAccBeatTrace() const { return _accBeatTrace; } // Stamped while a latency tracer is set
         math::Frequency GetAccNextBeatFrequency();
         bool            IsExpectingBeat();
-        void AddAccFeedListener(FeedListener listener);
-        void RemoveAccFeedListener(FeedListener& listener);
         
-        // Called regularly by native accelerometer functionality
+        // Tempo of detected beats, e.g. to pre-arm voices just before an expected beat or to quantise beats
+        TempoTracker&   GetTempoTracker() { return _tempoTracker; }
+        bool            IsBeatExpectedWithin(math::Time lead_time, math::PartOfOne min_confidence = 0.5);
+        math::Time      GetFeedTimestamp() const { return _currentFeedTimestamp; } // Of the last fed sample
+        
+        // Thresholds of beat and segment detection; best set before feeding, segments already detected are kept
+        void SetParams(const BeatDetectionParams& params);
+        const BeatDetectionParams& GetParams() const { return _params; }
+        
+        // Decides on candidate segments (of at least minBeatAmplitude of the params) instead of the thresholds of the params;
+        // nullptr (default) = thresholds. Not owned, must outlive feeding.
+        void SetBeatClassifier(const BeatClassifier* classifier) { _beatClassifier = classifier; }
+        const BeatFeatures& GetSegmentFeatures() const { return _segmentFeatures; } // Of the last ended segment, e.g. for training
+        
+        // Listeners may be added and removed from any thread, also from within a listener
+        ListenerToken AddAccFeedListener(FeedListener listener, int feed_events = FeedEvent_Sample);
+        bool          RemoveAccFeedListener(ListenerToken token);
+        
+        void SetPredictiveOnsets(bool enabled);
+        bool GetPredictiveOnsets() const { return _predictiveOnsets; }
+        ListenerToken AddOnsetListener(OnsetListener listener);
+        bool          RemoveOnsetListener(ListenerToken token);
+        const OnsetStats& GetOnsetStats() const { return _onsetStats; }
+        void ResetOnsetStats() { _onsetStats = OnsetStats(); }
+        math::Ratio GetOnsetThreshold() const { return _onsetThreshold; }
+        
+        // Called regularly by native accelerometer functionality; only queues the sample while a worker is set
         void FeedAcc(double acc_x, double acc_y, double acc_z,
                      double gyro_x, double gyro_y, double gyro_z,
                      double mag_x, double mag_y, double mag_z);
+        // Same, with the timestamp of the sample given by caller (e.g. when replaying recordings). Timestamps may be of any
+        // clock, and must increase from sample to sample
+        void FeedAcc(math::Time timestamp,
+                     double acc_x, double acc_y, double acc_z,
+                     double gyro_x, double gyro_y, double gyro_z,
+                     double mag_x, double mag_y, double mag_z);
+        // Feeds samples_num samples of a contiguous buffer (e.g. a burst from the sensors or a replayed log).
+        // Feed listeners are called once per batch if any of their events occurred in it, with whether any beat was detected;
+        // onset listeners per onset as usual.
+        // Appends timestamps of detected beats to beat_timestamps if given, returns num of beats detected.
+        int  FeedAccBatch(const Sample* samples, int samples_num, std::vector<math::Time>* beat_timestamps = nullptr);
+        
+        // Set by AccWorker while it processes the samples on its own thread
+        void SetWorker(AccWorker* worker) { _worker.store(worker, std::memory_order_release); }
+        
+        // Beats and onsets get their traces stamped up to the detection; best set before feeding, nullptr to stop
+        void SetLatencyTracer(sound::LatencyTracer* tracer) { _latencyTracer = tracer; }
         
         // Debugging methods
         void DrawTrajectory(graphics::Graphics* graphics);
         void DrawSegmentInConsole(trajectories::Segment segment);
         
     private:
-        bool IsSegmentABeat(trajectories::Segment& seg);
+        int  FeedSample(const Sample& sample); // Returns FeedEvent flags of what occurred, doesn't call feed listeners
+        bool IsSegmentABeat(trajectories::Segment& seg, BeatFeatures& features);
+        void CalcBeatFeatures(trajectories::Segment& seg, BeatFeatures& features);
+        bool IsBeatByParams(const BeatFeatures& features);
+        math::Frequency NormalizeBeatFrequency(const math::Vector3D& pos);
+        sound::BeatDynamics CalcBeatDynamics(trajectories::Segment& seg);
+        void UpdatePredictiveOnset(bool segment_just_ended, bool beat_is_detected);
+        void EmitOnset(OnsetType type, bool was_provisional, math::Time latency_gain);
+        sound::LatencyTrace StartLatencyTrace(math::Time sensor_arrival);
         
-        const math::Coo  MIN_BEAT_AMPLITUDE = 0.3; // [g] Min amplitude of a segment for a beat to be detected
-        const math::Coo  MAX_BEAT_AMPLITUDE = 4.0; // [g] Max amplitude of a beat (is clamped if more)
-        const math::Time MIN_SMALL_BEAT_AVG_VELOCITY = 4.0; // [g/sec] Min average velocity of a segment for a beat with amplitude MIN_BEAT_AMPLITUDE to be detected
-        const math::Time MIN_BIG_BEAT_AVG_VELOCITY = 25.0; // [g/sec] Min average velocity of a segment for a beat with amplitude MAX_BEAT_AMPLITUDE to be detected
+        const math::Ratio ONSET_INITIAL_THRESHOLD = 0.5; // Part of segment's peak speed (along the segment) under which a decelerating segment fires a provisional onset
+        const math::Ratio ONSET_MIN_THRESHOLD = 0.1;
+        const math::Ratio ONSET_MAX_THRESHOLD = 0.9;
+        const math::Ratio ONSET_THRESHOLD_STEP = 0.05; // Threshold is lowered by a step on each false fire, raised by a step on each beat that didn't decelerate below it
+        const math::Ratio ONSET_THRESHOLD_CONFIRMED_STEP = 0.01; // ...and raised by this on each confirmed onset, to keep firing as early as possible
+        const math::Time  ONSET_EXPECTED_LEAD_TIME = 0.1; // [sec] Before the next beat predicted by the tempo, during which...
+        const math::Ratio ONSET_EXPECTED_THRESHOLD_STEP = 0.1; // ...the threshold is raised by this, to fire earlier on a steady beat
         
         trajectories::Trajectory _accTrajectory;
         trajectories::Trajectory _magTrajectory;
         trajectories::Trajectory _gyroTrajectory;
+        OrientationEstimator     _orientation;
+        TempoTracker             _tempoTracker;
+        BeatDetectionParams      _params;
         
-        std::vector<FeedListener> _accFeedListeners;
+        ListenerRegistry<bool>    _accFeedListeners;
+        std::atomic<AccWorker*>   _worker;
         
         math::Time     _prevFeedTimestamp, _currentFeedTimestamp;
         math::Time     _prevSegEndTimestamp;
@@ -69,9 +199,27 @@ namespace yoss
         bool           _prevSegIsDrawn;
         math::Time     _prevBeatTimestamp;
         math::Coo      _prevBeatAmplitude;
-        trajectories::Segment* _prevBeatSegment;
-        trajectories::Segment* _prevSegment;
+        trajectories::SegmentHandle _prevBeatSegment;
+        trajectories::SegmentHandle _prevSegment;
         trajectories::BufferTimestamp _freezeDrawingAt;
+        
+        sound::LatencyTracer*    _latencyTracer;
+        sound::LatencyTrace      _accBeatTrace;
+        sound::BeatDynamics      _accBeatDynamics;
+        
+        const BeatClassifier*    _beatClassifier;
+        BeatFeatures             _segmentFeatures;
+        
+        bool                        _predictiveOnsets;
+        ListenerRegistry<const Onset&> _onsetListeners;
+        OnsetStats                  _onsetStats;
+        math::Ratio                 _onsetThreshold;
+        trajectories::SegmentHandle _onsetSegment; // Segment the state below is for
+        math::Velocity              _onsetPeakSpeed;
+        bool                        _onsetIsChecked; // Whether the segment was already checked for a provisional onset
+        bool                        _onsetIsPending; // Provisional onset was fired for the segment and is not confirmed or cancelled yet
+        math::Time                  _onsetTimestamp;
+        Onset                       _onset; // Last emitted
     };
 
 }
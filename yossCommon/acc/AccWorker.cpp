@@ -0,0 +1,131 @@
+#include "AccWorker.h"
+#include "../common/Log.h"
+
+using namespace std;
+using namespace yoss;
+using namespace yoss::math;
+
+
+//-----------------------------------------------------------------------
+AccWorker::AccWorker(AccEngine& acc_engine) :
+    _accEngine(acc_engine),
+    _isRunning(false),
+    _samples(ACC_WORKER_SAMPLES_QUEUE_SIZE),
+    _commands(ACC_WORKER_COMMANDS_QUEUE_SIZE),
+    _droppedSamplesNum(0)
+{
+}
+
+//-----------------------------------------------------------------------
+AccWorker::~AccWorker()
+{
+    Stop();
+}
+
+//-----------------------------------------------------------------------
+void AccWorker::Start()
+{
+    ASSERT(!_isRunning);
+
+    _isRunning = true;
+    _thread = thread([this] () { Run(); });
+    _accEngine.SetWorker(this);
+
+    Log::LogText("AccWorker started");
+}
+
+//-----------------------------------------------------------------------
+void AccWorker::Stop()
+{
+    if (!_isRunning)
+        return;
+
+    _accEngine.SetWorker(nullptr);
+    _isRunning = false;
+    Wake();
+    _thread.join();
+
+    Log::LogText("AccWorker stopped, dropped samples: " + Log::ToStr(_droppedSamplesNum.load()));
+}
+
+//-----------------------------------------------------------------------
+bool AccWorker::PushSample(const AccEngine::Sample& sample)
+{
+    if (!_samples.Push(sample))
+    {
+        _droppedSamplesNum++;
+        return false;
+    }
+
+    Wake();
+    return true;
+}
+
+//-----------------------------------------------------------------------
+bool AccWorker::PushCommand(Command command)
+{
+    if (!_commands.Push(command))
+        return false;
+
+    Wake();
+    return true;
+}
+
+//-----------------------------------------------------------------------
+// Taking the mutex orders the notification after the worker's check for work, or before it starts waiting
+void AccWorker::Wake()
+{
+    {
+        lock_guard<mutex> lock(_wakeMutex);
+    }
+    _wakeCondition.notify_one();
+}
+
+//-----------------------------------------------------------------------
+void AccWorker::Run()
+{
+    AccEngine::Sample sample;
+    Command command;
+
+    while (_isRunning)
+    {
+        int processed_num = 0;
+        while (true)
+        {
+            while (_commands.Pop(command))
+                switch (command)
+                {
+                    case Command_ResetInput:
+                        _accEngine.ResetInputState();
+                        break;
+                }
+
+            if (!_samples.Pop(sample))
+                break;
+
+            _accEngine.FeedAcc(sample.timestamp, sample.accX, sample.accY, sample.accZ,
+                               sample.gyroX, sample.gyroY, sample.gyroZ, sample.magX, sample.magY, sample.magZ);
+            processed_num++;
+        }
+
+        if (processed_num > 0)
+            PublishSnapshot();
+
+        unique_lock<mutex> lock(_wakeMutex);
+        _wakeCondition.wait(lock, [this] () { return !_isRunning || !_samples.IsEmpty() || !_commands.IsEmpty(); });
+    }
+}
+
+//-----------------------------------------------------------------------
+void AccWorker::PublishSnapshot()
+{
+    auto& snapshot = _snapshots.GetWriteValue();
+    snapshot.timestamp = _accEngine.GetFeedTimestamp();
+    snapshot.orientation = _accEngine.GetOrientation().GetQuaternion();
+    snapshot.gravity = _accEngine.GetGravity();
+    snapshot.linearAcc = _accEngine.GetLinearAcc();
+    snapshot.magPos = _accEngine.GetMagTrajectory().GetPositions().Get();
+    snapshot.tempo = _accEngine.GetTempoTracker().GetTempo();
+
+    _snapshots.Publish();
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "../common/Math.h"
+#include "../structs/SpscQueue.h"
+#include "../structs/TripleBuffer.h"
+#include "AccEngine.h"
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace yoss
+{
+    //-----------------------------------------------------------------------
+    // Structs and classes:
+    class AccWorker;
+    //-----------------------------------------------------------------------
+
+    //-----------------------------------------------------------------------
+    // Constants:
+    const int ACC_WORKER_SAMPLES_QUEUE_SIZE = 1024; // Samples not processed yet; several seconds of sensor data
+    const int ACC_WORKER_COMMANDS_QUEUE_SIZE = 16; // Requests of the UI not done yet
+    //-----------------------------------------------------------------------
+
+
+    //-----------------------------------------------------------------------
+    // Runs an AccEngine on its own thread, so that beat detection is never delayed by rendering.
+    // While running, samples fed to the engine by the native side are queued to the worker, which sleeps till they
+    // arrive and processes them. The engine's feed and onset listeners are called on the worker's thread, so beats
+    // are added to instruments there, never on the audio thread. A snapshot of the orientation is published to the UI.
+    // Samples, requests of the UI and snapshots are handed over lock-free with one producer and one consumer.
+    // The engine must not be used from other threads while the worker runs.
+    class AccWorker
+    {
+    public:
+        enum Command
+        {
+            Command_ResetInput, // AccEngine::ResetInputState()
+        };
+        struct Snapshot
+        {
+            math::Time     timestamp = 0; // Of the last processed sample
+            OrientationEstimator::Quaternion orientation;
+            math::Vector3D gravity;
+            math::Vector3D linearAcc;
+            math::Vector3D magPos;
+            math::Frequency tempo = 0; // [bpm] 0 if not locked
+        };
+
+        AccWorker(AccEngine& acc_engine);
+        ~AccWorker();
+
+        void Start();
+        void Stop(); // Waits till the worker finishes the samples it's processing
+        bool IsRunning() const { return _isRunning; }
+
+        // Sensor thread
+        bool PushSample(const AccEngine::Sample& sample); // False if the queue is full and the sample is dropped
+
+        // UI side
+        bool            PushCommand(Command command); // Done by the worker before the next sample it processes; false if the queue is full
+        bool            UpdateSnapshot() { return _snapshots.Update(); } // Takes the latest snapshot, false if there's no newer one
+        const Snapshot& GetSnapshot() const { return _snapshots.GetReadValue(); }
+
+        int GetDroppedSamplesNum() const { return _droppedSamplesNum; }
+
+    private:
+        void Run();
+        void Wake();
+        void PublishSnapshot();
+
+        AccEngine&               _accEngine;
+        std::thread              _thread;
+        std::atomic<bool>        _isRunning;
+        std::mutex               _wakeMutex; // Only guards the worker's check for work against a missed Wake()
+        std::condition_variable  _wakeCondition;
+
+        SpscQueue<AccEngine::Sample> _samples;
+        SpscQueue<Command>           _commands;
+        TripleBuffer<Snapshot>       _snapshots;
+
+        std::atomic<int>         _droppedSamplesNum;
+    };
+
+}
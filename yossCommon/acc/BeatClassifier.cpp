@@ -0,0 +1,130 @@
+#include "BeatClassifier.h"
+#include "../common/Log.h"
+#include "../common/System.h"
+
+#include <cstdlib>
+#include <cstdio>
+
+using namespace std;
+using namespace yoss;
+using namespace yoss::math;
+
+
+//-----------------------------------------------------------------------
+// Static defines, consts and vars
+
+static const char* FEATURE_NAMES[BeatFeatures::FEATURES_NUM] =
+{
+    "amplitude",
+    "duration",
+    "avgVelocity",
+    "angleToZ",
+    "gyroYStrength",
+    "straightness",
+    "prevSegAmplitude",
+    "prevSegAvgVelocity",
+    "prevSegIsAntiBeat",
+};
+
+//-----------------------------------------------------------------------
+
+
+//-----------------------------------------------------------------------
+const char* BeatFeatures::GetName(int feature)
+{
+    ASSERT(feature >= 0 && feature < FEATURES_NUM);
+    return FEATURE_NAMES[feature];
+}
+
+
+//-----------------------------------------------------------------------
+//-----------------------------------------------------------------------
+// class LinearBeatClassifier
+//-----------------------------------------------------------------------
+LinearBeatClassifier::LinearBeatClassifier() :
+    _bias(0)
+{
+    for (auto& weight : _weights)
+        weight = 0;
+}
+
+//-----------------------------------------------------------------------
+double LinearBeatClassifier::Score(const BeatFeatures& features) const
+{
+    double score = _bias;
+    for (int feature = 0; feature < BeatFeatures::FEATURES_NUM; feature++)
+        score += _weights[feature] * features[feature];
+    return score;
+}
+
+//-----------------------------------------------------------------------
+map<string, string> LinearBeatClassifier::ToMap() const
+{
+    map<string, string> map;
+    auto add_value = [&map] (const string& name, double value)
+    {
+        char value_str[32];
+        snprintf(value_str, sizeof(value_str), "%.17g", value); // Round-trips exactly
+        map[name] = value_str;
+    };
+
+    add_value("threshold", _threshold);
+    add_value("bias", _bias);
+    for (int feature = 0; feature < BeatFeatures::FEATURES_NUM; feature++)
+        add_value(string("w.") + BeatFeatures::GetName(feature), _weights[feature]);
+
+    return map;
+}
+
+//-----------------------------------------------------------------------
+bool LinearBeatClassifier::FromMap(const map<string, string>& map)
+{
+    bool all_known = true;
+
+    for (auto& entry : map)
+    {
+        double value = atof(entry.second.c_str());
+        if (entry.first == "threshold")
+        {
+            _threshold = value;
+            continue;
+        }
+        if (entry.first == "bias")
+        {
+            _bias = value;
+            continue;
+        }
+
+        bool is_known = false;
+        for (int feature = 0; feature < BeatFeatures::FEATURES_NUM; feature++)
+            if (entry.first == string("w.") + BeatFeatures::GetName(feature))
+            {
+                _weights[feature] = value;
+                is_known = true;
+                break;
+            }
+
+        if (!is_known)
+        {
+            Log::LogText("LinearBeatClassifier: unknown value '" + entry.first + "'");
+            all_known = false;
+        }
+    }
+
+    return all_known;
+}
+
+//-----------------------------------------------------------------------
+bool LinearBeatClassifier::Load(const string& filename)
+{
+    if (!system::FileExists(filename))
+        return false;
+
+    return FromMap(system::LoadMap(filename));
+}
+
+//-----------------------------------------------------------------------
+bool LinearBeatClassifier::Save(const string& filename) const
+{
+    return system::SaveMap(filename, ToMap());
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "../common/Math.h"
+
+#include <map>
+#include <string>
+
+namespace yoss
+{
+    //-----------------------------------------------------------------------
+    // Structs and classes:
+    struct BeatFeatures;
+    class BeatClassifier;
+    class LinearBeatClassifier;
+    //-----------------------------------------------------------------------
+
+    //-----------------------------------------------------------------------
+    // Constants:
+    const math::Ratio BEAT_FEATURE_MAX_RATIO = 100.0; // Cap of the ratio features, which are unbounded when their divisor is ~0
+    //-----------------------------------------------------------------------
+
+
+    //-----------------------------------------------------------------------
+    // Fixed feature vector of a candidate segment for beat classification, as computed by AccEngine
+    struct BeatFeatures
+    {
+        enum Feature
+        {
+            Feature_Amplitude,          // [g] Size of the segment's acc change
+            Feature_Duration,           // [sec]
+            Feature_AvgVelocity,        // [g/sec] Size of the average velocity
+            Feature_AngleToZ,           // [deg] Angle of the segment to +Z, beats go against it
+            Feature_GyroYStrength,      // Ratio of rotation around Y to rotation around X during the segment
+            Feature_Straightness,       // Traveled length / amplitude, 1 = straight
+            Feature_PrevSegAmplitude,   // [g]
+            Feature_PrevSegAvgVelocity, // [g/sec]
+            Feature_PrevSegIsAntiBeat,  // 1 if the previous segment went up (+Z), else 0
+            FEATURES_NUM
+        };
+
+        double values[FEATURES_NUM] = {};
+
+        inline double& operator[](int feature) { return values[feature]; }
+        inline double  operator[](int feature) const { return values[feature]; }
+
+        static const char* GetName(int feature); // As in model files
+    };
+
+    //-----------------------------------------------------------------------
+    // Decides whether a candidate segment is a beat by its features, instead of AccEngine's thresholds
+    // (AccEngine::SetBeatClassifier). Scoring is called on the sensor thread for every candidate,
+    // so implementations must not allocate and should take well under a microsecond.
+    class BeatClassifier
+    {
+    public:
+        BeatClassifier() : _threshold(0) {}
+        virtual ~BeatClassifier() {}
+
+        virtual double Score(const BeatFeatures& features) const = 0; // Higher = more likely a beat
+
+        bool   IsBeat(const BeatFeatures& features) const { return Score(features) > _threshold; }
+        void   SetThreshold(double threshold) { _threshold = threshold; }
+        double GetThreshold() const { return _threshold; }
+
+    protected:
+        double _threshold;
+    };
+
+    //-----------------------------------------------------------------------
+    // Logistic model: score is the log-odds of a beat, bias + weights . features (in the features' own units).
+    // Fitted by tools/BeatTrain; files are in system::LoadMap format, with names as BeatFeatures::GetName().
+    class LinearBeatClassifier : public BeatClassifier
+    {
+    public:
+        LinearBeatClassifier();
+
+        virtual double Score(const BeatFeatures& features) const;
+
+        double  GetBias() const { return _bias; }
+        void    SetBias(double bias) { _bias = bias; }
+        double  GetWeight(int feature) const { return _weights[feature]; }
+        void    SetWeight(int feature, double weight) { _weights[feature] = weight; }
+
+        std::map<std::string, std::string> ToMap() const;
+        bool FromMap(const std::map<std::string, std::string>& map); // Missing values keep theirs, false on unknown ones
+        bool Load(const std::string& filename);
+        bool Save(const std::string& filename) const;
+
+    private:
+        double _bias;
+        double _weights[BeatFeatures::FEATURES_NUM];
+    };
+
+}
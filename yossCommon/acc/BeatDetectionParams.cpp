@@ -0,0 +1,90 @@
+#include "BeatDetectionParams.h"
+#include "../common/Log.h"
+#include "../common/System.h"
+
+#include <cstdlib>
+#include <cstdio>
+
+using namespace std;
+using namespace yoss;
+using namespace yoss::math;
+
+
+//-----------------------------------------------------------------------
+vector<pair<string, double*>> BeatDetectionParams::GetFields()
+{
+    return {
+        { "minBeatAmplitude",            &minBeatAmplitude },
+        { "maxBeatAmplitude",            &maxBeatAmplitude },
+        { "minSmallBeatAvgVelocity",     &minSmallBeatAvgVelocity },
+        { "minBigBeatAvgVelocity",       &minBigBeatAvgVelocity },
+        { "maxAngleToZ",                 &maxAngleToZ },
+        { "minAvgVelocityAfterAntiBeat", &minAvgVelocityAfterAntiBeat },
+        { "minPrevSegAmplitude",         &minPrevSegAmplitude },
+        { "maxGyroYStrength",            &maxGyroYStrength },
+        { "segments.accNoiseSize",             &segments.accNoiseSize },
+        { "segments.movingAgainstMaxCos",      &segments.movingAgainstMaxCos },
+        { "segments.movingAgainstMaxDuration", &segments.movingAgainstMaxDuration },
+        { "segments.maxIdleDPos",              &segments.maxIdleDPos },
+        { "segments.minIdleDuration",          &segments.minIdleDuration },
+        { "segments.maxDriftSpeed",            &segments.maxDriftSpeed },
+        { "segments.minDriftDuration",         &segments.minDriftDuration },
+    };
+}
+
+//-----------------------------------------------------------------------
+map<string, string> BeatDetectionParams::ToMap() const
+{
+    map<string, string> map;
+    BeatDetectionParams copy = *this;
+    for (auto& field : copy.GetFields())
+    {
+        char value_str[32];
+        snprintf(value_str, sizeof(value_str), "%.17g", *field.second); // Round-trips exactly
+        map[field.first] = value_str;
+    }
+
+    return map;
+}
+
+//-----------------------------------------------------------------------
+bool BeatDetectionParams::FromMap(const map<string, string>& map)
+{
+    auto fields = GetFields();
+    bool all_known = true;
+
+    for (auto& entry : map)
+    {
+        bool is_known = false;
+        for (auto& field : fields)
+            if (field.first == entry.first)
+            {
+                *field.second = atof(entry.second.c_str());
+                is_known = true;
+                break;
+            }
+
+        if (!is_known)
+        {
+            Log::LogText("BeatDetectionParams: unknown param '" + entry.first + "'");
+            all_known = false;
+        }
+    }
+
+    return all_known;
+}
+
+//-----------------------------------------------------------------------
+bool BeatDetectionParams::Load(const string& filename)
+{
+    if (!system::FileExists(filename))
+        return false;
+
+    return FromMap(system::LoadMap(filename));
+}
+
+//-----------------------------------------------------------------------
+bool BeatDetectionParams::Save(const string& filename) const
+{
+    return system::SaveMap(filename, ToMap());
+}
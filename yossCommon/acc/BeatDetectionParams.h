@@ -0,0 +1,45 @@
+#pragma once
+
+#include "../common/Math.h"
+#include "../common/Config.h"
+#include "Trajectory.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace yoss
+{
+    //-----------------------------------------------------------------------
+    // Structs and classes:
+    struct BeatDetectionParams;
+    //-----------------------------------------------------------------------
+
+    //-----------------------------------------------------------------------
+    // Thresholds of AccEngine's beat detection and of the segment detection of its acc trajectory.
+    // Defaults are the hand-tuned values; can be loaded from a file (system::LoadMap format) to retune without recompiling.
+    struct BeatDetectionParams
+    {
+        math::Coo      minBeatAmplitude = 0.3; // [g] Min amplitude of a segment for a beat to be detected
+        math::Coo      maxBeatAmplitude = 4.0; // [g] Max amplitude of a beat (is clamped if more)
+        math::Velocity minSmallBeatAvgVelocity = 4.0; // [g/sec] Min average velocity of a segment for a beat with amplitude minBeatAmplitude to be detected
+        math::Velocity minBigBeatAvgVelocity = 25.0; // [g/sec] Min average velocity of a segment for a beat with amplitude maxBeatAmplitude to be detected
+        math::Angle    maxAngleToZ = Config::AccSegmentIsABeatMaxAngleToZ; // [deg] Max angle of a beat segment to -Z
+        math::Ratio    minAvgVelocityAfterAntiBeat = 0.75; // Part of the previous (anti-beat) segment's avg velocity a beat needs after it
+        math::Ratio    minPrevSegAmplitude = 0.1; // Part of beat amplitude the previous segment needs, i.e. there was an acceleration
+        math::Ratio    maxGyroYStrength = 1.0; // Max ratio of rotation around Y to rotation around X during a beat
+
+        trajectories::SegmentDetectionParams segments;
+
+        // Name and value of each param, by the same names as in the params file
+        std::vector<std::pair<std::string, double*>> GetFields();
+
+        std::map<std::string, std::string> ToMap() const;
+        bool FromMap(const std::map<std::string, std::string>& map); // Missing params keep their values, false on unknown ones
+
+        bool Load(const std::string& filename);
+        bool Save(const std::string& filename) const;
+    };
+
+}
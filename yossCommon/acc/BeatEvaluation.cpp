@@ -0,0 +1,202 @@
+#include "BeatEvaluation.h"
+#include "../common/Log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+using namespace yoss;
+using namespace yoss::math;
+
+
+//-----------------------------------------------------------------------
+// Static defines, consts and vars
+
+//-----------------------------------------------------------------------
+// Reads numbers separated by commas or whitespace, skipping empty and '#' lines
+static bool LoadNumbers(const string& path, vector<double>& numbers, int numbers_per_line)
+{
+    ifstream file(path);
+    if (!file)
+        return false;
+
+    string line;
+    while (getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        for (auto& c : line)
+            if (c == ',') c = ' ';
+
+        istringstream line_stream(line);
+        int line_numbers = 0;
+        double number;
+        while (line_stream >> number)
+        {
+            numbers.push_back(number);
+            line_numbers++;
+        }
+
+        if (line_numbers == 0)
+            continue;
+        if (line_numbers != numbers_per_line)
+        {
+            Log::LogText("Bad line in " + path + ": " + line);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------
+
+
+//-----------------------------------------------------------------------
+//-----------------------------------------------------------------------
+// struct AccRecording
+//-----------------------------------------------------------------------
+Time AccRecording::GetDuration() const
+{
+    int samples_num = GetSamplesNum();
+    if (samples_num < 2)
+        return 0;
+
+    return samples[samples_num - 1].timestamp - samples[0].timestamp;
+}
+
+//-----------------------------------------------------------------------
+bool AccRecording::Load(const string& recording_path, const string& labels_path)
+{
+    name = recording_path;
+    samples.clear();
+    onsets.clear();
+
+    vector<double> values;
+    if (!LoadNumbers(recording_path, values, VALUES_PER_SAMPLE))
+        return false;
+    if (!LoadNumbers(labels_path, onsets, 1))
+        return false;
+
+    samples.resize(values.size() / VALUES_PER_SAMPLE);
+    for (size_t sample_i = 0; sample_i < samples.size(); sample_i++)
+    {
+        const double* value = &values[sample_i * VALUES_PER_SAMPLE];
+        samples[sample_i] = { value[0], value[1], value[2], value[3], value[4], value[5], value[6], value[7], value[8], value[9] };
+
+        if (!isfinite(value[0]) || (sample_i > 0 && samples[sample_i].timestamp <= samples[sample_i - 1].timestamp))
+        {
+            Log::LogText("Bad timestamp in " + recording_path + " at sample " + Log::ToStr((int)sample_i));
+            return false;
+        }
+    }
+
+    sort(onsets.begin(), onsets.end());
+    return true;
+}
+
+//-----------------------------------------------------------------------
+string AccRecording::GetLabelsPath(const string& recording_path)
+{
+    auto dot_pos = recording_path.find_last_of('.');
+    auto slash_pos = recording_path.find_last_of('/');
+    if (dot_pos == string::npos || (slash_pos != string::npos && dot_pos < slash_pos))
+        return recording_path + ".onsets";
+    return recording_path.substr(0, dot_pos) + ".onsets";
+}
+
+//-----------------------------------------------------------------------
+vector<Time> AccRecording::Replay(AccEngine& acc_engine) const
+{
+    vector<Time> detections;
+    acc_engine.FeedAccBatch(samples.data(), GetSamplesNum(), &detections);
+    return detections;
+}
+
+
+//-----------------------------------------------------------------------
+//-----------------------------------------------------------------------
+// struct BeatEvaluation
+//-----------------------------------------------------------------------
+BeatEvaluation BeatEvaluation::Evaluate(const vector<Time>& onsets, const vector<Time>& detections, Time max_early, Time max_late)
+{
+    BeatEvaluation eval;
+    size_t detection_i = 0;
+
+    for (auto onset : onsets)
+    {
+        // Detections too early for this onset weren't matched by the previous ones either
+        while (detection_i < detections.size() && detections[detection_i] < onset - max_early)
+        {
+            eval.falsePositives++;
+            detection_i++;
+        }
+
+        if (detection_i < detections.size() && detections[detection_i] <= onset + max_late)
+        {
+            Time latency = detections[detection_i] - onset;
+            int bin = (int)floor((latency + BEAT_EVAL_MAX_EARLY) / BEAT_EVAL_HISTOGRAM_BIN);
+            eval.latencyHistogram[CLAMP(bin, 0, BEAT_EVAL_HISTOGRAM_BINS - 1)]++;
+            eval.latencySum += latency;
+            eval.truePositives++;
+            detection_i++;
+        }
+        else
+        {
+            eval.falseNegatives++;
+        }
+    }
+
+    eval.falsePositives += (int)(detections.size() - detection_i);
+    return eval;
+}
+
+//-----------------------------------------------------------------------
+void BeatEvaluation::Add(const BeatEvaluation& other)
+{
+    truePositives += other.truePositives;
+    falsePositives += other.falsePositives;
+    falseNegatives += other.falseNegatives;
+    latencySum += other.latencySum;
+    for (int bin = 0; bin < BEAT_EVAL_HISTOGRAM_BINS; bin++)
+        latencyHistogram[bin] += other.latencyHistogram[bin];
+}
+
+//-----------------------------------------------------------------------
+Ratio BeatEvaluation::GetFMeasure() const
+{
+    Ratio precision = GetPrecision();
+    Ratio recall = GetRecall();
+    return (precision + recall > 0 ? 2 * precision * recall / (precision + recall) : 0);
+}
+
+//-----------------------------------------------------------------------
+string BeatEvaluation::ToString(bool with_histogram) const
+{
+    string str = "P=" + Log::ToStr(GetPrecision(), 3) +
+                 " R=" + Log::ToStr(GetRecall(), 3) +
+                 " F=" + Log::ToStr(GetFMeasure(), 3) +
+                 " (tp=" + Log::ToStr(truePositives) +
+                 " fp=" + Log::ToStr(falsePositives) +
+                 " fn=" + Log::ToStr(falseNegatives) + ")" +
+                 " avg_latency=" + Log::ToStr(GetAvgLatency() * 1000, 1) + "ms";
+
+    if (with_histogram)
+    {
+        int max_count = 1;
+        for (auto count : latencyHistogram)
+            max_count = MAX(max_count, count);
+
+        for (int bin = 0; bin < BEAT_EVAL_HISTOGRAM_BINS; bin++)
+        {
+            int bin_start_ms = (int)round((bin * BEAT_EVAL_HISTOGRAM_BIN - BEAT_EVAL_MAX_EARLY) * 1000);
+            str += "\n  " + Log::ToStr(bin_start_ms) + "ms\t" + Log::ToStr(latencyHistogram[bin]) + "\t" +
+                   string(latencyHistogram[bin] * 40 / max_count, '#');
+        }
+    }
+
+    return str;
+}
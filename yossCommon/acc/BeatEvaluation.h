@@ -0,0 +1,74 @@
+#pragma once
+
+#include "../common/Math.h"
+#include "AccEngine.h"
+
+#include <string>
+#include <vector>
+
+namespace yoss
+{
+    //-----------------------------------------------------------------------
+    // Structs and classes:
+    struct AccRecording;
+    struct BeatEvaluation;
+    //-----------------------------------------------------------------------
+
+    //-----------------------------------------------------------------------
+    // Constants:
+    const math::Time BEAT_EVAL_MAX_EARLY = 0.05; // [sec] Max time a detection may precede its labelled onset to match it
+    const math::Time BEAT_EVAL_MAX_LATE = 0.15; // [sec] Max time a detection may follow its labelled onset to match it
+    const math::Time BEAT_EVAL_HISTOGRAM_BIN = 0.01; // [sec]
+    const int        BEAT_EVAL_HISTOGRAM_BINS = (int)((BEAT_EVAL_MAX_EARLY + BEAT_EVAL_MAX_LATE) / BEAT_EVAL_HISTOGRAM_BIN + 0.5);
+    //-----------------------------------------------------------------------
+
+
+    //-----------------------------------------------------------------------
+    // Sensor stream as fed to AccEngine::FeedAcc, with ground-truth onsets.
+    // Recording file: one sample per line, "timestamp, acc x y z, gyro x y z, mag x y z" separated by commas or spaces.
+    // Labels file: one onset timestamp per line. Lines starting with '#' are skipped in both.
+    // Timestamps are in seconds of any clock, the same in both files, increasing from sample to sample.
+    struct AccRecording
+    {
+        static constexpr int VALUES_PER_SAMPLE = 10;
+
+        std::string name;
+        std::vector<AccEngine::Sample> samples;
+        std::vector<math::Time> onsets;
+
+        int GetSamplesNum() const { return (int)samples.size(); }
+        math::Time GetDuration() const;
+
+        bool Load(const std::string& recording_path, const std::string& labels_path);
+        bool Load(const std::string& recording_path) { return Load(recording_path, GetLabelsPath(recording_path)); }
+
+        // Of the recording, by convention: the same path with extension ".onsets"
+        static std::string GetLabelsPath(const std::string& recording_path);
+
+        // Feeds all samples to acc_engine in one batch, returns timestamps at which beats were detected
+        std::vector<math::Time> Replay(AccEngine& acc_engine) const;
+    };
+
+    //-----------------------------------------------------------------------
+    // Detections matched to labelled onsets. Each onset is matched to at most one detection, in time order.
+    struct BeatEvaluation
+    {
+        int truePositives = 0;
+        int falsePositives = 0;
+        int falseNegatives = 0;
+        math::Time latencySum = 0; // Of true positives
+        std::vector<int> latencyHistogram = std::vector<int>(BEAT_EVAL_HISTOGRAM_BINS, 0); // From -BEAT_EVAL_MAX_EARLY, BEAT_EVAL_HISTOGRAM_BIN per bin
+
+        static BeatEvaluation Evaluate(const std::vector<math::Time>& onsets, const std::vector<math::Time>& detections,
+                                       math::Time max_early = BEAT_EVAL_MAX_EARLY, math::Time max_late = BEAT_EVAL_MAX_LATE);
+        void Add(const BeatEvaluation& other);
+
+        math::Ratio GetPrecision() const { return (truePositives + falsePositives > 0 ? (double)truePositives / (truePositives + falsePositives) : 0); }
+        math::Ratio GetRecall() const { return (truePositives + falseNegatives > 0 ? (double)truePositives / (truePositives + falseNegatives) : 0); }
+        math::Ratio GetFMeasure() const;
+        math::Time  GetAvgLatency() const { return (truePositives > 0 ? latencySum / truePositives : 0); }
+
+        std::string ToString(bool with_histogram) const;
+    };
+
+}
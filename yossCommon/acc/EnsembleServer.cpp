@@ -0,0 +1,467 @@
+#include "EnsembleServer.h"
+#include "../common/Log.h"
+#include "../common/System.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace yoss;
+using namespace yoss::math;
+using namespace yoss::sound;
+
+
+//-----------------------------------------------------------------------
+// Static defines, consts and vars
+
+#ifdef MSG_NOSIGNAL
+static const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static const int SEND_FLAGS = 0; // SO_NOSIGPIPE is set on the socket instead
+#endif
+
+//-----------------------------------------------------------------------
+static bool ParseAddress(const string& address, sockaddr_storage& addr, socklen_t& addr_len, string& unix_path)
+{
+    memset(&addr, 0, sizeof(addr));
+    unix_path.clear();
+
+    if (address.compare(0, 5, "unix:") == 0)
+    {
+        auto& unix_addr = (sockaddr_un&)addr;
+        unix_path = address.substr(5);
+        if (unix_path.empty() || unix_path.size() >= sizeof(unix_addr.sun_path))
+            return false;
+
+        unix_addr.sun_family = AF_UNIX;
+        strcpy(unix_addr.sun_path, unix_path.c_str());
+        addr_len = sizeof(sockaddr_un);
+        return true;
+    }
+
+    if (address.compare(0, 4, "tcp:") == 0)
+    {
+        auto& tcp_addr = (sockaddr_in&)addr;
+        int port = atoi(address.c_str() + 4);
+        if (port < 0 || port > 65535)
+            return false;
+
+        tcp_addr.sin_family = AF_INET;
+        tcp_addr.sin_port = htons((uint16_t)port);
+        tcp_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // Local performers only
+        addr_len = sizeof(sockaddr_in);
+        return true;
+    }
+
+    return false;
+}
+
+//-----------------------------------------------------------------------
+// True if the socket can be read (or was closed) within timeout
+static bool WaitReadable(int socket, Time timeout)
+{
+    pollfd poll_fd = { socket, POLLIN, 0 };
+    return (poll(&poll_fd, 1, (int)(timeout * 1000)) > 0);
+}
+
+//-----------------------------------------------------------------------
+static bool IsSampleFinite(const AccEngine::Sample& sample)
+{
+    return (isfinite(sample.timestamp) &&
+            isfinite(sample.accX) && isfinite(sample.accY) && isfinite(sample.accZ) &&
+            isfinite(sample.gyroX) && isfinite(sample.gyroY) && isfinite(sample.gyroZ) &&
+            isfinite(sample.magX) && isfinite(sample.magY) && isfinite(sample.magZ));
+}
+
+//-----------------------------------------------------------------------
+static bool SendAll(int socket, const void* data, size_t size)
+{
+    auto bytes = (const char*)data;
+    while (size > 0)
+    {
+        ssize_t sent = send(socket, bytes, size, SEND_FLAGS);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+
+        bytes += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------
+
+
+//-----------------------------------------------------------------------
+//-----------------------------------------------------------------------
+// class EnsembleServer
+//-----------------------------------------------------------------------
+EnsembleServer::EnsembleServer(const BeatDetectionParams& params) :
+    _params(params),
+    _listenSocket(-1),
+    _port(0),
+    _isRunning(false),
+    _refusedNum(0)
+{
+}
+
+//-----------------------------------------------------------------------
+EnsembleServer::~EnsembleServer()
+{
+    Stop();
+}
+
+//-----------------------------------------------------------------------
+bool EnsembleServer::Start(const string& address)
+{
+    ASSERT(!_isRunning);
+
+    sockaddr_storage addr;
+    socklen_t addr_len;
+    string unix_path;
+    if (!ParseAddress(address, addr, addr_len, unix_path))
+    {
+        Log::LogText("EnsembleServer: invalid address " + address);
+        return false;
+    }
+
+    _listenSocket = socket(addr.ss_family, SOCK_STREAM, 0);
+    if (_listenSocket < 0)
+        return false;
+
+    if (!unix_path.empty())
+    {
+        unlink(unix_path.c_str()); // Left by a server that didn't stop
+    }
+    else
+    {
+        int reuse = 1;
+        setsockopt(_listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    }
+
+    if (bind(_listenSocket, (sockaddr*)&addr, addr_len) < 0 || listen(_listenSocket, ENSEMBLE_MAX_STREAMS) < 0)
+    {
+        Log::LogText("EnsembleServer: can't listen on " + address + ": " + strerror(errno));
+        close(_listenSocket);
+        _listenSocket = -1;
+        return false;
+    }
+
+    if (unix_path.empty())
+    {
+        sockaddr_in bound_addr;
+        socklen_t bound_addr_len = sizeof(bound_addr);
+        if (getsockname(_listenSocket, (sockaddr*)&bound_addr, &bound_addr_len) == 0)
+            _port = ntohs(bound_addr.sin_port);
+    }
+
+    _unixPath = unix_path;
+    _isRunning = true;
+    _acceptThread = thread([this] () { RunAccepting(); });
+
+    Log::LogText("EnsembleServer listening on " + (unix_path.empty() ? "tcp:" + Log::ToStr(_port) : address));
+    return true;
+}
+
+//-----------------------------------------------------------------------
+void EnsembleServer::Stop()
+{
+    if (!_isRunning)
+        return;
+
+    _isRunning = false;
+    _acceptThread.join();
+    JoinFinishedStreams(true);
+
+    close(_listenSocket);
+    _listenSocket = -1;
+    if (!_unixPath.empty())
+        unlink(_unixPath.c_str());
+    _unixPath.clear();
+
+    Log::LogText("EnsembleServer stopped, refused connections: " + Log::ToStr(_refusedNum.load()));
+}
+
+//-----------------------------------------------------------------------
+void EnsembleServer::AssignInstrument(int performer_id, Instrument* instrument)
+{
+    lock_guard<mutex> lock(_instrumentsMutex);
+
+    if (instrument)
+        _instruments[performer_id] = instrument;
+    else
+        _instruments.erase(performer_id);
+}
+
+//-----------------------------------------------------------------------
+vector<EnsembleServer::StreamStats> EnsembleServer::GetStreamStats()
+{
+    lock_guard<mutex> lock(_streamsMutex);
+
+    auto stats = _finishedStreamStats;
+    for (auto& stream : _streams)
+        if (stream->performerId >= 0)
+            stats.push_back({ stream->performerId, !stream->isFinished, stream->samplesNum, stream->droppedNum, stream->beatsNum });
+
+    return stats;
+}
+
+//-----------------------------------------------------------------------
+void EnsembleServer::RunAccepting()
+{
+    while (_isRunning)
+    {
+        JoinFinishedStreams(false);
+
+        if (!WaitReadable(_listenSocket, ENSEMBLE_POLL_INTERVAL))
+            continue;
+
+        int stream_socket = accept(_listenSocket, nullptr, nullptr);
+        if (stream_socket < 0)
+            continue;
+
+        lock_guard<mutex> lock(_streamsMutex);
+
+        if ((int)_streams.size() >= ENSEMBLE_MAX_STREAMS)
+        {
+            close(stream_socket);
+            _refusedNum++;
+            Log::LogText("EnsembleServer: too many streams, connection refused");
+            continue;
+        }
+
+        // Engines are constructed here rather than by the streams, construction isn't thread-safe (logs)
+        auto stream = new Stream();
+        stream->socket = stream_socket;
+        stream->performerId = -1;
+        stream->accEngine.reset(new AccEngine());
+        stream->accEngine->SetParams(_params);
+        stream->thread = thread([this, stream] () { RunStream(stream); });
+        _streams.emplace_back(stream);
+    }
+}
+
+//-----------------------------------------------------------------------
+void EnsembleServer::RunStream(Stream* stream)
+{
+    if (ReceiveHello(stream))
+    {
+        stream->accEngine->AddAccFeedListener([this, stream] (bool beat_is_detected) { OnStreamBeat(stream); }, AccEngine::FeedEvent_Beat);
+
+        // Partial samples are kept at the start of the buffer till the rest arrives
+        AccEngine::Sample samples[ENSEMBLE_RECEIVE_BUFFER_SAMPLES];
+        size_t received_size = 0;
+
+        // The engine's trajectories need increasing timestamps, which the client's clock doesn't guarantee
+        bool has_timestamp = false;
+        Time last_timestamp = 0;
+        bool is_malformed = false;
+
+        while (_isRunning && !is_malformed)
+        {
+            if (!WaitReadable(stream->socket, ENSEMBLE_POLL_INTERVAL))
+                continue;
+
+            ssize_t received = recv(stream->socket, (char*)samples + received_size, sizeof(samples) - received_size, 0);
+            if (received < 0 && errno == EINTR)
+                continue;
+            if (received <= 0)
+                break; // Disconnected
+
+            received_size += received;
+            int samples_num = (int)(received_size / sizeof(AccEngine::Sample));
+            int fed_num = 0;
+            for (int sample_i = 0; sample_i < samples_num; sample_i++)
+            {
+                auto& sample = samples[sample_i];
+                if (!IsSampleFinite(sample))
+                {
+                    is_malformed = true;
+                    break;
+                }
+
+                if (has_timestamp && sample.timestamp <= last_timestamp)
+                {
+                    stream->droppedNum++;
+                    continue;
+                }
+                last_timestamp = sample.timestamp;
+                has_timestamp = true;
+
+                stream->accEngine->FeedAcc(sample.timestamp, sample.accX, sample.accY, sample.accZ,
+                                           sample.gyroX, sample.gyroY, sample.gyroZ, sample.magX, sample.magY, sample.magZ);
+                fed_num++;
+            }
+            stream->samplesNum += fed_num;
+
+            received_size -= samples_num * sizeof(AccEngine::Sample);
+            memmove(samples, samples + samples_num, received_size);
+        }
+
+        if (is_malformed)
+            Log::LogText("EnsembleServer: non-finite sample from performer " + Log::ToStr(stream->performerId) + ", stream closed");
+    }
+
+    stream->isFinished = true;
+}
+
+//-----------------------------------------------------------------------
+bool EnsembleServer::ReceiveHello(Stream* stream)
+{
+    EnsembleHello hello;
+    size_t received_size = 0;
+    Time deadline = system::GetCurrentTimestamp() + ENSEMBLE_HELLO_TIMEOUT;
+
+    while (received_size < sizeof(hello))
+    {
+        if (!_isRunning || system::GetCurrentTimestamp() > deadline)
+            return false;
+        if (!WaitReadable(stream->socket, ENSEMBLE_POLL_INTERVAL))
+            continue;
+
+        ssize_t received = recv(stream->socket, (char*)&hello + received_size, sizeof(hello) - received_size, 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return false;
+        received_size += received;
+    }
+
+    if (hello.magic != ENSEMBLE_MAGIC || hello.version != ENSEMBLE_VERSION || hello.performerId < 0)
+        return false;
+
+    // One stream per performer
+    lock_guard<mutex> lock(_streamsMutex);
+    for (auto& other : _streams)
+        if (other.get() != stream && other->performerId == hello.performerId && !other->isFinished)
+            return false;
+
+    stream->performerId = hello.performerId;
+    return true;
+}
+
+//-----------------------------------------------------------------------
+// Stream's thread
+void EnsembleServer::OnStreamBeat(Stream* stream)
+{
+    auto& acc_engine = *stream->accEngine;
+    Beat beat = { stream->performerId, acc_engine.GetFeedTimestamp(), acc_engine.GetAccBeatFrequency(), acc_engine.GetAccBeatAmplitude(),
+                  acc_engine.GetAccBeatDynamics() };
+    stream->beatsNum++;
+
+    {
+        lock_guard<mutex> lock(_instrumentsMutex);
+        auto it = _instruments.find(beat.performerId);
+        if (it != _instruments.end())
+            it->second->AddBeat(beat.normalizedFreq, beat.amplitude, beat.dynamics);
+    }
+
+    _beatListeners.Notify(ListenerRegistry<const Beat&>::ALL_KINDS, beat);
+}
+
+//-----------------------------------------------------------------------
+// Accepting thread, or the stopping one once it's joined
+void EnsembleServer::JoinFinishedStreams(bool join_all)
+{
+    vector<unique_ptr<Stream>> finished_streams;
+    {
+        lock_guard<mutex> lock(_streamsMutex);
+        for (auto it = _streams.begin(); it != _streams.end(); )
+        {
+            if (join_all || (*it)->isFinished)
+            {
+                finished_streams.push_back(move(*it));
+                it = _streams.erase(it);
+            }
+            else
+            {
+                it++;
+            }
+        }
+    }
+
+    for (auto& stream : finished_streams)
+    {
+        stream->thread.join();
+        close(stream->socket);
+
+        if (stream->performerId < 0)
+        {
+            Log::LogText("EnsembleServer: stream closed without a valid hello");
+            continue;
+        }
+
+        Log::LogText("EnsembleServer: stream of performer " + Log::ToStr(stream->performerId) + " closed, samples: " +
+                     Log::ToStr(stream->samplesNum.load()) + ", dropped: " + Log::ToStr(stream->droppedNum.load()) +
+                     ", beats: " + Log::ToStr(stream->beatsNum.load()));
+
+        lock_guard<mutex> lock(_streamsMutex);
+        _finishedStreamStats.push_back({ stream->performerId, false, stream->samplesNum, stream->droppedNum, stream->beatsNum });
+    }
+}
+
+
+//-----------------------------------------------------------------------
+//-----------------------------------------------------------------------
+// class EnsembleClient
+//-----------------------------------------------------------------------
+bool EnsembleClient::Connect(const string& address, int performer_id)
+{
+    Close();
+
+    sockaddr_storage addr;
+    socklen_t addr_len;
+    string unix_path;
+    if (!ParseAddress(address, addr, addr_len, unix_path))
+        return false;
+
+    _socket = socket(addr.ss_family, SOCK_STREAM, 0);
+    if (_socket < 0)
+        return false;
+
+#ifdef SO_NOSIGPIPE
+    int no_sigpipe = 1;
+    setsockopt(_socket, SOL_SOCKET, SO_NOSIGPIPE, &no_sigpipe, sizeof(no_sigpipe));
+#endif
+
+    EnsembleHello hello;
+    hello.performerId = performer_id;
+    if (connect(_socket, (sockaddr*)&addr, addr_len) < 0 || !SendAll(_socket, &hello, sizeof(hello)))
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------
+bool EnsembleClient::Send(const AccEngine::Sample* samples, int samples_num)
+{
+    if (_socket < 0)
+        return false;
+
+    if (SendAll(_socket, samples, samples_num * sizeof(AccEngine::Sample)))
+        return true;
+
+    Close();
+    return false;
+}
+
+//-----------------------------------------------------------------------
+void EnsembleClient::Close()
+{
+    if (_socket >= 0)
+        close(_socket);
+    _socket = -1;
+}
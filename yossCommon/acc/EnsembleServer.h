@@ -0,0 +1,149 @@
+#pragma once
+
+#include "../common/Math.h"
+#include "../structs/ListenerRegistry.h"
+#include "AccEngine.h"
+#include "BeatDetectionParams.h"
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace yoss
+{
+    //-----------------------------------------------------------------------
+    // Structs and classes:
+    struct EnsembleHello;
+    class EnsembleServer;
+    class EnsembleClient;
+    //-----------------------------------------------------------------------
+
+    //-----------------------------------------------------------------------
+    // Constants:
+    const uint32_t   ENSEMBLE_MAGIC = 0x534E4559; // "YENS"
+    const uint32_t   ENSEMBLE_VERSION = 1;
+    const int        ENSEMBLE_MAX_STREAMS = 8; // Connections over this are refused
+    const int        ENSEMBLE_RECEIVE_BUFFER_SAMPLES = 64; // Samples read from a stream at once
+    const math::Time ENSEMBLE_HELLO_TIMEOUT = 2.0; // [sec] Streams that don't introduce themselves in time are closed
+    const math::Time ENSEMBLE_POLL_INTERVAL = 0.1; // [sec] How often blocked threads check whether the server stops
+    //-----------------------------------------------------------------------
+
+
+    //-----------------------------------------------------------------------
+    // Sent by a client right after connecting, followed by AccEngine::Sample records till it disconnects.
+    // Both are sent in the host's byte order, since the sockets are local only.
+    struct EnsembleHello
+    {
+        uint32_t magic = ENSEMBLE_MAGIC;
+        uint32_t version = ENSEMBLE_VERSION;
+        int32_t  performerId = 0;
+        uint32_t reserved = 0;
+    };
+
+    //-----------------------------------------------------------------------
+    // Ingests timestamped sensor streams of several performers over a Unix domain or localhost TCP socket.
+    // Addresses are "unix:<path>" or "tcp:<port>" (port 0 = any free one, see GetPort()).
+    // Each connection is one performer's stream with its own AccEngine (and so its own trajectories), processed
+    // on its own thread. A stream's timestamps may be of any clock, samples that don't advance them are dropped,
+    // and a stream sending non-finite values is closed. Memory of a stream is bounded: samples are read in chunks of ENSEMBLE_RECEIVE_BUFFER_SAMPLES
+    // and the engine keeps only circular buffers. Beats are added to the instrument assigned to the performer
+    // and passed to beat listeners, both on the stream's thread.
+    class EnsembleServer
+    {
+    public:
+        struct Beat
+        {
+            int             performerId;
+            math::Time      timestamp; // Of the sample the beat was detected at, in the client's clock
+            math::PartOfOne normalizedFreq;
+            math::Coo       amplitude;
+            sound::BeatDynamics dynamics;
+        };
+        struct StreamStats
+        {
+            int  performerId;
+            bool isConnected;
+            int  samplesNum;
+            int  droppedNum; // Samples that didn't advance the stream's clock
+            int  beatsNum;
+        };
+        typedef std::function<void (const Beat& beat)> BeatListener;
+        typedef ListenerRegistry<const Beat&>::Token   ListenerToken;
+
+        EnsembleServer(const BeatDetectionParams& params = BeatDetectionParams());
+        ~EnsembleServer();
+
+        bool Start(const std::string& address); // False if the address can't be listened on
+        void Stop(); // Closes all streams and waits for their threads
+        bool IsRunning() const { return _isRunning; }
+        int  GetPort() const { return _port; } // Of a TCP server, once started
+
+        // Instrument may be shared by performers; once unassigned (nullptr) it's not called by the server anymore
+        void AssignInstrument(int performer_id, sound::Instrument* instrument);
+
+        ListenerToken AddBeatListener(BeatListener listener) { return _beatListeners.Add(listener); }
+        bool          RemoveBeatListener(ListenerToken token) { return _beatListeners.Remove(token); }
+
+        std::vector<StreamStats> GetStreamStats(); // Of connected streams and of those that disconnected since start
+        int GetRefusedNum() const { return _refusedNum; }
+
+    private:
+        struct Stream
+        {
+            int                        socket;
+            int                        performerId; // -1 till the hello is received; guarded by _streamsMutex
+            std::unique_ptr<AccEngine> accEngine;
+            std::thread                thread;
+            std::atomic<bool>          isFinished {false};
+            std::atomic<int>           samplesNum {0};
+            std::atomic<int>           droppedNum {0};
+            std::atomic<int>           beatsNum {0};
+        };
+
+        void RunAccepting();
+        void RunStream(Stream* stream);
+        bool ReceiveHello(Stream* stream);
+        void OnStreamBeat(Stream* stream);
+        void JoinFinishedStreams(bool join_all);
+
+        BeatDetectionParams _params;
+        std::string         _unixPath; // To be removed on stop
+        int                 _listenSocket;
+        int                 _port;
+        std::thread         _acceptThread;
+        std::atomic<bool>   _isRunning;
+        std::atomic<int>    _refusedNum;
+
+        std::vector<std::unique_ptr<Stream>> _streams;
+        std::vector<StreamStats>             _finishedStreamStats;
+        std::mutex                           _streamsMutex;
+
+        std::map<int, sound::Instrument*> _instruments; // By performer
+        std::mutex                        _instrumentsMutex; // Also held while a beat is added to an instrument
+
+        ListenerRegistry<const Beat&> _beatListeners;
+    };
+
+    //-----------------------------------------------------------------------
+    // Sends one performer's samples to an EnsembleServer, e.g. from a bridge of a remote sensor or a test client
+    class EnsembleClient
+    {
+    public:
+        EnsembleClient() : _socket(-1) {}
+        ~EnsembleClient() { Close(); }
+
+        bool Connect(const std::string& address, int performer_id);
+        bool Send(const AccEngine::Sample* samples, int samples_num); // Blocks till sent, false if the connection is lost
+        void Close();
+        bool IsConnected() const { return _socket >= 0; }
+
+    private:
+        int _socket;
+    };
+
+}
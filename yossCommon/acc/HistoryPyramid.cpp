@@ -0,0 +1,159 @@
+#include "HistoryPyramid.h"
+#include "../common/Log.h"
+
+using namespace std;
+using namespace yoss::math;
+using namespace yoss::trajectories;
+
+
+//-----------------------------------------------------------------------
+//-----------------------------------------------------------------------
+// struct HistoryBin
+//-----------------------------------------------------------------------
+Vector3D HistoryBin::GetMean() const
+{
+    ASSERT(!IsEmpty());
+    return sum * (1.0 / samplesNum);
+}
+
+//-----------------------------------------------------------------------
+void HistoryBin::Add(const Vector3D& value, Time timestamp)
+{
+    if (IsEmpty())
+    {
+        min = max = sum = value;
+        samplesNum = 1;
+        startTimestamp = endTimestamp = timestamp;
+        return;
+    }
+
+    min = Vector3D(MIN(min.x, value.x), MIN(min.y, value.y), MIN(min.z, value.z));
+    max = Vector3D(MAX(max.x, value.x), MAX(max.y, value.y), MAX(max.z, value.z));
+    sum = sum + value;
+    samplesNum++;
+    endTimestamp = timestamp;
+}
+
+//-----------------------------------------------------------------------
+void HistoryBin::Add(const HistoryBin& bin)
+{
+    if (bin.IsEmpty()) return;
+    if (IsEmpty())
+    {
+        *this = bin;
+        return;
+    }
+
+    min = Vector3D(MIN(min.x, bin.min.x), MIN(min.y, bin.min.y), MIN(min.z, bin.min.z));
+    max = Vector3D(MAX(max.x, bin.max.x), MAX(max.y, bin.max.y), MAX(max.z, bin.max.z));
+    sum = sum + bin.sum;
+    samplesNum += bin.samplesNum;
+    startTimestamp = MIN(startTimestamp, bin.startTimestamp);
+    endTimestamp = MAX(endTimestamp, bin.endTimestamp);
+}
+
+
+//-----------------------------------------------------------------------
+//-----------------------------------------------------------------------
+// class HistoryPyramid
+//-----------------------------------------------------------------------
+HistoryPyramid::HistoryPyramid(int levels_num, int bins_num) :
+    _binsNum(bins_num),
+    _pendingBins(levels_num),
+    _pendingBinsNum(levels_num, 0)
+{
+    ASSERT(levels_num > 0 && bins_num > 0);
+    for (int level = 0; level < levels_num; level++)
+        _levels.emplace_back(new CircularBuffer<HistoryBin>(bins_num, false));
+}
+
+//-----------------------------------------------------------------------
+void HistoryPyramid::Push(const Vector3D& value, Time timestamp)
+{
+    HistoryBin bin;
+    bin.Add(value, timestamp);
+    _levels[0]->Push(bin);
+
+    // A completed bin carries on to the next level while it completes one there too
+    for (int level = 1; level < GetLevelsNum(); level++)
+    {
+        _pendingBins[level].Add(bin);
+        if (++_pendingBinsNum[level] < HISTORY_PYRAMID_LEVEL_FACTOR)
+            break;
+
+        bin = _pendingBins[level];
+        _levels[level]->Push(bin);
+        _pendingBins[level] = HistoryBin();
+        _pendingBinsNum[level] = 0;
+    }
+}
+
+//-----------------------------------------------------------------------
+void HistoryPyramid::Clear()
+{
+    for (int level = 0; level < GetLevelsNum(); level++)
+    {
+        _levels[level].reset(new CircularBuffer<HistoryBin>(_binsNum, false));
+        _pendingBins[level] = HistoryBin();
+        _pendingBinsNum[level] = 0;
+    }
+}
+
+//-----------------------------------------------------------------------
+int HistoryPyramid::GetSamplesPerBin(int level) const
+{
+    ASSERT(level >= 0 && level < GetLevelsNum());
+    int samples_per_bin = 1;
+    for (int i = 0; i < level; i++)
+        samples_per_bin *= HISTORY_PYRAMID_LEVEL_FACTOR;
+    return samples_per_bin;
+}
+
+//-----------------------------------------------------------------------
+const CircularBuffer<HistoryBin>& HistoryPyramid::GetLevel(int level) const
+{
+    ASSERT(level >= 0 && level < GetLevelsNum());
+    return *_levels[level];
+}
+
+//-----------------------------------------------------------------------
+// Samples past the level's last bin are in the pending bins of it and of every finer level
+HistoryBin HistoryPyramid::GetPendingBin(int level) const
+{
+    ASSERT(level >= 0 && level < GetLevelsNum());
+    HistoryBin pending_bin;
+    for (int i = 1; i <= level; i++)
+        pending_bin.Add(_pendingBins[i]);
+    return pending_bin;
+}
+
+//-----------------------------------------------------------------------
+int HistoryPyramid::ChooseLevel(int samples_num, int max_bins) const
+{
+    ASSERT(max_bins > 0);
+    int level = 0;
+    int samples_per_bin = 1;
+    while (level < GetLevelsNum() - 1 && (samples_num + samples_per_bin - 1) / samples_per_bin > max_bins)
+    {
+        level++;
+        samples_per_bin *= HISTORY_PYRAMID_LEVEL_FACTOR;
+    }
+    return level;
+}
+
+//-----------------------------------------------------------------------
+HistoryBin HistoryPyramid::Summarize(int samples_num) const
+{
+    int level = ChooseLevel(samples_num);
+    auto& bins = *_levels[level];
+
+    HistoryBin summary = GetPendingBin(level);
+    for (CircularBuffer<HistoryBin>::BackPos back_pos = 0;
+         summary.samplesNum < samples_num && bins.IsBackPosOccupied(back_pos);
+         back_pos++)
+    {
+        summary.Add(bins.Get(back_pos));
+    }
+
+    return summary;
+}
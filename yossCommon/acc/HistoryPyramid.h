@@ -0,0 +1,89 @@
+#pragma once
+
+#include "../common/Math.h"
+#include "../structs/CircularBuffer.h"
+
+#include <memory>
+#include <vector>
+
+namespace yoss
+{
+    namespace trajectories
+    {
+        using yoss::CircularBuffer;
+        using yoss::math::Vector3D;
+        using yoss::math::Time;
+
+        //-----------------------------------------------------------------------
+        // Structs and classes:
+        struct HistoryBin;
+        class HistoryPyramid;
+        //-----------------------------------------------------------------------
+
+        //-----------------------------------------------------------------------
+        // Constants:
+        const int HISTORY_PYRAMID_LEVELS_NUM = 4; // Levels of 1, 4, 16 and 64 samples per bin
+        const int HISTORY_PYRAMID_LEVEL_FACTOR = 4; // Bins of a level merged into one bin of the next
+        const int HISTORY_PYRAMID_BINS_NUM = 256; // Per level, so the top one covers 256 * 64 samples (~2.7 min at 100 Hz)
+        const int HISTORY_PYRAMID_MAX_QUERY_BINS = 64; // Summarize() reads the finest level that covers the span in that many bins
+        //-----------------------------------------------------------------------
+
+
+        //-----------------------------------------------------------------------
+        // Min, max and sum of consecutive samples. Default-constructed = empty
+        struct HistoryBin
+        {
+            Vector3D min;
+            Vector3D max;
+            Vector3D sum;
+            int      samplesNum = 0;
+            Time     startTimestamp = 0; // Of the oldest sample
+            Time     endTimestamp = 0; // Of the newest sample
+
+            bool     IsEmpty() const { return samplesNum == 0; }
+            Vector3D GetMean() const;
+
+            void Add(const Vector3D& value, Time timestamp); // Newer than the bin's samples
+            void Add(const HistoryBin& bin); // Either newer or older than the bin's samples
+        };
+
+        //-----------------------------------------------------------------------
+        // Downsampled history of a series of vectors: level i keeps the last bins_num bins of LEVEL_FACTOR^i samples each.
+        // Pushing is O(1) amortized and O(levels_num) at worst, as only the bin of each level in progress is updated,
+        // and a completed one is merged into the next level's. Meant for views and queries over seconds or minutes,
+        // which read the level of their resolution in bounded time instead of walking the raw samples.
+        class HistoryPyramid
+        {
+        public:
+            HistoryPyramid(int levels_num = HISTORY_PYRAMID_LEVELS_NUM, int bins_num = HISTORY_PYRAMID_BINS_NUM);
+
+            HistoryPyramid(const HistoryPyramid&) = delete;
+            HistoryPyramid& operator=(const HistoryPyramid&) = delete;
+
+            void Push(const Vector3D& value, Time timestamp);
+            void Clear();
+
+            int GetLevelsNum() const { return (int)_levels.size(); }
+            int GetSamplesPerBin(int level) const;
+
+            // Completed bins of the level, newest at back pos 0
+            const CircularBuffer<HistoryBin>& GetLevel(int level) const;
+
+            // Samples newer than the level's newest completed bin, which are still being merged into its next one
+            HistoryBin GetPendingBin(int level) const;
+
+            // Finest level on which samples_num samples span at most max_bins bins, else the coarsest one
+            int ChooseLevel(int samples_num, int max_bins = HISTORY_PYRAMID_MAX_QUERY_BINS) const;
+
+            // Of the last samples_num samples, in whole bins of ChooseLevel(samples_num): the span is extended back
+            // to a bin boundary, by less than one bin of that level. Limited by the history kept on that level
+            HistoryBin Summarize(int samples_num) const;
+
+        protected:
+            int _binsNum;
+            std::vector<std::unique_ptr<CircularBuffer<HistoryBin>>> _levels;
+            std::vector<HistoryBin> _pendingBins; // Per level, the bins of the finer level merged so far (none on level 0)
+            std::vector<int>        _pendingBinsNum;
+        };
+    }
+}
@@ -0,0 +1,227 @@
+#include "OrientationEstimator.h"
+
+using namespace yoss;
+using namespace yoss::math;
+
+
+//-----------------------------------------------------------------------
+// Static defines, consts and vars
+
+//-----------------------------------------------------------------------
+static inline double InvSqrt(double x)
+{
+    return 1.0 / sqrt(x);
+}
+
+//-----------------------------------------------------------------------
+
+
+//-----------------------------------------------------------------------
+OrientationEstimator::OrientationEstimator(double gain) :
+    _gain(gain),
+    _useMagnetometer(false)
+{
+    Reset();
+}
+
+//-----------------------------------------------------------------------
+void OrientationEstimator::Reset()
+{
+    _isInitialized = false;
+    _initializedDuration = 0;
+    _q = Quaternion();
+    _gravity = Vector3D(0, 0, -1);
+    _linearAcc = Vector3D(0, 0, 0);
+}
+
+//-----------------------------------------------------------------------
+void OrientationEstimator::Update(const Vector3D& acc, const Vector3D& gyro, const Vector3D& mag, Time dt)
+{
+    // Filter works with the reaction to gravity (pointing up), fed acc points down
+    double ax = -acc.x, ay = -acc.y, az = -acc.z;
+    bool acc_is_valid = (ax != 0 || ay != 0 || az != 0);
+
+    if (!_isInitialized)
+    {
+        if (!acc_is_valid)
+            return;
+
+        InitFromAcc(ax, ay, az);
+        UpdateGravity(acc);
+        return;
+    }
+
+    dt = CLAMP(dt, 0.0, ORIENTATION_MAX_DT);
+    _initializedDuration += dt;
+
+    bool mag_is_valid = (mag.x != 0 || mag.y != 0 || mag.z != 0);
+    if (!acc_is_valid)
+    {
+        // Only integrate the gyro
+        UpdateIMU(gyro.x, gyro.y, gyro.z, 0, 0, 0, dt);
+    }
+    else if (_useMagnetometer && mag_is_valid)
+    {
+        UpdateMARG(gyro.x, gyro.y, gyro.z, ax, ay, az, mag.x, mag.y, mag.z, dt);
+    }
+    else
+    {
+        UpdateIMU(gyro.x, gyro.y, gyro.z, ax, ay, az, dt);
+    }
+
+    UpdateGravity(acc);
+}
+
+//-----------------------------------------------------------------------
+// Roll and pitch from the up vector, yaw = 0
+void OrientationEstimator::InitFromAcc(double ax, double ay, double az)
+{
+    double roll = atan2(ay, az);
+    double pitch = atan2(-ax, sqrt(ay * ay + az * az));
+
+    double cr = cos(roll * 0.5), sr = sin(roll * 0.5);
+    double cp = cos(pitch * 0.5), sp = sin(pitch * 0.5);
+
+    _q.w = cr * cp;
+    _q.x = sr * cp;
+    _q.y = cr * sp;
+    _q.z = -sr * sp;
+    _isInitialized = true;
+}
+
+//-----------------------------------------------------------------------
+// Gyro integration corrected by a gradient descent step towards the measured up vector
+void OrientationEstimator::UpdateIMU(double gx, double gy, double gz, double ax, double ay, double az, Time dt)
+{
+    double q0 = _q.w, q1 = _q.x, q2 = _q.y, q3 = _q.z;
+    double gain = GetCurrentGain();
+
+    double q_dot0 = 0.5 * (-q1 * gx - q2 * gy - q3 * gz);
+    double q_dot1 = 0.5 * (q0 * gx + q2 * gz - q3 * gy);
+    double q_dot2 = 0.5 * (q0 * gy - q1 * gz + q3 * gx);
+    double q_dot3 = 0.5 * (q0 * gz + q1 * gy - q2 * gx);
+
+    if (ax != 0 || ay != 0 || az != 0)
+    {
+        double norm = InvSqrt(ax * ax + ay * ay + az * az);
+        ax *= norm; ay *= norm; az *= norm;
+
+        double _2q0 = 2.0 * q0, _2q1 = 2.0 * q1, _2q2 = 2.0 * q2, _2q3 = 2.0 * q3;
+        double _4q0 = 4.0 * q0, _4q1 = 4.0 * q1, _4q2 = 4.0 * q2;
+        double _8q1 = 8.0 * q1, _8q2 = 8.0 * q2;
+        double q0q0 = q0 * q0, q1q1 = q1 * q1, q2q2 = q2 * q2, q3q3 = q3 * q3;
+
+        double s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+        double s1 = _4q1 * q3q3 - _2q3 * ax + 4.0 * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+        double s2 = 4.0 * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+        double s3 = 4.0 * q1q1 * q3 - _2q1 * ax + 4.0 * q2q2 * q3 - _2q2 * ay;
+
+        double s_size_sq = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+        if (s_size_sq > 0)
+        {
+            norm = InvSqrt(s_size_sq);
+            q_dot0 -= gain * s0 * norm;
+            q_dot1 -= gain * s1 * norm;
+            q_dot2 -= gain * s2 * norm;
+            q_dot3 -= gain * s3 * norm;
+        }
+    }
+
+    q0 += q_dot0 * dt;
+    q1 += q_dot1 * dt;
+    q2 += q_dot2 * dt;
+    q3 += q_dot3 * dt;
+
+    double norm = InvSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+    _q.w = q0 * norm;
+    _q.x = q1 * norm;
+    _q.y = q2 * norm;
+    _q.z = q3 * norm;
+}
+
+//-----------------------------------------------------------------------
+// As UpdateIMU(), with the gradient also including the direction of the earth's magnetic field
+void OrientationEstimator::UpdateMARG(double gx, double gy, double gz, double ax, double ay, double az, double mx, double my, double mz, Time dt)
+{
+    double q0 = _q.w, q1 = _q.x, q2 = _q.y, q3 = _q.z;
+    double gain = GetCurrentGain();
+
+    double q_dot0 = 0.5 * (-q1 * gx - q2 * gy - q3 * gz);
+    double q_dot1 = 0.5 * (q0 * gx + q2 * gz - q3 * gy);
+    double q_dot2 = 0.5 * (q0 * gy - q1 * gz + q3 * gx);
+    double q_dot3 = 0.5 * (q0 * gz + q1 * gy - q2 * gx);
+
+    double norm = InvSqrt(ax * ax + ay * ay + az * az);
+    ax *= norm; ay *= norm; az *= norm;
+    norm = InvSqrt(mx * mx + my * my + mz * mz);
+    mx *= norm; my *= norm; mz *= norm;
+
+    double _2q0mx = 2.0 * q0 * mx, _2q0my = 2.0 * q0 * my, _2q0mz = 2.0 * q0 * mz, _2q1mx = 2.0 * q1 * mx;
+    double _2q0 = 2.0 * q0, _2q1 = 2.0 * q1, _2q2 = 2.0 * q2, _2q3 = 2.0 * q3;
+    double _2q0q2 = 2.0 * q0 * q2, _2q2q3 = 2.0 * q2 * q3;
+    double q0q0 = q0 * q0, q0q1 = q0 * q1, q0q2 = q0 * q2, q0q3 = q0 * q3;
+    double q1q1 = q1 * q1, q1q2 = q1 * q2, q1q3 = q1 * q3;
+    double q2q2 = q2 * q2, q2q3 = q2 * q3, q3q3 = q3 * q3;
+
+    // Reference direction of the earth's magnetic field (horizontal _2bx, vertical _2bz)
+    double hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 + _2q1 * mz * q3 - mx * q2q2 - mx * q3q3;
+    double hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
+    double _2bx = sqrt(hx * hx + hy * hy);
+    double _2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
+    double _4bx = 2.0 * _2bx, _4bz = 2.0 * _2bz;
+
+    double f_ax = 2.0 * q1q3 - _2q0q2 - ax;
+    double f_ay = 2.0 * q0q1 + _2q2q3 - ay;
+    double f_az = 1.0 - 2.0 * q1q1 - 2.0 * q2q2 - az;
+    double f_mx = _2bx * (0.5 - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx;
+    double f_my = _2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my;
+    double f_mz = _2bx * (q0q2 + q1q3) + _2bz * (0.5 - q1q1 - q2q2) - mz;
+
+    double s0 = -_2q2 * f_ax + _2q1 * f_ay - _2bz * q2 * f_mx + (-_2bx * q3 + _2bz * q1) * f_my + _2bx * q2 * f_mz;
+    double s1 = _2q3 * f_ax + _2q0 * f_ay - 2.0 * _2q1 * f_az + _2bz * q3 * f_mx + (_2bx * q2 + _2bz * q0) * f_my + (_2bx * q3 - _4bz * q1) * f_mz;
+    double s2 = -_2q0 * f_ax + _2q3 * f_ay - 2.0 * _2q2 * f_az + (-_4bx * q2 - _2bz * q0) * f_mx + (_2bx * q1 + _2bz * q3) * f_my + (_2bx * q0 - _4bz * q2) * f_mz;
+    double s3 = _2q1 * f_ax + _2q2 * f_ay + (-_4bx * q3 + _2bz * q1) * f_mx + (-_2bx * q0 + _2bz * q2) * f_my + _2bx * q1 * f_mz;
+
+    double s_size_sq = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+    if (s_size_sq > 0)
+    {
+        norm = InvSqrt(s_size_sq);
+        q_dot0 -= gain * s0 * norm;
+        q_dot1 -= gain * s1 * norm;
+        q_dot2 -= gain * s2 * norm;
+        q_dot3 -= gain * s3 * norm;
+    }
+
+    q0 += q_dot0 * dt;
+    q1 += q_dot1 * dt;
+    q2 += q_dot2 * dt;
+    q3 += q_dot3 * dt;
+
+    norm = InvSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+    _q.w = q0 * norm;
+    _q.x = q1 * norm;
+    _q.y = q2 * norm;
+    _q.z = q3 * norm;
+}
+
+//-----------------------------------------------------------------------
+double OrientationEstimator::GetCurrentGain() const
+{
+    if (_initializedDuration >= ORIENTATION_INIT_DURATION)
+        return _gain;
+
+    PartOfOne init_part = _initializedDuration / ORIENTATION_INIT_DURATION;
+    return ORIENTATION_INIT_GAIN + (_gain - ORIENTATION_INIT_GAIN) * init_part;
+}
+
+//-----------------------------------------------------------------------
+void OrientationEstimator::UpdateGravity(const Vector3D& acc)
+{
+    double q0 = _q.w, q1 = _q.x, q2 = _q.y, q3 = _q.z;
+
+    // Up direction in device frame, negated to the convention of fed acc
+    _gravity = Vector3D(-2.0 * (q1 * q3 - q0 * q2),
+                        -2.0 * (q0 * q1 + q2 * q3),
+                        -(q0 * q0 - q1 * q1 - q2 * q2 + q3 * q3));
+    _linearAcc = acc - _gravity;
+}
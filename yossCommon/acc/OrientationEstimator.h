@@ -0,0 +1,63 @@
+#pragma once
+
+#include "../common/Math.h"
+
+namespace yoss
+{
+    //-----------------------------------------------------------------------
+    // Structs and classes:
+    class OrientationEstimator;
+    //-----------------------------------------------------------------------
+
+    //-----------------------------------------------------------------------
+    // Constants:
+    const double ORIENTATION_DEFAULT_GAIN = 0.1; // Madgwick's beta: how fast the acc (and mag) pull back the gyro-integrated orientation
+    const math::Time ORIENTATION_MAX_DT = 0.1; // [sec] Longer gaps between samples (e.g. after a suspend) are integrated as this
+    const double ORIENTATION_INIT_GAIN = 10; // Gain right after initialization, ramped down to the set gain...
+    const math::Time ORIENTATION_INIT_DURATION = 3; // [sec] ...over this, as the first sample may have been taken in motion
+    //-----------------------------------------------------------------------
+
+
+    //-----------------------------------------------------------------------
+    // Madgwick-style fusion of the gyro, accelerometer and (optionally) magnetometer samples fed to AccEngine.
+    // Constant cost per sample, no history and no system dependencies, so it can be run headlessly over recorded logs.
+    // Acc is in [g] as fed by the device (pointing along gravity, i.e. (0, 0, -1) when lying face up), gyro is in [rad/sec].
+    class OrientationEstimator
+    {
+    public:
+        // Rotation of the earth frame relative to the device frame
+        struct Quaternion
+        {
+            double w = 1, x = 0, y = 0, z = 0;
+        };
+
+        OrientationEstimator(double gain = ORIENTATION_DEFAULT_GAIN);
+
+        void Reset();
+        void SetGain(double gain) { _gain = gain; }
+        void SetUseMagnetometer(bool use) { _useMagnetometer = use; } // Off by default: only pitch and roll are corrected, yaw drifts with the gyro
+
+        void Update(const math::Vector3D& acc, const math::Vector3D& gyro, const math::Vector3D& mag, math::Time dt);
+
+        bool                  IsInitialized() const { return _isInitialized; }
+        const Quaternion&     GetQuaternion() const { return _q; }
+        const math::Vector3D& GetGravity() const { return _gravity; } // [g] In device frame, same direction convention as acc
+        const math::Vector3D& GetLinearAcc() const { return _linearAcc; } // [g] acc without gravity
+
+    protected:
+        void InitFromAcc(double ax, double ay, double az);
+        void UpdateIMU(double gx, double gy, double gz, double ax, double ay, double az, math::Time dt);
+        void UpdateMARG(double gx, double gy, double gz, double ax, double ay, double az, double mx, double my, double mz, math::Time dt);
+        void UpdateGravity(const math::Vector3D& acc);
+        double GetCurrentGain() const;
+
+        double     _gain;
+        bool       _useMagnetometer;
+        bool       _isInitialized;
+        math::Time _initializedDuration;
+        Quaternion _q;
+        math::Vector3D _gravity;
+        math::Vector3D _linearAcc;
+    };
+
+}
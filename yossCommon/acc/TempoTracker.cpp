@@ -0,0 +1,159 @@
+#include "TempoTracker.h"
+
+using namespace yoss;
+using namespace yoss::math;
+
+
+//-----------------------------------------------------------------------
+TempoTracker::TempoTracker()
+{
+    Reset();
+}
+
+//-----------------------------------------------------------------------
+void TempoTracker::Reset()
+{
+    _hasLastBeat = false;
+    _lastBeatTimestamp = 0;
+    _period = 0;
+    _gridTimestamp = 0;
+    _smoothedSqError = 0;
+    _fittingBeatsNum = 0;
+    _outliersNum = 0;
+    _halfPeriodBeatsNum = 0;
+    _doublePeriodBeatsNum = 0;
+    _confidence = 0;
+}
+
+//-----------------------------------------------------------------------
+void TempoTracker::AddBeat(Time timestamp)
+{
+    Time interval = timestamp - _lastBeatTimestamp;
+    bool is_first_beat = !_hasLastBeat;
+    _hasLastBeat = true;
+    _lastBeatTimestamp = timestamp;
+
+    if (is_first_beat || interval <= 0)
+        return;
+
+    if (!IsLocked())
+    {
+        Relock(interval);
+        return;
+    }
+
+    // Onsets in a row at half the period fit every other beat of the grid, but are its tempo, e.g. once the tracker
+    // has locked to every other beat after a missing onset. A grace beat makes two such intervals, a few in a row more
+    Ratio half_periods_num = interval / (_period / 2);
+    if (ABS(half_periods_num - 1) <= TEMPO_MAX_PHASE_ERROR && _period / 2 >= TEMPO_MIN_PERIOD)
+        _halfPeriodBeatsNum++;
+    else
+        _halfPeriodBeatsNum = 0;
+
+    if (_halfPeriodBeatsNum >= TEMPO_HALF_PERIOD_BEATS)
+    {
+        _period /= 2;
+        _gridTimestamp = timestamp;
+        _halfPeriodBeatsNum = 0;
+        _doublePeriodBeatsNum = 0;
+        _outliersNum = 0;
+        UpdateConfidence();
+        return;
+    }
+
+    // Onset relative to the nearest beat on the grid, which is at the last fitting onset
+    Ratio beats_from_grid = (timestamp - _gridTimestamp) / _period;
+    Ratio beats_num = round(beats_from_grid);
+    Ratio phase_error = beats_from_grid - beats_num;
+
+    if (ABS(phase_error) > TEMPO_MAX_PHASE_ERROR || beats_num < 1 || beats_num > 1 + TEMPO_MAX_SKIPPED_BEATS)
+    {
+        // A single off-grid onset (e.g. a false or a grace beat) only lowers confidence
+        if (++_outliersNum > TEMPO_MAX_OUTLIERS)
+            Relock(interval);
+        else
+        {
+            _fittingBeatsNum /= 2;
+            UpdateConfidence();
+        }
+        return;
+    }
+    _outliersNum = 0;
+
+    // Phase-locked loop: move the grid towards the onset and correct the period by the error per beat
+    Time error = phase_error * _period;
+    _gridTimestamp = _gridTimestamp + beats_num * _period + TEMPO_PHASE_GAIN * error;
+    _period += TEMPO_PERIOD_GAIN * error / beats_num;
+    _period = CLAMP(_period, TEMPO_MIN_PERIOD, TEMPO_MAX_PERIOD);
+
+    // Onsets in a row on every other beat of the grid mean it's twice their tempo, e.g. once the tracker has locked
+    // to a grace beat and the beat after it
+    _doublePeriodBeatsNum = (beats_num == 2 ? _doublePeriodBeatsNum + 1 : 0);
+    if (_doublePeriodBeatsNum >= TEMPO_DOUBLE_PERIOD_BEATS && _period * 2 <= TEMPO_MAX_PERIOD)
+    {
+        _period *= 2;
+        _doublePeriodBeatsNum = 0;
+        _halfPeriodBeatsNum = 0;
+    }
+
+    _smoothedSqError += TEMPO_ERROR_SMOOTHING * (phase_error * phase_error - _smoothedSqError);
+    _fittingBeatsNum = MIN(_fittingBeatsNum + 1, TEMPO_MIN_FITTING_BEATS);
+    UpdateConfidence();
+}
+
+//-----------------------------------------------------------------------
+// Starts following a new tempo from the last interval, if it's a plausible period
+void TempoTracker::Relock(Time interval)
+{
+    _fittingBeatsNum = 0;
+    _outliersNum = 0;
+    _halfPeriodBeatsNum = 0;
+    _doublePeriodBeatsNum = 0;
+    _smoothedSqError = TEMPO_CONFIDENCE_ERROR * TEMPO_CONFIDENCE_ERROR;
+
+    if (interval >= TEMPO_MIN_PERIOD && interval <= TEMPO_MAX_PERIOD)
+    {
+        _period = interval;
+        _gridTimestamp = _lastBeatTimestamp;
+    }
+    else
+    {
+        _period = 0;
+    }
+
+    UpdateConfidence();
+}
+
+//-----------------------------------------------------------------------
+void TempoTracker::UpdateConfidence()
+{
+    if (!IsLocked())
+    {
+        _confidence = 0;
+        return;
+    }
+
+    PartOfOne fitting_part = (double)_fittingBeatsNum / TEMPO_MIN_FITTING_BEATS;
+    Ratio error = sqrt(_smoothedSqError) / TEMPO_CONFIDENCE_ERROR;
+    _confidence = fitting_part * exp(-error * error);
+}
+
+//-----------------------------------------------------------------------
+Time TempoTracker::GetNextBeatTime(Time timestamp) const
+{
+    if (!IsLocked())
+        return 0;
+
+    Ratio beats_num = floor((timestamp - _gridTimestamp) / _period) + 1;
+    return _gridTimestamp + beats_num * _period;
+}
+
+//-----------------------------------------------------------------------
+Time TempoTracker::Quantize(Time timestamp, PartOfOne min_confidence) const
+{
+    if (!IsLocked() || _confidence < min_confidence)
+        return timestamp;
+
+    Ratio beats_num = round((timestamp - _gridTimestamp) / _period);
+    return _gridTimestamp + beats_num * _period;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "../common/Math.h"
+
+namespace yoss
+{
+    //-----------------------------------------------------------------------
+    // Structs and classes:
+    class TempoTracker;
+    //-----------------------------------------------------------------------
+
+    //-----------------------------------------------------------------------
+    // Constants:
+    const math::Time  TEMPO_MIN_PERIOD = 0.2; // [sec] 300 bpm
+    const math::Time  TEMPO_MAX_PERIOD = 1.5; // [sec] 40 bpm
+    const int         TEMPO_MAX_SKIPPED_BEATS = 3; // Max num of missing beats between two onsets that still fit the tempo
+    const int         TEMPO_MAX_OUTLIERS = 1; // Num of off-grid onsets in a row that are ignored before following a new tempo
+    const int         TEMPO_HALF_PERIOD_BEATS = 6; // Num of onsets in a row at half the period after which it's halved (more than grace beats make)
+    const int         TEMPO_DOUBLE_PERIOD_BEATS = 4; // Num of onsets in a row on every other beat after which the period is doubled
+    const math::Ratio TEMPO_MAX_PHASE_ERROR = 0.25; // Part of period an onset may deviate from the grid and still fit the tempo
+    const math::Ratio TEMPO_PERIOD_GAIN = 0.25; // How much of the period error of a fitting onset is corrected
+    const math::Ratio TEMPO_PHASE_GAIN = 0.5; // How much of the phase error of a fitting onset is corrected
+    const math::Ratio TEMPO_ERROR_SMOOTHING = 0.2; // Weight of the last onset in the smoothed squared phase error
+    const math::Ratio TEMPO_CONFIDENCE_ERROR = 0.08; // Smoothed phase error (part of period) at which confidence drops to ~0.37
+    const int         TEMPO_MIN_FITTING_BEATS = 3; // Num of fitting onsets in a row for full confidence
+    //-----------------------------------------------------------------------
+
+
+    //-----------------------------------------------------------------------
+    // Follows period and phase of onsets with a phase-locked loop, to predict the time of the next beat.
+    // Constant time per onset, no history and no system dependencies, so it can be fed synthetic or recorded onsets.
+    class TempoTracker
+    {
+    public:
+        TempoTracker();
+
+        void Reset();
+        void AddBeat(math::Time timestamp);
+
+        bool       IsLocked() const { return _period > 0; }
+        math::Time GetPeriod() const { return _period; }
+        math::Frequency GetTempo() const { return (_period > 0 ? 60.0 / _period : 0); } // [bpm]
+        math::PartOfOne GetConfidence() const { return _confidence; }
+
+        // Predicted time of the first beat after timestamp, 0 if not locked
+        math::Time GetNextBeatTime(math::Time timestamp) const;
+        // Nearest beat on the grid if confidence is at least min_confidence, timestamp itself otherwise
+        math::Time Quantize(math::Time timestamp, math::PartOfOne min_confidence = 0.5) const;
+
+    protected:
+        void Relock(math::Time interval);
+        void UpdateConfidence();
+
+        bool       _hasLastBeat;
+        math::Time _lastBeatTimestamp;
+        math::Time _period;
+        math::Time _gridTimestamp; // A beat time on the predicted grid
+        math::Ratio _smoothedSqError;
+        int         _fittingBeatsNum;
+        int         _outliersNum;
+        int         _halfPeriodBeatsNum;
+        int         _doublePeriodBeatsNum;
+        math::PartOfOne _confidence;
+    };
+
+}
@@ -8,6 +8,11 @@ using namespace yoss::trajectories;
 #define DEBUG_SEGMENTS(str) //Log::LogText(str, true, 3)
 #define DEBUG_SEG_END_REASON(str_reason) { _debugSegEndReason = str_reason; }
 #define DEBUG_ISMOVINGAGAINST_BACKPOS(past_backpos) { _debugIsMovingAgainstPastBackPos = past_backpos; }
+#ifdef YOSS_DEBUG_TRAJECTORY_PEAKS
+    #define DEBUG_PUSH_PEAK(peaks_vector, timestamp) { peaks_vector.push_back(timestamp); }
+#else
+    #define DEBUG_PUSH_PEAK(peaks_vector, timestamp)
+#endif
 
 //-----------------------------------------------------------------------
 //-----------------------------------------------------------------------
@@ -16,7 +21,8 @@ using namespace yoss::trajectories;
 Point::Point() :
     absPos(Vector3D(0, 0, 0)),
     timestamp(0.0),
-    bufferTimestamp((BufferTimestamp)0)
+    bufferTimestamp((BufferTimestamp)0),
+    isSet(false)
 {
 }
 
@@ -26,7 +32,8 @@ yoss::trajectories::Point::Point(const Vector3D& abs_pos,
              const BufferTimestamp buffer_timestamp) :
     absPos(abs_pos),
     timestamp(timestamp),
-    bufferTimestamp(buffer_timestamp)
+    bufferTimestamp(buffer_timestamp),
+    isSet(true)
 {
 }
 
@@ -50,12 +57,12 @@ Coo yoss::trajectories::Point::GetDistanceTo(const Point& another_point)
 //-----------------------------------------------------------------------
 // struct Segment
 //-----------------------------------------------------------------------
-Segment::Segment(Point* start_point, Point* end_point) :
+Segment::Segment(const Point& start_point, const Point& end_point) :
     type(SegmentType_Undefined),
     startPoint(start_point),
     endPoint(end_point),
-    peakPoint(nullptr),
-    widePeakPoint(nullptr),
+    peakPoint(),
+    widePeakPoint(),
     samplesNum(0),
     detectedGrav(0, 0, 0),
     traveledLength(0),
@@ -70,7 +77,7 @@ Segment::Segment(Point* start_point, Point* end_point) :
 void Segment::MergePrevSegment(Segment* prev_segment)
 {
     ASSERT(prev_segment);
-    ASSERT(prev_segment->endPoint == startPoint);
+    ASSERT(prev_segment->endPoint.bufferTimestamp == startPoint.bufferTimestamp);
     
     startPoint = prev_segment->startPoint;
 }
@@ -79,7 +86,7 @@ void Segment::MergePrevSegment(Segment* prev_segment)
 void Segment::MergeNextSegment(Segment* next_segment)
 {
     ASSERT(next_segment);
-    ASSERT(next_segment->startPoint == endPoint);
+    ASSERT(next_segment->startPoint.bufferTimestamp == endPoint.bufferTimestamp);
     
     endPoint = next_segment->endPoint;
 }
@@ -87,29 +94,29 @@ void Segment::MergeNextSegment(Segment* next_segment)
 //-----------------------------------------------------------------------
 Vector3D Segment::GetDPos()
 {
-    ASSERT(startPoint && endPoint);
-    return (endPoint->absPos - startPoint->absPos);
+    ASSERT(startPoint.IsSet() && endPoint.IsSet());
+    return (endPoint.absPos - startPoint.absPos);
 }
 
 //-----------------------------------------------------------------------
 Time Segment::GetDuration()
 {
-    ASSERT(startPoint && endPoint);
-    return (endPoint->timestamp - startPoint->timestamp);
+    ASSERT(startPoint.IsSet() && endPoint.IsSet());
+    return (endPoint.timestamp - startPoint.timestamp);
 }
 
 //-----------------------------------------------------------------------
 Time Segment::GetDurationToPeak()
 {
-    ASSERT(startPoint && peakPoint);
-    return (peakPoint->timestamp - startPoint->timestamp);
+    ASSERT(startPoint.IsSet() && peakPoint.IsSet());
+    return (peakPoint.timestamp - startPoint.timestamp);
 }
 
 //-----------------------------------------------------------------------
 Time Segment::GetDurationAfterPeak()
 {
-    ASSERT(endPoint && peakPoint);
-    return (endPoint->timestamp - peakPoint->timestamp);
+    ASSERT(endPoint.IsSet() && peakPoint.IsSet());
+    return (endPoint.timestamp - peakPoint.timestamp);
 }
 
 //-----------------------------------------------------------------------
@@ -120,15 +127,15 @@ Velocity Segment::GetAvgVelocitySize()
 }
 
 //-----------------------------------------------------------------------
-bool Segment::ContainsPoint(Point* point, bool include_start_and_end)
+bool Segment::ContainsPoint(const Point& point, bool include_start_and_end)
 {
-    ASSERT(startPoint && endPoint && point);
-    ASSERT(point->timestamp != 0.0);
+    ASSERT(startPoint.IsSet() && endPoint.IsSet());
+    ASSERT(point.IsSet());
     
     if (include_start_and_end)
-        return (point->timestamp >= startPoint->timestamp && point->timestamp <= endPoint->timestamp);
+        return (point.timestamp >= startPoint.timestamp && point.timestamp <= endPoint.timestamp);
     else
-        return (point->timestamp > startPoint->timestamp && point->timestamp < endPoint->timestamp);
+        return (point.timestamp > startPoint.timestamp && point.timestamp < endPoint.timestamp);
 }
 
 
@@ -136,35 +143,49 @@ bool Segment::ContainsPoint(Point* point, bool include_start_and_end)
 //-----------------------------------------------------------------------
 // class Trajectory
 //-----------------------------------------------------------------------
-Trajectory::Trajectory(SegmentDetectionType detection_type) :
+Trajectory::Trajectory(SegmentDetectionType detection_type, int history_size, int segments_num, bool with_pyramid) :
     _detectionType(detection_type),
-    _points(TRAJECTORY_BUFFERS_SIZE * 4, false),
-    _segments(TRAJECTORY_BUFFERS_SIZE, false),
+    _params(),
     _feedsCounter(0),
     _processedFeedsCounter(0),
     _lastFeedTimestamp(0),
+    _isFed(false),
     _segmentJustEnded(false),
-    _timestamps(TRAJECTORY_BUFFERS_SIZE, false),
-    _pos(TRAJECTORY_BUFFERS_SIZE, true),
-    _velocity(TRAJECTORY_BUFFERS_SIZE, true),
-    _acc(TRAJECTORY_BUFFERS_SIZE, true),
+    _timestamps(history_size, false),
+    _pos(history_size, true),
+    _velocity(history_size, true),
+    _acc(history_size, true),
+    _segmentSumsStart(0),
     _debugSegEndReason(""),
     _debugIsMovingAgainstPastBackPos(-33),
     _debugIsMovingAgainstSinceBackPos(-33),
     _isIdlingSince(0),
     _isDriftingSince(0)
 {
-    FeedNewPosition(ZERO_VECTOR, 1.0);
-    FeedNewPosition(ZERO_VECTOR, 2.0);
-    FeedNewPosition(ZERO_VECTOR, 3.0);
+    if (_detectionType != SegmentDetectionType_None)
+    {
+        _segmentSums.reset(new CircularBuffer<SegmentSums>(history_size, false));
+        _localVelocities.reset(new CircularBuffer<Vector3D>(history_size, false));
+        _localVelocitySums.reset(new CircularBuffer<Vector3D>(history_size, false));
+    }
+    if (with_pyramid)
+        _posPyramid.reset(new HistoryPyramid());
     
-    // Create inital Point
-    Point point_zero(ZERO_VECTOR, _timestamps.Get(), GetTimestamp());
-    _points.Push(point_zero);
+    // Seeds are timed relative to 0 till the first position is fed, see StampSeeds()
+    for (int seed_i = 0; seed_i < TRAJECTORY_SEEDS_NUM; seed_i++)
+        PushPosition(ZERO_VECTOR, (seed_i - TRAJECTORY_SEEDS_NUM) * TRAJECTORY_SEED_INTERVAL);
+    
+    if (_detectionType == SegmentDetectionType_None) return;
+    
+    if (segments_num <= 0)
+        segments_num = history_size;
+    _segments.reset(new CircularBuffer<Segment>(segments_num, false));
     
     // Create inital Segment
-    Segment segment_zero(&_points.Get());
-    _segments.Push(segment_zero);
+    Point point_zero(ZERO_VECTOR, _timestamps.Get(), GetTimestamp());
+    Segment segment_zero(point_zero);
+    _segments->Push(segment_zero);
+    RebaseSegmentSums(segment_zero.startPoint.bufferTimestamp);
 }
 
 //-----------------------------------------------------------------------
@@ -175,7 +196,37 @@ Trajectory::~Trajectory()
 //-----------------------------------------------------------------------
 void Trajectory::FeedNewPosition(const Vector3D& new_pos, Time timestamp)
 {
-    Time dt = timestamp - _lastFeedTimestamp;
+    if (!_isFed)
+    {
+        StampSeeds(timestamp);
+        _isFed = true;
+    }
+    
+    PushPosition(new_pos, timestamp);
+    if (_posPyramid)
+        _posPyramid->Push(new_pos, timestamp);
+}
+
+//-----------------------------------------------------------------------
+// Seeds were pushed at times relative to 0, which become relative to the first fed position, whatever clock it's of
+void Trajectory::StampSeeds(Time first_timestamp)
+{
+    for (BufferBackPos back_pos = 0; _timestamps.IsBackPosOccupied(back_pos); back_pos++)
+        _timestamps.Get(back_pos) += first_timestamp;
+    _lastFeedTimestamp += first_timestamp;
+    
+    // Only the initial segment exists, starting at the last seed
+    if (_segments)
+    {
+        ASSERT(_segments->GetOccupiedSize() == 1);
+        _segments->Get().startPoint.timestamp += first_timestamp;
+    }
+}
+
+//-----------------------------------------------------------------------
+void Trajectory::PushPosition(const Vector3D& new_pos, Time timestamp)
+{
+    Time dt = (_timestamps.GetOccupiedSize() > 0 ? timestamp - _lastFeedTimestamp : TRAJECTORY_SEED_INTERVAL);
     if (dt == 0) dt = 0.001;
     ASSERT(dt > 0);
     _lastFeedTimestamp = timestamp;
@@ -192,20 +243,100 @@ void Trajectory::FeedNewPosition(const Vector3D& new_pos, Time timestamp)
     Vector3D acc = (v - prev_v) * (1.0 / dt);
     _acc.Push(acc);
     
+    if (_segmentSums)
+    {
+        _segmentSums->Push(SegmentSums());
+        AccumulateSegmentSums(0);
+    }
+    
+    if (_localVelocities)
+    {
+        _localVelocities->Push(ZERO_VECTOR);
+        _localVelocitySums->Push(ZERO_VECTOR);
+        if (_localVelocities->IsBackPosOccupied(LOCAL_VELOCITY_MAX_SPREAD))
+        {
+            Vector3D local_velocity = CalcLocalVelocity(LOCAL_VELOCITY_MAX_SPREAD);
+            _localVelocities->Get(LOCAL_VELOCITY_MAX_SPREAD) = local_velocity;
+            
+            // Local velocities are differences of positions, so the sums stay in the range of positions over time and don't need rebasing
+            Vector3D prev_sum = (_localVelocitySums->IsBackPosOccupied(LOCAL_VELOCITY_MAX_SPREAD + 1) ?
+                                 _localVelocitySums->Get(LOCAL_VELOCITY_MAX_SPREAD + 1) : ZERO_VECTOR);
+            _localVelocitySums->Get(LOCAL_VELOCITY_MAX_SPREAD) = prev_sum + local_velocity;
+        }
+    }
+    
     _feedsCounter++;
 }
 
 //-----------------------------------------------------------------------
+// Newest segment starting at or before timestamp. Segment starts don't increase with back pos, so binary search
 Segment* Trajectory::GetSegmentAt(BufferTimestamp timestamp)
 {
-    for (BufferBackPos i = 0; i < _segments.GetOccupiedSize(); i++)
+    if (!_segments || _segments->GetOccupiedSize() == 0) return nullptr;
+    
+    BufferBackPos lo = 0;
+    BufferBackPos hi = _segments->GetOccupiedSize() - 1;
+    if (_segments->Get(hi).startPoint.bufferTimestamp > timestamp) return nullptr;
+    
+    // Invariant: segment at hi starts at or before timestamp
+    while (lo < hi)
     {
-        auto& seg = _segments.Get(i);
-        if (seg.startPoint->bufferTimestamp <= timestamp)
-            return &seg;
+        BufferBackPos mid = (lo + hi) / 2;
+        if (_segments->Get(mid).startPoint.bufferTimestamp <= timestamp)
+            hi = mid;
+        else
+            lo = mid + 1;
     }
     
-    return nullptr;
+    return &_segments->Get(hi);
+}
+
+//-----------------------------------------------------------------------
+SegmentKinematics Trajectory::CalcSegmentKinematics(Segment& segment)
+{
+    SegmentKinematics kinematics;
+    if (!segment.startPoint.IsSet() || !segment.peakPoint.IsSet() || !IsPointDataInBuffer(segment.peakPoint))
+        return kinematics;
+
+    BufferBackPos end_when = (segment.IsFinished() ? GetBackPos(segment.endPoint.bufferTimestamp) : 0);
+    if (!IsBackPosInBuffer(end_when))
+        return kinematics;
+
+    kinematics.peakVelocity = _velocity.GetByTimestamp(segment.peakPoint.bufferTimestamp).Size();
+    kinematics.timeToPeak = segment.GetDurationToPeak();
+
+    Time after_peak = _timestamps.Get(end_when) - segment.peakPoint.timestamp;
+    Velocity end_velocity = _velocity.Get(end_when).Size();
+    if (after_peak > 0 && end_velocity < kinematics.peakVelocity)
+        kinematics.deceleration = (kinematics.peakVelocity - end_velocity) / after_peak;
+
+    return kinematics;
+}
+
+//-----------------------------------------------------------------------
+SegmentHandle Trajectory::GetSegmentHandle(BufferBackPos segment_back_pos)
+{
+    ASSERT(_segments && _segments->IsBackPosOccupied(segment_back_pos));
+    
+    SegmentHandle handle;
+    handle.index = _segments->GetTimestamp(segment_back_pos);
+    return handle;
+}
+
+//-----------------------------------------------------------------------
+bool Trajectory::IsSegmentHandleValid(SegmentHandle handle) const
+{
+    return (_segments && !handle.IsNull() &&
+            handle.index <= _segments->GetTimestamp() &&
+            _segments->IsStillInBuffer(handle.index));
+}
+
+//-----------------------------------------------------------------------
+Segment* Trajectory::GetSegment(SegmentHandle handle)
+{
+    if (!IsSegmentHandleValid(handle)) return nullptr;
+    
+    return &_segments->GetByTimestamp(handle.index);
 }
 
 //-----------------------------------------------------------------------
@@ -228,14 +359,14 @@ void Trajectory::Update()
         //const Vector3D current_vel = _velocity.Get(buffer_pos);
         //const Time     current_time = _timestamps.Get(buffer_pos);
 
-        Segment& segment = _segments.Get();
-        //BufferBackPos segment_start_back_pos = GetBackPos(segment.startPoint->bufferTimestamp);
+        Segment& segment = _segments->Get();
+        //BufferBackPos segment_start_back_pos = GetBackPos(segment.startPoint.bufferTimestamp);
         
         bool end_detected = false;
         std::string debug_end_str;
         BufferBackPos end_back_pos = buffer_pos;
         
-        Vector3D seg_vec = current_pos - segment.startPoint->absPos;
+        Vector3D seg_vec = current_pos - segment.startPoint.absPos;
         
         BufferBackPos drifting_start_backpos;
         bool is_drifting = IsDrifting(buffer_pos, &drifting_start_backpos, segment);
@@ -342,23 +473,24 @@ void Trajectory::Update()
         
         if (end_detected)
         {
-            BufferBackPos seg_start_back_pos = GetBackPos(segment.startPoint->bufferTimestamp);
+            BufferBackPos seg_start_back_pos = GetBackPos(segment.startPoint.bufferTimestamp);
             if (end_back_pos > seg_start_back_pos)
                 end_back_pos = seg_start_back_pos;
             
             // Create end Point
-            Point& end_point = PushNewPoint(end_back_pos);
-            segment.endPoint = &end_point;
+            Point end_point = MakePoint(end_back_pos);
+            segment.endPoint = end_point;
             
             //if (end_back_pos != buffer_pos)
-            seg_vec = segment.endPoint->absPos - segment.startPoint->absPos;
+            seg_vec = segment.endPoint.absPos - segment.startPoint.absPos;
             
             // Create next Segment
-            Segment next_segment(&end_point);
-            _segments.Push(next_segment);
+            Segment next_segment(end_point);
+            _segments->Push(next_segment);
             
-            // Calculate ended segment's parameters
+            // Calculate ended segment's parameters, then restart the running sums from the next one
             CalcSegmentParams(segment);
+            RebaseSegmentSums(end_point.bufferTimestamp);
             
             _segmentJustEnded = true;
             
@@ -384,38 +516,78 @@ void Trajectory::Update()
 //-----------------------------------------------------------------------
 void Trajectory::CalcSegmentParams(Segment& segment)
 {
-    segment.samplesNum = 1 + segment.endPoint->bufferTimestamp - segment.startPoint->bufferTimestamp;
+    segment.samplesNum = 1 + segment.endPoint.bufferTimestamp - segment.startPoint.bufferTimestamp;
     double one_div_samples_num = (double)1 / (double)segment.samplesNum;
     
-    segment.avgVelocity = 0;
-    segment.weightCenter *= 0;
-    segment.traveledLength = 0;
+    SegmentSums sums = GetSegmentSums(segment);
+    segment.avgVelocity = sums.velocitySum;
+    segment.weightCenter = sums.posSum;
+    segment.traveledLength = sums.traveledLength;
+    
+    segment.avgVelocity *= one_div_samples_num;
+    segment.weightCenter *= one_div_samples_num;
+    segment.middleOfStartEnd = (segment.startPoint.absPos + segment.endPoint.absPos) * 0.5;
+}
+
+//-----------------------------------------------------------------------
+// Adds sample at when to the sums up to the previous sample, so the additions happen in the same order as in a scan from segment start
+void Trajectory::AccumulateSegmentSums(BufferBackPos when)
+{
+    SegmentSums sums;
+    if (GetTimestamp(when) > _segmentSumsStart && _segmentSums->IsBackPosOccupied(when + 1))
+        sums = _segmentSums->Get(when + 1);
+    
+    sums.velocitySum += _velocity.Get(when);
+    sums.posSum += _pos.Get(when);
+    sums.traveledLength += _pos.GetDiff(when).Size();
+    
+    _segmentSums->Get(when) = sums;
+}
+
+//-----------------------------------------------------------------------
+void Trajectory::RebaseSegmentSums(BufferTimestamp start_timestamp)
+{
+    ASSERT(_segmentSums);
+    _segmentSumsStart = start_timestamp;
     
-    for (auto t = segment.startPoint->bufferTimestamp; t <= segment.endPoint->bufferTimestamp; t++)
+    for (auto t = start_timestamp; t <= GetTimestamp(); t++)
+    {
+        if (!_segmentSums->IsStillInBuffer(t)) continue;
+        AccumulateSegmentSums(GetBackPos(t));
+    }
+}
+
+//-----------------------------------------------------------------------
+SegmentSums Trajectory::GetSegmentSums(Segment& segment)
+{
+    SegmentSums sums;
+    auto start_t = segment.startPoint.bufferTimestamp;
+    auto end_t = segment.endPoint.bufferTimestamp;
+    
+    // Samples of a segment longer than the buffer are not summed at all
+    if (!_pos.IsStillInBuffer(start_t)) return sums;
+    
+    // Running sums hold the diff to the sample before start, which a scan doesn't see once start is the oldest sample
+    bool start_has_prev = _pos.IsBackPosOccupied(GetBackPos(start_t) + 1);
+    if (_segmentSums && start_t == _segmentSumsStart && start_has_prev && _segmentSums->IsStillInBuffer(end_t))
+        return _segmentSums->GetByTimestamp(end_t);
+    
+    // Not the current segment: sum up by scanning
+    for (auto t = start_t; t <= end_t; t++)
     {
-        if (!_pos.IsStillInBuffer(t)) break;
-        
         auto back_t = GetBackPos(t);
-        auto pos = _pos.Get(back_t);
-        auto v = _velocity.Get(back_t);
-        
-        segment.avgVelocity += v;
-        segment.weightCenter += pos;
-        segment.traveledLength += _pos.GetDiff(back_t).Size();
+        sums.velocitySum += _velocity.Get(back_t);
+        sums.posSum += _pos.Get(back_t);
+        sums.traveledLength += _pos.GetDiff(back_t).Size();
     }
     
-    segment.avgVelocity *= one_div_samples_num;
-    segment.weightCenter *= one_div_samples_num;
-    segment.middleOfStartEnd = (segment.startPoint->absPos + segment.endPoint->absPos) * 0.5;
+    return sums;
 }
 
 //-----------------------------------------------------------------------
-Point& Trajectory::PushNewPoint(BufferBackPos when)
+Point Trajectory::MakePoint(BufferBackPos when)
 {
-    Point point(_pos.Get(when), _timestamps.Get(when), GetTimestamp(when));
-    _points.Push(point);
-    
-    return _points.Get();
+    return Point(_pos.Get(when), _timestamps.Get(when), GetTimestamp(when));
 }
 
 //-----------------------------------------------------------------------
@@ -437,9 +609,21 @@ bool Trajectory::IsBackPosInBuffer(BufferBackPos back_pos)
 }
 
 //-----------------------------------------------------------------------
-bool Trajectory::IsPointDataInBuffer(Point* point)
+// At the sample rate over the last SAMPLE_RATE_SPAN samples, as sensors don't deliver at their nominal rate; 0 until there are two
+int Trajectory::GetSamplesNumIn(Time duration)
+{
+    int span = MIN(SAMPLE_RATE_SPAN, _timestamps.GetOccupiedSize() - 1);
+    if (span <= 0)
+        return 0;
+    
+    Time sample_interval = (_timestamps.Get(0) - _timestamps.Get(span)) / span;
+    return (sample_interval > 0 ? (int)round(duration / sample_interval) : 0);
+}
+
+//-----------------------------------------------------------------------
+bool Trajectory::IsPointDataInBuffer(const Point& point)
 {
-    return IsBackPosInBuffer(GetBackPos(point->bufferTimestamp));
+    return IsBackPosInBuffer(GetBackPos(point.bufferTimestamp));
 }
 
 //-----------------------------------------------------------------------
@@ -456,6 +640,39 @@ Vector3D Trajectory::GetWideVelocity(BufferBackPos when)
 
 //-----------------------------------------------------------------------
 Vector3D Trajectory::GetLocalVelocity(BufferBackPos when)
+{
+    // Newer samples don't have all their later neighbours yet, so are not cached
+    if (_localVelocities && when >= LOCAL_VELOCITY_MAX_SPREAD && _localVelocities->IsBackPosOccupied(when))
+        return _localVelocities->Get(when);
+    
+    return CalcLocalVelocity(when);
+}
+
+//-----------------------------------------------------------------------
+// Of the samples from from_when back to to_when, inclusive. O(1): the cached ones from the running sums,
+// and the at most LOCAL_VELOCITY_MAX_SPREAD newer ones, which aren't cached yet, one by one
+Vector3D Trajectory::GetLocalVelocitiesSum(BufferBackPos from_when, BufferBackPos to_when)
+{
+    ASSERT(from_when >= 0 && from_when <= to_when);
+    ASSERT(_localVelocitySums);
+    
+    Vector3D sum = ZERO_VECTOR;
+    for (; from_when < LOCAL_VELOCITY_MAX_SPREAD && from_when <= to_when; from_when++)
+        sum = sum + CalcLocalVelocity(from_when);
+    
+    if (from_when <= to_when)
+    {
+        // The oldest sum in the buffer has no older one to subtract, so the window ends before it
+        to_when = MIN(to_when, _localVelocitySums->GetOccupiedSize() - 2);
+        if (from_when <= to_when)
+            sum = sum + (_localVelocitySums->Get(from_when) - _localVelocitySums->Get(to_when + 1));
+    }
+    
+    return sum;
+}
+
+//-----------------------------------------------------------------------
+Vector3D Trajectory::CalcLocalVelocity(BufferBackPos when)
 {
     ASSERT(when >= 0 && IsBackPosInBuffer(when));
     
@@ -466,7 +683,7 @@ Vector3D Trajectory::GetLocalVelocity(BufferBackPos when)
     BufferBackPos from_when = when + 1;
     BufferBackPos to_when = when;
     
-    while (dpos.Size() < ACC_NOISE_SIZE &&
+    while (dpos.Size() < _params.accNoiseSize &&
            spread <= LOCAL_VELOCITY_MAX_SPREAD)
     {
         if (IsBackPosInBuffer(from_when + 1))
@@ -486,11 +703,11 @@ Vector3D Trajectory::GetLocalVelocity(BufferBackPos when)
 //-----------------------------------------------------------------------
 BufferBackPos Trajectory::GetLastPeakOrStart(Segment& in_segment)
 {
-    Point* point = in_segment.startPoint;
-    if (in_segment.peakPoint)
-        point = in_segment.peakPoint;
-    if (in_segment.widePeakPoint && in_segment.widePeakPoint->bufferTimestamp > point->bufferTimestamp)
-        point = in_segment.widePeakPoint;
+    const Point* point = &in_segment.startPoint;
+    if (in_segment.peakPoint.IsSet())
+        point = &in_segment.peakPoint;
+    if (in_segment.widePeakPoint.IsSet() && in_segment.widePeakPoint.bufferTimestamp > point->bufferTimestamp)
+        point = &in_segment.widePeakPoint;
     
     return GetBackPos(point->bufferTimestamp);
 }
@@ -498,31 +715,30 @@ BufferBackPos Trajectory::GetLastPeakOrStart(Segment& in_segment)
 //-----------------------------------------------------------------------
 void Trajectory::UpdateSegmentPeaks(BufferBackPos when, Segment& in_segment)
 {
-    if (_pos.GetDiff(when).Size() <= ACC_NOISE_SIZE) return;
+    if (_pos.GetDiff(when).Size() <= _params.accNoiseSize) return;
     
     auto when_vel_size = _velocity.Get(when).Size();
 
     // Update segment.peakPoint
-    if (!in_segment.peakPoint)
+    if (!in_segment.peakPoint.IsSet())
     {
         // Create peak Point
-        Point& peak_point = PushNewPoint(when);
-        in_segment.peakPoint = &peak_point;
+        in_segment.peakPoint = MakePoint(when);
         
-        in_segment.debugPeaksTimestamps.push_back(GetTimestamp(when));
+        DEBUG_PUSH_PEAK(in_segment.debugPeaksTimestamps, GetTimestamp(when));
     }
     else
     {
         // Update existing peak Point
         auto peak_vel_size = IsPointDataInBuffer(in_segment.peakPoint) ?
-            _velocity.GetByTimestamp(in_segment.peakPoint->bufferTimestamp).Size() : 0;
+            _velocity.GetByTimestamp(in_segment.peakPoint.bufferTimestamp).Size() : 0;
         if (when_vel_size >= peak_vel_size)
         {
-            in_segment.peakPoint->absPos = _pos.Get(when);
-            in_segment.peakPoint->timestamp = _timestamps.Get(when);
-            in_segment.peakPoint->bufferTimestamp = GetTimestamp(when);
+            in_segment.peakPoint.absPos = _pos.Get(when);
+            in_segment.peakPoint.timestamp = _timestamps.Get(when);
+            in_segment.peakPoint.bufferTimestamp = GetTimestamp(when);
             
-            in_segment.debugPeaksTimestamps.push_back(GetTimestamp(when));
+            DEBUG_PUSH_PEAK(in_segment.debugPeaksTimestamps, GetTimestamp(when));
         }
     }
     
@@ -530,13 +746,12 @@ void Trajectory::UpdateSegmentPeaks(BufferBackPos when, Segment& in_segment)
     auto wide_when = when + 1;
     auto wide_when2 = when + 2;
     
-    if (!in_segment.widePeakPoint)
+    if (!in_segment.widePeakPoint.IsSet())
     {
         // Create peak Point
-        Point& peak_point = PushNewPoint(wide_when);
-        in_segment.widePeakPoint = &peak_point;
+        in_segment.widePeakPoint = MakePoint(wide_when);
         
-        in_segment.debugWidePeaksTimestamps.push_back(GetTimestamp(wide_when));
+        DEBUG_PUSH_PEAK(in_segment.debugWidePeaksTimestamps, GetTimestamp(wide_when));
     }
     else
     {
@@ -544,28 +759,30 @@ void Trajectory::UpdateSegmentPeaks(BufferBackPos when, Segment& in_segment)
         auto wide_when_vel_size = GetWideVelocity(wide_when).Size();
         auto wide_when2_vel_size = GetWideVelocity(wide_when2).Size();
         
-        auto when_wide_peak = GetBackPos(in_segment.widePeakPoint->bufferTimestamp);
+        auto when_wide_peak = GetBackPos(in_segment.widePeakPoint.bufferTimestamp);
         auto wide_peak_vel_size = IsPointDataInBuffer(in_segment.widePeakPoint) ?
             GetWideVelocity(when_wide_peak).Size() : 0;
         
         if (wide_when2_vel_size >= wide_peak_vel_size &&
             wide_when2_vel_size > wide_when_vel_size)
         {
-            in_segment.widePeakPoint->absPos = _pos.Get(wide_when2);
-            in_segment.widePeakPoint->timestamp = _timestamps.Get(wide_when2);
-            in_segment.widePeakPoint->bufferTimestamp = GetTimestamp(wide_when2);
+            in_segment.widePeakPoint.absPos = _pos.Get(wide_when2);
+            in_segment.widePeakPoint.timestamp = _timestamps.Get(wide_when2);
+            in_segment.widePeakPoint.bufferTimestamp = GetTimestamp(wide_when2);
 
+#ifdef YOSS_DEBUG_TRAJECTORY_PEAKS
             if (in_segment.debugWidePeaksTimestamps.size() == 0 ||
                 in_segment.debugWidePeaksTimestamps.back() != wide_when2)
                 in_segment.debugWidePeaksTimestamps.push_back(GetTimestamp(wide_when2));
+#endif
         }
         else if (wide_when_vel_size >= wide_peak_vel_size)
         {
-            in_segment.widePeakPoint->absPos = _pos.Get(wide_when);
-            in_segment.widePeakPoint->timestamp = _timestamps.Get(wide_when);
-            in_segment.widePeakPoint->bufferTimestamp = GetTimestamp(wide_when);
+            in_segment.widePeakPoint.absPos = _pos.Get(wide_when);
+            in_segment.widePeakPoint.timestamp = _timestamps.Get(wide_when);
+            in_segment.widePeakPoint.bufferTimestamp = GetTimestamp(wide_when);
             
-            in_segment.debugWidePeaksTimestamps.push_back(GetTimestamp(wide_when));
+            DEBUG_PUSH_PEAK(in_segment.debugWidePeaksTimestamps, GetTimestamp(wide_when));
         }
     }
 }
@@ -616,21 +833,18 @@ void Trajectory::UpdateDetectedGrav(BufferBackPos when, Segment& in_segment)
 //}
 
 //-----------------------------------------------------------------------
-bool Trajectory::IsMovingAgainst(Vector3D against_velocity, BufferBackPos when, BufferBackPos* since_when)
+// Whether local velocity at when points against against_velocity, and if so, since when it does, walking back at most up to max_since.
+// A sample that isn't moving against is rejected in O(1); one that is ends the segment, and its walk back is bounded by
+// the samples of movingAgainstMaxDuration
+bool Trajectory::IsMovingAgainst(Vector3D against_velocity, BufferBackPos when, BufferBackPos* since_when, BufferBackPos max_since)
 {
-    BufferBackPos since = when;
+    BufferBackPos since = WalkMovingAgainst(against_velocity, when, MIN(max_since, when + GetSamplesNumIn(_params.movingAgainstMaxDuration)));
     
-    bool use_x = true;
-    bool use_y = (_detectionType != SegmentDetectionType_MovingAgainstSegmentInZ);
-    bool use_z = true;
-
-    while (IsBackPosInBuffer(since + 1) &&
-           RadToDeg(GetLocalVelocity(since).
-                    Filtered(use_x, use_y, use_z).
-                    AngleTo(against_velocity)) >= 110)
-    {
-        since++;
-    }
+#ifdef YOSS_DEBUG_TRAJECTORY_MOVING_AGAINST
+    BufferBackPos unbounded_since = WalkMovingAgainst(against_velocity, when, max_since);
+    if (unbounded_since != since)
+        Log::LogText("IsMovingAgainst: run of " + Log::ToStr(unbounded_since - when) + " samples cut to " + Log::ToStr(since - when));
+#endif
     
     if (since > when)
     {
@@ -642,33 +856,70 @@ bool Trajectory::IsMovingAgainst(Vector3D against_velocity, BufferBackPos when,
 }
 
 //-----------------------------------------------------------------------
-bool Trajectory::IsMovingAgainst(BufferBackPos against_when, BufferBackPos when, BufferBackPos* since_when)
+// Walks back from when while local velocity points against against_velocity, at most up to max_since
+BufferBackPos Trajectory::WalkMovingAgainst(Vector3D against_velocity, BufferBackPos when, BufferBackPos max_since)
 {
-    bool is_against = IsMovingAgainst(GetLocalVelocity(against_when), when, since_when);
+    BufferBackPos since = when;
+    
+    bool use_x = true;
+    bool use_y = (_detectionType != SegmentDetectionType_MovingAgainstSegmentInZ);
+    bool use_z = true;
+    
+    // angle >= 110 deg <=> dot <= movingAgainstMaxCos * |v| * |against|, and as the cos is negative:
+    // dot < 0 && dot^2 >= movingAgainstMaxCos^2 * |v|^2 * |against|^2
+    const Coo min_dot_sq_factor = _params.movingAgainstMaxCos * _params.movingAgainstMaxCos * against_velocity.DotProduct(against_velocity);
+    
+    while (since < max_since && IsBackPosInBuffer(since + 1))
+    {
+        Vector3D v = GetLocalVelocity(since).Filtered(use_x, use_y, use_z);
+        Coo dot = v.DotProduct(against_velocity);
+        if (dot >= 0 || dot * dot < min_dot_sq_factor * v.DotProduct(v))
+            break;
+        
+        since++;
+    }
+    
+    return since;
+}
+
+//-----------------------------------------------------------------------
+bool Trajectory::IsMovingAgainst(BufferBackPos against_when, BufferBackPos when, BufferBackPos* since_when, BufferBackPos max_since)
+{
+    bool is_against = IsMovingAgainst(GetLocalVelocity(against_when), when, since_when, max_since);
     
     if (is_against) DEBUG_ISMOVINGAGAINST_BACKPOS(against_when);
     
     return is_against;
 }
 
+//-----------------------------------------------------------------------
+// Segment end is clamped to the segment's start by Update(), so walking back further than it doesn't change the result
+BufferBackPos Trajectory::GetMaxMovingAgainstSince(BufferBackPos when, Segment& in_segment)
+{
+    BufferBackPos seg_start = GetBackPos(in_segment.startPoint.bufferTimestamp);
+    return MAX(seg_start, when + 1);
+}
+
 //-----------------------------------------------------------------------
 bool Trajectory::IsMovingAgainstPeak(BufferBackPos when, BufferBackPos* since_when, Segment& in_segment)
 {
+    BufferBackPos max_since = GetMaxMovingAgainstSince(when, in_segment);
+    
     bool is_against = false;
-    auto peak = in_segment.peakPoint;
-    if (peak && IsPointDataInBuffer(peak))
+    auto& peak = in_segment.peakPoint;
+    if (peak.IsSet() && IsPointDataInBuffer(peak))
     {
-        is_against = IsMovingAgainst(_velocity.GetByTimestamp(peak->bufferTimestamp), when, since_when);
+        is_against = IsMovingAgainst(_velocity.GetByTimestamp(peak.bufferTimestamp), when, since_when, max_since);
         
-        if (is_against) DEBUG_ISMOVINGAGAINST_BACKPOS(GetBackPos(peak->bufferTimestamp));
+        if (is_against) DEBUG_ISMOVINGAGAINST_BACKPOS(GetBackPos(peak.bufferTimestamp));
     }
     
-    auto wide_peak = in_segment.widePeakPoint;
-    if (!is_against && wide_peak && IsPointDataInBuffer(wide_peak))
+    auto& wide_peak = in_segment.widePeakPoint;
+    if (!is_against && wide_peak.IsSet() && IsPointDataInBuffer(wide_peak))
     {
-        auto wide_peak_back_pos = GetBackPos(wide_peak->bufferTimestamp);
+        auto wide_peak_back_pos = GetBackPos(wide_peak.bufferTimestamp);
         auto wide_peak_vel = GetWideVelocity(wide_peak_back_pos);
-        is_against = IsMovingAgainst(wide_peak_vel, when, since_when);
+        is_against = IsMovingAgainst(wide_peak_vel, when, since_when, max_since);
         
         if (is_against) DEBUG_ISMOVINGAGAINST_BACKPOS(wide_peak_back_pos);
     }
@@ -677,31 +928,51 @@ bool Trajectory::IsMovingAgainstPeak(BufferBackPos when, BufferBackPos* since_wh
 }
 
 //-----------------------------------------------------------------------
+// Against the summed local velocity of the past since the last peak, from the running sums in O(1),
+// rather than against each past sample in turn, which took a walk over the past per sample
 bool Trajectory::IsMovingAgainstPast(BufferBackPos when, BufferBackPos* since_when, Segment& in_segment)
 {
+    BufferBackPos max_since = GetMaxMovingAgainstSince(when, in_segment);
     auto up_to_past = GetLastPeakOrStart(in_segment);
-    //auto up_to_past = GetBackPos(in_segment.startPoint->bufferTimestamp);
+    //auto up_to_past = GetBackPos(in_segment.startPoint.bufferTimestamp);
     //up_to_past = min(up_to_past, when + 4);
     
-    for (BufferBackPos past = when + 1; past < up_to_past; past++)
+    if (up_to_past <= when + 1) return false;
+    
+    Vector3D past_velocity = GetLocalVelocitiesSum(when + 1, up_to_past - 1);
+    bool is_against = IsMovingAgainst(past_velocity, when, since_when, max_since);
+    
+#ifdef YOSS_DEBUG_TRAJECTORY_MOVING_AGAINST
+    Vector3D walked_past_velocity = ZERO_VECTOR;
+    bool is_against_any_past = false;
+    BufferBackPos any_since_when = 0;
+    for (BufferBackPos past = when + 1; past < up_to_past && past < _localVelocitySums->GetOccupiedSize() - 1; past++)
     {
-        if (IsMovingAgainst(past, when, since_when)) return true;
+        walked_past_velocity = walked_past_velocity + GetLocalVelocity(past);
+        is_against_any_past = is_against_any_past || IsMovingAgainst(past, when, &any_since_when, max_since);
     }
+    ASSERT((past_velocity - walked_past_velocity).Size() <= 1e-6 * (1 + walked_past_velocity.Size()));
+    if (is_against != is_against_any_past)
+        Log::LogText("IsMovingAgainstPast: against the summed past = " + std::string(is_against ? "yes" : "no") +
+                     ", against any past sample = " + std::string(is_against_any_past ? "yes" : "no"));
+#endif
     
-    return false;
+    if (is_against) DEBUG_ISMOVINGAGAINST_BACKPOS(up_to_past - 1);
+    
+    return is_against;
 }
 
 //-----------------------------------------------------------------------
 bool Trajectory::IsMovingAgainstSegment(BufferBackPos when, BufferBackPos* since_when, Segment& in_segment)
 {
-    BufferBackPos seg_start = GetBackPos(in_segment.startPoint->bufferTimestamp);
+    BufferBackPos seg_start = GetBackPos(in_segment.startPoint.bufferTimestamp);
     BufferBackPos seg_end = when + 1;
     if (seg_start - seg_end < 4) return false;
     
     Vector3D start_pos = _pos.Get(_pos.IsBackPosOccupied(seg_start) ? seg_start : _pos.GetOccupiedSize() - 1);
     Vector3D seg_vec = _pos.Get(seg_end) - start_pos;
     
-    bool is_against = IsMovingAgainst(seg_vec, when, since_when);
+    bool is_against = IsMovingAgainst(seg_vec, when, since_when, GetMaxMovingAgainstSince(when, in_segment));
     return is_against;
 }
 
@@ -717,10 +988,10 @@ bool Trajectory::IsIdling(BufferBackPos when, BufferBackPos* since_when, Segment
     if (!_pos.IsBackPosOccupied(is_idling_since_back_pos))
         is_idling_since_back_pos = _pos.GetOccupiedSize() - 1;
     auto is_idling_since_time = _timestamps.Get(is_idling_since_back_pos);
-    bool is_idling = (when_pos - _pos.Get(is_idling_since_back_pos)).Size() <= MAX_IDLE_DPOS;
+    bool is_idling = (when_pos - _pos.Get(is_idling_since_back_pos)).Size() <= _params.maxIdleDPos;
     
     if (is_idling &&
-        when_time - is_idling_since_time >= MIN_IDLE_DURATION)
+        when_time - is_idling_since_time >= _params.minIdleDuration)
     {
         *since_when = is_idling_since_back_pos;
         return true;
@@ -749,10 +1020,10 @@ bool Trajectory::IsDrifting(BufferBackPos when, BufferBackPos* since_when, Segme
         is_drifting_since_back_pos = _timestamps.GetOccupiedSize() - 1;
     
     auto is_drifting_since_time = _timestamps.Get(is_drifting_since_back_pos);
-    bool is_drifting = (_velocity.Get(when).Size() <= MAX_DRIFT_SPEED);
+    bool is_drifting = (_velocity.Get(when).Size() <= _params.maxDriftSpeed);
     
     if (is_drifting &&
-        when_time - is_drifting_since_time >= MIN_DRIFT_DURATION)
+        when_time - is_drifting_since_time >= _params.minDriftDuration)
     {
         *since_when = is_drifting_since_back_pos;
         return true;
@@ -775,7 +1046,7 @@ bool Trajectory::IsAccelerating(BufferBackPos when)
     Vector3D v = GetLocalVelocity(when);
     Vector3D prev_v = GetLocalVelocity(when + 1);
     
-    if (_pos.GetDiff(when).Size() <= ACC_NOISE_SIZE) return false;
+    if (_pos.GetDiff(when).Size() <= _params.accNoiseSize) return false;
     if (v.Size() <= prev_v.Size()) return false;
     //if (v.DotProduct(prev_v) < 0.0) return false;
     
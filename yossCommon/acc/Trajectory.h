@@ -2,7 +2,10 @@
 
 #include "../common/Math.h"
 #include "../structs/CircularBuffer.h"
-#include "../structs/CircularSummedBuffer.h"
+#include "../structs/CircularVectorBuffer.h"
+#include "HistoryPyramid.h"
+
+#include <memory>
 
 namespace yoss
 {
@@ -20,6 +23,9 @@ namespace yoss
         // Structs and classes:
         struct Point;
         struct Segment;
+        struct SegmentSums;
+        struct SegmentKinematics;
+        struct SegmentDetectionParams;
         class Trajectory;
         //-----------------------------------------------------------------------
         
@@ -27,6 +33,17 @@ namespace yoss
         // Types:
         typedef CircularBuffer<Vector3D>::BackPos BufferBackPos;
         typedef CircularBuffer<Vector3D>::Timestamp BufferTimestamp;
+        
+        // Reference to a Segment that stays checkable after the segment is overwritten in the circular buffer:
+        // index is the segment's push count, so its slot is index % size and its generation index / size
+        struct SegmentHandle
+        {
+            BufferTimestamp index = -1;
+            
+            bool IsNull() const { return index < 0; }
+            bool operator==(const SegmentHandle& other) const { return index == other.index; }
+            bool operator!=(const SegmentHandle& other) const { return index != other.index; }
+        };
         enum SegmentType
         {
             SegmentType_Undefined,
@@ -46,12 +63,18 @@ namespace yoss
         
         //-----------------------------------------------------------------------
         // Constants:
-        const int TRAJECTORY_BUFFERS_SIZE = 10000; // In samples
+        const int TRAJECTORY_BUFFERS_SIZE = 10000; // In samples, default history size of a Trajectory
+        const int TRAJECTORY_SEEDS_NUM = 3; // Zero positions a trajectory starts with, so that its buffers can be read before it's fed
+        const Time TRAJECTORY_SEED_INTERVAL = 1.0; // [sec] Between the seeds, and from the last one to the first fed position
         
         const Coo ACC_NOISE_SIZE = 0.07; // [acc]
         
         const int LOCAL_VELOCITY_MAX_SPREAD = 2; // Max number of adjacent points to spread over the averaging of velocity
         
+        const Coo MOVING_AGAINST_MAX_COS = -0.3420201433256687; // cos(110 deg): min angle of local velocity to a direction to be moving against it
+        const Time MOVING_AGAINST_MAX_DURATION = 0.16; // [sec] Max walk back from a sample moving against a direction to where it started doing so
+        const int SAMPLE_RATE_SPAN = 16; // In samples, last ones over which a trajectory measures its sample rate
+        
         const Coo MAX_IDLE_DPOS = ACC_NOISE_SIZE * 2.0; // [acc] Max displacement relative to idle state start pos
         const Time MIN_IDLE_DURATION = 0.08; // [sec] Minimal time without any (inc. drifting) movement for an "idle" state to be detected
         const BufferTimestamp MAX_IDLE_SEGMENT_LEN = TRAJECTORY_BUFFERS_SIZE / 3;
@@ -63,40 +86,83 @@ namespace yoss
         //-----------------------------------------------------------------------
         
         
+        //-----------------------------------------------------------------------
+        // Thresholds of segment detection that can be tuned at runtime, defaults are the constants above
+        struct SegmentDetectionParams
+        {
+            Coo      accNoiseSize = ACC_NOISE_SIZE;
+            Coo      movingAgainstMaxCos = MOVING_AGAINST_MAX_COS;
+            Time     movingAgainstMaxDuration = MOVING_AGAINST_MAX_DURATION;
+            Coo      maxIdleDPos = MAX_IDLE_DPOS;
+            Time     minIdleDuration = MIN_IDLE_DURATION;
+            Velocity maxDriftSpeed = MAX_DRIFT_SPEED;
+            Time     minDriftDuration = MIN_DRIFT_DURATION;
+        };
+        
+        
         //-----------------------------------------------------------------------
         class Trajectory
         {
             friend class yoss::AccEngine;
             
         public:
-            Trajectory(SegmentDetectionType detection_type);
+            // history_size: num of samples kept; segments_num: capacity of segments buffer (0 = history_size).
+            // Segments are allocated only when detection_type is not SegmentDetectionType_None,
+            // the pyramid of positions only with with_pyramid.
+            Trajectory(SegmentDetectionType detection_type, int history_size = TRAJECTORY_BUFFERS_SIZE, int segments_num = 0,
+                       bool with_pyramid = false);
             ~Trajectory();
             
+            // Timestamps may be of any clock, and must increase from position to position
             void FeedNewPosition(const Vector3D& new_pos, Time timestamp);
             void Update();
             bool SegmentJustEnded() { return _segmentJustEnded; }
             
-            CircularBuffer<Segment>&        GetSegments()      { return _segments; }
+            void SetParams(const SegmentDetectionParams& params) { ASSERT(params.movingAgainstMaxCos < 0 && params.movingAgainstMaxDuration >= 0); _params = params; }
+            const SegmentDetectionParams& GetParams() const { return _params; }
+            
+            bool                            HasSegments() const { return (bool)_segments; }
+            CircularBuffer<Segment>&        GetSegments()      { ASSERT(_segments); return *_segments; }
             Segment*                        GetSegmentAt(BufferTimestamp timestamp);
             
+            // Of a segment whose samples are still in the buffers; an unfinished one is taken as ending at the last sample
+            SegmentKinematics CalcSegmentKinematics(Segment& segment);
+            
+            SegmentHandle GetSegmentHandle(BufferBackPos segment_back_pos = 0);
+            bool          IsSegmentHandleValid(SegmentHandle handle) const;
+            Segment*      GetSegment(SegmentHandle handle); // nullptr if the segment was overwritten
+            
             CircularBuffer<Time>&           GetTimestamps()    { return _timestamps; }
-            CircularSummedBuffer<Vector3D>& GetPositions()     { return _pos; }
-            CircularSummedBuffer<Vector3D>& GetVelocities()    { return _velocity; }
-            CircularSummedBuffer<Vector3D>& GetAccelerations() { return _acc; }
+            CircularVectorBuffer&           GetPositions()     { return _pos; }
+            CircularVectorBuffer&           GetVelocities()    { return _velocity; }
+            CircularVectorBuffer&           GetAccelerations() { return _acc; }
+            bool                            HasPositionsPyramid() const { return (bool)_posPyramid; }
+            const HistoryPyramid&           GetPositionsPyramid() const { ASSERT(_posPyramid); return *_posPyramid; } // Downsampled positions, for long spans
             
         protected:
             SegmentDetectionType        _detectionType;
-            CircularBuffer<Point>       _points;
-            CircularBuffer<Segment>     _segments;
+            SegmentDetectionParams      _params;
+            std::unique_ptr<CircularBuffer<Segment>> _segments;
             
-            CircularBuffer<Time>           _timestamps;
-            CircularSummedBuffer<Vector3D> _pos;
-            CircularSummedBuffer<Vector3D> _velocity;
-            CircularSummedBuffer<Vector3D> _acc;
+            CircularBuffer<Time>  _timestamps;
+            CircularVectorBuffer  _pos;
+            CircularVectorBuffer  _velocity;
+            CircularVectorBuffer  _acc;
+            std::unique_ptr<HistoryPyramid> _posPyramid;
+            
+            // Sums from _segmentSumsStart (start of current segment) up to each sample, kept in step with _pos
+            std::unique_ptr<CircularBuffer<SegmentSums>> _segmentSums;
+            BufferTimestamp _segmentSumsStart;
+            
+            // Local velocity of each sample, calculated once it is LOCAL_VELOCITY_MAX_SPREAD samples old
+            std::unique_ptr<CircularBuffer<Vector3D>> _localVelocities;
+            // Running sum of the cached local velocities up to each sample, so the sum over a window is the difference of its ends'
+            std::unique_ptr<CircularBuffer<Vector3D>> _localVelocitySums;
             
             int _feedsCounter;
             int _processedFeedsCounter;
             Time _lastFeedTimestamp;
+            bool _isFed; // Whether a position was fed after the seeds
             bool _segmentJustEnded;
             
             std::string   _debugSegEndReason;
@@ -110,8 +176,9 @@ namespace yoss
             bool IsDrifting(BufferBackPos when, BufferBackPos* since_when, Segment& in_segment);
             
             //bool IsMovingFast(BufferBackPos when, BufferBackPos* since_when, Segment& in_segment);
-            bool IsMovingAgainst(Vector3D against_velocity, BufferBackPos when, BufferBackPos* since_when);
-            bool IsMovingAgainst(BufferBackPos against_when, BufferBackPos when, BufferBackPos* since_when);
+            bool IsMovingAgainst(Vector3D against_velocity, BufferBackPos when, BufferBackPos* since_when, BufferBackPos max_since);
+            BufferBackPos WalkMovingAgainst(Vector3D against_velocity, BufferBackPos when, BufferBackPos max_since);
+            bool IsMovingAgainst(BufferBackPos against_when, BufferBackPos when, BufferBackPos* since_when, BufferBackPos max_since);
             bool IsMovingAgainstPast(BufferBackPos when, BufferBackPos* since_when, Segment& in_segment);
             bool IsMovingAgainstPeak(BufferBackPos when, BufferBackPos* since_when, Segment& in_segment);
             bool IsMovingAgainstSegment(BufferBackPos when, BufferBackPos* since_when, Segment& in_segment);
@@ -124,42 +191,75 @@ namespace yoss
             void UpdateSegmentPeaks(BufferBackPos when, Segment& in_segment);
             void CalcSegmentParams(Segment& segment);
             
-            Point& PushNewPoint(BufferBackPos when);
+            void        AccumulateSegmentSums(BufferBackPos when);
+            void        RebaseSegmentSums(BufferTimestamp start_timestamp);
+            SegmentSums GetSegmentSums(Segment& segment);
+            
+            Point MakePoint(BufferBackPos when);
             BufferBackPos GetLastPeakOrStart(Segment& in_segment);
             
+            BufferBackPos GetMaxMovingAgainstSince(BufferBackPos when, Segment& in_segment);
+            
             Vector3D GetWideVelocity(BufferBackPos when);
             Vector3D GetLocalVelocity(BufferBackPos when);
+            Vector3D CalcLocalVelocity(BufferBackPos when);
+            Vector3D GetLocalVelocitiesSum(BufferBackPos from_when, BufferBackPos to_when);
             
             BufferBackPos GetBackPos(BufferTimestamp buffer_timestamp);
             BufferTimestamp GetTimestamp(BufferBackPos back_pos = 0);
             bool IsBackPosInBuffer(BufferBackPos back_pos);
-            bool IsPointDataInBuffer(Point* point);
+            void PushPosition(const Vector3D& new_pos, Time timestamp);
+            void StampSeeds(Time first_timestamp);
+            int  GetSamplesNumIn(Time duration);
+            bool IsPointDataInBuffer(const Point& point);
         };
         
         //-----------------------------------------------------------------------
+        // Sample of a trajectory, copied out of its buffers. Default-constructed = not set
         struct Point
         {
             Vector3D absPos;
             Time timestamp;
             BufferTimestamp bufferTimestamp;
+            bool isSet;
             
             Point();
             Point(const Vector3D& abs_pos,
                   const Time timestamp,
                   const BufferTimestamp buffer_timestamp);
             
+            bool IsSet() const { return isSet; }
+            
             Coo GetDistanceTo(const Vector3D& pos);
             Coo GetDistanceTo(const Point& another_point);
         };
         
+        //-----------------------------------------------------------------------
+        // Running sums over the samples of a segment, from its start point up to some sample
+        struct SegmentSums
+        {
+            Vector3D velocitySum = Vector3D(0, 0, 0);
+            Vector3D posSum = Vector3D(0, 0, 0);
+            Coo      traveledLength = 0;
+        };
+        
+        //-----------------------------------------------------------------------
+        // How a segment was moved through: how fast at its peak and how abruptly it rose to and stopped after it
+        struct SegmentKinematics
+        {
+            Velocity peakVelocity = 0; // [acc/sec] Size of velocity at the segment's peak point
+            Coo      deceleration = 0; // [acc/sec^2] Avg drop of the speed from the peak to the end
+            Time     timeToPeak = 0;   // [sec] From the start to the peak point
+        };
+        
         //-----------------------------------------------------------------------
         struct Segment
         {
             SegmentType type;
-            Point* startPoint;
-            Point* endPoint;
-            Point* peakPoint;
-            Point* widePeakPoint;
+            Point startPoint;
+            Point endPoint;
+            Point peakPoint;
+            Point widePeakPoint;
             int samplesNum; // Number of samples in the buffer that the segment contains (including the start and end points)
             Vector3D detectedGrav;
             Coo      traveledLength;
@@ -168,20 +268,22 @@ namespace yoss
             Vector3D weightCenter;
             Vector3D middleOfStartEnd;
             
+#ifdef YOSS_DEBUG_TRAJECTORY_PEAKS
             std::vector<BufferTimestamp> debugPeaksTimestamps;
             std::vector<BufferTimestamp> debugWidePeaksTimestamps;
+#endif
             
-            Segment(Point* start = nullptr, Point* end = nullptr);
+            Segment(const Point& start = Point(), const Point& end = Point());
             void MergePrevSegment(Segment* prev_segment);
             void MergeNextSegment(Segment* next_segment);
             
-            bool     IsFinished() { return (endPoint != nullptr); }
+            bool     IsFinished() { return endPoint.IsSet(); }
             Vector3D GetDPos();
             Time     GetDuration();
             Time     GetDurationToPeak();
             Time     GetDurationAfterPeak();
             Velocity GetAvgVelocitySize();
-            bool     ContainsPoint(Point* point, bool include_start_and_end = true);
+            bool     ContainsPoint(const Point& point, bool include_start_and_end = true);
         };
         
     }
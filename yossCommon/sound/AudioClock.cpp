@@ -0,0 +1,140 @@
+#include "AudioClock.h"
+
+#include <cmath>
+
+using namespace yoss;
+using namespace yoss::sound;
+using namespace yoss::math;
+
+
+//-----------------------------------------------------------------------
+AudioClock::AudioClock(Frequency nominal_samples_per_sec) :
+    _sequence(0),
+    _sharedHostTime(0),
+    _sharedSampleIndex(0),
+    _sharedSamplesPerSec(0),
+    _sharedJitter(0),
+    _observationsNum(0)
+{
+    Reset(nominal_samples_per_sec);
+}
+
+//-----------------------------------------------------------------------
+void AudioClock::Reset(Frequency nominal_samples_per_sec)
+{
+    _nominalSamplesPerSec = nominal_samples_per_sec;
+    _mapping = { 0, 0, nominal_samples_per_sec };
+    _prevObservationTime = 0;
+    _prevObservationIndex = 0;
+    _smoothedSqError = 0;
+
+    _observationsNum.store(0, std::memory_order_release);
+    WriteMapping(_mapping);
+    _sharedJitter.store(0, std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------
+void AudioClock::AddObservation(Time host_time, uint64_t sample_index)
+{
+    ASSERT(_nominalSamplesPerSec > 0);
+
+    int observations_num = _observationsNum.load(std::memory_order_relaxed);
+    double predicted_index = _mapping.sampleIndex + (host_time - _mapping.hostTime) * _mapping.samplesPerSec;
+    double error = (double)sample_index - predicted_index; // [samples]
+    Time error_time = error / _mapping.samplesPerSec;
+
+    if (observations_num == 0 || fabs(error_time) > AUDIO_CLOCK_RESYNC_ERROR || host_time <= _prevObservationTime)
+    {
+        // (Re)start from this observation, keeping the measured rate
+        _mapping.hostTime = host_time;
+        _mapping.sampleIndex = (double)sample_index;
+        _prevObservationTime = host_time;
+        _prevObservationIndex = sample_index;
+        _observationsNum.store(1, std::memory_order_release);
+        WriteMapping(_mapping);
+        return;
+    }
+
+    // Mapping is re-anchored at each observation, so that the numbers stay small.
+    // Interval is taken from the sample indices: host time of an observation is what jitters, and it correlates with the error.
+    Time dt = MAX(sample_index - _prevObservationIndex, (uint64_t)1) / _nominalSamplesPerSec;
+    _mapping.hostTime = host_time;
+    _mapping.sampleIndex = predicted_index + AUDIO_CLOCK_OFFSET_GAIN * error;
+    _mapping.samplesPerSec += AUDIO_CLOCK_RATE_GAIN * error / dt;
+    _mapping.samplesPerSec = CLAMP(_mapping.samplesPerSec,
+                                   _nominalSamplesPerSec * (1 - AUDIO_CLOCK_MAX_RATE_DEVIATION),
+                                   _nominalSamplesPerSec * (1 + AUDIO_CLOCK_MAX_RATE_DEVIATION));
+    _prevObservationTime = host_time;
+    _prevObservationIndex = sample_index;
+
+    _smoothedSqError += AUDIO_CLOCK_JITTER_SMOOTHING * (error_time * error_time - _smoothedSqError);
+
+    WriteMapping(_mapping);
+    _sharedJitter.store(sqrt(_smoothedSqError), std::memory_order_relaxed);
+    if (observations_num < AUDIO_CLOCK_MIN_OBSERVATIONS)
+        _observationsNum.store(observations_num + 1, std::memory_order_release);
+}
+
+//-----------------------------------------------------------------------
+double AudioClock::GetSampleAt(Time host_time) const
+{
+    auto mapping = ReadMapping();
+    return mapping.sampleIndex + (host_time - mapping.hostTime) * mapping.samplesPerSec;
+}
+
+//-----------------------------------------------------------------------
+Time AudioClock::GetHostTimeAt(double sample_index) const
+{
+    auto mapping = ReadMapping();
+    return mapping.hostTime + (sample_index - mapping.sampleIndex) / mapping.samplesPerSec;
+}
+
+//-----------------------------------------------------------------------
+Frequency AudioClock::GetSamplesPerSec() const
+{
+    return ReadMapping().samplesPerSec;
+}
+
+//-----------------------------------------------------------------------
+Ratio AudioClock::GetDrift() const
+{
+    return (_nominalSamplesPerSec > 0 ? ReadMapping().samplesPerSec / _nominalSamplesPerSec - 1 : 0);
+}
+
+//-----------------------------------------------------------------------
+Time AudioClock::GetJitter() const
+{
+    return _sharedJitter.load(std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------
+AudioClock::Mapping AudioClock::ReadMapping() const
+{
+    Mapping mapping;
+    unsigned sequence;
+    do
+    {
+        sequence = _sequence.load(std::memory_order_acquire);
+        mapping.hostTime = _sharedHostTime.load(std::memory_order_relaxed);
+        mapping.sampleIndex = _sharedSampleIndex.load(std::memory_order_relaxed);
+        mapping.samplesPerSec = _sharedSamplesPerSec.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    while ((sequence & 1) || sequence != _sequence.load(std::memory_order_relaxed));
+
+    return mapping;
+}
+
+//-----------------------------------------------------------------------
+void AudioClock::WriteMapping(const Mapping& mapping)
+{
+    unsigned sequence = _sequence.load(std::memory_order_relaxed);
+    _sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    _sharedHostTime.store(mapping.hostTime, std::memory_order_relaxed);
+    _sharedSampleIndex.store(mapping.sampleIndex, std::memory_order_relaxed);
+    _sharedSamplesPerSec.store(mapping.samplesPerSec, std::memory_order_relaxed);
+
+    _sequence.store(sequence + 2, std::memory_order_release);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Sound.h"
+
+#include <atomic>
+#include <cstdint>
+
+
+namespace yoss
+{
+    namespace sound
+    {
+        //-----------------------------------------------------------------------
+        // Structs and classes:
+        class AudioClock;
+        //-----------------------------------------------------------------------
+
+        //-----------------------------------------------------------------------
+        // Constants:
+        static const Ratio AUDIO_CLOCK_OFFSET_GAIN = 0.02; // How much of the error of an observation is corrected in the sample offset
+        static const Ratio AUDIO_CLOCK_RATE_GAIN = 0.0001; // ...and in the rate; ~OFFSET_GAIN^2 / 4 for a critically damped loop
+        static const Ratio AUDIO_CLOCK_MAX_RATE_DEVIATION = 0.01; // Max part of nominal rate the measured rate may differ by
+        static const Ratio AUDIO_CLOCK_JITTER_SMOOTHING = 0.05; // Weight of the last observation in the smoothed squared error
+        static const Time  AUDIO_CLOCK_RESYNC_ERROR = 0.05; // [sec] Larger errors (e.g. after an audio interruption) restart the mapping
+        static const int   AUDIO_CLOCK_MIN_OBSERVATIONS = 64; // Num of observations after a (re)start before the mapping is trusted
+        //-----------------------------------------------------------------------
+
+
+        //-----------------------------------------------------------------------
+        // Maps host time (system::GetCurrentTimestamp(), as used for sensor samples) to the index of rendered audio samples.
+        // Observations of (host time, sample index) pairs come from the audio thread, typically at the start of each slice;
+        // their jitter is filtered by a phase-locked loop, which also follows drift of the audio clock against the host clock.
+        // Conversions may be called from any thread. Output latency of the device isn't included: a converted index
+        // is the one being rendered at the given time, not the one being heard. Callbacks are only ever late,
+        // so the mapping lags by their mean delay, which is part of that constant latency too.
+        class AudioClock
+        {
+        public:
+            AudioClock(Frequency nominal_samples_per_sec = 0);
+
+            void Reset(Frequency nominal_samples_per_sec);
+
+            // Audio thread
+            void AddObservation(Time host_time, uint64_t sample_index);
+
+            // Any thread
+            bool      IsSynced() const { return _observationsNum.load(std::memory_order_acquire) >= AUDIO_CLOCK_MIN_OBSERVATIONS; }
+            double    GetSampleAt(Time host_time) const; // Fractional sample index
+            Time      GetHostTimeAt(double sample_index) const;
+            Frequency GetSamplesPerSec() const; // Measured, in samples per host second
+            Ratio     GetDrift() const; // Measured rate / nominal rate - 1
+            Time      GetJitter() const; // [sec] RMS error of observations against the mapping
+
+        private:
+            // Mapping published by the audio thread, read with a sequence lock
+            struct Mapping
+            {
+                Time      hostTime;
+                double    sampleIndex;
+                Frequency samplesPerSec;
+            };
+            Mapping ReadMapping() const;
+            void    WriteMapping(const Mapping& mapping);
+
+            Frequency _nominalSamplesPerSec;
+
+            // Audio thread only
+            Mapping   _mapping;
+            Time      _prevObservationTime;
+            uint64_t  _prevObservationIndex;
+            double    _smoothedSqError;
+
+            std::atomic<unsigned> _sequence; // Odd while the mapping is being written
+            std::atomic<double>   _sharedHostTime;
+            std::atomic<double>   _sharedSampleIndex;
+            std::atomic<double>   _sharedSamplesPerSec;
+            std::atomic<double>   _sharedJitter;
+            std::atomic<int>      _observationsNum;
+        };
+
+    }
+}
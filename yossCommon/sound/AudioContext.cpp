@@ -0,0 +1,39 @@
+#include "AudioContext.h"
+
+using namespace yoss;
+using namespace yoss::sound;
+
+
+//-----------------------------------------------------------------------
+// Static members
+
+thread_local const AudioContext* AudioContext::_currentContext = nullptr;
+
+//-----------------------------------------------------------------------
+
+
+//-----------------------------------------------------------------------
+AudioContext& AudioContext::Default()
+{
+    static AudioContext default_context;
+    return default_context;
+}
+
+//-----------------------------------------------------------------------
+const AudioContext& AudioContext::Current()
+{
+    return (_currentContext ? *_currentContext : Default());
+}
+
+//-----------------------------------------------------------------------
+AudioContext::Scope::Scope(const AudioContext& context):
+    _prevContext(_currentContext)
+{
+    _currentContext = &context;
+}
+
+//-----------------------------------------------------------------------
+AudioContext::Scope::~Scope()
+{
+    _currentContext = _prevContext;
+}
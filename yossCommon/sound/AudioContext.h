@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Sound.h"
+
+#include <atomic>
+#include <cstdint>
+
+
+namespace yoss
+{
+    namespace sound
+    {
+        //-----------------------------------------------------------------------
+        // Structs and classes:
+        struct AudioContext;
+        //-----------------------------------------------------------------------
+
+        //-----------------------------------------------------------------------
+        // Constants:
+        static const int DEFAULT_AUDIO_BLOCK_SIZE = 512;
+        //-----------------------------------------------------------------------
+
+
+        //-----------------------------------------------------------------------
+        // Rendering parameters of one SoundEngine (or offline render session).
+        // Units and instruments keep a pointer to the context they were created in, or were prepared with by their engine
+        // (see Instrument::Prepare()), and take sample rate from it, so several engines at different rates can run in one process, each on its own thread.
+        struct AudioContext
+        {
+            Frequency samplesPerSec = 0;
+            Time      sampleDuration = 0;
+            int       blockSize = DEFAULT_AUDIO_BLOCK_SIZE; // Max num of samples rendered per slice
+            std::atomic<uint64_t> samplesRendered{0};       // Time base: samples rendered since the engine started, see GetSamplesRendered()
+
+            AudioContext() {}
+            AudioContext(Frequency samples_per_sec, int block_size = DEFAULT_AUDIO_BLOCK_SIZE) { SetSamplesPerSec(samples_per_sec); blockSize = block_size; }
+            AudioContext(const AudioContext& other) { *this = other; }
+            AudioContext& operator=(const AudioContext& other)
+            {
+                samplesPerSec = other.samplesPerSec;
+                sampleDuration = other.sampleDuration;
+                blockSize = other.blockSize;
+                samplesRendered.store(other.GetSamplesRendered(), std::memory_order_relaxed);
+                return *this;
+            }
+
+            inline void SetSamplesPerSec(Frequency samples_per_sec) { samplesPerSec = samples_per_sec; sampleDuration = 1.0 / samples_per_sec; }
+            // samplesRendered is advanced by the audio thread once per slice and may be read from any thread
+            inline uint64_t GetSamplesRendered() const { return samplesRendered.load(std::memory_order_relaxed); }
+            inline void AdvanceSamplesRendered(int samples_num) { samplesRendered.store(GetSamplesRendered() + samples_num, std::memory_order_relaxed); } // By the audio thread only
+            inline Time GetTime() const { return GetSamplesRendered() * sampleDuration; }
+            inline bool IsFrequencyPlayable(Frequency freq) const { return freq >= 20 && freq <= samplesPerSec / 2; }
+
+            // Process-wide context, configured by the first (live) SoundEngine
+            static AudioContext& Default();
+
+            // Context that newly created units and instruments get on the calling thread: the innermost Scope's or Default()
+            static const AudioContext& Current();
+
+            // While alive, makes context the Current() one on the calling thread
+            class Scope
+            {
+            public:
+                Scope(const AudioContext& context);
+                ~Scope();
+                Scope(const Scope&) = delete;
+                Scope& operator=(const Scope&) = delete;
+            private:
+                const AudioContext* _prevContext;
+            };
+
+        private:
+            static thread_local const AudioContext* _currentContext;
+        };
+
+    }
+}
@@ -47,7 +47,7 @@ Drone::Drone() :
             harmonic.overtoneMultiplier = 1;
             
             static const double harm_multiplier[] = {1.0, 2.0, 3.0, 4.0, 5.0, 6.0};
-            if (Unit::IsFrequencyPlayable(harm_multiplier[hi] * freq))
+            if (GetContext().IsFrequencyPlayable(harm_multiplier[hi] * freq))
                 harmonic.overtoneMultiplier = harm_multiplier[hi];
             else
                 harmonic.leftVolume = harmonic.rightVolume = 0;
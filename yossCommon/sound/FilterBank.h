@@ -0,0 +1,206 @@
+#pragma once
+
+#include "Sound.h"
+#include "SoundUnit.h"
+
+
+namespace yoss
+{
+    namespace sound
+    {
+        //-----------------------------------------------------------------------
+        // Structs and classes:
+        template <int LanesNum> class FilterBank;
+        //-----------------------------------------------------------------------
+
+        //-----------------------------------------------------------------------
+        // Types:
+        enum FilterBankMode
+        {
+            FilterBankMode_Spring, // Same response as a lagged math::Stepper: spring (acc, damp) or half-step (one-pole)
+            FilterBankMode_SVF     // Low-pass state-variable filter (cutoff, resonance)
+        };
+        //-----------------------------------------------------------------------
+
+
+        //-----------------------------------------------------------------------
+        // Bank of filters of the same mode, processing one sample of all lanes (e.g. partials of a voice) at once.
+        // Lanes are kept in separate arrays so that Process() vectorises; coefficients are ramped linearly per block.
+        template <int LanesNum>
+        class FilterBank : public Unit
+        {
+        public:
+            static constexpr int PaddedLanesNum = (LanesNum + 3) & ~3;
+
+            //-----------------------------------------------------------------------
+            FilterBank(FilterBankMode mode = FilterBankMode_Spring) :
+                _mode(mode),
+                _rampStepsLeft(0)
+            {
+                for (int lane_i = 0; lane_i < PaddedLanesNum; lane_i++)
+                {
+                    _state1[lane_i] = _state2[lane_i] = 0;
+                    _isFrozen[lane_i] = false;
+                    _coeff1[lane_i] = _coeff2[lane_i] = _coeff3[lane_i] = 0;
+                    _coeff1Step[lane_i] = _coeff2Step[lane_i] = _coeff3Step[lane_i] = 0;
+                    _coeff1Target[lane_i] = _coeff2Target[lane_i] = _coeff3Target[lane_i] = 0;
+                }
+
+                // Spring lanes pass input through until set; SVF lanes must be set before use
+                if (_mode == FilterBankMode_Spring)
+                    for (int lane_i = 0; lane_i < LanesNum; lane_i++)
+                        SetPassThrough(lane_i);
+            }
+
+            //-----------------------------------------------------------------------
+            inline FilterBankMode GetMode() const { return _mode; }
+
+            // Spring mode: velocity = velocity * damp + (input - output) * acc * damp; output += velocity
+            inline void SetSpring(int lane_i, Sample acc, Sample damp) { SetSpringTarget(lane_i, acc, damp); JumpToTarget(lane_i); }
+            inline void SetSpringTarget(int lane_i, Sample acc, Sample damp)
+            {
+                ASSERT(_mode == FilterBankMode_Spring && lane_i >= 0 && lane_i < LanesNum);
+                _coeff1Target[lane_i] = damp;
+                _coeff2Target[lane_i] = acc * damp;
+            }
+            inline void SetSpringAccTarget(int lane_i, Sample acc) { SetSpringTarget(lane_i, acc, _coeff1Target[lane_i]); }
+
+            // Spring mode: output += (input - output) * half_step
+            inline void SetHalfStep(int lane_i, Sample half_step)
+            {
+                ASSERT(_mode == FilterBankMode_Spring && lane_i >= 0 && lane_i < LanesNum);
+                _coeff1Target[lane_i] = 0;
+                _coeff2Target[lane_i] = half_step;
+                JumpToTarget(lane_i);
+            }
+
+            inline void SetPassThrough(int lane_i) { SetHalfStep(lane_i, 1.0); }
+
+            // SVF mode (trapezoidal integration)
+            inline void SetSVF(int lane_i, Frequency cutoff, Ratio resonance) { SetSVFTarget(lane_i, cutoff, resonance); JumpToTarget(lane_i); }
+            inline void SetSVFTarget(int lane_i, Frequency cutoff, Ratio resonance)
+            {
+                ASSERT(_mode == FilterBankMode_SVF && lane_i >= 0 && lane_i < LanesNum);
+                ASSERT(resonance > 0);
+                cutoff = CLAMP(cutoff, 1.0, 0.49 * GetSamplesPerSec());
+                Sample g = tan(math::PI * cutoff * GetSampleDuration());
+                Sample k = 1.0 / resonance;
+                _coeff1Target[lane_i] = 1.0 / (1.0 + g * (g + k));
+                _coeff2Target[lane_i] = g * _coeff1Target[lane_i];
+                _coeff3Target[lane_i] = g * _coeff2Target[lane_i];
+            }
+
+            // Coefficient targets set since the last call are reached linearly in samples_num samples
+            inline void StartRamp(int samples_num)
+            {
+                ASSERT(samples_num > 0);
+                for (int lane_i = 0; lane_i < PaddedLanesNum; lane_i++)
+                {
+                    _coeff1Step[lane_i] = (_coeff1Target[lane_i] - _coeff1[lane_i]) / samples_num;
+                    _coeff2Step[lane_i] = (_coeff2Target[lane_i] - _coeff2[lane_i]) / samples_num;
+                    _coeff3Step[lane_i] = (_coeff3Target[lane_i] - _coeff3[lane_i]) / samples_num;
+                }
+                _rampStepsLeft = samples_num;
+            }
+
+            inline void Reset(int lane_i) { _state1[lane_i] = _state2[lane_i] = 0; }
+
+            // Frozen lanes keep their state and output 0, as silent partials skip their filters
+            inline void SetFrozen(int lane_i, bool is_frozen) { ASSERT(lane_i >= 0 && lane_i < LanesNum); _isFrozen[lane_i] = is_frozen; }
+            inline bool IsFrozen(int lane_i) const { return _isFrozen[lane_i]; }
+
+            //-----------------------------------------------------------------------
+            // Filters lanes[0 .. LanesNum) in place
+            inline void Process(Sample* lanes)
+            {
+                Sample io[PaddedLanesNum];
+                for (int lane_i = 0; lane_i < PaddedLanesNum; lane_i++)
+                    io[lane_i] = (lane_i < LanesNum ? lanes[lane_i] : 0);
+
+                UpdateRamp();
+
+                if (_mode == FilterBankMode_Spring)
+                {
+                    // _state1 = output, _state2 = velocity
+                    for (int lane_i = 0; lane_i < PaddedLanesNum; lane_i++)
+                    {
+                        Sample velocity = _state2[lane_i] * _coeff1[lane_i] + (io[lane_i] - _state1[lane_i]) * _coeff2[lane_i];
+                        Sample output = _state1[lane_i] + velocity;
+                        _state2[lane_i] = (_isFrozen[lane_i] ? _state2[lane_i] : velocity);
+                        _state1[lane_i] = (_isFrozen[lane_i] ? _state1[lane_i] : output);
+                        io[lane_i] = (_isFrozen[lane_i] ? 0 : output);
+                    }
+                }
+                else
+                {
+                    // _state1, _state2 = integrator states
+                    for (int lane_i = 0; lane_i < PaddedLanesNum; lane_i++)
+                    {
+                        Sample v3 = io[lane_i] - _state2[lane_i];
+                        Sample v1 = _coeff1[lane_i] * _state1[lane_i] + _coeff2[lane_i] * v3;
+                        Sample v2 = _state2[lane_i] + _coeff2[lane_i] * _state1[lane_i] + _coeff3[lane_i] * v3;
+                        _state1[lane_i] = (_isFrozen[lane_i] ? _state1[lane_i] : 2.0 * v1 - _state1[lane_i]);
+                        _state2[lane_i] = (_isFrozen[lane_i] ? _state2[lane_i] : 2.0 * v2 - _state2[lane_i]);
+                        io[lane_i] = (_isFrozen[lane_i] ? 0 : v2);
+                    }
+                }
+
+                for (int lane_i = 0; lane_i < LanesNum; lane_i++)
+                    lanes[lane_i] = io[lane_i];
+            }
+
+        protected:
+            //-----------------------------------------------------------------------
+            inline void JumpToTarget(int lane_i)
+            {
+                _coeff1[lane_i] = _coeff1Target[lane_i];
+                _coeff2[lane_i] = _coeff2Target[lane_i];
+                _coeff3[lane_i] = _coeff3Target[lane_i];
+                _coeff1Step[lane_i] = _coeff2Step[lane_i] = _coeff3Step[lane_i] = 0;
+            }
+
+            //-----------------------------------------------------------------------
+            inline void UpdateRamp()
+            {
+                if (_rampStepsLeft == 0)
+                    return;
+
+                if (--_rampStepsLeft == 0)
+                {
+                    for (int lane_i = 0; lane_i < PaddedLanesNum; lane_i++)
+                    {
+                        _coeff1[lane_i] = _coeff1Target[lane_i];
+                        _coeff2[lane_i] = _coeff2Target[lane_i];
+                        _coeff3[lane_i] = _coeff3Target[lane_i];
+                    }
+                }
+                else
+                {
+                    for (int lane_i = 0; lane_i < PaddedLanesNum; lane_i++)
+                    {
+                        _coeff1[lane_i] += _coeff1Step[lane_i];
+                        _coeff2[lane_i] += _coeff2Step[lane_i];
+                        _coeff3[lane_i] += _coeff3Step[lane_i];
+                    }
+                }
+            }
+
+            FilterBankMode _mode;
+            int _rampStepsLeft;
+
+            alignas(32) Sample _state1[PaddedLanesNum];
+            alignas(32) Sample _state2[PaddedLanesNum];
+            alignas(32) bool   _isFrozen[PaddedLanesNum];
+            alignas(32) Sample _coeff1[PaddedLanesNum];
+            alignas(32) Sample _coeff2[PaddedLanesNum];
+            alignas(32) Sample _coeff3[PaddedLanesNum];
+            alignas(32) Sample _coeff1Step[PaddedLanesNum];
+            alignas(32) Sample _coeff2Step[PaddedLanesNum];
+            alignas(32) Sample _coeff3Step[PaddedLanesNum];
+            alignas(32) Sample _coeff1Target[PaddedLanesNum];
+            alignas(32) Sample _coeff2Target[PaddedLanesNum];
+            alignas(32) Sample _coeff3Target[PaddedLanesNum];
+        };
+
+    }
+}
@@ -10,6 +10,7 @@ using namespace yoss::sound;
 
 //-----------------------------------------------------------------------
 // Static defines, consts and vars
+static std::atomic<BeatId> lastBeatId(NO_BEAT_ID);
 
 //-----------------------------------------------------------------------
 
@@ -28,3 +29,13 @@ Frequency Instrument::UnnormalizeFrequency(PartOfOne normalized_freq)
     return freq;
 }
 
+
+//-----------------------------------------------------------------------
+BeatId Instrument::NewBeatId()
+{
+    BeatId beat_id = ++lastBeatId;
+    if (beat_id == NO_BEAT_ID) // Wrapped around
+        beat_id = ++lastBeatId;
+    
+    return beat_id;
+}
@@ -7,6 +7,7 @@
 #include <vector>
 #include <map>
 #include <mutex>
+#include <atomic>
 
 
 namespace yoss
@@ -16,12 +17,14 @@ namespace yoss
         
         //-----------------------------------------------------------------------
         // Structs and classes:
+        struct BeatDynamics;
         class Instrument;
         //-----------------------------------------------------------------------
         
         //-----------------------------------------------------------------------
         // Types:
         using math::PartOfOne;
+        typedef uint32_t BeatId; // Serial of a beat added to an instrument, unique among all instruments
         //-----------------------------------------------------------------------
         
         //-----------------------------------------------------------------------
@@ -29,19 +32,38 @@ namespace yoss
         static const Frequency BEAT_MIN_SWING_FREQUENCY = 20.0; // Minimal freq allowed while the freq "swings" around to the minimal value due to inertia effects
         static const Frequency BEAT_FUNDAMENTAL_MIN_FREQUENCY = 200.0; //450.0;
         static const Frequency BEAT_FUNDAMENTAL_MAX_FREQUENCY = 600.0; //14000.0;
+        static const Volume    BEAT_CANCEL_FADE_FACTOR = 0.999; // Per-sample volume factor of a beat fading out after CancelBeat()
+        static const BeatId    NO_BEAT_ID = 0; // Of beats that played nothing
         //-----------------------------------------------------------------------
  
         
         
+        //-----------------------------------------------------------------------
+        // How a beat was struck, normalized by the beat detector from the kinematics of its segment.
+        // Defaults are neutral, for beats without them (e.g. demo beats); instruments map them once per beat.
+        struct BeatDynamics
+        {
+            PartOfOne velocity = 0.5;  // Peak speed of the strike
+            PartOfOne sharpness = 0.5; // How abruptly it rose to its peak and stopped after it
+        };
+        
         //-----------------------------------------------------------------------
         // Base class of all instruments
         class Instrument
         {
         public:
-            Instrument(): _isSustained(false) {}
+            Instrument(): _context(&AudioContext::Current()), _isSustained(false), _controlBlockSize(1), _controlSamplesLeft(0) {}
             virtual ~Instrument() {}
 
-            virtual void AddBeat(PartOfOne normalized_freq, Volume volume) {}
+            // Return the id of the added beat for CancelBeat(), NO_BEAT_ID if nothing is played for it
+            virtual BeatId AddBeat(PartOfOne normalized_freq, Volume volume) { return NO_BEAT_ID; }
+            virtual BeatId AddBeat(PartOfOne normalized_freq, Volume volume, const BeatDynamics& dynamics) { return AddBeat(normalized_freq, volume); } // Dynamics are ignored by default
+            
+            // Softly aborts the beat of beat_id if it's still played, e.g. a provisional beat that was not confirmed. Beats are
+            // only to be played provisionally to instruments that CanCancelBeats(), the others would play them out
+            virtual void CancelBeat(BeatId beat_id) {}
+            virtual bool CanCancelBeats() const { return false; }
+            
             virtual void SetSustain(bool do_sustain) { _isSustained = do_sustain; }
             virtual void SetPitch(PartOfOne normalized_freq) {}
             virtual void SetVolume(Volume volume) {}
@@ -50,8 +72,44 @@ namespace yoss
             
             virtual StereoSample GenerateSample() = 0;
             
+            // Called by SoundEngine when the instrument is added to it: moves the instrument and its units to the engine's
+            // context. Units sized by the rate when created (e.g. Delays) aren't resized, so the rates are to match.
+            virtual void Prepare(const AudioContext& context)
+            {
+                ASSERT(&context == _context || context.samplesPerSec == _context->samplesPerSec);
+                _context = &context;
+                SetUnitsContext(context);
+            }
+            const AudioContext& GetContext() const { return *_context; }
+            
+            // Num of samples between evaluations of modulators (LFOs, steppers) by instruments that support it; 1 = every sample
+            void SetControlBlockSize(int samples_num) { _controlBlockSize = MAX(samples_num, 1); _controlSamplesLeft = 0; }
+            int  GetControlBlockSize() const { return _controlBlockSize; }
+            
         protected:
+            // Sets context of the units the instrument owns; units of beats it spawns later are set to GetContext() when added
+            virtual void SetUnitsContext(const AudioContext& context) {}
+            
+            // Id for a new beat, never NO_BEAT_ID
+            static BeatId NewBeatId();
+            
+            // Whether modulators are to be evaluated at the current sample
+            inline bool IsControlTick()
+            {
+                if (_controlSamplesLeft > 0)
+                {
+                    _controlSamplesLeft--;
+                    return false;
+                }
+                
+                _controlSamplesLeft = _controlBlockSize - 1;
+                return true;
+            }
+            
+            const AudioContext* _context;
             bool _isSustained;
+            int  _controlBlockSize;
+            int  _controlSamplesLeft;
         };
  
     }    
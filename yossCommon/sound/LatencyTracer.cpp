@@ -0,0 +1,233 @@
+#include "LatencyTracer.h"
+#include "AudioClock.h"
+#include "../common/Log.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace yoss;
+using namespace yoss::sound;
+using namespace yoss::math;
+
+
+//-----------------------------------------------------------------------
+// Static defines, consts and vars
+
+static const char* STAGE_NAMES[LatencyTrace::STAGES_NUM] = { "arrival", "confirmed", "add_beat", "output" };
+
+//-----------------------------------------------------------------------
+
+
+//-----------------------------------------------------------------------
+LatencyTracer::LatencyTracer(Clock clock) :
+    _clock(clock),
+    _audioClock(nullptr),
+    _sliceTime(0),
+    _sampleDuration(0),
+    _outputLevel(0),
+    _onsetHoldEnd(0),
+    _addedTraces(LATENCY_TRACE_QUEUE_SIZE),
+    _cancelledBeats(LATENCY_TRACE_QUEUE_SIZE),
+    _completedTraces(LATENCY_TRACE_QUEUE_SIZE),
+    _historyPos(0),
+    _noOutputNum(0),
+    _cancelledNum(0),
+    _droppedNum(0)
+{
+    ASSERT(_clock);
+    _awaitingTraces.reserve(LATENCY_TRACE_QUEUE_SIZE);
+    _history.reserve(LATENCY_TRACE_HISTORY_SIZE);
+}
+
+//-----------------------------------------------------------------------
+void LatencyTracer::OnAddBeat(const LatencyTrace& trace, BeatId beat_id)
+{
+    if (beat_id == NO_BEAT_ID)
+        return;
+
+    LatencyTrace added_trace = trace;
+    added_trace.beatId = beat_id;
+
+    if (!_addedTraces.Push(added_trace))
+        _droppedNum++;
+}
+
+//-----------------------------------------------------------------------
+void LatencyTracer::OnCancelBeat(BeatId beat_id)
+{
+    if (beat_id != NO_BEAT_ID && !_cancelledBeats.Push(beat_id))
+        _droppedNum++;
+}
+
+//-----------------------------------------------------------------------
+void LatencyTracer::StartSlice(Time sample_duration, uint64_t sample_index)
+{
+    _sliceTime = (_audioClock && _audioClock->IsSynced() ? _audioClock->GetHostTimeAt((double)sample_index) : Now());
+    _sampleDuration = sample_duration;
+
+    // Beats added since the last slice can't have sounded before this one
+    LatencyTrace trace;
+    while (_addedTraces.Pop(trace))
+    {
+        if (_awaitingTraces.size() < _awaitingTraces.capacity())
+            _awaitingTraces.push_back({ trace, _outputLevel });
+        else
+            _droppedNum++;
+    }
+
+    // Pushed after the trace of the beat, so it's awaited already, unless completed
+    BeatId beat_id;
+    while (_cancelledBeats.Pop(beat_id))
+        for (auto awaiting_it = _awaitingTraces.begin(); awaiting_it != _awaitingTraces.end(); awaiting_it++)
+            if (awaiting_it->trace.beatId == beat_id)
+            {
+                _cancelledNum++;
+                _awaitingTraces.erase(awaiting_it);
+                break;
+            }
+
+    for (size_t trace_i = 0; trace_i < _awaitingTraces.size(); )
+    {
+        auto& awaiting = _awaitingTraces[trace_i];
+        if (_sliceTime - awaiting.trace.stamps[LatencyTrace::Stage_AddBeat] > LATENCY_TRACE_MAX_OUTPUT_DELAY)
+        {
+            _noOutputNum++;
+            Complete(awaiting.trace);
+            _awaitingTraces.erase(_awaitingTraces.begin() + trace_i);
+        }
+        else
+        {
+            trace_i++;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------
+void LatencyTracer::UpdateOutput(int sample_i, const StereoSample& sample)
+{
+    _outputLevel = MAX(MAX(fabs(sample.left), fabs(sample.right)), _outputLevel * LATENCY_TRACE_LEVEL_DECAY);
+    if (_awaitingTraces.empty())
+        return;
+
+    Time time = _sliceTime + sample_i * _sampleDuration;
+    bool is_holding = (time < _onsetHoldEnd);
+    for (auto& awaiting : _awaitingTraces)
+        awaiting.minLevel = (is_holding ? _outputLevel : MIN(awaiting.minLevel, _outputLevel));
+
+    // An onset is of the last beat added before it. Beats start in the order they're added, so the earlier ones
+    // that haven't sounded till then won't
+    auto& newest = _awaitingTraces.back();
+    if (!is_holding && _outputLevel > LATENCY_TRACE_SILENCE_LEVEL && _outputLevel > newest.minLevel * LATENCY_TRACE_ONSET_RISE)
+    {
+        newest.trace.stamps[LatencyTrace::Stage_Output] = time;
+        for (auto& awaiting : _awaitingTraces)
+        {
+            if (&awaiting != &newest)
+                _noOutputNum++;
+            Complete(awaiting.trace);
+        }
+        _awaitingTraces.clear();
+        _onsetHoldEnd = time + LATENCY_TRACE_ONSET_HOLD;
+    }
+}
+
+//-----------------------------------------------------------------------
+void LatencyTracer::Complete(const LatencyTrace& trace)
+{
+    if (!_completedTraces.Push(trace))
+        _droppedNum++;
+}
+
+//-----------------------------------------------------------------------
+void LatencyTracer::Collect()
+{
+    LatencyTrace trace;
+    while (_completedTraces.Pop(trace))
+        AddToHistory(trace);
+}
+
+//-----------------------------------------------------------------------
+void LatencyTracer::AddToHistory(const LatencyTrace& trace)
+{
+    if ((int)_history.size() < LATENCY_TRACE_HISTORY_SIZE)
+        _history.push_back(trace);
+    else
+        _history[_historyPos] = trace;
+
+    _historyPos = (_historyPos + 1) % LATENCY_TRACE_HISTORY_SIZE;
+}
+
+//-----------------------------------------------------------------------
+int LatencyTracer::GetTracesNum()
+{
+    Collect();
+    return (int)_history.size();
+}
+
+//-----------------------------------------------------------------------
+LatencyTracer::Percentiles LatencyTracer::GetPercentiles(LatencyTrace::Stage from, LatencyTrace::Stage to)
+{
+    Collect();
+
+    vector<Time> latencies;
+    latencies.reserve(_history.size());
+    for (auto& trace : _history)
+        if (trace.IsStamped(from) && trace.IsStamped(to))
+            latencies.push_back(trace.GetLatency(from, to));
+
+    Percentiles percentiles;
+    percentiles.count = (int)latencies.size();
+    if (latencies.empty())
+        return percentiles;
+
+    sort(latencies.begin(), latencies.end());
+    auto get_percentile = [&latencies] (double part) { return latencies[(size_t)ceil(part * latencies.size()) - 1]; };
+    percentiles.p50 = get_percentile(0.50);
+    percentiles.p90 = get_percentile(0.90);
+    percentiles.p99 = get_percentile(0.99);
+    percentiles.max = latencies.back();
+
+    return percentiles;
+}
+
+//-----------------------------------------------------------------------
+string LatencyTracer::ToString()
+{
+    string str = "Latency [ms] of " + Log::ToStr(GetTracesNum()) + " beats (no output: " + Log::ToStr(GetNoOutputNum()) +
+                 ", cancelled: " + Log::ToStr(GetCancelledNum()) + ", dropped: " + Log::ToStr(GetDroppedNum()) + ")";
+
+    auto add_line = [this, &str] (LatencyTrace::Stage from, LatencyTrace::Stage to)
+    {
+        auto percentiles = GetPercentiles(from, to);
+        str += "\n  " + string(STAGE_NAMES[from]) + " -> " + STAGE_NAMES[to] + ":" +
+               " p50=" + Log::ToStr(percentiles.p50 * 1000, 1) +
+               " p90=" + Log::ToStr(percentiles.p90 * 1000, 1) +
+               " p99=" + Log::ToStr(percentiles.p99 * 1000, 1) +
+               " max=" + Log::ToStr(percentiles.max * 1000, 1) +
+               " (n=" + Log::ToStr(percentiles.count) + ")";
+    };
+    for (int stage = 0; stage + 1 < LatencyTrace::STAGES_NUM; stage++)
+        add_line((LatencyTrace::Stage)stage, (LatencyTrace::Stage)(stage + 1));
+    add_line(LatencyTrace::Stage_SensorArrival, LatencyTrace::Stage_Output);
+
+    return str;
+}
+
+//-----------------------------------------------------------------------
+void LatencyTracer::Merge(LatencyTracer& other)
+{
+    ASSERT(&other != this);
+    Collect();
+    other.Collect();
+
+    // Oldest first, so that a full ring keeps the newest ones
+    int other_num = (int)other._history.size();
+    int oldest_pos = (other_num < LATENCY_TRACE_HISTORY_SIZE ? 0 : other._historyPos);
+    for (int trace_i = 0; trace_i < other_num; trace_i++)
+        AddToHistory(other._history[(oldest_pos + trace_i) % other_num]);
+
+    _noOutputNum += other._noOutputNum;
+    _cancelledNum += other._cancelledNum;
+    _droppedNum += other._droppedNum;
+}
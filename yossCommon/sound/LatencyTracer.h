@@ -0,0 +1,141 @@
+#pragma once
+
+#include "Sound.h"
+#include "Instrument.h"
+#include "../structs/SpscQueue.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+namespace yoss
+{
+    namespace sound
+    {
+        //-----------------------------------------------------------------------
+        // Structs and classes:
+        struct LatencyTrace;
+        class LatencyTracer;
+        class AudioClock;
+        //-----------------------------------------------------------------------
+
+        //-----------------------------------------------------------------------
+        // Constants:
+        static const int    LATENCY_TRACE_QUEUE_SIZE = 64; // Traces between AddBeat and their output, and completed ones not aggregated yet
+        static const int    LATENCY_TRACE_HISTORY_SIZE = 4096; // Num of last completed traces the percentiles are taken from
+        static const Volume LATENCY_TRACE_SILENCE_LEVEL = 0.001; // Output level over which a beat is considered sounding...
+        static const Ratio  LATENCY_TRACE_ONSET_RISE = 1.25; // ...when also this many times over the lowest output level since its AddBeat
+        static const Ratio  LATENCY_TRACE_LEVEL_DECAY = 0.998; // Per-sample decay of the followed output level: follows dips of retriggered notes, yet rises by less than LATENCY_TRACE_ONSET_RISE over half periods of BEAT_FUNDAMENTAL_MIN_FREQUENCY at 44.1 kHz
+        static const Time   LATENCY_TRACE_MAX_OUTPUT_DELAY = 0.5; // [sec] Traces without output after this are completed without it
+        static const Time   LATENCY_TRACE_ONSET_HOLD = 0.05; // [sec] After an onset of the output, rise of its attack isn't taken for the next beat's onset
+        //-----------------------------------------------------------------------
+
+
+        //-----------------------------------------------------------------------
+        // Times of one beat on its way from the sensor to the speaker, in the tracer's clock (0 = not reached)
+        struct LatencyTrace
+        {
+            enum Stage
+            {
+                Stage_SensorArrival,    // Arrival of the sample at the end of the beat's segment (the last fed one for provisional onsets)
+                Stage_SegmentConfirmed, // Detection of the beat (or of the provisional onset)
+                Stage_AddBeat,          // Entry to Instrument::AddBeat
+                Stage_Output,           // Rendering of the first output sample of the beat
+                STAGES_NUM
+            };
+
+            Time   stamps[STAGES_NUM] = {};
+            BeatId beatId = NO_BEAT_ID; // Of the beat the instrument played for it
+
+            bool IsStamped(Stage stage) const { return stamps[stage] > 0; }
+            Time GetLatency(Stage from, Stage to) const { return stamps[to] - stamps[from]; }
+        };
+
+        //-----------------------------------------------------------------------
+        // Collects traces of beats and exports percentiles of the latency between their stages.
+        // Detection stamps the first two stages (AccEngine::SetLatencyTracer), the code adding beats to instruments
+        // calls StampAddBeat() and OnAddBeat() and SoundEngine (SetLatencyTracer) stamps the output while rendering.
+        // Each beat's trace awaits its output till LATENCY_TRACE_MAX_OUTPUT_DELAY, however many beats are added meanwhile;
+        // a rise of the output is the last added beat's onset, and the earlier ones still awaiting won't sound after it.
+        // Everything is stamped by the tracer's clock, so that replays can run it on a virtual clock with an offline SoundEngine.
+        // OnAddBeat() may be called from one thread, stamping of the output from the audio thread and the reporting
+        // methods from one more; hand-offs are lock-free.
+        class LatencyTracer
+        {
+        public:
+            typedef std::function<Time ()> Clock;
+
+            struct Percentiles
+            {
+                int  count = 0;
+                Time p50 = 0, p90 = 0, p99 = 0, max = 0;
+            };
+
+            LatencyTracer(Clock clock);
+
+            Time Now() const { return _clock(); }
+
+            // While the clock is synced, output is stamped by the host time it maps the rendered samples to, instead of
+            // by the time the slice's callback came, which jitters. Only for a tracer on host time (system::GetCurrentTimestamp()).
+            // Best set before rendering, nullptr (default) = callback times
+            void SetAudioClock(const AudioClock* audio_clock) { _audioClock = audio_clock; }
+
+            // Right before Instrument::AddBeat, and right after it with the id it returned; beats that played nothing
+            // (NO_BEAT_ID) aren't traced
+            void StampAddBeat(LatencyTrace& trace) const { trace.stamps[LatencyTrace::Stage_AddBeat] = Now(); }
+            void OnAddBeat(const LatencyTrace& trace, BeatId beat_id);
+            void OnCancelBeat(BeatId beat_id); // Right after Instrument::CancelBeat; its trace isn't awaited any more
+
+            // SoundEngine, on the audio thread
+            void StartSlice(Time sample_duration, uint64_t sample_index); // Index of the slice's first sample in the context
+            void UpdateOutput(int sample_i, const StereoSample& sample);
+            bool IsAwaitingOutput() const { return !_awaitingTraces.empty(); }
+
+            // Reporting; Collect() should also be called regularly (e.g. on frames), so that completed traces aren't dropped
+            void        Collect();
+            Percentiles GetPercentiles(LatencyTrace::Stage from, LatencyTrace::Stage to);
+            int         GetTracesNum(); // Completed ones in the history
+            int         GetNoOutputNum() const { return _noOutputNum; } // Traces completed without output
+            int         GetCancelledNum() const { return _cancelledNum; } // Traces of cancelled beats, not completed
+            int         GetDroppedNum() const { return _droppedNum; } // Traces lost to full queues
+            std::string ToString();
+            void        Merge(LatencyTracer& other); // Adds completed traces and counters of other, e.g. of a replay on another thread
+
+        private:
+            void Complete(const LatencyTrace& trace);
+            void AddToHistory(const LatencyTrace& trace);
+
+            struct AwaitingTrace
+            {
+                LatencyTrace trace;
+                Volume       minLevel; // Of the output since the beat was added, or since LATENCY_TRACE_ONSET_HOLD after the last onset
+            };
+
+            Clock _clock;
+            const AudioClock* _audioClock;
+
+            // Audio thread only
+            std::vector<AwaitingTrace> _awaitingTraces;
+            Time   _sliceTime;
+            Time   _sampleDuration;
+            Volume _outputLevel;
+            Time   _onsetHoldEnd; // Till when the rise after the last onset is taken as part of it
+
+            SpscQueue<LatencyTrace> _addedTraces; // From OnAddBeat() to the audio thread
+            SpscQueue<BeatId>       _cancelledBeats; // From OnCancelBeat() to the audio thread
+            SpscQueue<LatencyTrace> _completedTraces; // From the audio thread to reporting
+
+            // Reporting thread only
+            std::vector<LatencyTrace> _history; // Ring of the last LATENCY_TRACE_HISTORY_SIZE traces
+            int _historyPos;
+
+            std::atomic<int> _noOutputNum;
+            std::atomic<int> _cancelledNum;
+            std::atomic<int> _droppedNum;
+        };
+
+    }
+}
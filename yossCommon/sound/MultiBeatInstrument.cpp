@@ -26,7 +26,7 @@ MultiBeatInstrument::MultiBeatInstrument() :
 }
 
 //-----------------------------------------------------------------------
-void MultiBeatInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
+BeatId MultiBeatInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
 {
     volume *= 0.3;
     volume *= volume;
@@ -35,6 +35,8 @@ void MultiBeatInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
     Frequency fundamental_freq = UnnormalizeFrequency(normalized_freq);
     
     Beat beat;
+    beat.SetContext(GetContext()); // Before its units are set up, as they take the rate from it
+    beat.id = NewBeatId();
     beat.fundamentalFreq = fundamental_freq;
     beat.volume = volume;
     
@@ -68,7 +70,7 @@ void MultiBeatInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
             {
                 harmonic.overtoneMultiplier = 60.0 / fundamental_freq;
             }
-            else if (Unit::IsFrequencyPlayable(HARMONIC_MULTIPLIER[i] * fundamental_freq))
+            else if (GetContext().IsFrequencyPlayable(HARMONIC_MULTIPLIER[i] * fundamental_freq))
             {
                 harmonic.overtoneMultiplier = HARMONIC_MULTIPLIER[i];
                 //harmonic.leftVolume *= RandomCoo(0.3, 0.9);
@@ -116,6 +118,7 @@ void MultiBeatInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
     }
     
     _beats.Push(beat);
+    return beat.id;
 }
 
 //-----------------------------------------------------------------------
@@ -151,6 +154,26 @@ StereoSample MultiBeatInstrument::GenerateSample_Beat(Beat& beat)
     return output_sample;
 }
 
+//-----------------------------------------------------------------------
+void MultiBeatInstrument::CancelBeat(BeatId beat_id)
+{
+    if (beat_id == NO_BEAT_ID) return;
+    
+    std::lock_guard<std::mutex> lock(_beatsMutex);
+    for (int beat_i = 0; beat_i < _beats.GetOccupiedSize(); beat_i++)
+    {
+        auto& beat = _beats.Get(beat_i);
+        if (beat.id != beat_id)
+            continue;
+        
+        for (auto& harmonic : beat.harmonics)
+        {
+            harmonic.envelope.SetReleaseFadeFactor(BEAT_CANCEL_FADE_FACTOR, BEAT_CANCEL_FADE_FACTOR);
+            harmonic.envelope.Release();
+        }
+    }
+}
+
 //-----------------------------------------------------------------------
 StereoSample MultiBeatInstrument::GenerateSample()
 {
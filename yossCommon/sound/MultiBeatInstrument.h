@@ -51,23 +51,31 @@ namespace yoss
                 Frequency overtoneMultiplier;
                 WaveSource wave, lfo;
                 Envelope envelope;
+                
+                void SetContext(const AudioContext& context) { wave.SetContext(context); lfo.SetContext(context); envelope.SetContext(context); }
             };
             
             //-----------------------------------------------------------------------
             struct Beat
             {
+                BeatId    id = NO_BEAT_ID;
                 Frequency fundamentalFreq = 0;
                 Volume    volume = 1;
                 bool      isFinished = false;
                 
                 BeatPartial harmonics[HARMONICS_PER_BEAT];
+                
+                void SetContext(const AudioContext& context) { for (auto& harmonic : harmonics) harmonic.SetContext(context); }
             };
             
             static const int MAX_BEATS = 6; // Max num of simultaneously-played beats
             
             MultiBeatInstrument();
             
-            virtual void AddBeat(PartOfOne normalized_freq, Volume volume);
+            using Instrument::AddBeat;
+            virtual BeatId AddBeat(PartOfOne normalized_freq, Volume volume);
+            virtual void CancelBeat(BeatId beat_id);
+            virtual bool CanCancelBeats() const { return true; }
             //virtual void SetPitch(PartOfOne normalized_freq);
             
             virtual StereoSample GenerateSample();
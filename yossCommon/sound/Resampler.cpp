@@ -0,0 +1,201 @@
+#include "Resampler.h"
+
+using namespace yoss;
+using namespace yoss::math;
+using namespace yoss::sound;
+
+
+//-----------------------------------------------------------------------
+// Static defines, consts and vars
+
+//-----------------------------------------------------------------------
+static Sample BlackmanWindow(double x, double half_width)
+{
+    if (x <= -half_width || x >= half_width)
+        return 0;
+
+    double u = x / half_width;
+    return 0.42 + 0.5 * cos(PI * u) + 0.08 * cos(DOUBLE_PI * u);
+}
+
+//-----------------------------------------------------------------------
+static void NormalizeKernelRow(Sample* row, int taps_num)
+{
+    Sample sum = 0;
+    for (int tap_i = 0; tap_i < taps_num; tap_i++)
+        sum += row[tap_i];
+
+    ASSERT(sum != 0);
+    for (int tap_i = 0; tap_i < taps_num; tap_i++)
+        row[tap_i] /= sum;
+}
+
+//-----------------------------------------------------------------------
+// Static members
+
+//-----------------------------------------------------------------------
+
+
+//-----------------------------------------------------------------------
+Resampler::Tables::Tables()
+{
+    linear.resize(RESAMPLE_PHASES_NUM * RESAMPLE_LINEAR_TAPS);
+    cubic.resize(RESAMPLE_PHASES_NUM * RESAMPLE_CUBIC_TAPS);
+
+    for (int phase_i = 0; phase_i < RESAMPLE_PHASES_NUM; phase_i++)
+    {
+        double f = (double)phase_i / RESAMPLE_PHASES_NUM;
+
+        // Taps are for frames [pos - 0, pos + 1]
+        Sample* linear_row = &linear[phase_i * RESAMPLE_LINEAR_TAPS];
+        linear_row[0] = 1.0 - f;
+        linear_row[1] = f;
+
+        // Catmull-Rom, taps are for frames [pos - 1, pos + 2]
+        Sample* cubic_row = &cubic[phase_i * RESAMPLE_CUBIC_TAPS];
+        double f2 = f * f, f3 = f2 * f;
+        cubic_row[0] = 0.5 * (-f3 + 2.0 * f2 - f);
+        cubic_row[1] = 0.5 * (3.0 * f3 - 5.0 * f2 + 2.0);
+        cubic_row[2] = 0.5 * (-3.0 * f3 + 4.0 * f2 + f);
+        cubic_row[3] = 0.5 * (f3 - f2);
+    }
+
+    // Windowed sinc, taps are for frames [pos - 3, pos + 4]
+    static constexpr double half_width = RESAMPLE_SINC_TAPS / 2;
+    for (int cutoff_i = 0; cutoff_i < RESAMPLE_SINC_CUTOFFS_NUM; cutoff_i++)
+    {
+        auto& table = sinc[cutoff_i];
+        table.resize(RESAMPLE_PHASES_NUM * RESAMPLE_SINC_TAPS);
+        double cutoff = RESAMPLE_SINC_PASSBAND / RESAMPLE_SINC_CUTOFFS_MAX_SPEED[cutoff_i];
+
+        for (int phase_i = 0; phase_i < RESAMPLE_PHASES_NUM; phase_i++)
+        {
+            double f = (double)phase_i / RESAMPLE_PHASES_NUM;
+            Sample* row = &table[phase_i * RESAMPLE_SINC_TAPS];
+
+            for (int tap_i = 0; tap_i < RESAMPLE_SINC_TAPS; tap_i++)
+            {
+                double x = (tap_i - RESAMPLE_SINC_TAPS / 2 + 1) - f; // Distance of tap from read pos
+                double sinc_x = (x == 0 ? 1.0 : sin(PI * cutoff * x) / (PI * cutoff * x));
+                row[tap_i] = cutoff * sinc_x * BlackmanWindow(x, half_width);
+            }
+
+            NormalizeKernelRow(row, RESAMPLE_SINC_TAPS);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------
+const Resampler::Tables& Resampler::GetTables()
+{
+    static const Tables tables; // Built once, by PrepareTables()
+    return tables;
+}
+
+//-----------------------------------------------------------------------
+Resampler::Kernel Resampler::GetKernel(ResampleQuality quality, Ratio play_speed)
+{
+    auto& tables = GetTables();
+    Kernel kernel;
+
+    switch (quality)
+    {
+        case ResampleQuality_Linear:
+            kernel.coeffs = tables.linear.data();
+            kernel.tapsNum = RESAMPLE_LINEAR_TAPS;
+            break;
+        case ResampleQuality_Cubic:
+            kernel.coeffs = tables.cubic.data();
+            kernel.tapsNum = RESAMPLE_CUBIC_TAPS;
+            break;
+        case ResampleQuality_Sinc:
+        {
+            // Lower the cutoff when playing faster, so that pitching up doesn't alias
+            int cutoff_i = 0;
+            while (cutoff_i < RESAMPLE_SINC_CUTOFFS_NUM - 1 && play_speed > RESAMPLE_SINC_CUTOFFS_MAX_SPEED[cutoff_i])
+                cutoff_i++;
+
+            kernel.coeffs = tables.sinc[cutoff_i].data();
+            kernel.tapsNum = RESAMPLE_SINC_TAPS;
+            break;
+        }
+        default:
+            ASSERT(false);
+    }
+
+    return kernel;
+}
+
+//-----------------------------------------------------------------------
+template <int TapsNum>
+int Resampler::ResampleStereoTaps(const Sample* coeffs, const Sample* buffer, int buffer_frames,
+                                  ResamplePos& pos, ResamplePos step, StereoSample* output, int frames_num)
+{
+    static constexpr int taps_before_pos = TapsNum / 2 - 1;
+
+    int frame_i = 0;
+    for (; frame_i < frames_num; frame_i++)
+    {
+        int frame = GetFrame(pos);
+        if (frame >= buffer_frames)
+            break;
+
+        const Sample* row = coeffs + GetPhase(pos) * TapsNum;
+        int first_frame = frame - taps_before_pos;
+        Sample left = 0, right = 0;
+
+        if (first_frame >= 0 && first_frame + TapsNum <= buffer_frames)
+        {
+            // Scalar over taps: the left and right products of a tap are adjacent, which the compiler packs into
+            // one SSE2 multiply-add, but taps of interleaved frames don't fill wider vectors
+            const Sample* src = buffer + 2 * first_frame;
+            for (int tap_i = 0; tap_i < TapsNum; tap_i++)
+            {
+                left  += src[2 * tap_i]     * row[tap_i];
+                right += src[2 * tap_i + 1] * row[tap_i];
+            }
+        }
+        else
+        {
+            // Near the ends of buffer: frames outside of it are silence
+            for (int tap_i = 0; tap_i < TapsNum; tap_i++)
+            {
+                int tap_frame = first_frame + tap_i;
+                if (tap_frame < 0 || tap_frame >= buffer_frames)
+                    continue;
+                left  += buffer[2 * tap_frame]     * row[tap_i];
+                right += buffer[2 * tap_frame + 1] * row[tap_i];
+            }
+        }
+
+        output[frame_i] = StereoSample(left, right);
+        pos += step;
+    }
+
+    return frame_i;
+}
+
+//-----------------------------------------------------------------------
+int Resampler::ResampleStereo(const Kernel& kernel, const Sample* buffer, int buffer_frames,
+                              ResamplePos& pos, ResamplePos step, StereoSample* output, int frames_num)
+{
+    ASSERT(kernel.coeffs && buffer);
+
+    switch (kernel.tapsNum)
+    {
+        case RESAMPLE_LINEAR_TAPS: return ResampleStereoTaps<RESAMPLE_LINEAR_TAPS>(kernel.coeffs, buffer, buffer_frames, pos, step, output, frames_num);
+        case RESAMPLE_CUBIC_TAPS:  return ResampleStereoTaps<RESAMPLE_CUBIC_TAPS>(kernel.coeffs, buffer, buffer_frames, pos, step, output, frames_num);
+        case RESAMPLE_SINC_TAPS:   return ResampleStereoTaps<RESAMPLE_SINC_TAPS>(kernel.coeffs, buffer, buffer_frames, pos, step, output, frames_num);
+        default:
+            ASSERT(false);
+            return 0;
+    }
+}
+
+//-----------------------------------------------------------------------
+StereoSample Resampler::ResampleStereoFrame(const Kernel& kernel, const Sample* buffer, int buffer_frames, ResamplePos pos)
+{
+    StereoSample output;
+    ResampleStereo(kernel, buffer, buffer_frames, pos, 0, &output, 1);
+    return output;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Sound.h"
+
+#include <cstdint>
+#include <vector>
+
+
+namespace yoss
+{
+    namespace sound
+    {
+        //-----------------------------------------------------------------------
+        // Structs and classes:
+        class Resampler;
+        //-----------------------------------------------------------------------
+
+        //-----------------------------------------------------------------------
+        // Types:
+        typedef uint64_t ResamplePos; // Fixed-point position in frames: integer part in the high bits, fraction in the low RESAMPLE_POS_FRACTION_BITS
+
+        enum ResampleQuality
+        {
+            ResampleQuality_Linear, // 2 taps, same as the old floor/ceil interpolation
+            ResampleQuality_Cubic,  // 4 taps, Catmull-Rom
+            ResampleQuality_Sinc,   // 8 taps, Blackman-windowed sinc with cutoff following the play speed
+            ResampleQualities_Num
+        };
+        //-----------------------------------------------------------------------
+
+        //-----------------------------------------------------------------------
+        // Constants:
+        static constexpr int RESAMPLE_POS_FRACTION_BITS = 32;
+        static constexpr ResamplePos RESAMPLE_POS_ONE = (ResamplePos)1 << RESAMPLE_POS_FRACTION_BITS;
+        static constexpr int RESAMPLE_PHASES_BITS = 9;
+        static constexpr int RESAMPLE_PHASES_NUM = 1 << RESAMPLE_PHASES_BITS; // Sub-frame positions per kernel table
+        static constexpr int RESAMPLE_LINEAR_TAPS = 2;
+        static constexpr int RESAMPLE_CUBIC_TAPS = 4;
+        static constexpr int RESAMPLE_SINC_TAPS = 8;
+        static constexpr int RESAMPLE_SINC_CUTOFFS_NUM = 4;
+        static constexpr Ratio RESAMPLE_SINC_CUTOFFS_MAX_SPEED[RESAMPLE_SINC_CUTOFFS_NUM] = { 1.0, 1.5, 2.0, 4.0 };
+        static constexpr Ratio RESAMPLE_SINC_PASSBAND = 0.95; // Part of Nyquist kept at play speed 1x
+        //-----------------------------------------------------------------------
+
+
+        //-----------------------------------------------------------------------
+        // Resampling of interleaved stereo buffers with a fixed-point read position
+        // and precomputed polyphase kernel tables (one row of taps per sub-frame phase)
+        class Resampler
+        {
+        public:
+            struct Kernel
+            {
+                const Sample* coeffs = nullptr; // RESAMPLE_PHASES_NUM rows of tapsNum coefficients
+                int tapsNum = 0;
+            };
+
+            // Builds the kernel tables, which takes a few ms. Called by SoundEngine on init so that the first
+            // GetKernel() doesn't build them on the audio thread; later calls do nothing
+            static void PrepareTables() { GetTables(); }
+
+            static Kernel GetKernel(ResampleQuality quality, Ratio play_speed);
+
+            static inline ResamplePos SpeedToStep(Ratio play_speed) { return (ResamplePos)(play_speed * (Ratio)RESAMPLE_POS_ONE + 0.5); }
+            static inline int         GetFrame(ResamplePos pos) { return (int)(pos >> RESAMPLE_POS_FRACTION_BITS); }
+            static inline int         GetPhase(ResamplePos pos) { return (int)(pos >> (RESAMPLE_POS_FRACTION_BITS - RESAMPLE_PHASES_BITS)) & (RESAMPLE_PHASES_NUM - 1); }
+
+            // Renders up to frames_num frames starting at pos, advancing pos by step per frame.
+            // Returns the num of rendered frames, which is less than frames_num only when the end of buffer is reached.
+            static int ResampleStereo(const Kernel& kernel, const Sample* buffer, int buffer_frames,
+                                      ResamplePos& pos, ResamplePos step, StereoSample* output, int frames_num);
+
+            static StereoSample ResampleStereoFrame(const Kernel& kernel, const Sample* buffer, int buffer_frames, ResamplePos pos);
+
+        protected:
+            struct Tables
+            {
+                Tables();
+                std::vector<Sample> linear;
+                std::vector<Sample> cubic;
+                std::vector<Sample> sinc[RESAMPLE_SINC_CUTOFFS_NUM];
+            };
+
+            static const Tables& GetTables();
+
+            template <int TapsNum>
+            static int ResampleStereoTaps(const Sample* coeffs, const Sample* buffer, int buffer_frames,
+                                          ResamplePos& pos, ResamplePos step, StereoSample* output, int frames_num);
+        };
+
+    }
+}
@@ -25,14 +25,25 @@ SamplerInstrument::SamplerInstrument(Sample* sample_buffer, int samples_num, Fre
     _beats(MAX_BEATS, false),
     _sampleBuffer(sample_buffer),
     _sampleBufferSize(samples_num),
-    _nativeFreq(native_frequency)
+    _nativeFreq(native_frequency),
+    _resampleQuality(DEFAULT_RESAMPLE_QUALITY),
+    _pitchCache(nullptr),
+    _pitchCacheStopRequested(false)
 {
 }
 
+//-----------------------------------------------------------------------
+SamplerInstrument::~SamplerInstrument()
+{
+    StopPitchCache();
+    delete _pitchCache.load();
+}
+
 //-----------------------------------------------------------------------
 void SamplerInstrument::LoadSample(const std::string& file, bool is_stereo, Frequency native_freq, Volume native_vol, int start_offset, int samples_num)
 {
     ASSERT(is_stereo); // ToDo: make WaveSource handle mono samples
+    ASSERT(!_pitchCacheThread.joinable() && !_pitchCache.load()); // Pitch cache is of the samples loaded before it
     
     auto sample_contents = system::LoadFile(system::GetResourcePath(file));
     
@@ -45,6 +56,31 @@ void SamplerInstrument::LoadSample(const std::string& file, bool is_stereo, Freq
     new_sample.nativeVolume = native_vol;
 }
 
+//-----------------------------------------------------------------------
+void SamplerInstrument::LoadSampleLayer(int sample_index, const std::string& file, Volume native_vol, PartOfOne min_velocity)
+{
+    ASSERT(sample_index >= 0 && sample_index < _samples.size());
+    LoadSample(file, true, _samples[sample_index].nativeFrequency, native_vol);
+    int layer_index = (int)_samples.size() - 1;
+    _samples[layer_index].layerMinVelocity = min_velocity;
+    
+    // Layers are chained from the sample by increasing min velocity
+    int softer_index = sample_index;
+    while (_samples[softer_index].strongerLayer >= 0 && _samples[_samples[softer_index].strongerLayer].layerMinVelocity <= min_velocity)
+        softer_index = _samples[softer_index].strongerLayer;
+    _samples[layer_index].strongerLayer = _samples[softer_index].strongerLayer;
+    _samples[softer_index].strongerLayer = layer_index;
+}
+
+//-----------------------------------------------------------------------
+const SamplerInstrument::SamplerSample& SamplerInstrument::GetSampleLayer(const SamplerSample& sample, PartOfOne velocity) const
+{
+    const SamplerSample* layer = &sample;
+    while (layer->strongerLayer >= 0 && velocity >= _samples[layer->strongerLayer].layerMinVelocity)
+        layer = &_samples[layer->strongerLayer];
+    return *layer;
+}
+
 //-----------------------------------------------------------------------
 void SamplerInstrument::SetCurrentSampleData(const Sample* sample_buffer, int samples_num)
 {
@@ -59,27 +95,70 @@ void SamplerInstrument::SetCurrentSampleNativeFrequency(Frequency native_frequen
 }
 
 //-----------------------------------------------------------------------
-void SamplerInstrument::AddBeat(PartOfOne normalized_freq, Volume volume, const SamplerSample& sample)
+BeatId SamplerInstrument::AddBeat(PartOfOne normalized_freq, Volume volume, const SamplerSample& sample, const BeatDynamics& dynamics, BeatId beat_id)
 {
-    SetCurrentSampleData(sample.buffer.data() + sample.offsetInBuffer, sample.lenInBuffer);
-    SetCurrentSampleNativeFrequency(sample.nativeFrequency);
+    auto& layer = GetSampleLayer(sample, dynamics.velocity);
+    Frequency frequency = UnnormalizeFrequency(normalized_freq);
+    auto pitched_sample = GetPitchedSample(layer, frequency);
+    if (pitched_sample)
+    {
+        // Within PITCH_CACHE_FREQUENCY_TOLERANCE of the beat's frequency, so played as is, at fixed speed
+        SetCurrentSampleData(pitched_sample->buffer.data(), (int)pitched_sample->buffer.size());
+        SetCurrentSampleNativeFrequency(frequency);
+    }
+    else
+    {
+        SetCurrentSampleData(layer.buffer.data() + layer.offsetInBuffer, layer.lenInBuffer);
+        SetCurrentSampleNativeFrequency(layer.nativeFrequency);
+    }
     
-    SamplerInstrument::AddBeat(normalized_freq, volume / sample.nativeVolume);
+    if (beat_id == NO_BEAT_ID)
+        beat_id = NewBeatId();
+    
+    PushBeat(beat_id, normalized_freq, volume / layer.nativeVolume, dynamics);
+    return beat_id;
+}
+
+//-----------------------------------------------------------------------
+BeatId SamplerInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
+{
+    return SamplerInstrument::AddBeat(normalized_freq, volume, BeatDynamics());
+}
+
+//-----------------------------------------------------------------------
+BeatId SamplerInstrument::AddBeat(PartOfOne normalized_freq, Volume volume, const BeatDynamics& dynamics)
+{
+    BeatId beat_id = NewBeatId();
+    PushBeat(beat_id, normalized_freq, volume, dynamics);
+    return beat_id;
 }
 
 //-----------------------------------------------------------------------
-void SamplerInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
+// Of the current sample data, see SetCurrentSampleData()
+void SamplerInstrument::PushBeat(BeatId beat_id, PartOfOne normalized_freq, Volume volume, const BeatDynamics& dynamics)
 {
     volume *= 0.3;
     volume *= volume;
+    volume *= 1 + (dynamics.velocity - 0.5) * 2 * DYNAMICS_GAIN_RANGE;
     volume = (volume > 1.0 ? 1.0 : volume);
     
     Beat beat;
+    beat.SetContext(GetContext()); // Before its units are set up, as they take the rate from it
+    beat.id = beat_id;
     beat.fundamentalFreq = UnnormalizeFrequency(normalized_freq);
     beat.leftVolume = beat.rightVolume = volume;
     beat.speedMultiplier = beat.fundamentalFreq / _nativeFreq;
     
+    // Softer strikes than neutral are muffled, the cutoff going exponentially from DYNAMICS_MIN_CUTOFF to Nyquist
+    if (dynamics.sharpness < 0.5)
+    {
+        Frequency max_cutoff = GetContext().samplesPerSec * 0.5;
+        Frequency cutoff = DYNAMICS_MIN_CUTOFF * pow(max_cutoff / DYNAMICS_MIN_CUTOFF, dynamics.sharpness * 2);
+        beat.lowPassCoef = 1 - exp(-DOUBLE_PI * cutoff * GetContext().sampleDuration);
+    }
+    
     // Initialize partial's units
+    beat.wave.SetResampleQuality(_resampleQuality);
     beat.wave.SetSample(_sampleBuffer, _sampleBufferSize);
     beat.wave.SetSamplePlaySpeed(beat.speedMultiplier);
     
@@ -98,12 +177,155 @@ void SamplerInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
     _beats.Push(beat);
 }
 
+//-----------------------------------------------------------------------
+void SamplerInstrument::CancelBeat(BeatId beat_id)
+{
+    if (beat_id == NO_BEAT_ID) return;
+    
+    std::lock_guard<std::mutex> lock(_beatsMutex);
+    for (int beat_i = 0; beat_i < _beats.GetOccupiedSize(); beat_i++)
+    {
+        auto& beat = _beats.Get(beat_i);
+        if (beat.id == beat_id)
+            beat.cancelFadeFactor = BEAT_CANCEL_FADE_FACTOR;
+    }
+}
+
+//-----------------------------------------------------------------------
+void SamplerInstrument::StartPitchCache(const std::vector<Frequency>& frequencies, size_t max_bytes)
+{
+    ASSERT(!_pitchCacheThread.joinable() && !_pitchCache.load());
+    
+    _pitchCacheStopRequested = false;
+    _pitchCacheThread = std::thread([this, frequencies, max_bytes]() { BuildPitchCache(frequencies, max_bytes); });
+}
+
+//-----------------------------------------------------------------------
+void SamplerInstrument::StopPitchCache()
+{
+    _pitchCacheStopRequested = true;
+    if (_pitchCacheThread.joinable())
+        _pitchCacheThread.join();
+}
+
+//-----------------------------------------------------------------------
+void SamplerInstrument::BuildPitchCache(const std::vector<Frequency>& frequencies, size_t max_bytes)
+{
+    const int frequencies_num = (int)frequencies.size();
+    size_t cache_bytes = 0;
+    int pitched_num = 0;
+    
+    auto cache = new PitchCache();
+    cache->frequencies = frequencies;
+    cache->pitchedSamples.resize(_samples.size() * frequencies_num);
+    
+    for (int sample_i = 0; sample_i < (int)_samples.size(); sample_i++)
+    {
+        auto& sample = _samples[sample_i];
+        const Sample* sample_data = sample.buffer.data() + sample.offsetInBuffer;
+        const int sample_frames = sample.lenInBuffer >> 1;
+        
+        for (int freq_i = 0; freq_i < frequencies_num; freq_i++)
+        {
+            if (_pitchCacheStopRequested)
+            {
+                delete cache;
+                return;
+            }
+            
+            auto& pitched = cache->pitchedSamples[sample_i * frequencies_num + freq_i];
+            Ratio play_speed = frequencies[freq_i] / sample.nativeFrequency;
+            if (play_speed == 1 || sample_frames == 0)
+                continue; // Plays at fixed speed anyway
+            
+            int pitched_frames = (int)ceil(sample_frames / play_speed);
+            size_t pitched_bytes = pitched_frames * 2 * sizeof(Sample);
+            if (cache_bytes + pitched_bytes > max_bytes)
+                continue;
+            
+            std::vector<StereoSample> frames(pitched_frames);
+            ResamplePos pos = 0;
+            auto kernel = Resampler::GetKernel(PITCH_CACHE_RESAMPLE_QUALITY, play_speed);
+            pitched_frames = Resampler::ResampleStereo(kernel, sample_data, sample_frames,
+                                                       pos, Resampler::SpeedToStep(play_speed), frames.data(), pitched_frames);
+            
+            pitched.buffer.resize(pitched_frames * 2);
+            for (int frame_i = 0; frame_i < pitched_frames; frame_i++)
+            {
+                pitched.buffer[2 * frame_i]     = frames[frame_i].left;
+                pitched.buffer[2 * frame_i + 1] = frames[frame_i].right;
+            }
+            pitched.frequency = frequencies[freq_i];
+            
+            cache_bytes += pitched_bytes;
+            pitched_num++;
+        }
+    }
+    
+    _pitchCache.store(cache, std::memory_order_release);
+    
+    Log::LogText("Sampler pitch cache: " + Log::ToStr(pitched_num) + " pitched samples, " +
+                 Log::ToStr(cache_bytes / (1024.0 * 1024.0), 1) + " MB");
+}
+
+//-----------------------------------------------------------------------
+const SamplerInstrument::PitchedSample* SamplerInstrument::GetPitchedSample(const SamplerSample& sample, Frequency frequency) const
+{
+    const PitchCache* cache = _pitchCache.load(std::memory_order_acquire);
+    if (!cache || _samples.empty() || &sample < _samples.data() || &sample >= _samples.data() + _samples.size())
+        return nullptr;
+    
+    const int frequencies_num = (int)cache->frequencies.size();
+    const int sample_i = (int)(&sample - _samples.data());
+    
+    for (int freq_i = 0; freq_i < frequencies_num; freq_i++)
+    {
+        if (ABS(cache->frequencies[freq_i] - frequency) > frequency * PITCH_CACHE_FREQUENCY_TOLERANCE)
+            continue;
+        
+        auto& pitched = cache->pitchedSamples[sample_i * frequencies_num + freq_i];
+        return (pitched.buffer.empty() ? nullptr : &pitched);
+    }
+    
+    return nullptr;
+}
+
 //-----------------------------------------------------------------------
 StereoSample SamplerInstrument::GenerateSample_Beat(Beat& beat)
 {
-    auto wave_output = (beat.speedMultiplier == 1) ?
-        beat.wave.UpdateStereoFixedSpeed() : beat.wave.UpdateStereo();
-    beat.isFinished = beat.wave.SampleFinished();
+    StereoSample wave_output;
+    if (beat.speedMultiplier == 1)
+    {
+        wave_output = beat.wave.UpdateStereoFixedSpeed();
+        beat.isFinished = beat.wave.SampleFinished();
+    }
+    else
+    {
+        if (beat.resampledBlockPos >= beat.resampledBlockFramesNum)
+        {
+            beat.resampledBlockFramesNum = beat.wave.UpdateStereoBlock(beat.resampledBlock, RESAMPLE_BLOCK_SIZE);
+            beat.resampledBlockPos = 0;
+        }
+        
+        if (beat.resampledBlockPos < beat.resampledBlockFramesNum)
+            wave_output = beat.resampledBlock[beat.resampledBlockPos++];
+        beat.isFinished = (beat.resampledBlockPos >= beat.resampledBlockFramesNum && beat.wave.SampleFinished());
+    }
+    
+    if (beat.lowPassCoef < 1)
+    {
+        beat.lowPassState.left += (wave_output.left - beat.lowPassState.left) * beat.lowPassCoef;
+        beat.lowPassState.right += (wave_output.right - beat.lowPassState.right) * beat.lowPassCoef;
+        wave_output = beat.lowPassState;
+    }
+    
+    if (beat.cancelFadeFactor < 1)
+    {
+        beat.leftVolume *= beat.cancelFadeFactor;
+        beat.rightVolume *= beat.cancelFadeFactor;
+        if (beat.leftVolume < 0.0001 && beat.rightVolume < 0.0001)
+            beat.isFinished = true;
+    }
     
     return StereoSample(
         wave_output.left * beat.leftVolume,
@@ -8,6 +8,8 @@
 #include <vector>
 #include <map>
 #include <mutex>
+#include <atomic>
+#include <thread>
 
 
 namespace yoss
@@ -19,6 +21,8 @@ namespace yoss
         class SamplerInstrument;
         // sub-class struct SamplerInstrument::Beat;
         // sub-class struct SamplerInstrument::SamplerSample;
+        // sub-class struct SamplerInstrument::PitchedSample;
+        // sub-class struct SamplerInstrument::PitchCache;
         //-----------------------------------------------------------------------
         
         //-----------------------------------------------------------------------
@@ -32,6 +36,8 @@ namespace yoss
         class SamplerInstrument : virtual public Instrument
         {
         public:
+            static const int RESAMPLE_BLOCK_SIZE = 32; // [frames] Rendered at once for pitched beats
+            
             //-----------------------------------------------------------------------
             struct SamplerSample
             {
@@ -40,6 +46,25 @@ namespace yoss
                 int lenInBuffer;
                 Frequency nativeFrequency;
                 Volume    nativeVolume;
+                PartOfOne layerMinVelocity = 0; // Min BeatDynamics::velocity for which this layer is played instead of softer ones
+                int       strongerLayer = -1;   // Index of the next layer of the sample, see LoadSampleLayer()
+            };
+            
+            //-----------------------------------------------------------------------
+            // Copy of a SamplerSample resampled to be played at fixed speed for a given frequency
+            struct PitchedSample
+            {
+                std::vector<Sample> buffer; // Empty if the copy didn't fit in the cache
+                Frequency frequency = 0;
+            };
+            
+            //-----------------------------------------------------------------------
+            // Built whole by the cache thread and published once finished, then kept till the instrument is destroyed
+            // (beats play from its buffers)
+            struct PitchCache
+            {
+                std::vector<Frequency>     frequencies;
+                std::vector<PitchedSample> pitchedSamples; // [sample index * frequencies num + frequency index]
             };
             
             //-----------------------------------------------------------------------
@@ -49,40 +74,80 @@ namespace yoss
                     wave(WaveSource::WST_StereoSample)
                 {}
                 
+                BeatId    id = NO_BEAT_ID; // Shared by the beats of one AddBeat, e.g. both drums of a hit
                 Frequency fundamentalFreq = 0;
                 Frequency speedMultiplier = 1;
                 bool      isFinished = false;
                 
                 Volume leftVolume = 1;
                 Volume rightVolume = 1;
+                Volume cancelFadeFactor = 1; // < 1 while fading out after CancelBeat()
+                Sample lowPassCoef = 1; // One-pole low-pass of softly struck beats, 1 = bypassed
+                StereoSample lowPassState;
                 WaveSource wave;
+                
+                // Resampled frames are rendered ahead in small blocks
+                StereoSample resampledBlock[RESAMPLE_BLOCK_SIZE];
+                int resampledBlockPos = 0;
+                int resampledBlockFramesNum = 0;
+                
+                void SetContext(const AudioContext& context) { wave.SetContext(context); }
             };
             
             //-----------------------------------------------------------------------
             // Constants:
             static const int MAX_BEATS = 6; // Max num of simultaneously-played beats
             static constexpr Frequency DEFAULT_SAMPLE_NATIVE_FREQUENCY = 440;
+            static constexpr ResampleQuality DEFAULT_RESAMPLE_QUALITY = ResampleQuality_Cubic;
+            static constexpr ResampleQuality PITCH_CACHE_RESAMPLE_QUALITY = ResampleQuality_Sinc;
+            static constexpr size_t DEFAULT_PITCH_CACHE_MAX_BYTES = 32 * 1024 * 1024;
+            static constexpr Ratio PITCH_CACHE_FREQUENCY_TOLERANCE = 0.001; // Relative freq diff at which a pitched copy is still used
+            static constexpr Ratio DYNAMICS_GAIN_RANGE = 0.5; // Gain of a beat is 1 -/+ this at BeatDynamics::velocity 0/1
+            static constexpr Frequency DYNAMICS_MIN_CUTOFF = 1500; // [Hz] Low-pass cutoff at sharpness 0, opening up to bypassed at neutral sharpness
             
             
             //-----------------------------------------------------------------------
             SamplerInstrument(Sample* sample_buffer = nullptr, int samples_num = 0, Frequency native_frequency = DEFAULT_SAMPLE_NATIVE_FREQUENCY);
+            virtual ~SamplerInstrument();
             
             virtual void LoadSample(const std::string& file, bool is_stereo, Frequency native_freq, Volume native_vol, int start_offset = 0, int samples_num = -1);
             virtual SamplerSample& GetSample(int sample_index) { ASSERT(sample_index >= 0 && sample_index < _samples.size()); return _samples[sample_index]; }
             int GetSamplesNum() { return (int)_samples.size(); }
+            
+            // Loads a layer of sample_index played for beats of at least min_velocity (of BeatDynamics), e.g. a harder hit of a drum,
+            // as DrumKitInstrument::LoadDrum() does for the drums it finds a "_hard" sample of
+            void LoadSampleLayer(int sample_index, const std::string& file, Volume native_vol, PartOfOne min_velocity);
+            const SamplerSample& GetSampleLayer(const SamplerSample& sample, PartOfOne velocity) const;
             std::vector<SamplerSample>& GetSamples() { return _samples; }
             
             virtual void SetCurrentSampleData(const Sample* sample_buffer, int samples_num = 0);
             virtual void SetCurrentSampleNativeFrequency(Frequency native_frequency);
             
-            virtual void AddBeat(PartOfOne normalized_freq, Volume volume);
-            virtual void AddBeat(PartOfOne normalized_freq, Volume volume, const SamplerSample& sample);
+            void SetResampleQuality(ResampleQuality quality) { _resampleQuality = quality; }
+            ResampleQuality GetResampleQuality() const { return _resampleQuality; }
+            
+            // Resamples all loaded samples to each of the frequencies in a background thread, so that beats at these
+            // frequencies play their pitched copy at fixed speed. Copies that don't fit in max_bytes are skipped.
+            // Must be called once, after all samples are loaded (see KineticInstrument::StartSamplesPitchCacheForNotes())
+            void StartPitchCache(const std::vector<Frequency>& frequencies, size_t max_bytes = DEFAULT_PITCH_CACHE_MAX_BYTES);
+            void StopPitchCache();
+            const PitchedSample* GetPitchedSample(const SamplerSample& sample, Frequency frequency) const;
+            
+            virtual BeatId AddBeat(PartOfOne normalized_freq, Volume volume);
+            virtual BeatId AddBeat(PartOfOne normalized_freq, Volume volume, const BeatDynamics& dynamics);
+            // Plays sample as part of the beat of beat_id if given, e.g. the second drum of a hit, as a new beat otherwise
+            virtual BeatId AddBeat(PartOfOne normalized_freq, Volume volume, const SamplerSample& sample, const BeatDynamics& dynamics = BeatDynamics(),
+                                   BeatId beat_id = NO_BEAT_ID);
+            virtual void CancelBeat(BeatId beat_id);
+            virtual bool CanCancelBeats() const { return true; }
             CircularBuffer<Beat>& GetBeats() { return _beats; }
             
             virtual StereoSample GenerateSample();
 
         protected:
             StereoSample GenerateSample_Beat(Beat& beat);
+            void BuildPitchCache(const std::vector<Frequency>& frequencies, size_t max_bytes);
+            void PushBeat(BeatId beat_id, PartOfOne normalized_freq, Volume volume, const BeatDynamics& dynamics);
 
             CircularBuffer<Beat> _beats;
             std::mutex _beatsMutex;
@@ -92,6 +157,11 @@ namespace yoss
             const Sample* _sampleBuffer;
             int _sampleBufferSize;
             Frequency _nativeFreq;
+            ResampleQuality _resampleQuality;
+            
+            std::atomic<PitchCache*> _pitchCache; // nullptr till the cache thread finishes it
+            std::thread              _pitchCacheThread;
+            std::atomic<bool>        _pitchCacheStopRequested;
         };
   
     }    
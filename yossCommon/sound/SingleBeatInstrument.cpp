@@ -26,7 +26,8 @@ SingleBeatInstrument::SingleBeatInstrument() :
     _pitchVelocity(0),
     _pitchTransition(SmoothTransition::Type_Ease),
     _volume(0),
-    _beatIsFinished(true)
+    _beatIsFinished(true),
+    _beatId(NO_BEAT_ID)
 {
     _pitchInertia.SetWeight(0.01);
     _pitchInertia.SetFriction(50.0);
@@ -50,6 +51,16 @@ SingleBeatInstrument::SingleBeatInstrument() :
     }
 }
 
+//-----------------------------------------------------------------------
+void SingleBeatInstrument::SetUnitsContext(const AudioContext& context)
+{
+    _pitchInertia.SetContext(context);
+    _pitchTransition.SetContext(context);
+    _volumeInertia.SetContext(context);
+    for (auto& harmonic : _harmonics)
+        harmonic.SetContext(context);
+}
+
 //-----------------------------------------------------------------------
 void SingleBeatInstrument::SetVolume(Volume volume)
 {
@@ -58,7 +69,7 @@ void SingleBeatInstrument::SetVolume(Volume volume)
 }
 
 //-----------------------------------------------------------------------
-void SingleBeatInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
+BeatId SingleBeatInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
 {
     volume *= 0.3;
     volume *= volume * volume;
@@ -78,6 +89,7 @@ void SingleBeatInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
     
     _volume = volume;
     _beatIsFinished = false;
+    _beatId = NewBeatId();
     
     //_volumeInertia.SetValue(volume);
     
@@ -116,7 +128,7 @@ void SingleBeatInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
             default: ASSERT(false);
         }
  
-        if (!Unit::IsFrequencyPlayable(harmonic.overtoneMultiplier * fundamental_freq))
+        if (!GetContext().IsFrequencyPlayable(harmonic.overtoneMultiplier * fundamental_freq))
         {
             harmonic.leftVolume = harmonic.rightVolume = 0;
             continue;
@@ -130,9 +142,28 @@ void SingleBeatInstrument::AddBeat(PartOfOne normalized_freq, Volume volume)
                          ", overtone=" + Log::ToStr(harmonic.overtoneMultiplier));
         
         harmonic.envelope.SetIsSustained(false);
+        harmonic.envelope.SetReleaseFadeFactor(RELEASE_FADE_FACTOR, RELEASE_FADE_FACTOR); // After a cancelled beat
         //harmonic.envelope.FadeCurrentAndStart(FADE_OUT_BEFORE_ATTACK);
         harmonic.envelope.StartFromCurrent();
     }
+    
+    return _beatId;
+}
+
+//-----------------------------------------------------------------------
+// Monophonic, so only the last beat can still be cancelled: an earlier one has been taken over by it
+void SingleBeatInstrument::CancelBeat(BeatId beat_id)
+{
+    std::lock_guard<std::mutex> lock(_beatMutex);
+    if (beat_id == NO_BEAT_ID || beat_id != _beatId)
+        return;
+    
+    for (auto& harmonic : _harmonics)
+    {
+        harmonic.envelope.SetReleaseFadeFactor(BEAT_CANCEL_FADE_FACTOR, BEAT_CANCEL_FADE_FACTOR);
+        harmonic.envelope.Release();
+    }
+    _beatId = NO_BEAT_ID;
 }
 
 //-----------------------------------------------------------------------
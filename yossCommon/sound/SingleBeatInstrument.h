@@ -48,6 +48,8 @@ namespace yoss
                 Frequency overtoneMultiplier;
                 WaveSource wave, lfo;
                 Envelope envelope;
+                
+                void SetContext(const AudioContext& context) { wave.SetContext(context); lfo.SetContext(context); envelope.SetContext(context); }
             };
             
             static constexpr int MAX_HARMONICS = 10; // Max num of harmonics per instrument
@@ -59,13 +61,18 @@ namespace yoss
             
             SingleBeatInstrument();
 
-            virtual void AddBeat(PartOfOne normalized_freq, Volume volume);
+            using Instrument::AddBeat;
+            virtual BeatId AddBeat(PartOfOne normalized_freq, Volume volume);
+            virtual void CancelBeat(BeatId beat_id);
+            virtual bool CanCancelBeats() const { return true; }
             virtual void SetVolume(Volume volume);
             //virtual void SetPitch(PartOfOne normalized_freq);
             
             virtual StereoSample GenerateSample();
             
         protected:
+            virtual void SetUnitsContext(const AudioContext& context);
+            
             Frequency _pitch;
             Frequency _targetPitch;
             Frequency _pitchVelocity;
@@ -74,6 +81,7 @@ namespace yoss
             Inertia   _volumeInertia;
             Volume    _volume;
             bool      _beatIsFinished;
+            BeatId    _beatId; // Of the beat played, till the next one takes over
             
             BeatPartial _harmonics[MAX_HARMONICS];
             
@@ -8,13 +8,40 @@ using namespace yoss::math;
 
 //-----------------------------------------------------------------------
 SoundEngine::SoundEngine(int samples_per_sec):
-    _samplesPerSec((Frequency)samples_per_sec),
-    _samplesCounter(0),
+    _context(&AudioContext::Default()),
+    _clock((Frequency)samples_per_sec),
+    _isLive(true),
+    _latencyTracer(nullptr),
     _finalCompressor(nullptr),
     _delays(nullptr),
     _isFunctional(false)
 {
-    Unit::SetSamplesPerSec(_samplesPerSec);
+    _context->SetSamplesPerSec((Frequency)samples_per_sec);
+    _context->samplesRendered = 0;
+    Init();
+}
+
+//-----------------------------------------------------------------------
+SoundEngine::SoundEngine(const AudioContext& context):
+    _context(&_ownContext),
+    _ownContext(context),
+    _clock(context.samplesPerSec),
+    _isLive(false),
+    _latencyTracer(nullptr),
+    _finalCompressor(nullptr),
+    _delays(nullptr),
+    _isFunctional(false)
+{
+    ASSERT(_ownContext.samplesPerSec > 0);
+    _ownContext.samplesRendered = 0;
+    Init();
+}
+
+//-----------------------------------------------------------------------
+void SoundEngine::Init()
+{
+    AudioContext::Scope context_scope(*_context);
+    Resampler::PrepareTables();
     
     if (USE_COMPRESSOR)
         _finalCompressor = new Compressor(OUTPUT_CHANELS);
@@ -62,10 +89,17 @@ void SoundEngine::GenerateSlice(OutputSampleType* output_left, OutputSampleType*
 {
     if (!_isFunctional) return;
     
+    if (_isLive)
+        _clock.AddObservation(system::GetCurrentTimestamp(), _context->GetSamplesRendered());
+    
     const int step = (output_left == output_right ? 2 : 1);
     output_right = (output_left == output_right ? output_right + 1 : output_right);
     
     std::lock_guard<std::mutex> lock(_instrumentsListMutex);
+    AudioContext::Scope context_scope(*_context);
+    
+    if (_latencyTracer)
+        _latencyTracer->StartSlice(_context->sampleDuration, _context->GetSamplesRendered());
     
     for(int sample_i = 0; sample_i < num_samples; sample_i++)
     {
@@ -86,14 +120,17 @@ void SoundEngine::GenerateSlice(OutputSampleType* output_left, OutputSampleType*
         if (USE_COMPRESSOR)
             output_sample = _finalCompressor->Update(output_sample);
         
+        if (_latencyTracer)
+            _latencyTracer->UpdateOutput(sample_i, output_sample);
+        
         *output_left = (OutputSampleType)output_sample.left;
         *output_right = (OutputSampleType)output_sample.right;
         
         output_left += step;
         output_right += step;
-        
-        _samplesCounter++;
     }
+    
+    _context->AdvanceSamplesRendered(num_samples);
 }
 
 //-----------------------------------------------------------------------
@@ -107,7 +144,7 @@ void SoundEngine::AddEcho(Time normalized_delay, Volume volume, Volume feedback_
     delay.volume[0] = delay.volume[1] = volume;
     delay.feedbackVolume = feedback_volume;
     delay.delay = MIN_ECHO_DELAY + (MAX_ECHO_DELAY - MIN_ECHO_DELAY) * normalized_delay;
-    delay.delayBackPos = (BufferBackPos)(delay.delay * _samplesPerSec);
+    delay.delayBackPos = (BufferBackPos)(delay.delay * _context->samplesPerSec);
     delay.takeAverage = take_average;
     
     _delays->List().push_back(delay);
@@ -118,6 +155,8 @@ void SoundEngine::AddInstrument(Instrument* instrument, Instrument* add_before)
 {
     std::lock_guard<std::mutex> lock(_instrumentsListMutex);
     
+    instrument->Prepare(*_context);
+    
     if (add_before)
     {
         auto it = std::find(_instruments.begin(), _instruments.end(), instrument);
@@ -145,3 +184,11 @@ bool SoundEngine::IsPlayingInstrument(Instrument *instrument)
     
     return (std::find(_instruments.begin(), _instruments.end(), instrument) != _instruments.end());
 }
+
+//-----------------------------------------------------------------------
+void SoundEngine::SetLatencyTracer(LatencyTracer* tracer)
+{
+    std::lock_guard<std::mutex> lock(_instrumentsListMutex);
+    
+    _latencyTracer = tracer;
+}
@@ -14,6 +14,8 @@
 #include "MultiBeatInstrument.h"
 #include "SamplerInstrument.h"
 #include "Drone.h"
+#include "AudioClock.h"
+#include "LatencyTracer.h"
 
 namespace yoss
 {
@@ -49,9 +51,15 @@ namespace yoss
         class SoundEngine
         {
         public:
-            SoundEngine(int samples_per_sec);
+            SoundEngine(int samples_per_sec); // Live engine: configures AudioContext::Default()
+            SoundEngine(const AudioContext& context); // Engine with its own context, e.g. for offline rendering
             ~SoundEngine();
             
+            inline const AudioContext& GetContext() const { return *_context; }
+            
+            // Maps host time (e.g. of sensor samples) to samplesRendered of the context; synced by live engines only
+            inline const AudioClock& GetClock() const { return _clock; }
+            
             void AddInstrument(Instrument* instrument, Instrument* add_before = nullptr);
             void RemoveInstrument(Instrument* instrument);
             bool IsPlayingInstrument(Instrument* instrument);
@@ -62,12 +70,21 @@ namespace yoss
             // Single buffer is also supported - then output_left == output_right
             void GenerateSlice(OutputSampleType* output_left, OutputSampleType* output_right, int num_samples);
             
+            
+            // Stamps the output of beats passed to tracer->OnAddBeat() while rendering; nullptr to stop
+            void SetLatencyTracer(LatencyTracer* tracer);
+            
         private:
-            Frequency _samplesPerSec;
-            int _samplesCounter;
+            void Init();
+            
+            AudioContext* _context;
+            AudioContext  _ownContext;
+            AudioClock    _clock;
+            bool          _isLive;
 
             std::vector<Instrument*> _instruments;
             std::mutex _instrumentsListMutex;
+            LatencyTracer* _latencyTracer; // Guarded by _instrumentsListMutex
             Delays* _delays;
             Compressor* _finalCompressor;
             bool _isFunctional;
@@ -25,29 +25,49 @@ using namespace yoss::sound;
 //-----------------------------------------------------------------------
 // Static members
 
-int Unit::_unitsNum = 0;
+#ifdef YOSS_DEBUG_SOUND_UNITS
+std::atomic<int> Unit::_unitsNum(0);
+std::mutex Unit::_allUnitsMutex;
 std::vector<Unit*> Unit::_allUnits;
-
-Frequency Unit::_samplesPerSec = 0;
-Time      Unit::_sampleDuration = 0;
+#endif
 
 
 
+#ifdef YOSS_DEBUG_SOUND_UNITS
 //-----------------------------------------------------------------------
 Unit::Unit():
+    _context(&AudioContext::Current()),
     _id()
 {
-    // Debugging
-    _unitsNum++;
+    Register();
+}
+
+//-----------------------------------------------------------------------
+Unit::Unit(const Unit& other):
+    _context(other._context),
+    _id(other._id)
+{
+    Register();
+}
+
+//-----------------------------------------------------------------------
+void Unit::Register()
+{
+    int units_num = ++_unitsNum;
     if (DEBUG_UNITS_INSTANCES)
+    {
+        std::lock_guard<std::mutex> lock(_allUnitsMutex);
         _allUnits.push_back(this);
-    if ((_unitsNum - 1) / UNITS_LEAKAGE_WARNING_COUNT != _unitsNum / UNITS_LEAKAGE_WARNING_COUNT)
+    }
+    
+    if ((units_num - 1) / UNITS_LEAKAGE_WARNING_COUNT != units_num / UNITS_LEAKAGE_WARNING_COUNT)
     {
-        Log::LogText("!!! Warning: sound::Units count = " + Log::ToStr(_unitsNum));
+        Log::LogText("!!! Warning: sound::Units count = " + Log::ToStr(units_num));
         
         if (DEBUG_UNITS_INSTANCES)
         {
             std::map<std::string, int> id_counters;
+            std::lock_guard<std::mutex> lock(_allUnitsMutex);
             for (auto it = _allUnits.begin(); it != _allUnits.end(); it++)
             {
                 std::string id = (*it)->_id;
@@ -72,18 +92,13 @@ Unit::~Unit()
     {
         Log::LogText("deleting unit #" + _id);
         
+        std::lock_guard<std::mutex> lock(_allUnitsMutex);
         auto pos_in_all = std::find(_allUnits.begin(), _allUnits.end(), this);
         ASSERT(pos_in_all != _allUnits.end());
         _allUnits.erase(pos_in_all);
     }
 }
-
-//-----------------------------------------------------------------------
-void Unit::SetSamplesPerSec(Frequency samples_per_sec)
-{
-    _samplesPerSec = samples_per_sec;
-    _sampleDuration = 1.0 / _samplesPerSec;
-}
+#endif // YOSS_DEBUG_SOUND_UNITS
 
 //-----------------------------------------------------------------------
 void Envelope::SetStep(EnvelopeStep step)
@@ -131,7 +146,7 @@ void Envelope::SetStep(EnvelopeStep step)
     {
         _step = step;
         _stepProgress = 0;
-        _stepProgressStep = (step_duration == 0 ? 0 : 1.0 / (step_duration * _samplesPerSec));
+        _stepProgressStep = (step_duration == 0 ? 0 : 1.0 / (step_duration * GetSamplesPerSec()));
         _stepStartVolume = _currentVolume;
         _stepEndVolume = volume_end;
         _stepEase = step_ease;
@@ -181,15 +196,98 @@ Volume Envelope::Update()
     return _currentVolume;
 }
 
+//-----------------------------------------------------------------------
+Sample ControlStepper::Update(int samples_num)
+{
+    ASSERT(samples_num > 0);
+    
+#ifdef YOSS_DEBUG_SOUND_UNITS
+    ControlStepper stepped = *this;
+    stepped.UpdateSteps(samples_num);
+#endif
+    
+    if (samples_num != _blockSamplesNum)
+        CalcBlockTransition(samples_num);
+    
+    Sample diff = _laggedPos - _pos;
+    Sample new_diff = _block00 * diff + _block01 * _springSpeed;
+    _springSpeed = _block10 * diff + _block11 * _springSpeed;
+    _laggedPos = _pos + new_diff;
+    
+#ifdef YOSS_DEBUG_SOUND_UNITS
+    ASSERT(ABS(_laggedPos - stepped._laggedPos) <= CONTROL_STEPPER_CHECK_TOLERANCE * (1 + ABS(stepped._laggedPos)));
+#endif
+    
+    return _laggedPos;
+}
+
+//-----------------------------------------------------------------------
+// Per-sample step matrix to the power of samples_num, by squaring
+void ControlStepper::CalcBlockTransition(int samples_num)
+{
+    Sample step00, step01, step10, step11;
+    if (_springAcc > 0)
+    {
+        // diff' = diff + speed', speed' = speed * damp - diff * acc * damp
+        step00 = 1 - _springAcc * _springDamp;  step01 = _springDamp;
+        step10 = -_springAcc * _springDamp;     step11 = _springDamp;
+    }
+    else
+    {
+        // No lag is a half-step of 1
+        Sample half_step = (_halfStep > 0 ? _halfStep : 1);
+        step00 = 1 - half_step;  step01 = 0;
+        step10 = 0;              step11 = 0;
+    }
+    
+    _block00 = 1;  _block01 = 0;
+    _block10 = 0;  _block11 = 1;
+    for (int power = samples_num; power > 0; power >>= 1)
+    {
+        if (power & 1)
+        {
+            Sample b00 = _block00 * step00 + _block01 * step10, b01 = _block00 * step01 + _block01 * step11;
+            Sample b10 = _block10 * step00 + _block11 * step10, b11 = _block10 * step01 + _block11 * step11;
+            _block00 = b00;  _block01 = b01;
+            _block10 = b10;  _block11 = b11;
+        }
+        
+        Sample s00 = step00 * step00 + step01 * step10, s01 = step00 * step01 + step01 * step11;
+        Sample s10 = step10 * step00 + step11 * step10, s11 = step10 * step01 + step11 * step11;
+        step00 = s00;  step01 = s01;
+        step10 = s10;  step11 = s11;
+    }
+    
+    _blockSamplesNum = samples_num;
+}
+
+//-----------------------------------------------------------------------
+// Reference per-sample steps, as Update(1) samples_num times
+void ControlStepper::UpdateSteps(int samples_num)
+{
+    for (int step_i = 0; step_i < samples_num; step_i++)
+    {
+        if (_springAcc > 0)
+        {
+            _springSpeed = _springSpeed * _springDamp + (_pos - _laggedPos) * _springAcc * _springDamp;
+            _laggedPos += _springSpeed;
+        }
+        else
+        {
+            _laggedPos += (_pos - _laggedPos) * (_halfStep > 0 ? _halfStep : 1);
+            _springSpeed = 0;
+        }
+    }
+}
+
 //-----------------------------------------------------------------------
 Compressor::Compressor(int chanels_num):
     _chanelsNum(chanels_num),
     _level(MAX_COMPRESSOR_OUTPUT_LEVEL),
-    _minLevel(MAX_COMPRESSOR_OUTPUT_LEVEL),
-    _prevMinLevel(MAX_COMPRESSOR_OUTPUT_LEVEL),
     _levelStep(0),
-    _delay((BufferBackPos)(COMPRESSOR_DELAY * _samplesPerSec) + ((BufferBackPos)(COMPRESSOR_DELAY * _samplesPerSec) % 2 == 1 ? 1 : 0)),
+    _delay((BufferBackPos)(COMPRESSOR_DELAY * GetSamplesPerSec()) + ((BufferBackPos)(COMPRESSOR_DELAY * GetSamplesPerSec()) % 2 == 1 ? 1 : 0)),
     _buffers(new CircularBuffer<Sample>*[chanels_num]),
+    _peaks(_delay, true),
     _currentOutput(new Sample[chanels_num])
 {
     ASSERT(_delay != 0);
@@ -219,25 +317,23 @@ void Compressor::UpdateInternal(Sample* input)
     auto pos_in_delay = _buffers[0]->GetTimestamp() % (_delay / 2);
     if (pos_in_delay == 0)
     {
-        auto next_min_level = MIN(_minLevel, _prevMinLevel);
+        // Level that fits the peak of the delayed samples, reached in half the delay
+        Sample delayed_peak = _peaks.GetMax();
+        auto next_min_level = (delayed_peak > MAX_COMPRESSOR_OUTPUT_LEVEL ? MAX_COMPRESSOR_OUTPUT_LEVEL / delayed_peak : MAX_COMPRESSOR_OUTPUT_LEVEL);
         _levelStep = (next_min_level - _level) / (Sample)(_delay / 2);
-        _prevMinLevel = _minLevel;
-        _minLevel = MAX_COMPRESSOR_OUTPUT_LEVEL;
     }
     
+    Sample peak = 0;
     for (int i = 0; i < _chanelsNum; i++)
     {
         Sample input_value = input[i];
         Sample abs_input_value = abs(input_value);
         _buffers[i]->Push(input_value);
         
-        if (abs_input_value > MAX_COMPRESSOR_OUTPUT_LEVEL)
-        {
-            Volume level_to_fit_sample = MAX_COMPRESSOR_OUTPUT_LEVEL / abs_input_value;
-            if (level_to_fit_sample < _minLevel)
-                _minLevel = level_to_fit_sample;
-        }
+        if (abs_input_value > peak)
+            peak = abs_input_value;
     }
+    _peaks.Push(peak);
     
     _level += _levelStep;
     
@@ -260,7 +356,7 @@ Delays::Delays(int chanels_num, Time buffer_len):
 {
     ASSERT(_chanelsNum <= MAX_DELAYS_CHANELS);
     
-    _buffersSize = buffer_len * _samplesPerSec + 1;
+    _buffersSize = buffer_len * GetSamplesPerSec() + 1;
     
     for (int i = 0; i < _chanelsNum; i++)
     {
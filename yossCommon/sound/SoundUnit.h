@@ -2,9 +2,17 @@
 
 #include <vector>
 #include <map>
+#ifdef YOSS_DEBUG_SOUND_UNITS
+    #include <atomic>
+    #include <mutex>
+    #include <string>
+#endif
 
 #include "Sound.h"
+#include "Resampler.h"
+#include "AudioContext.h"
 #include "../structs/CircularSummedBuffer.h"
+#include "../structs/CircularRangeBuffer.h"
 #include "../common/Log.h"
 
 
@@ -19,6 +27,8 @@ namespace yoss
         class HalfWayThere;
         class Inertia;
         class SmoothTransition;
+        class ControlRamp;
+        class ControlStepper;
         class WaveSource;
         class Envelope;
         class Compressor;
@@ -31,34 +41,54 @@ namespace yoss
         
         //-----------------------------------------------------------------------
         // Constants:
+#ifdef YOSS_DEBUG_SOUND_UNITS
         static const bool DEBUG_UNITS_INSTANCES = false; // Whether to print debug info on creating/deleting units
         static const int UNITS_LEAKAGE_WARNING_COUNT = 1000;
+        static const Sample CONTROL_STEPPER_CHECK_TOLERANCE = 1e-6; // Max diff of a block update from per-sample steps, relative to 1 + |value|
+#endif
         
         //-----------------------------------------------------------------------
 
         
         //-----------------------------------------------------------------------
-        // Base class of all sound Units
+        // Base class of all sound Units.
+        // Holds only its AudioContext: AudioContext::Current() at construction, until its instrument sets its own.
+        // In release builds units are trivially copyable and have no vtable;
+        // define YOSS_DEBUG_SOUND_UNITS to count live units and track them by id.
         class Unit
         {
         public:
+#ifdef YOSS_DEBUG_SOUND_UNITS
             Unit();
+            Unit(const Unit& other);
+            Unit& operator=(const Unit& other) = default;
             virtual ~Unit();
-            inline void SetID(std::string new_id) { _id = new_id; }
+            inline void SetID(const std::string& new_id) { _id = new_id; }
+            inline static int GetUnitsNum() { return _unitsNum; }
+#else
+            Unit(): _context(&AudioContext::Current()) {}
+            template <typename T> inline void SetID(const T&) {}
+            inline static int GetUnitsNum() { return -1; } // Not counted in release builds
+#endif
             
-            static void SetSamplesPerSec(Frequency samples_per_sec);
-            inline static Frequency GetSamplesPerSec() { return _samplesPerSec; }
-            inline static Time      GetSampleDuration() { return _sampleDuration; }
-            inline static bool IsFrequencyPlayable(Frequency freq) { return freq >= 20 && freq <= _samplesPerSec / 2; }
+            inline void SetContext(const AudioContext& context) { _context = &context; }
+            inline const AudioContext& GetContext() const { return *_context; }
+            inline Frequency GetSamplesPerSec() const { return _context->samplesPerSec; }
+            inline Time      GetSampleDuration() const { return _context->sampleDuration; }
+            inline bool IsFrequencyPlayable(Frequency freq) const { return _context->IsFrequencyPlayable(freq); }
         protected:
-            static Frequency _samplesPerSec;
-            static Time      _sampleDuration;
+            const AudioContext* _context;
             
+#ifdef YOSS_DEBUG_SOUND_UNITS
         private:
-            static int _unitsNum; // Counter of currently existing units
+            void Register();
+            
+            static std::atomic<int> _unitsNum; // Counter of currently existing units
+            static std::mutex _allUnitsMutex;
             static std::vector<Unit*> _allUnits;
             
             std::string _id;
+#endif
         };
         
         //-----------------------------------------------------------------------
@@ -133,7 +163,7 @@ namespace yoss
             
             SmoothTransition(TransitionType type, Time transition_duration = 1, Sample start_value = 0, Sample end_value = 0):
                 _type(type) { SetDuration(transition_duration); StartTransition(start_value, end_value); }
-            inline void SetDuration(Time transition_duration) { _duration = transition_duration; _progressStep = 1.0 / (_duration * _samplesPerSec); }
+            inline void SetDuration(Time transition_duration) { _duration = transition_duration; _progressStep = 1.0 / (_duration * GetSamplesPerSec()); }
             inline void StartTransition(Sample start_value, Sample end_value) { _startValue = start_value; _endValue = end_value; _progress = 0; }
             
             inline Sample Update()
@@ -162,6 +192,111 @@ namespace yoss
             double _progressStep;
         };
         
+        //-----------------------------------------------------------------------
+        // Linear ramp towards values evaluated once per control block (every few samples)
+        class ControlRamp : public Unit
+        {
+        public:
+            ControlRamp():
+                _currentValue(0), _targetValue(0), _step(0), _stepsLeft(0), _isSet(false) {}
+            inline void SetValue(Sample value) { _currentValue = _targetValue = value; _stepsLeft = 0; _isSet = true; }
+            inline void SetTarget(Sample target_value, int samples_num)
+            {
+                if (!_isSet)
+                {
+                    SetValue(target_value);
+                    return;
+                }
+                
+                _targetValue = target_value;
+                _step = (_targetValue - _currentValue) / samples_num;
+                _stepsLeft = samples_num;
+            }
+            
+            inline Sample Update()
+            {
+                if (_stepsLeft > 0)
+                    _currentValue = (--_stepsLeft == 0 ? _targetValue : _currentValue + _step);
+                return _currentValue;
+            }
+            
+            inline Sample GetValue() const { return _currentValue; }
+            
+        protected:
+            Sample _currentValue;
+            Sample _targetValue;
+            Sample _step;
+            int    _stepsLeft;
+            bool   _isSet;
+        };
+        
+        //-----------------------------------------------------------------------
+        // Value that follows its position with a lag, for modulators updated once per control block.
+        // Position is set by SetTarget() or moves linearly by SetMovement() / UpdateMovement(), like math::Stepper.
+        // The lag is a spring (acc > 0) or else a one-pole half-step, per sample; Update(samples_num) applies
+        // samples_num of these steps at once in closed form, with the position held for the block.
+        class ControlStepper : public Unit
+        {
+        public:
+            ControlStepper():
+                _pos(0), _laggedPos(0), _springSpeed(0), _springAcc(0), _springDamp(0), _halfStep(0),
+                _movementTarget(0), _movementSpeed(0), _blockSamplesNum(0) {}
+            
+            // Spring: speed = speed * damp + (pos - lagged) * acc * damp; lagged += speed
+            inline void SetSpring(Sample acc, Sample damp) { _springAcc = acc; _springDamp = damp; _blockSamplesNum = 0; }
+            // Half-step: lagged += (pos - lagged) * half_step, when there's no spring; 0 = no lag
+            inline void SetHalfStep(Sample half_step) { _halfStep = half_step; _blockSamplesNum = 0; }
+            
+            inline void SetTarget(Sample target, bool jump = false)
+            {
+                _pos = _movementTarget = target;
+                _movementSpeed = 0;
+                if (jump)
+                {
+                    _laggedPos = target;
+                    _springSpeed = 0;
+                }
+            }
+            inline void SetMovement(Sample target, Time duration)
+            {
+                ASSERT(duration > 0);
+                _movementTarget = target;
+                _movementSpeed = ABS(target - _pos) / duration;
+            }
+            inline void UpdateMovement(Time dt)
+            {
+                if (_movementSpeed == 0) return;
+                Sample step = _movementSpeed * dt;
+                if (ABS(_movementTarget - _pos) <= step)
+                {
+                    _pos = _movementTarget;
+                    _movementSpeed = 0;
+                }
+                else
+                    _pos += (_movementTarget > _pos ? step : -step);
+            }
+            
+            Sample Update(int samples_num = 1);
+            
+            inline Sample GetPos() const { return _pos; }
+            inline Sample GetLaggedPos() const { return _laggedPos; }
+            
+        protected:
+            Sample _pos;
+            Sample _laggedPos;
+            Sample _springSpeed;
+            Sample _springAcc, _springDamp;
+            Sample _halfStep;
+            Sample _movementTarget, _movementSpeed;
+            
+            // Transition of (lagged - pos, speed) over _blockSamplesNum steps, 0 = not calculated
+            int    _blockSamplesNum;
+            Sample _block00, _block01, _block10, _block11;
+            
+            void CalcBlockTransition(int samples_num);
+            void UpdateSteps(int samples_num);
+        };
+        
         //-----------------------------------------------------------------------
         class WaveSource : public Unit
         {
@@ -180,24 +315,27 @@ namespace yoss
             };
             
             WaveSource(WaveSourceType type, AngularVelocity phase_speed = 0, Sample initial_phase = 0):
-                _type(type), _phase(initial_phase), _phaseSpeed(phase_speed * _sampleDuration), _pulseWidth(0.5),
-                _sampleBuffer(nullptr), _sampleBufferSize(0), _currentSampleIndex(0) {}
+                _type(type), _phase(initial_phase), _phaseSpeed(phase_speed * GetSampleDuration()), _pulseWidth(0.5),
+                _sampleBuffer(nullptr), _sampleBufferSize(0), _currentSampleIndex(0),
+                _samplePos(0), _samplePosStep(0), _samplePlaySpeed(1), _resampleQuality(ResampleQuality_Linear) {}
             inline void SetType(WaveSourceType type) { _type = type; }
             inline void SetPulseWidth(PartOfOne pulsew) { _pulseWidth = pulsew; }
-            inline void SetPhaseSpeed(AngularVelocity phase_speed) { _phaseSpeed = phase_speed * _sampleDuration; }
-            inline void SetFrequency(Frequency freq) { _phaseSpeed = math::FrequencyToPhaseSpeed(freq) * _sampleDuration; }
+            inline void SetPhaseSpeed(AngularVelocity phase_speed) { _phaseSpeed = phase_speed * GetSampleDuration(); }
+            inline void SetFrequency(Frequency freq) { _phaseSpeed = math::FrequencyToPhaseSpeed(freq) * GetSampleDuration(); }
             inline void SetPhase(Angle phase) { _phase = phase; }
-            inline void SetSample(const Sample* sample_buffer, int samples_num = 0) { _phase = 0; _sampleBuffer = sample_buffer; _sampleBufferSize = samples_num; _currentSampleIndex = 0; }
-            inline void SetSamplePlaySpeed(AngularVelocity speed_multiplier) { _phaseSpeed = _sampleBufferSize > 0 ? (4.0 * math::PI * speed_multiplier) / _sampleBufferSize : 0; }
-            inline bool SampleFinished() const { return (_phase >= 2 * math::PI || _currentSampleIndex >= _sampleBufferSize); }
+            inline void SetSample(const Sample* sample_buffer, int samples_num = 0) { _phase = 0; _sampleBuffer = sample_buffer; _sampleBufferSize = samples_num; _currentSampleIndex = 0; _samplePos = 0; UpdateResampleKernel(); }
+            inline void SetSamplePlaySpeed(Ratio speed_multiplier) { _samplePlaySpeed = speed_multiplier; _samplePosStep = Resampler::SpeedToStep(speed_multiplier); UpdateResampleKernel(); }
+            inline void SetResampleQuality(ResampleQuality quality) { _resampleQuality = quality; UpdateResampleKernel(); }
+            inline bool SampleFinished() const { return (Resampler::GetFrame(_samplePos) >= (_sampleBufferSize >> 1) || _currentSampleIndex >= _sampleBufferSize); }
             
             inline bool IsStartingNewCicle() const { return _phase - _phaseSpeed < 0; } // || (int)(_phase / 2 * M_PI) != (int)((_phase - _phaseSpeed) / 2 * M_PI); }
             inline Frequency GetCurrentPhase() const { return _phase; }
             inline WaveSourceType GetType() const { return _type; }
             
-            inline Sample Update()
+            // steps_num > 1 advances the phase by that many samples at once, for control-rate LFOs
+            inline Sample Update(int steps_num = 1)
             {
-                _phase = fmod(_phase + _phaseSpeed, math::DOUBLE_PI);
+                _phase = fmod(_phase + _phaseSpeed * steps_num, math::DOUBLE_PI);
                 
                 switch (_type)
                 {
@@ -238,27 +376,18 @@ namespace yoss
                 ASSERT(_type == WST_StereoSample);
                 ASSERT(_sampleBuffer);
                 
-                _phase += _phaseSpeed;
-#define INTERPOLATE_SAMPLE 1
-#if INTERPOLATE_SAMPLE
-                if (_phase > 2 * math::PI)
-                    return StereoSample(0);
+                auto output = Resampler::ResampleStereoFrame(_resampleKernel, _sampleBuffer, _sampleBufferSize >> 1, _samplePos);
+                _samplePos += _samplePosStep;
+                return output;
+            }
+            
+            // Renders frames_num frames at the current play speed; returns less than frames_num only when the sample ends
+            inline int UpdateStereoBlock(StereoSample* output, int frames_num)
+            {
+                ASSERT(_type == WST_StereoSample);
+                ASSERT(_sampleBuffer);
                 
-                math::PartOfOne progress = _phase / (2.0 * math::PI);
-                math::Coo pos_in_buffer = progress * (_sampleBufferSize >> 1);
-                math::PartOfOne interpolate_progress = pos_in_buffer - floor(pos_in_buffer);
-                int pos_in_buffer1 = 2 * (int)floor(pos_in_buffer);
-                int pos_in_buffer2 = 2 * (int)ceil(pos_in_buffer);
-                auto left_sample  = math::Interpolate(_sampleBuffer[pos_in_buffer1], _sampleBuffer[pos_in_buffer2], interpolate_progress);
-                auto right_sample = math::Interpolate(_sampleBuffer[pos_in_buffer1 + 1], _sampleBuffer[pos_in_buffer2 + 1], interpolate_progress);
-#else
-                int pos_in_buffer = 2 * (int)round((_phase * _sampleBufferSize) / (4.0 * math::PI));
-                if (pos_in_buffer >= _sampleBufferSize - 1)
-                    return StereoSample(0);
-                auto left_sample  = _sampleBuffer[pos_in_buffer];
-                auto right_sample = _sampleBuffer[pos_in_buffer + 1];
-#endif
-                return StereoSample(left_sample, right_sample);
+                return Resampler::ResampleStereo(_resampleKernel, _sampleBuffer, _sampleBufferSize >> 1, _samplePos, _samplePosStep, output, frames_num);
             }
             
             inline StereoSample UpdateStereoFixedSpeed()
@@ -285,6 +414,13 @@ namespace yoss
             const Sample* _sampleBuffer;
             int _sampleBufferSize;
             int _currentSampleIndex;
+            ResamplePos _samplePos;
+            ResamplePos _samplePosStep;
+            Ratio _samplePlaySpeed;
+            ResampleQuality _resampleQuality;
+            Resampler::Kernel _resampleKernel;
+            
+            inline void UpdateResampleKernel() { _resampleKernel = Resampler::GetKernel(_resampleQuality, _samplePlaySpeed); }
         };
         
         //-----------------------------------------------------------------------
@@ -382,11 +518,10 @@ namespace yoss
         protected:
             int       _chanelsNum;
             Volume    _level;
-            Volume    _minLevel;
-            Volume    _prevMinLevel;
             Volume    _levelStep;
             BufferBackPos _delay;
             CircularBuffer<Sample>** _buffers;
+            CircularRangeBuffer<Sample> _peaks; // Max abs value of the chanels of each sample in the delay
             Sample*   _currentOutput;
             
             void UpdateInternal(Sample* input);
@@ -439,7 +574,7 @@ namespace yoss
                 d.volume[0] = d.volume[1] = volume;
                 d.feedbackVolume = feedback_volume;
                 d.delay = delay;
-                d.delayBackPos = (BufferBackPos)(delay * _samplesPerSec);
+                d.delayBackPos = (BufferBackPos)(delay * GetSamplesPerSec());
                 d.takeAverage = take_average;
                 _delays.push_back(d);
             }
@@ -0,0 +1,252 @@
+#pragma once
+
+#include "../common/Log.h"
+
+
+namespace yoss
+{
+
+    //-----------------------------------------------------------------------
+    // Circular buffer of the last size values with range queries over recent windows:
+    // sums and averages in O(1) from prefix sums, min and max in O(1) amortized from monotonic deques.
+    // Min and max are O(1) over the whole buffer and O(log size) over a shorter window, so it's best sized to the window.
+    // Prefix sums are rebuilt from the values once per size pushes, so their rounding error doesn't accumulate.
+    template <class T> class CircularRangeBuffer
+    {
+    public:
+        typedef int BackPos;
+
+        //-----------------------------------------------------------------------
+        // Initially full buffer holds size default (zero) values
+        CircularRangeBuffer(int size, bool initially_full) :
+            _size(size)
+        {
+            ASSERT(size > 0);
+            _values = new T[_size];
+            _prefixSums = new T[_size + 1];
+            _minDeque = new int[_size];
+            _maxDeque = new int[_size];
+
+            if (initially_full)
+                FillWith(T());
+            else
+                Clear();
+        }
+
+        //-----------------------------------------------------------------------
+        ~CircularRangeBuffer()
+        {
+            delete[] _values;
+            delete[] _prefixSums;
+            delete[] _minDeque;
+            delete[] _maxDeque;
+        }
+
+        CircularRangeBuffer(const CircularRangeBuffer&) = delete;
+        CircularRangeBuffer& operator=(const CircularRangeBuffer&) = delete;
+
+        //-----------------------------------------------------------------------
+        void Clear()
+        {
+            _occupied = 0;
+            _currentPos = _size - 1;
+            _currentSumPos = 0;
+            _pushesSinceRebase = 0;
+            _prefixSums[0] = T();
+            _minDequeStart = _minDequeSize = 0;
+            _maxDequeStart = _maxDequeSize = 0;
+        }
+
+        //-----------------------------------------------------------------------
+        void FillWith(const T& value)
+        {
+            Clear();
+            for (int i = 0; i < _size; i++)
+                Push(value);
+        }
+
+        //-----------------------------------------------------------------------
+        void Push(const T& value)
+        {
+            if (_occupied < _size)
+                _occupied++;
+
+            _currentPos = (_currentPos + 1 < _size ? _currentPos + 1 : 0);
+            _values[_currentPos] = value;
+
+            int prev_sum_pos = _currentSumPos;
+            _currentSumPos = (_currentSumPos + 1 <= _size ? _currentSumPos + 1 : 0);
+            _prefixSums[_currentSumPos] = _prefixSums[prev_sum_pos] + value;
+
+            // The oldest entry of a deque drops out along with its value, once the buffer is full;
+            // entries of values that aren't below (above) the new one won't be the min (max) of any window anymore
+            if (_minDequeSize > 0 && _minDeque[_minDequeStart] == _currentPos)
+                PopFront(_minDequeStart, _minDequeSize);
+            if (_maxDequeSize > 0 && _maxDeque[_maxDequeStart] == _currentPos)
+                PopFront(_maxDequeStart, _maxDequeSize);
+
+            while (_minDequeSize > 0 && !(_values[GetDequeEntry(_minDeque, _minDequeStart, _minDequeSize - 1)] < value))
+                _minDequeSize--;
+            while (_maxDequeSize > 0 && !(value < _values[GetDequeEntry(_maxDeque, _maxDequeStart, _maxDequeSize - 1)]))
+                _maxDequeSize--;
+            _minDeque[GetDequeSlot(_minDequeStart, _minDequeSize++)] = _currentPos;
+            _maxDeque[GetDequeSlot(_maxDequeStart, _maxDequeSize++)] = _currentPos;
+
+            if (++_pushesSinceRebase >= _size)
+                Rebase();
+        }
+
+        //-----------------------------------------------------------------------
+        const T& Get(BackPos back_pos = 0) const
+        {
+            ASSERT(IsBackPosOccupied(back_pos));
+            return _values[GetAbsPos(back_pos)];
+        }
+
+        //-----------------------------------------------------------------------
+        T GetSum(BackPos from_back_pos, BackPos to_back_pos) const
+        {
+            ASSERT(from_back_pos >= 0 && from_back_pos <= to_back_pos);
+            ASSERT(IsBackPosOccupied(to_back_pos));
+
+            return _prefixSums[GetSumPos(from_back_pos)] - _prefixSums[GetSumPos(to_back_pos + 1)];
+        }
+
+        //-----------------------------------------------------------------------
+        T GetAverage(BackPos from_back_pos, BackPos to_back_pos) const
+        {
+            double one_div_elements_num = (double)1 / (double)(to_back_pos - from_back_pos + 1);
+            T avg = GetSum(from_back_pos, to_back_pos) * one_div_elements_num;
+            return avg;
+        }
+
+        //-----------------------------------------------------------------------
+        // Of the values from the last one back to to_back_pos; -1 = the whole buffer
+        const T& GetMin(BackPos to_back_pos = -1) const
+        {
+            return _values[GetDequeFront(_minDeque, _minDequeStart, _minDequeSize, to_back_pos)];
+        }
+
+        //-----------------------------------------------------------------------
+        const T& GetMax(BackPos to_back_pos = -1) const
+        {
+            return _values[GetDequeFront(_maxDeque, _maxDequeStart, _maxDequeSize, to_back_pos)];
+        }
+
+        //-----------------------------------------------------------------------
+        bool IsBackPosOccupied(BackPos back_pos) const
+        {
+            ASSERT(back_pos >= 0);
+            return ((int)back_pos < _occupied);
+        }
+
+        //-----------------------------------------------------------------------
+        int GetOccupiedSize() const
+        {
+            return _occupied;
+        }
+
+        //-----------------------------------------------------------------------
+        int GetSize() const
+        {
+            return _size;
+        }
+
+
+    protected:
+        int _size;
+        int _occupied;
+        T*  _values;
+        int _currentPos;
+        T*  _prefixSums; // Of the values up to each one since the last rebase, a slot longer than _values
+        int _currentSumPos;
+        int _pushesSinceRebase;
+
+        // Positions of the values that are the min (max) of some window ending with the last value,
+        // from the oldest one (the min of the whole buffer) with increasing (decreasing) values
+        int* _minDeque;
+        int  _minDequeStart, _minDequeSize;
+        int* _maxDeque;
+        int  _maxDequeStart, _maxDequeSize;
+
+        //-----------------------------------------------------------------------
+        int GetAbsPos(BackPos back_pos) const
+        {
+            int pos = _currentPos - (int)back_pos;
+            return (pos < 0 ? pos + _size : pos);
+        }
+
+        //-----------------------------------------------------------------------
+        // Slot of the sum of the values up to the one at back_pos
+        int GetSumPos(BackPos back_pos) const
+        {
+            int pos = _currentSumPos - (int)back_pos;
+            return (pos < 0 ? pos + _size + 1 : pos);
+        }
+
+        //-----------------------------------------------------------------------
+        int GetDequeSlot(int start, int i) const
+        {
+            int slot = start + i;
+            return (slot >= _size ? slot - _size : slot);
+        }
+
+        //-----------------------------------------------------------------------
+        int GetDequeEntry(const int* deque, int start, int i) const
+        {
+            return deque[GetDequeSlot(start, i)];
+        }
+
+        //-----------------------------------------------------------------------
+        void PopFront(int& start, int& size)
+        {
+            start = GetDequeSlot(start, 1);
+            size--;
+        }
+
+        //-----------------------------------------------------------------------
+        // Oldest entry of the deque within the window, found by binary search as entries' ages decrease
+        int GetDequeFront(const int* deque, int start, int size, BackPos to_back_pos) const
+        {
+            ASSERT(size > 0);
+            if (to_back_pos < 0 || to_back_pos >= _occupied - 1)
+                return deque[start];
+
+            int lo = 0;
+            int hi = size - 1; // The last value is always in the deque
+            while (lo < hi)
+            {
+                int mid = (lo + hi) / 2;
+                if (GetBackPos(GetDequeEntry(deque, start, mid)) <= to_back_pos)
+                    hi = mid;
+                else
+                    lo = mid + 1;
+            }
+            return GetDequeEntry(deque, start, lo);
+        }
+
+        //-----------------------------------------------------------------------
+        BackPos GetBackPos(int abs_pos) const
+        {
+            int back_pos = _currentPos - abs_pos;
+            return (back_pos < 0 ? back_pos + _size : back_pos);
+        }
+
+        //-----------------------------------------------------------------------
+        // Sums restart from the oldest value, which keeps them as exact as a sum over the buffer
+        void Rebase()
+        {
+            int sum_pos = GetSumPos(_occupied);
+            _prefixSums[sum_pos] = T();
+            for (BackPos back_pos = _occupied - 1; back_pos >= 0; back_pos--)
+            {
+                int next_sum_pos = (sum_pos + 1 <= _size ? sum_pos + 1 : 0);
+                _prefixSums[next_sum_pos] = _prefixSums[sum_pos] + Get(back_pos);
+                sum_pos = next_sum_pos;
+            }
+
+            _pushesSinceRebase = 0;
+        }
+    };
+
+}
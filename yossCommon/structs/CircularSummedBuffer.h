@@ -25,7 +25,7 @@ namespace yoss
         }
 
         //-----------------------------------------------------------------------
-        CircularSummedBuffer()
+        ~CircularSummedBuffer()
         {
             delete[] _buffer;
         }
@@ -0,0 +1,209 @@
+#pragma once
+
+#include "../common/Log.h"
+#include "../common/Math.h"
+
+
+namespace yoss
+{
+
+    //-----------------------------------------------------------------------
+    // Circular buffer of 3D vectors, kept as three single-precision columns (x, y, z).
+    // Has the interface of CircularSummedBuffer<Vector3D>, but sums are calculated by scanning the columns,
+    // which stay contiguous (at most two runs per range) and so are vectorisable.
+    class CircularVectorBuffer
+    {
+    public:
+        typedef int Timestamp;
+        typedef int BackPos;
+        typedef float Component;
+
+        //-----------------------------------------------------------------------
+        CircularVectorBuffer(int size, bool initially_full) :
+            _size(size),
+            _occupied(initially_full ? size : 0),
+            _currentPos(-1),
+            _currentTimestamp(-1)
+        {
+            ASSERT(size > 0);
+            for (int ci = 0; ci < 3; ci++)
+            {
+                _columns[ci] = new Component[_size];
+                for (int i = 0; i < _size; i++)
+                    _columns[ci][i] = 0;
+            }
+        }
+
+        //-----------------------------------------------------------------------
+        ~CircularVectorBuffer()
+        {
+            for (int ci = 0; ci < 3; ci++)
+                delete[] _columns[ci];
+        }
+
+        CircularVectorBuffer(const CircularVectorBuffer&) = delete;
+        CircularVectorBuffer& operator=(const CircularVectorBuffer&) = delete;
+
+        //-----------------------------------------------------------------------
+        void FillWith(const math::Vector3D& value)
+        {
+            _occupied = _size;
+            for (int i = 0; i < _size; i++)
+                SetAt(i, value);
+        }
+
+        //-----------------------------------------------------------------------
+        void Push(const math::Vector3D& value)
+        {
+            if (_occupied < _size)
+                _occupied++;
+
+            _currentTimestamp++;
+            _currentPos++;
+            if (_currentPos >= _size)
+                _currentPos = 0;
+
+            SetAt(_currentPos, value);
+        }
+
+        //-----------------------------------------------------------------------
+        math::Vector3D Get(BackPos back_pos = 0) const
+        {
+            ASSERT(IsBackPosOccupied(back_pos));
+
+            int pos = GetAbsPos(back_pos);
+            return math::Vector3D(_columns[0][pos], _columns[1][pos], _columns[2][pos]);
+        }
+
+        //-----------------------------------------------------------------------
+        math::Vector3D GetByTimestamp(Timestamp timestamp) const
+        {
+            return Get(GetBackPos(timestamp));
+        }
+
+        //-----------------------------------------------------------------------
+        math::Vector3D GetDiff(BackPos back_pos = 0) const
+        {
+            ASSERT(IsBackPosOccupied(back_pos));
+
+            auto val = Get(back_pos);
+            if (IsBackPosOccupied(back_pos + 1))
+                return val - Get(back_pos + 1);
+            return val;
+        }
+
+        //-----------------------------------------------------------------------
+        math::Vector3D GetSum(BackPos from_back_pos, BackPos to_back_pos) const
+        {
+            ASSERT(from_back_pos <= to_back_pos);
+            ASSERT(to_back_pos < _occupied);
+
+            // Range in the columns is [to_abs_pos .. from_abs_pos], possibly wrapping around the end
+            int from_abs_pos = GetAbsPos(from_back_pos);
+            int to_abs_pos = GetAbsPos(to_back_pos);
+
+            double sum[3] = {0, 0, 0};
+            if (to_abs_pos <= from_abs_pos)
+            {
+                AddColumnsRun(sum, to_abs_pos, from_abs_pos + 1);
+            }
+            else
+            {
+                AddColumnsRun(sum, to_abs_pos, _size);
+                AddColumnsRun(sum, 0, from_abs_pos + 1);
+            }
+
+            return math::Vector3D(sum[0], sum[1], sum[2]);
+        }
+
+        //-----------------------------------------------------------------------
+        math::Vector3D GetAverage(BackPos from_back_pos, BackPos to_back_pos) const
+        {
+            double one_div_elements_num = (double)1 / (double)(to_back_pos - from_back_pos + 1);
+            return GetSum(from_back_pos, to_back_pos) * one_div_elements_num;
+        }
+
+        //-----------------------------------------------------------------------
+        BackPos GetBackPos(Timestamp timestamp) const
+        {
+            return (BackPos)(_currentTimestamp - timestamp);
+        }
+
+        //-----------------------------------------------------------------------
+        Timestamp GetTimestamp(BackPos back_pos = 0) const
+        {
+            return _currentTimestamp - (Timestamp)back_pos;
+        }
+
+        //-----------------------------------------------------------------------
+        bool IsStillInBuffer(Timestamp timestamp) const
+        {
+            ASSERT(timestamp <= _currentTimestamp);
+            return ((int)(_currentTimestamp - timestamp) < _occupied);
+        }
+
+        //-----------------------------------------------------------------------
+        bool IsBackPosOccupied(BackPos back_pos) const
+        {
+            ASSERT(back_pos >= 0);
+            return ((int)back_pos < _occupied);
+        }
+
+        //-----------------------------------------------------------------------
+        int GetOccupiedSize() const
+        {
+            return _occupied;
+        }
+
+        //-----------------------------------------------------------------------
+        int GetSize() const
+        {
+            return _size;
+        }
+
+        // Raw column (0 = x, 1 = y, 2 = z) of GetSize() elements, indexed by GetAbsPos()
+        const Component* GetColumn(int column_i) const { ASSERT(column_i >= 0 && column_i < 3); return _columns[column_i]; }
+
+        //-----------------------------------------------------------------------
+        int GetAbsPos(BackPos back_pos) const
+        {
+            ASSERT(IsBackPosOccupied(back_pos));
+
+            int pos = (_currentPos - (int)back_pos);
+            if (pos < 0)
+                pos += _size;
+
+            return pos;
+        }
+
+    protected:
+        int _size;
+        int _occupied;
+        Component* _columns[3];
+
+        int _currentPos;
+        Timestamp _currentTimestamp;
+
+        //-----------------------------------------------------------------------
+        inline void SetAt(int abs_pos, const math::Vector3D& value)
+        {
+            _columns[0][abs_pos] = (Component)value.x;
+            _columns[1][abs_pos] = (Component)value.y;
+            _columns[2][abs_pos] = (Component)value.z;
+        }
+
+        //-----------------------------------------------------------------------
+        inline void AddColumnsRun(double* sum, int from_abs_pos, int to_abs_pos) const
+        {
+            for (int ci = 0; ci < 3; ci++)
+            {
+                const Component* column = _columns[ci];
+                double column_sum = 0;
+                for (int i = from_abs_pos; i < to_abs_pos; i++)
+                    column_sum += column[i];
+                sum[ci] += column_sum;
+            }
+        }
+    };
+
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include "../common/Log.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace yoss
+{
+
+    //-----------------------------------------------------------------------
+    // Listeners identified by tokens, each subscribed to a mask of event kinds.
+    // Notify() runs over an immutable snapshot of the listeners without locking, so listeners may be added or removed
+    // from any thread, also from within a notification. A removed listener isn't called anymore once Remove() returns:
+    // Remove() waits for its calls in progress on other threads (a call on the removing thread is the caller's own).
+    // Replaced snapshots are freed by a later Add() or Remove(), once the notifications that could be reading them are over:
+    // notifications count themselves under the parity of an epoch, which is advanced when snapshots are retired,
+    // so the ones under the previous parity drain even while new ones keep starting.
+    template <class... Args> class ListenerRegistry
+    {
+    public:
+        typedef int Token;
+        typedef std::function<void (Args...)> Listener;
+        static const Token INVALID_TOKEN = 0;
+        static const int   ALL_KINDS = ~0;
+
+        //-----------------------------------------------------------------------
+        ListenerRegistry() :
+            _snapshot(new Snapshot()),
+            _nextToken(INVALID_TOKEN + 1)
+        {
+        }
+
+        //-----------------------------------------------------------------------
+        ~ListenerRegistry()
+        {
+            delete _snapshot.load();
+            ASSERT(_notifyingNum[0].load() == 0 && _notifyingNum[1].load() == 0);
+            for (auto snapshot : _retiredSnapshots)
+                delete snapshot;
+            for (auto snapshot : _drainingSnapshots)
+                delete snapshot;
+        }
+
+        ListenerRegistry(const ListenerRegistry&) = delete;
+        ListenerRegistry& operator=(const ListenerRegistry&) = delete;
+
+        //-----------------------------------------------------------------------
+        Token Add(Listener listener, int kinds = ALL_KINDS)
+        {
+            ASSERT(listener && kinds != 0);
+            std::lock_guard<std::mutex> lock(_changeMutex);
+
+            Entry entry = { _nextToken++, kinds, listener, std::make_shared<EntryState>() };
+            Snapshot* snapshot = new Snapshot(*_snapshot.load());
+            snapshot->push_back(entry);
+            Replace(snapshot);
+
+            return entry.token;
+        }
+
+        //-----------------------------------------------------------------------
+        // Returns false if there is no listener with the token (e.g. it was already removed)
+        bool Remove(Token token)
+        {
+            std::shared_ptr<EntryState> removed_state;
+            {
+                std::lock_guard<std::mutex> lock(_changeMutex);
+
+                const Snapshot* current = _snapshot.load();
+                Snapshot* snapshot = new Snapshot();
+                snapshot->reserve(current->size());
+                for (auto& entry : *current)
+                {
+                    if (entry.token == token)
+                    {
+                        entry.state->isActive.store(false);
+                        removed_state = entry.state;
+                    }
+                    else
+                    {
+                        snapshot->push_back(entry);
+                    }
+                }
+
+                if (!removed_state)
+                {
+                    delete snapshot;
+                    return false;
+                }
+
+                Replace(snapshot);
+            }
+
+            // Outside the lock, as the listener may be adding or removing listeners itself
+            int own_calls_num = 0;
+            for (auto state : GetCallingStates())
+                own_calls_num += (state == removed_state.get() ? 1 : 0);
+            while (removed_state->callsNum.load() > own_calls_num)
+                std::this_thread::yield();
+
+            return true;
+        }
+
+        //-----------------------------------------------------------------------
+        // Calls listeners subscribed to any of the kinds
+        void Notify(int kinds, Args... args) const
+        {
+            // Counted before the snapshot is read, see Replace()
+            auto& notifying_num = _notifyingNum[_epoch.load() & 1];
+            notifying_num++;
+            const Snapshot* snapshot = _snapshot.load();
+            auto& calling_states = GetCallingStates();
+            for (auto& entry : *snapshot)
+            {
+                if (!(entry.kinds & kinds))
+                    continue;
+
+                // Counted before the check, so Remove() either sees the call or the call sees the removal
+                EntryState* state = entry.state.get();
+                state->callsNum++;
+                if (state->isActive.load())
+                {
+                    calling_states.push_back(state);
+                    entry.listener(args...);
+                    calling_states.pop_back();
+                }
+                state->callsNum--;
+            }
+            notifying_num--;
+        }
+
+        //-----------------------------------------------------------------------
+        bool IsEmpty() const
+        {
+            auto& notifying_num = _notifyingNum[_epoch.load() & 1]; // Holds the snapshot as Notify() does
+            notifying_num++;
+            bool is_empty = _snapshot.load()->empty();
+            notifying_num--;
+            return is_empty;
+        }
+
+    private:
+        struct EntryState
+        {
+            std::atomic<bool> isActive {true};
+            std::atomic<int>  callsNum {0}; // In progress, on any thread
+        };
+        struct Entry
+        {
+            Token    token;
+            int      kinds;
+            Listener listener;
+            std::shared_ptr<EntryState> state; // Shared by the copies of the entry in all snapshots
+        };
+        typedef std::vector<Entry> Snapshot;
+
+        //-----------------------------------------------------------------------
+        // Called under _changeMutex. A notification counted under the current parity after the epoch was advanced
+        // reads the snapshot only after those retired before, so once the count under the previous parity drops to 0,
+        // no notification reads the draining snapshots anymore. The epoch is advanced only when none is counted
+        // under the parity it moves to, which leaves no notification older than the previous epoch under either
+        void Replace(const Snapshot* snapshot)
+        {
+            _retiredSnapshots.push_back(_snapshot.exchange(snapshot));
+
+            auto& prev_notifying_num = _notifyingNum[(_epoch.load() & 1) ^ 1];
+            if (prev_notifying_num.load() != 0)
+                return;
+
+            for (auto draining : _drainingSnapshots)
+                delete draining;
+            _drainingSnapshots.swap(_retiredSnapshots);
+            _retiredSnapshots.clear();
+            _epoch++;
+        }
+
+        //-----------------------------------------------------------------------
+        // Of the listeners being called on this thread, innermost last
+        static std::vector<const EntryState*>& GetCallingStates()
+        {
+            static thread_local std::vector<const EntryState*> calling_states;
+            return calling_states;
+        }
+
+        std::atomic<const Snapshot*> _snapshot;
+        std::vector<const Snapshot*> _retiredSnapshots; // Replaced in the current epoch
+        std::vector<const Snapshot*> _drainingSnapshots; // Replaced in the previous epoch
+        std::atomic<int>             _epoch {0};
+        mutable std::atomic<int>     _notifyingNum[2] = {}; // Notifications in progress, by the parity of the epoch they started in
+        std::mutex                   _changeMutex; // Add() and Remove() only
+        Token                        _nextToken;
+    };
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "../common/Log.h"
+
+#include <atomic>
+
+
+namespace yoss
+{
+
+    //-----------------------------------------------------------------------
+    // Fixed-size lock-free queue for exactly one producer thread and one consumer thread.
+    // Push fails (the value is dropped) when the queue is full, so neither side ever waits.
+    template <class T> class SpscQueue
+    {
+    public:
+        //-----------------------------------------------------------------------
+        SpscQueue(int capacity) :
+            _size(capacity + 1), // One slot is always free to tell full from empty
+            _head(0),
+            _tail(0)
+        {
+            ASSERT(capacity > 0);
+            _buffer = new T[_size];
+        }
+
+        //-----------------------------------------------------------------------
+        ~SpscQueue()
+        {
+            delete[] _buffer;
+        }
+
+        SpscQueue(const SpscQueue&) = delete;
+        SpscQueue& operator=(const SpscQueue&) = delete;
+
+        //-----------------------------------------------------------------------
+        // Producer side
+        bool Push(const T& value)
+        {
+            int tail = _tail.load(std::memory_order_relaxed);
+            int next_tail = (tail + 1 < _size ? tail + 1 : 0);
+            if (next_tail == _head.load(std::memory_order_acquire))
+                return false;
+
+            _buffer[tail] = value;
+            _tail.store(next_tail, std::memory_order_release);
+            return true;
+        }
+
+        //-----------------------------------------------------------------------
+        // Consumer side
+        bool Pop(T& value)
+        {
+            int head = _head.load(std::memory_order_relaxed);
+            if (head == _tail.load(std::memory_order_acquire))
+                return false;
+
+            value = _buffer[head];
+            _head.store(head + 1 < _size ? head + 1 : 0, std::memory_order_release);
+            return true;
+        }
+
+        //-----------------------------------------------------------------------
+        // Consumer side
+        bool IsEmpty() const
+        {
+            return _head.load(std::memory_order_relaxed) == _tail.load(std::memory_order_acquire);
+        }
+
+        //-----------------------------------------------------------------------
+        int GetCapacity() const { return _size - 1; }
+
+    private:
+        T* _buffer;
+        const int _size;
+        alignas(64) std::atomic<int> _head; // Next to pop, written by the consumer
+        alignas(64) std::atomic<int> _tail; // Next to push, written by the producer
+    };
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+
+
+namespace yoss
+{
+
+    //-----------------------------------------------------------------------
+    // Lock-free hand-off of the latest value from one writer thread to one reader thread.
+    // The writer fills its own slot and publishes it, the reader takes the last published slot;
+    // neither side ever waits and the reader always sees a complete value.
+    template <class T> class TripleBuffer
+    {
+    public:
+        //-----------------------------------------------------------------------
+        TripleBuffer() :
+            _writeSlot(0),
+            _sharedSlot(1),
+            _readSlot(2)
+        {
+        }
+
+        TripleBuffer(const TripleBuffer&) = delete;
+        TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+        //-----------------------------------------------------------------------
+        // Writer side: the slot to fill before Publish()
+        T& GetWriteValue() { return _slots[_writeSlot]; }
+
+        //-----------------------------------------------------------------------
+        // Writer side
+        void Publish()
+        {
+            int prev_shared = _sharedSlot.exchange(_writeSlot | FRESH_FLAG, std::memory_order_acq_rel);
+            _writeSlot = prev_shared & SLOT_MASK;
+        }
+
+        //-----------------------------------------------------------------------
+        // Reader side: takes the last published value if there is a newer one than the one read before.
+        // Returns whether the value changed.
+        bool Update()
+        {
+            if (!(_sharedSlot.load(std::memory_order_relaxed) & FRESH_FLAG))
+                return false;
+
+            int prev_shared = _sharedSlot.exchange(_readSlot, std::memory_order_acq_rel);
+            _readSlot = prev_shared & SLOT_MASK;
+            return true;
+        }
+
+        //-----------------------------------------------------------------------
+        // Reader side: the value taken by the last Update()
+        const T& GetReadValue() const { return _slots[_readSlot]; }
+
+    private:
+        static const int SLOT_MASK = 3;
+        static const int FRESH_FLAG = 4;
+
+        T _slots[3];
+        int _writeSlot; // Used only by the writer
+        std::atomic<int> _sharedSlot; // Slot index with FRESH_FLAG set when published and not yet taken
+        int _readSlot; // Used only by the reader
+    };
+
+}